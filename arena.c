@@ -0,0 +1,132 @@
+/**
+ * arena.c - Bump allocator for json2relcsv
+ */
+
+#include "arena.h"
+#include "error.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_DEFAULT_BLOCK_SIZE (256 * 1024)
+#define ARENA_ALIGN 8
+
+// Allocate a block able to hold at least 'min_size' bytes and push it as current
+static ArenaBlock* arena_push_block(Arena* arena, size_t min_size) {
+    ArenaBlock* block = NULL;
+    if (arena->spare && arena->spare->size >= min_size) {
+        block = arena->spare;
+        arena->spare = NULL;
+    } else {
+        size_t size = min_size > arena->block_size ? min_size : arena->block_size;
+        if (arena->limit && arena->block_bytes + size > arena->limit) {
+            fatal_error("Error: The input does not fit in --memory-limit; only a top-level array in an --input file is converted in parts\n");
+        }
+        block = (ArenaBlock*)malloc(sizeof(ArenaBlock) + size);
+        if (!block) {
+            fatal_error("Error: Memory allocation failed for arena block (%zu bytes)\n", size);
+        }
+        block->size = size;
+        arena->blocks_allocated++;
+        arena->block_bytes += size;
+        if (arena->block_bytes > arena->peak_block_bytes) arena->peak_block_bytes = arena->block_bytes;
+    }
+    block->used = 0;
+    block->prev = arena->current;
+    arena->current = block;
+    return block;
+}
+
+Arena* arena_create(size_t block_size) {
+    Arena* arena = (Arena*)calloc(1, sizeof(Arena));
+    if (!arena) {
+        fatal_error("Error: Memory allocation failed for arena\n");
+    }
+    arena->block_size = block_size ? block_size : ARENA_DEFAULT_BLOCK_SIZE;
+    arena_push_block(arena, 0);
+    return arena;
+}
+
+void arena_destroy(Arena* arena) {
+    if (!arena) return;
+    ArenaBlock* block = arena->current;
+    while (block) {
+        ArenaBlock* prev = block->prev;
+        free(block);
+        block = prev;
+    }
+    free(arena->spare);
+    free(arena);
+}
+
+// Bump-allocate 'size' bytes at the given power-of-two alignment
+static void* arena_alloc_aligned(Arena* arena, size_t size, size_t align) {
+    arena->allocations++;
+    arena->bytes_requested += size;
+    ArenaBlock* block = arena->current;
+    size_t offset = (block->used + (align - 1)) & ~(align - 1);
+    if (offset + size > block->size) {
+        block = arena_push_block(arena, size);
+        offset = 0;
+    }
+    block->used = offset + size;
+    return block->data + offset;
+}
+
+void* arena_alloc(Arena* arena, size_t size) {
+    return arena_alloc_aligned(arena, size, ARENA_ALIGN);
+}
+
+void* arena_calloc(Arena* arena, size_t size) {
+    void* ptr = arena_alloc_aligned(arena, size, ARENA_ALIGN);
+    memset(ptr, 0, size);
+    return ptr;
+}
+
+char* arena_strndup(Arena* arena, const char* str, size_t len) {
+    char* copy = (char*)arena_alloc_aligned(arena, len + 1, 1); // Strings need no alignment
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+void* arena_grow(Arena* arena, void* ptr, size_t old_size, size_t new_size) {
+    if (!ptr) return arena_alloc(arena, new_size);
+    if (new_size <= old_size) return ptr;
+
+    ArenaBlock* block = arena->current;
+    char* end = block->data + block->used;
+    if ((char*)ptr + old_size == end && block->used + (new_size - old_size) <= block->size) {
+        block->used += new_size - old_size; // Last allocation: extend in place
+        arena->bytes_requested += new_size - old_size;
+        return ptr;
+    }
+
+    // The abandoned copy stays in the arena; with geometric growth the
+    // waste is bounded by the final size.
+    void* new_ptr = arena_alloc(arena, new_size);
+    memcpy(new_ptr, ptr, old_size);
+    return new_ptr;
+}
+
+ArenaMark arena_mark(Arena* arena) {
+    ArenaMark mark;
+    mark.block = arena->current;
+    mark.used = arena->current->used;
+    return mark;
+}
+
+void arena_release(Arena* arena, ArenaMark mark) {
+    // Drop every block pushed after the mark, keeping the last one as spare
+    while (arena->current != mark.block) {
+        ArenaBlock* block = arena->current;
+        arena->current = block->prev;
+        if (!arena->spare) {
+            arena->spare = block;
+        } else {
+            arena->block_bytes -= block->size;
+            free(block);
+        }
+    }
+    arena->current->used = mark.used;
+}
@@ -0,0 +1,54 @@
+/**
+ * arena.h - Bump allocator owning the AST and strings of one parse
+ *
+ * Allocations are carved out of large blocks and are never freed one by
+ * one; the whole arena is released at once. A mark/release pair rolls the
+ * arena back to an earlier point, which the --stream emitter uses to drop
+ * a closed object's strings.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+typedef struct ArenaBlock {
+    struct ArenaBlock* prev; // Older block
+    size_t size;             // Usable bytes in data
+    size_t used;
+    char data[];
+} ArenaBlock;
+
+typedef struct Arena {
+    ArenaBlock* current;     // Block allocations are taken from
+    ArenaBlock* spare;       // One released block kept for reuse
+    size_t block_size;       // Default size of new blocks
+    size_t limit;            // --memory-limit: block memory it may hold, 0 for no limit
+    // Counters reported by --stats
+    size_t allocations;
+    size_t bytes_requested;
+    size_t blocks_allocated; // Blocks obtained from malloc
+    size_t block_bytes;      // Block memory currently held, spare included
+    size_t peak_block_bytes;
+} Arena;
+
+// Position to roll an arena back to with arena_release()
+typedef struct ArenaMark {
+    ArenaBlock* block;
+    size_t used;
+} ArenaMark;
+
+Arena* arena_create(size_t block_size); // 0 selects the default block size
+void arena_destroy(Arena* arena);
+
+void* arena_alloc(Arena* arena, size_t size);   // 8-byte aligned, uninitialized
+void* arena_calloc(Arena* arena, size_t size);  // 8-byte aligned, zeroed
+char* arena_strndup(Arena* arena, const char* str, size_t len);
+// Resize an allocation of 'old_size' bytes. Grows in place when it is the most
+// recent allocation and the block has room; otherwise copies to a new spot.
+void* arena_grow(Arena* arena, void* ptr, size_t old_size, size_t new_size);
+
+ArenaMark arena_mark(Arena* arena);
+void arena_release(Arena* arena, ArenaMark mark); // Frees everything allocated after 'mark'
+
+#endif /* ARENA_H */
@@ -0,0 +1,357 @@
+/**
+ * arrow_writer.c - Apache Arrow IPC file output for json2relcsv (--format arrow)
+ *
+ * Each table becomes one Arrow file: the magic, a Schema message, one
+ * RecordBatch message per ARROW_BATCH_ROWS rows, the end-of-stream marker
+ * and a Footer indexing the batches. Buffers are uncompressed and padded to
+ * 8 bytes. Message metadata is FlatBuffers, built front to back: a table's
+ * vtable is written just before it and every object it references follows
+ * it, so offsets only ever point forward.
+ */
+
+#include "columnar.h"
+#include "error.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARROW_MAGIC "ARROW1"
+#define ARROW_BATCH_ROWS 65536
+#define ARROW_CONTINUATION 0xFFFFFFFFu
+
+// Enum values from Schema.fbs and Message.fbs
+enum { METADATA_V5 = 4 };
+enum { HEADER_SCHEMA = 1, HEADER_RECORD_BATCH = 3 };
+enum { TYPE_INT = 2, TYPE_FLOATING_POINT = 3, TYPE_UTF8 = 5, TYPE_BOOL = 6 };
+enum { PRECISION_DOUBLE = 2 };
+
+#define FB_MAX_FIELDS 8
+
+// Fields of one FlatBuffers table, collected before it is written
+typedef struct FlatTable {
+    int count;
+    int ids[FB_MAX_FIELDS];
+    int sizes[FB_MAX_FIELDS];        // 1, 2, 4 or 8 bytes; offsets are 4
+    uint64_t values[FB_MAX_FIELDS];
+    size_t positions[FB_MAX_FIELDS]; // Where each field landed, set by fb_write_table
+} FlatTable;
+
+typedef struct ArrowBlock {
+    int64_t offset;                  // File offset of the message
+    int32_t metadata_length;         // Prefix and padded metadata
+    int64_t body_length;
+} ArrowBlock;
+
+// Returns the field's index, for looking up its position once written
+static int fb_add(FlatTable* table, int id, int size, uint64_t value) {
+    table->ids[table->count] = id;
+    table->sizes[table->count] = size;
+    table->values[table->count] = value;
+    return table->count++;
+}
+
+// Point the offset field at 'field_position' to 'target', which follows it
+static void fb_patch(ByteBuffer* out, size_t field_position, size_t target) {
+    buffer_set_u32(out, field_position, (uint32_t)(target - field_position));
+}
+
+// Write the vtable, then the table with its fields largest first so each one
+// is naturally aligned; returns the table's position
+static size_t fb_write_table(ByteBuffer* out, FlatTable* table) {
+    uint16_t field_offsets[FB_MAX_FIELDS];
+    int max_id = -1;
+    size_t inline_size = 4; // The vtable offset
+    for (int size = 8; size >= 1; size /= 2) {
+        for (int i = 0; i < table->count; i++) {
+            if (table->sizes[i] != size) continue;
+            field_offsets[i] = (uint16_t)inline_size;
+            inline_size += size;
+        }
+    }
+    for (int i = 0; i < table->count; i++) {
+        if (table->ids[i] > max_id) max_id = table->ids[i];
+    }
+
+    buffer_pad(out, 2);
+    size_t vtable_position = out->length;
+    buffer_put_u16(out, (uint16_t)(4 + 2 * (max_id + 1)));
+    buffer_put_u16(out, (uint16_t)inline_size);
+    for (int id = 0; id <= max_id; id++) {
+        uint16_t offset = 0;
+        for (int i = 0; i < table->count; i++) {
+            if (table->ids[i] == id) offset = field_offsets[i];
+        }
+        buffer_put_u16(out, offset);
+    }
+
+    // 8-byte fields start right after the 4-byte vtable offset
+    while (out->length % 8 != 4) buffer_put_u8(out, 0);
+    size_t table_position = out->length;
+    buffer_put_u32(out, (uint32_t)(table_position - vtable_position));
+    buffer_put_zeros(out, inline_size - 4);
+    for (int i = 0; i < table->count; i++) {
+        table->positions[i] = table_position + field_offsets[i];
+        for (int b = 0; b < table->sizes[i]; b++) {
+            out->data[table->positions[i] + b] = (uint8_t)(table->values[i] >> (8 * b));
+        }
+    }
+    return table_position;
+}
+
+// Length of a vector whose elements, written by the caller, are aligned to
+// 'alignment' (4 or 8); returns the vector's position
+static size_t fb_vector(ByteBuffer* out, uint32_t count, size_t alignment) {
+    buffer_pad(out, 4);
+    while ((out->length + 4) % alignment != 0) buffer_put_u32(out, 0);
+    size_t position = out->length;
+    buffer_put_u32(out, count);
+    return position;
+}
+
+static size_t fb_string(ByteBuffer* out, const char* text) {
+    size_t length = strlen(text);
+    buffer_pad(out, 4);
+    size_t position = out->length;
+    buffer_put_u32(out, (uint32_t)length);
+    buffer_put(out, text, length + 1);
+    return position;
+}
+
+static int arrow_type(ColumnKind kind) {
+    switch (kind) {
+        case COLUMN_INT64: return TYPE_INT;
+        case COLUMN_DOUBLE: return TYPE_FLOATING_POINT;
+        case COLUMN_BOOL: return TYPE_BOOL;
+        default: return TYPE_UTF8;
+    }
+}
+
+static size_t fb_field(ByteBuffer* out, const TableColumn* column) {
+    FlatTable field = {0};
+    int name = fb_add(&field, 0, 4, 0);
+    fb_add(&field, 1, 1, column->null_count > 0);
+    fb_add(&field, 2, 1, (uint64_t)arrow_type(column->kind));
+    int type = fb_add(&field, 3, 4, 0);
+    int children = fb_add(&field, 5, 4, 0);
+    size_t position = fb_write_table(out, &field);
+    fb_patch(out, field.positions[name], fb_string(out, column->name));
+
+    FlatTable type_table = {0}; // Utf8 and Bool have no fields
+    if (column->kind == COLUMN_INT64) {
+        fb_add(&type_table, 0, 4, 64);
+        fb_add(&type_table, 1, 1, 1);
+    } else if (column->kind == COLUMN_DOUBLE) {
+        fb_add(&type_table, 0, 2, PRECISION_DOUBLE);
+    }
+    fb_patch(out, field.positions[type], fb_write_table(out, &type_table));
+    fb_patch(out, field.positions[children], fb_vector(out, 0, 4));
+    return position;
+}
+
+static size_t fb_schema(ByteBuffer* out, const TableColumn* columns, int column_count) {
+    FlatTable schema = {0};
+    fb_add(&schema, 0, 2, 0); // Little-endian
+    int fields = fb_add(&schema, 1, 4, 0);
+    size_t position = fb_write_table(out, &schema);
+
+    size_t vector = fb_vector(out, (uint32_t)column_count, 4);
+    buffer_put_zeros(out, 4 * (size_t)column_count);
+    fb_patch(out, schema.positions[fields], vector);
+    for (int i = 0; i < column_count; i++) {
+        fb_patch(out, vector + 4 + 4 * (size_t)i, fb_field(out, &columns[i]));
+    }
+    return position;
+}
+
+// Start a Message flatbuffer in 'out'; returns the position of its header
+// field, which the caller points at the header table
+static size_t fb_message(ByteBuffer* out, int header_type, int64_t body_length) {
+    out->length = 0;
+    buffer_put_u32(out, 0); // Root offset
+    FlatTable message = {0};
+    fb_add(&message, 0, 2, METADATA_V5);
+    fb_add(&message, 1, 1, (uint64_t)header_type);
+    int header = fb_add(&message, 2, 4, 0);
+    fb_add(&message, 3, 8, (uint64_t)body_length);
+    fb_patch(out, 0, fb_write_table(out, &message));
+    return message.positions[header];
+}
+
+static int64_t file_offset(const CsvWriter* writer) {
+    return (int64_t)(writer->bytes_written + writer->length);
+}
+
+// Continuation marker, metadata size, metadata padded to 8 bytes, body
+static void write_message(CsvWriter* writer, const ByteBuffer* metadata, const ByteBuffer* body, ArrowBlock* block) {
+    static const char padding[8] = {0};
+    size_t padded = (metadata->length + 7) & ~(size_t)7;
+    uint8_t prefix[8];
+    for (int i = 0; i < 4; i++) {
+        prefix[i] = (uint8_t)(ARROW_CONTINUATION >> (8 * i));
+        prefix[4 + i] = (uint8_t)(padded >> (8 * i));
+    }
+
+    block->offset = file_offset(writer);
+    block->metadata_length = (int32_t)(sizeof(prefix) + padded);
+    block->body_length = body ? (int64_t)body->length : 0;
+    csv_put_bytes(writer, (const char*)prefix, sizeof(prefix));
+    csv_put_bytes(writer, (const char*)metadata->data, metadata->length);
+    csv_put_bytes(writer, padding, padded - metadata->length);
+    if (body) csv_put_bytes(writer, (const char*)body->data, body->length);
+}
+
+// Validity bitmap of rows [first, first + count), or nothing when all are set
+static void put_validity(ByteBuffer* body, const TableSchema* table, const TableColumn* column,
+                         int first, int count, int null_count) {
+    if (null_count == 0) return;
+    size_t start = body->length;
+    buffer_put_zeros(body, ((size_t)count + 7) / 8);
+    for (int i = 0; i < count; i++) {
+        if (!cell_is_null(table_cell(table, column, first + i))) body->data[start + i / 8] |= (uint8_t)(1 << (i % 8));
+    }
+}
+
+// Data buffers of one column for rows [first, first + count)
+static void put_column_data(ByteBuffer* body, const TableSchema* table, const TableColumn* column,
+                            int first, int count, ByteBuffer* buffers) {
+    size_t start = body->length;
+    char scratch[NUMBER_FORMAT_MAX + 1];
+    if (column->kind == COLUMN_BOOL) {
+        buffer_put_zeros(body, ((size_t)count + 7) / 8);
+        for (int i = 0; i < count; i++) {
+            Value_Node value = table_cell(table, column, first + i);
+            if (!cell_is_null(value) && value.boolean_val) body->data[start + i / 8] |= (uint8_t)(1 << (i % 8));
+        }
+    } else if (column->kind == COLUMN_UTF8) {
+        // Offsets first, then the bytes they index
+        size_t offsets = start;
+        buffer_put_zeros(body, 4 * ((size_t)count + 1));
+        buffer_put_u64(buffers, (uint64_t)offsets);
+        buffer_put_u64(buffers, (uint64_t)(body->length - offsets));
+        buffer_pad(body, 8);
+        start = body->length;
+        for (int i = 0; i < count; i++) {
+            Value_Node value = table_cell(table, column, first + i);
+            if (!cell_is_null(value)) {
+                const char* text;
+                size_t length = cell_text(value, scratch, &text);
+                buffer_put(body, text, length);
+            }
+            buffer_set_u32(body, offsets + 4 * ((size_t)i + 1), (uint32_t)(body->length - start));
+        }
+    } else {
+        for (int i = 0; i < count; i++) {
+            Value_Node value = table_cell(table, column, first + i);
+            if (cell_is_null(value)) {
+                buffer_put_u64(body, 0);
+            } else if (column->kind == COLUMN_INT64) {
+                buffer_put_u64(body, (uint64_t)cell_int64(value));
+            } else {
+                buffer_put_double(body, cell_double(value));
+            }
+        }
+    }
+    buffer_put_u64(buffers, (uint64_t)start);
+    buffer_put_u64(buffers, (uint64_t)(body->length - start));
+    buffer_pad(body, 8);
+}
+
+// Body and metadata of the RecordBatch holding rows [first, first + count)
+static void encode_batch(const TableSchema* table, const TableColumn* columns, int column_count,
+                         int first, int count, ByteBuffer* metadata, ByteBuffer* body) {
+    ByteBuffer nodes = {0};   // FieldNode structs
+    ByteBuffer buffers = {0}; // Buffer structs
+    body->length = 0;
+    for (int c = 0; c < column_count; c++) {
+        int null_count = 0;
+        for (int i = 0; i < count; i++) {
+            if (cell_is_null(table_cell(table, &columns[c], first + i))) null_count++;
+        }
+        buffer_put_u64(&nodes, (uint64_t)count);
+        buffer_put_u64(&nodes, (uint64_t)null_count);
+
+        size_t validity = body->length;
+        put_validity(body, table, &columns[c], first, count, null_count);
+        buffer_put_u64(&buffers, (uint64_t)validity);
+        buffer_put_u64(&buffers, (uint64_t)(body->length - validity));
+        buffer_pad(body, 8);
+        put_column_data(body, table, &columns[c], first, count, &buffers);
+    }
+
+    size_t header = fb_message(metadata, HEADER_RECORD_BATCH, (int64_t)body->length);
+    FlatTable batch = {0};
+    fb_add(&batch, 0, 8, (uint64_t)count);
+    int node_field = fb_add(&batch, 1, 4, 0);
+    int buffer_field = fb_add(&batch, 2, 4, 0);
+    fb_patch(metadata, header, fb_write_table(metadata, &batch));
+    fb_patch(metadata, batch.positions[node_field], fb_vector(metadata, (uint32_t)column_count, 8));
+    buffer_put(metadata, nodes.data, nodes.length);
+    fb_patch(metadata, batch.positions[buffer_field], fb_vector(metadata, (uint32_t)(buffers.length / 16), 8));
+    buffer_put(metadata, buffers.data, buffers.length);
+    buffer_free(&nodes);
+    buffer_free(&buffers);
+}
+
+static void encode_footer(const TableColumn* columns, int column_count,
+                          const ArrowBlock* batches, int batch_count, ByteBuffer* out) {
+    out->length = 0;
+    buffer_put_u32(out, 0); // Root offset
+    FlatTable footer = {0};
+    fb_add(&footer, 0, 2, METADATA_V5);
+    int schema = fb_add(&footer, 1, 4, 0);
+    int dictionaries = fb_add(&footer, 2, 4, 0);
+    int record_batches = fb_add(&footer, 3, 4, 0);
+    fb_patch(out, 0, fb_write_table(out, &footer));
+    fb_patch(out, footer.positions[schema], fb_schema(out, columns, column_count));
+    fb_patch(out, footer.positions[dictionaries], fb_vector(out, 0, 8));
+    fb_patch(out, footer.positions[record_batches], fb_vector(out, (uint32_t)batch_count, 8));
+    for (int i = 0; i < batch_count; i++) { // Block structs
+        buffer_put_u64(out, (uint64_t)batches[i].offset);
+        buffer_put_u32(out, (uint32_t)batches[i].metadata_length);
+        buffer_put_u32(out, 0);
+        buffer_put_u64(out, (uint64_t)batches[i].body_length);
+    }
+}
+
+void write_arrow_table(TableSchema* table, const OutputOptions* options) {
+    // Opened first: a file that cannot be opened fails before anything is allocated
+    CsvWriter* writer = csv_writer_open_file(options, table->name, ".arrow");
+    int column_count;
+    TableColumn* columns = table_columns(table, &column_count);
+    int rows = table_rows(table);
+    int batch_count = (rows + ARROW_BATCH_ROWS - 1) / ARROW_BATCH_ROWS;
+    ArrowBlock* batches = (ArrowBlock*)calloc(batch_count ? batch_count : 1, sizeof(ArrowBlock));
+    if (!batches) {
+        fatal_error("Error: Memory allocation failed for record batches of table '%s'\n", table->name);
+    }
+
+    ByteBuffer metadata = {0}, body = {0};
+    csv_put_bytes(writer, ARROW_MAGIC "\0\0", 8);
+
+    ArrowBlock schema_block;
+    size_t header = fb_message(&metadata, HEADER_SCHEMA, 0);
+    fb_patch(&metadata, header, fb_schema(&metadata, columns, column_count));
+    write_message(writer, &metadata, NULL, &schema_block);
+
+    for (int b = 0; b < batch_count; b++) {
+        int first = b * ARROW_BATCH_ROWS;
+        int count = rows - first < ARROW_BATCH_ROWS ? rows - first : ARROW_BATCH_ROWS;
+        encode_batch(table, columns, column_count, first, count, &metadata, &body);
+        write_message(writer, &metadata, &body, &batches[b]);
+    }
+
+    static const uint8_t end_of_stream[8] = {0xFF, 0xFF, 0xFF, 0xFF, 0, 0, 0, 0};
+    csv_put_bytes(writer, (const char*)end_of_stream, sizeof(end_of_stream));
+
+    encode_footer(columns, column_count, batches, batch_count, &metadata);
+    buffer_put_u32(&metadata, (uint32_t)metadata.length);
+    buffer_put(&metadata, ARROW_MAGIC, 6);
+    csv_put_bytes(writer, (const char*)metadata.data, metadata.length);
+
+    writer->rows = (uint64_t)rows;
+    csv_writer_close(writer);
+    buffer_free(&metadata);
+    buffer_free(&body);
+    free(batches);
+    free_table_columns(columns, column_count);
+}
@@ -9,6 +9,9 @@
  #include <stdlib.h>
  #include <string.h>
  #include <stdbool.h>
+ #include <stdint.h>
+ #include "arena.h"
+ #include "name_index.h"
  
  // Forward declarations
  struct AST_Node;
@@ -20,7 +23,8 @@
 // Value types
 typedef enum {
     VALUE_STRING,
-    VALUE_NUMBER,
+    VALUE_NUMBER,   // Non-integral, or an integer outside int64_t
+    VALUE_INTEGER,  // Exact integer
     VALUE_BOOLEAN,
     VALUE_NULL,
     VALUE_OBJECT,
@@ -33,6 +37,7 @@ typedef struct Value_Node {
     union {
         char* string_val;
         double number_val;
+        int64_t integer_val;
         bool boolean_val;
         struct Object_Node* object_val;
         struct Array_Node* array_val;
@@ -46,13 +51,15 @@ typedef struct Value_Node {
      NODE_ARRAY,
      NODE_STRING,
      NODE_NUMBER,
+     NODE_INTEGER,
      NODE_BOOLEAN,
      NODE_NULL
  } NodeType;
  
  // Key-value pair structure
  typedef struct Pair_Node {
-     char* key;
+     const char* key;          // Interned name of key_id (symbols.h), shared by all pairs with this key
+     int key_id;
      Value_Node value;
      struct Pair_Node* next;
  } Pair_Node;
@@ -61,14 +68,17 @@ typedef struct Value_Node {
  typedef struct Object_Node {
      Pair_Node* pairs;
      int pair_count;
-     int node_id;              // Used for primary key in CSV
-     struct Object_Node* next; // Used for linking objects with same schema
+     int node_id;              // Used for primary key in CSV. In the empty placeholder of
+                               // a subtree the fast parser skimmed, -N for the N IDs
+                               // its objects would have had
  } Object_Node;
  
  // JSON array structure
  typedef struct Array_Node {
-     Value_Node* elements;
+     Value_Node* elements;     // Contiguous storage in ast_arena
      int size;
+     int capacity;             // Allocated slots in elements; -N in a skimmed placeholder
+                               // for the N IDs of its objects
  } Array_Node;
  
  // Root AST node structure
@@ -79,42 +89,144 @@ typedef struct Value_Node {
          Array_Node* array;
          char* string_val;
          double number_val;
+         int64_t integer_val;
          bool boolean_val;
      };
  } AST_Node;
  
+ // Arena owning all nodes, keys and string payloads of the current parse.
+ // Must be created before parsing; free_ast() destroys it. Each thread has its
+ // own, so --jobs parse workers fill separate arenas (parallel.c).
+ extern _Thread_local Arena* ast_arena;
+ 
  // Function declarations
  AST_Node* create_ast_node(NodeType type);
  Object_Node* create_object_node();
  Array_Node* create_array_node(int size);
  Value_Node create_string_value(char* value);
  Value_Node create_number_value(double value);
+ Value_Node create_integer_value(int64_t value);
  Value_Node create_boolean_value(bool value);
  Value_Node create_null_value();
  Value_Node create_object_value(Object_Node* obj);
  Value_Node create_array_value(Array_Node* arr);
- Pair_Node* create_pair_node(char* key, Value_Node value);
+ Pair_Node* create_pair_node(int key_id, Value_Node value); // key_id from intern_key()
  void add_pair_to_object(Object_Node* obj, Pair_Node* pair);
  void add_element_to_array(Array_Node* arr, int index, Value_Node value);
- void free_ast(AST_Node* root);
+ void append_element_to_array(Array_Node* arr, Value_Node value); // Amortized O(1)
+ void free_ast(AST_Node* root); // Releases ast_arena
  void print_ast(AST_Node* root, int indent);
  
+ // Rows of a junction table (an array of scalars), stored by column
+ typedef struct JunctionRows {
+     int* owner_ids;         // node_id of the object holding the array (0 under root)
+     int* item_indexes;      // Position of the scalar in its array
+     Value_Node* values;     // Payloads point into ast_arena or the mapped input
+     int count;
+     int capacity;
+ } JunctionRows;
+ 
+ // Payload of one cell of a row store column; booleans use integer_val
+ typedef union ColumnCell {
+     const char* string_val;   // Points into ast_arena or the mapped input
+     double number_val;
+     int64_t integer_val;
+ } ColumnCell;
+ 
+ // One column slot of a row store. VALUE_NULL also marks a missing key, and
+ // nested objects and arrays keep their type but carry no payload.
+ typedef struct ColumnVector {
+     uint8_t* types;           // ValueType of each row
+     ColumnCell* cells;
+ } ColumnVector;
+ 
+ // Rows of an object table, stored by column
+ typedef struct RowStore {
+     int* ids;
+     int* parent_ids;          // node_id of the enclosing object (FK column), 0 under root
+     ColumnVector* columns;    // Indexed by column slot; slots no data column reads stay NULL
+     int count;
+     int capacity;
+ } RowStore;
+ 
  // Table schema structures
  typedef struct {
      char* name;
      char** columns;
      int column_count;
-     Object_Node* objects;  // Objects with same schema
+     NameIndex column_index; // Column name -> slot (position of its first occurrence)
+     int* column_slots;      // Slot of each column, indexes RowStore.columns
+     RowStore rows;          // Rows of objects with this name, in input order
+     bool has_parent_fk;     // Column 1 is <parent>_id
+     bool is_junction;       // <owner>_id,item_index,value table; rows are in 'junction'
+     bool omitted;           // Not selected (projection.h): walked for its nested tables, not written
+     JunctionRows junction;
  } TableSchema;
  
  typedef struct {
      TableSchema* tables;
      int table_count;
+     int next_node_id;       // First ID not handed out yet; 0 if unknown
+     bool dedup;             // Laid out by a --dedup run: shared tables have no FK column
  } Schema;
  
+ // Cell 'row' of column slot 'slot', as the Value_Node it was parsed from
+ static inline Value_Node row_store_value(const RowStore* rows, int slot, int row) {
+     Value_Node value;
+     ColumnCell cell = rows->columns[slot].cells[row];
+     value.type = (ValueType)rows->columns[slot].types[row];
+     switch (value.type) {
+         case VALUE_STRING: value.string_val = (char*)cell.string_val; break;
+         case VALUE_NUMBER: value.number_val = cell.number_val; break;
+         case VALUE_INTEGER: value.integer_val = cell.integer_val; break;
+         case VALUE_BOOLEAN: value.boolean_val = cell.integer_val != 0; break;
+         default: value.object_val = NULL; break;
+     }
+     return value;
+ }
+ 
  // Schema functions
- Schema* generate_schema(AST_Node* root);
+ struct Projection; // projection.h
+// Starts from the tables and next_node_id of 'known' (schema_file.h) if not
+// NULL, and skips the subtrees 'projection' does not need (NULL keeps all).
+// With 'dedup' (--dedup, dedup.h) nested objects of equal content share one
+// row, referenced by ID from their key's column in the parent row.
+Schema* generate_schema(AST_Node* root, const Schema* known, const struct Projection* projection, bool dedup);
  void free_schema(Schema* schema);
- void write_csv_files(Schema* schema, const char* out_dir);
+ size_t schema_row_bytes(const Schema* schema); // Memory held by the row stores of its tables
+ char* get_table_name_for_array(const char* parent_name, const char* key); // Heap-allocated "parent_key" (or "key" under root)
+ char* get_fk_column_name(const char* table_name); // Heap-allocated "table_id"
+ // Hand out 'count' IDs from '*next_node_id' and return the first. IDs are
+ // ints, which the runs of a long --append history could use up: fatal_error()
+ // rather than wrap around to negative IDs and an unreadable state file.
+ int take_node_ids(int* next_node_id, int64_t count);
+ void build_column_map(TableSchema* table); // Fills column_index/column_slots from columns
+ struct OutputOptions; // csv_writer.h
+ void write_csv_files(Schema* schema, const struct OutputOptions* options);
+ 
+ // Incremental schema generation for --ndjson and --memory-limit. Tables and node IDs persist
+ // across records; a record's rows stay in their tables until
+ // schema_builder_clear_rows(), which must run before its AST is released.
+ typedef struct SchemaBuilder SchemaBuilder;
+ SchemaBuilder* create_schema_builder(const Schema* known, const struct Projection* projection, bool dedup); // As for generate_schema()
+ bool schema_add_record(SchemaBuilder* builder, AST_Node* record); // Named like the elements of a top-level array; false (reported) for a scalar record
+ // --memory-limit: add the next part of a top-level array, whose first element
+ // is element 'first_index' of the array; the parts give the tables of the whole
+ void schema_add_elements(SchemaBuilder* builder, Array_Node* elements, int first_index);
+ Schema* schema_builder_tables(SchemaBuilder* builder); // All tables so far; valid until the next record
+ int schema_builder_touched(SchemaBuilder* builder, const int** positions); // Tables holding the record's rows
+ void schema_builder_clear_rows(SchemaBuilder* builder);
+ Schema* finish_schema_builder(SchemaBuilder* builder); // Frees the builder; free the result with free_schema()
+ 
+ // --ndjson and --memory-limit output: each table's file stays open and gets every record's rows appended
+ typedef struct RecordWriter RecordWriter;
+ RecordWriter* create_record_writer(const struct OutputOptions* options); // Keeps a pointer to options
+ void write_record_rows(RecordWriter* writer, SchemaBuilder* builder);
+ void finish_record_writer(RecordWriter* writer, Schema* schema); // Also writes tables that never got rows
+ // Free the writer without writing; after an error, with its files left to discard_open_files()
+ void free_record_writer(RecordWriter* writer);
+ 
+ // Shared by the batch writer and the --stream emitter
+ void ensure_directory(const char* path); // fatal_error() if it cannot be created
  
  #endif /* AST_H */
\ No newline at end of file
@@ -0,0 +1,148 @@
+/**
+ * gen_json.c - Synthetic JSON generator for the json2relcsv benchmarks
+ *
+ * Usage: gen_json [--ndjson] SHAPE SIZE_MB [SEED] > out.json
+ *
+ * Shapes:
+ *   wide      array of flat objects with 48 scalar columns of mixed types
+ *   deep      array of objects nested 12 levels deep through a "child" key
+ *   scalars   records carrying large scalar arrays (like "genres")
+ *   siblings  "store"-like records with many differently shaped sub-objects
+ *
+ * --ndjson writes one record per line instead of a top-level array.
+ * Output is deterministic for a given shape, size and seed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdarg.h>
+
+static uint64_t rng_state = 88172645463325252ULL;
+
+static uint64_t next_random(void) {
+    // xorshift64
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static long long bytes_written = 0;
+
+static void emit(const char* text) {
+    bytes_written += (long long)strlen(text);
+    fputs(text, stdout);
+}
+
+static void emitf(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    int n = vprintf(format, args);
+    va_end(args);
+    if (n > 0) bytes_written += n;
+}
+
+static const char* words[] = {
+    "alpha", "bravo", "charlie", "delta", "echo", "foxtrot", "golf", "hotel",
+    "india", "juliet", "kilo", "lima", "mike", "november", "oscar", "papa",
+    "quote \\\"inside\\\"", "comma, separated", "line\\nbreak", "unicode \\u00e9"
+};
+#define WORD_COUNT (sizeof(words) / sizeof(words[0]))
+
+// One scalar of a type chosen by 'kind'
+static void emit_scalar(int kind) {
+    switch (kind % 6) {
+        case 0: emitf("%llu", (unsigned long long)(next_random() % 10000000000ULL)); break;
+        case 1: emitf("%.6f", (double)(next_random() % 100000000) / 1000.0); break;
+        case 2: emitf("\"%s %s\"", words[next_random() % WORD_COUNT], words[next_random() % WORD_COUNT]); break;
+        case 3: emit(next_random() & 1 ? "true" : "false"); break;
+        case 4: emit(next_random() % 4 == 0 ? "null" : "\"x\""); break;
+        default: emitf("%lld", (long long)(next_random() % 2000001) - 1000000); break;
+    }
+}
+
+static void emit_wide_object(void) {
+    emit("{");
+    for (int i = 0; i < 48; i++) {
+        emitf("%s\"col%02d\":", i ? "," : "", i);
+        emit_scalar(i);
+    }
+    emit("}");
+}
+
+static void emit_deep_object(int depth) {
+    emitf("{\"level\":%d,\"name\":\"%s\",\"score\":", depth, words[next_random() % WORD_COUNT]);
+    emit_scalar(1);
+    if (depth < 12) {
+        emit(",\"child\":");
+        emit_deep_object(depth + 1);
+    }
+    emit("}");
+}
+
+static void emit_scalars_record(long long index) {
+    emitf("{\"movie\":\"title %lld\",\"genres\":[", index);
+    for (int i = 0; i < 500; i++) {
+        emitf("%s\"%s\"", i ? "," : "", words[next_random() % WORD_COUNT]);
+    }
+    emit("],\"ratings\":[");
+    for (int i = 0; i < 500; i++) {
+        emitf("%s%llu", i ? "," : "", (unsigned long long)(next_random() % 11));
+    }
+    emit("]}");
+}
+
+static void emit_siblings_record(long long index) {
+    emitf("{\"store\":{\"name\":\"store %lld\"", index);
+    for (int s = 0; s < 24; s++) {
+        // Sibling s has s % 8 + 1 keys, so shapes differ between siblings
+        emitf(",\"section%02d\":{", s);
+        for (int k = 0; k <= s % 8; k++) {
+            emitf("%s\"f%d_%d\":", k ? "," : "", s, k);
+            emit_scalar(k + s);
+        }
+        emit("}");
+    }
+    emit(",\"staff\":[");
+    for (int e = 0; e < 4; e++) {
+        emitf("%s{\"id\":\"E%03d\",\"name\":\"%s\"}", e ? "," : "", e, words[next_random() % WORD_COUNT]);
+    }
+    emit("]}}");
+}
+
+int main(int argc, char** argv) {
+    int ndjson = argc > 1 && strcmp(argv[1], "--ndjson") == 0;
+    if (ndjson) {
+        argv++;
+        argc--;
+    }
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s [--ndjson] wide|deep|scalars|siblings SIZE_MB [SEED]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    const char* shape = argv[1];
+    long long target = atoll(argv[2]) * 1024 * 1024;
+    if (argc > 3) rng_state ^= (uint64_t)atoll(argv[3]) * 0x9E3779B97F4A7C15ULL;
+    if (rng_state == 0) rng_state = 1;
+
+    if (!ndjson) emit("[");
+    for (long long i = 0; bytes_written < target; i++) {
+        if (i) emit(ndjson ? "\n" : ",\n");
+        if (strcmp(shape, "wide") == 0) {
+            emit_wide_object();
+        } else if (strcmp(shape, "deep") == 0) {
+            emit_deep_object(0);
+        } else if (strcmp(shape, "scalars") == 0) {
+            emit_scalars_record(i);
+        } else if (strcmp(shape, "siblings") == 0) {
+            emit_siblings_record(i);
+        } else {
+            fprintf(stderr, "Error: Unknown shape '%s'\n", shape);
+            return EXIT_FAILURE;
+        }
+    }
+    emit(ndjson ? "\n" : "]\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,98 @@
+#!/bin/bash
+#
+# run_bench.sh - Throughput benchmark for json2relcsv (run via `make bench`)
+#
+# Generates one input per shape with bench/gen_json, converts it in batch and
+# --stream mode (and as NDJSON with --ndjson) and prints MB/s, peak RSS and per-phase times (best of N runs).
+#
+# Environment:
+#   BENCH_MB      input size per shape in MiB (default 64)
+#   BENCH_RUNS    runs per measurement, best is kept (default 3)
+#   BENCH_SHAPES  shapes to run (default "wide deep scalars siblings")
+#   BENCH_MODES   modes to run (default "batch stream"; "ndjson" is also available)
+#   BENCH_FLAGS   extra json2relcsv options, e.g. "--jobs 8"
+
+set -e
+
+BENCH_DIR="$(cd "$(dirname "$0")" && pwd)"
+BIN="$BENCH_DIR/../json2relcsv"
+GEN="$BENCH_DIR/gen_json"
+DATA_DIR="$BENCH_DIR/data"
+OUT_DIR="$BENCH_DIR/out"
+
+MB=${BENCH_MB:-64}
+RUNS=${BENCH_RUNS:-3}
+SHAPES=${BENCH_SHAPES:-"wide deep scalars siblings"}
+MODES=${BENCH_MODES:-"batch stream"}
+
+if [ ! -x "$BIN" ] || [ ! -x "$GEN" ]; then
+    echo "Build first: make json2relcsv bench/gen_json" >&2
+    exit 1
+fi
+
+mkdir -p "$DATA_DIR"
+
+# Extract key=value from a "Timing:" line
+field() {
+    echo "$1" | tr ' ' '\n' | sed -n "s/^$2=//p"
+}
+
+printf "%-9s %-6s %8s %9s %9s %9s %9s %9s %10s\n" \
+    shape mode MiB "MiB/s" "parse_s" "schema_s" "write_s" "total_s" "rss_MiB"
+
+for shape in $SHAPES; do
+    for mode in $MODES; do
+        mode_flag=""
+        [ "$mode" = "stream" ] && mode_flag="--stream"
+        if [ "$mode" = "ndjson" ]; then
+            mode_flag="--ndjson"
+            input="$DATA_DIR/$shape-$MB.ndjson"
+            [ -f "$input" ] || "$GEN" --ndjson "$shape" "$MB" > "$input"
+        else
+            input="$DATA_DIR/$shape-$MB.json"
+            [ -f "$input" ] || "$GEN" "$shape" "$MB" > "$input"
+        fi
+        bytes=$(wc -c < "$input")
+
+        best=""
+        best_total=""
+        for run in $(seq "$RUNS"); do
+            rm -rf "$OUT_DIR"
+            mkdir -p "$OUT_DIR"
+            output=$("$BIN" --input "$input" --out-dir "$OUT_DIR" --timing $mode_flag $BENCH_FLAGS 2>&1 >/dev/null || true)
+            line=$(echo "$output" | grep '^Timing:' || true)
+            if [ -z "$line" ]; then
+                best=""
+                break
+            fi
+            total=$(field "$line" total)
+            if [ -z "$best_total" ] || awk "BEGIN { exit !($total < $best_total) }"; then
+                best="$line"
+                best_total="$total"
+            fi
+        done
+
+        if [ -z "$best" ]; then
+            printf "%-9s %-6s failed: %s\n" "$shape" "$mode" "$(echo "$output" | head -n 1)"
+            continue
+        fi
+
+        parse=$(field "$best" parse)
+        schema=$(field "$best" schema)
+        write=$(field "$best" write)
+        if [ "$mode" != "batch" ]; then
+            parse=$(field "$best" "$mode") # Parse and write overlap
+            schema="-"
+            write="-"
+        fi
+        rss=$(field "$best" peak_rss_kb)
+        awk -v shape="$shape" -v mode="$mode" -v bytes="$bytes" -v total="$best_total" \
+            -v parse="$parse" -v schema="$schema" -v write="$write" -v rss="$rss" 'BEGIN {
+            printf "%-9s %-6s %8.1f %9.1f %9s %9s %9s %9.3f %10.1f\n",
+                shape, mode, bytes / 1048576, bytes / 1048576 / total,
+                parse, schema, write, total, rss / 1024
+        }'
+    done
+done
+
+rm -rf "$OUT_DIR"
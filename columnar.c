@@ -0,0 +1,275 @@
+/**
+ * columnar.c - Typed columns for the binary output formats
+ */
+
+#include "columnar.h"
+#include "error.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+int table_rows(const TableSchema* table) {
+    return table->is_junction ? table->junction.count : table->rows.count;
+}
+
+Value_Node table_cell(const TableSchema* table, const TableColumn* column, int row) {
+    switch (column->source) {
+        case SOURCE_ID:
+            return create_integer_value(table->rows.ids[row]);
+        case SOURCE_PARENT_ID:
+            return create_integer_value(table->rows.parent_ids[row]);
+        case SOURCE_SLOT:
+            return row_store_value(&table->rows, column->slot, row);
+        case SOURCE_JUNCTION_OWNER:
+            return create_integer_value(table->junction.owner_ids[row]);
+        case SOURCE_JUNCTION_INDEX:
+            return create_integer_value(table->junction.item_indexes[row]);
+        case SOURCE_JUNCTION_VALUE:
+            return table->junction.values[row];
+    }
+    return create_null_value();
+}
+
+size_t cell_text(Value_Node value, char scratch[NUMBER_FORMAT_MAX + 1], const char** text) {
+    switch (value.type) {
+        case VALUE_STRING:
+            *text = value.string_val ? value.string_val : "";
+            return strlen(*text);
+        case VALUE_NUMBER:
+            *text = scratch;
+            return (size_t)format_double(value.number_val, scratch);
+        case VALUE_INTEGER:
+            *text = scratch;
+            return (size_t)format_int64(value.integer_val, scratch);
+        case VALUE_BOOLEAN:
+            *text = value.boolean_val ? "true" : "false";
+            return strlen(*text);
+        default:
+            *text = "";
+            return 0;
+    }
+}
+
+// A double that converts to int64 and back unchanged; -0.0 is not, since its
+// sign would be lost
+static bool double_is_int64(double number) {
+    return number >= -9223372036854775808.0 && number < 9223372036854775808.0 &&
+           number == (double)(int64_t)number && !(number == 0 && signbit(number));
+}
+
+// An int64 that converts to double and back unchanged
+static bool int64_is_double(int64_t integer) {
+    double number = (double)integer;
+    return number >= -9223372036854775808.0 && number < 9223372036854775808.0 && (int64_t)number == integer;
+}
+
+// Pick the column's type from the value types of its cells. A column mixing
+// integers and other numbers takes the type that holds all of them exactly:
+// int64 when every number is a whole value in range, else double when every
+// integer is exact as a double, else text.
+static void infer_column_kind(const TableSchema* table, TableColumn* column) {
+    unsigned seen = 0; // Bit per ValueType
+    bool numbers_whole = true;   // Every VALUE_NUMBER fits an int64 exactly
+    bool integers_exact = true;  // Every VALUE_INTEGER fits a double exactly
+    int rows = table_rows(table);
+    column->null_count = 0;
+    for (int row = 0; row < rows; row++) {
+        Value_Node value = table_cell(table, column, row);
+        if (cell_is_null(value)) {
+            column->null_count++;
+            continue;
+        }
+        seen |= 1u << value.type;
+        if (value.type == VALUE_NUMBER && numbers_whole) {
+            numbers_whole = double_is_int64(value.number_val);
+        } else if (value.type == VALUE_INTEGER && integers_exact) {
+            integers_exact = int64_is_double(value.integer_val);
+        }
+    }
+
+    unsigned integers = 1u << VALUE_INTEGER;
+    unsigned numbers = integers | 1u << VALUE_NUMBER;
+    if (seen && (seen & ~integers) == 0) {
+        column->kind = COLUMN_INT64;
+    } else if (seen == numbers && numbers_whole) {
+        column->kind = COLUMN_INT64;
+    } else if (seen && (seen & ~numbers) == 0 && integers_exact) {
+        column->kind = COLUMN_DOUBLE;
+    } else if (seen == 1u << VALUE_BOOLEAN) {
+        column->kind = COLUMN_BOOL;
+    } else {
+        column->kind = COLUMN_UTF8;
+    }
+}
+
+// Give a column a name no earlier column of the table has
+static char* unique_column_name(const TableColumn* columns, int count, const char* name) {
+    size_t size = strlen(name) + 12;
+    char* unique = (char*)malloc(size);
+    if (!unique) {
+        fatal_error("Error: Memory allocation failed for column name '%s'\n", name);
+    }
+    snprintf(unique, size, "%s", name);
+    for (int suffix = 2; ; suffix++) {
+        bool taken = false;
+        for (int i = 0; i < count && !taken; i++) {
+            taken = strcmp(columns[i].name, unique) == 0;
+        }
+        if (!taken) return unique;
+        snprintf(unique, size, "%s_%d", name, suffix);
+    }
+}
+
+TableColumn* table_columns(const TableSchema* table, int* count) {
+    TableColumn* columns = (TableColumn*)calloc(table->column_count, sizeof(TableColumn));
+    if (!columns) {
+        fatal_error("Error: Memory allocation failed for columns of table '%s'\n", table->name);
+    }
+
+    for (int i = 0; i < table->column_count; i++) {
+        TableColumn* column = &columns[i];
+        if (table->is_junction) {
+            column->source = i == 0 ? SOURCE_JUNCTION_OWNER : i == 1 ? SOURCE_JUNCTION_INDEX : SOURCE_JUNCTION_VALUE;
+        } else if (i == 0) {
+            column->source = SOURCE_ID;
+        } else if (i == 1 && table->has_parent_fk) {
+            column->source = SOURCE_PARENT_ID;
+        } else {
+            column->source = SOURCE_SLOT;
+            column->slot = table->column_slots[i];
+        }
+        column->name = unique_column_name(columns, i, table->columns[i]);
+        infer_column_kind(table, column);
+    }
+    *count = table->column_count;
+    return columns;
+}
+
+void free_table_columns(TableColumn* columns, int count) {
+    for (int i = 0; i < count; i++) {
+        free(columns[i].name);
+    }
+    free(columns);
+}
+
+void buffer_reserve(ByteBuffer* buffer, size_t extra) {
+    if (buffer->capacity - buffer->length >= extra) return;
+    size_t capacity = buffer->capacity ? buffer->capacity : 4096;
+    while (capacity - buffer->length < extra) capacity *= 2;
+    uint8_t* grown = (uint8_t*)realloc(buffer->data, capacity);
+    if (!grown) {
+        fatal_error("Error: Memory reallocation failed for output buffer\n");
+    }
+    buffer->data = grown;
+    buffer->capacity = capacity;
+}
+
+void buffer_put(ByteBuffer* buffer, const void* data, size_t length) {
+    if (length == 0) return; // 'data' may be NULL
+    buffer_reserve(buffer, length);
+    memcpy(buffer->data + buffer->length, data, length);
+    buffer->length += length;
+}
+
+void buffer_put_zeros(ByteBuffer* buffer, size_t length) {
+    if (length == 0) return;
+    buffer_reserve(buffer, length);
+    memset(buffer->data + buffer->length, 0, length);
+    buffer->length += length;
+}
+
+void buffer_pad(ByteBuffer* buffer, size_t alignment) {
+    buffer_put_zeros(buffer, (alignment - buffer->length % alignment) % alignment);
+}
+
+void buffer_free(ByteBuffer* buffer) {
+    free(buffer->data);
+    buffer->data = NULL;
+    buffer->length = 0;
+    buffer->capacity = 0;
+}
+
+static void write_columnar_table(TableSchema* table, const OutputOptions* options) {
+    if (table->omitted) return;
+    if (options->format == OUTPUT_PARQUET) {
+        write_parquet_table(table, options);
+    } else if (options->format == OUTPUT_ARROW) {
+        write_arrow_table(table, options);
+    } else {
+        write_pgcopy_table(table, options);
+    }
+}
+
+// Tables are independent files, so workers simply take the next one
+typedef struct TablePool {
+    Schema* schema;
+    const OutputOptions* options;
+    int next_table;
+    pthread_mutex_t lock;
+    WorkerErrors errors;     // Raised by write_columnar_files() once the workers are joined
+} TablePool;
+
+static void* table_pool_worker(void* arg) {
+    TablePool* pool = (TablePool*)arg;
+    // A table's file is registered in open_files, which discards it after an error
+    ErrorTrap trap;
+    error_trap_push(&trap);
+    if (setjmp(trap.jump) != 0) {
+        error_trap_pop(&trap);
+        worker_errors_keep(&pool->errors, trap.message);
+        return NULL;
+    }
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        int index = pool->next_table < pool->schema->table_count ? pool->next_table++ : -1;
+        pthread_mutex_unlock(&pool->lock);
+        if (index < 0 || worker_errors_failed(&pool->errors)) break;
+        write_columnar_table(&pool->schema->tables[index], pool->options);
+    }
+    error_trap_pop(&trap);
+    return NULL;
+}
+
+void write_columnar_files(Schema* schema, const OutputOptions* options) {
+    if (options->format == OUTPUT_PGCOPY) {
+        if (options->to_stdout) { // One stream, so one table at a time
+            write_pgcopy_stream(schema, options);
+            return;
+        }
+        write_pgcopy_ddl(schema, options);
+    }
+
+    int jobs = options->jobs < schema->table_count ? options->jobs : schema->table_count;
+    if (jobs <= 1) {
+        for (int i = 0; i < schema->table_count; i++) {
+            write_columnar_table(&schema->tables[i], options);
+        }
+        return;
+    }
+
+    pthread_t* threads = (pthread_t*)malloc(jobs * sizeof(pthread_t));
+    if (!threads) {
+        fatal_error("Error: Memory allocation failed for worker threads\n");
+    }
+    TablePool pool = {0};
+    pool.schema = schema;
+    pool.options = options;
+    pthread_mutex_init(&pool.lock, NULL);
+    worker_errors_init(&pool.errors);
+    int started = 0;
+    for (; started < jobs; started++) {
+        if (pthread_create(&threads[started], NULL, table_pool_worker, &pool) != 0) {
+            // The threads already started stop at their next table
+            worker_errors_keep(&pool.errors, "Error: Failed to start output worker thread");
+            break;
+        }
+    }
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+    pthread_mutex_destroy(&pool.lock);
+    worker_errors_raise(&pool.errors);
+}
@@ -0,0 +1,133 @@
+/**
+ * columnar.h - Typed columns for the binary output formats (--format parquet|arrow|pgcopy)
+ *
+ * Every table is presented as a list of TableColumns with one type each,
+ * inferred from the Value_Node types of its cells:
+ *   - int64 when every value is an integer (ids and FKs always are),
+ *   - double for other numbers; a column mixing integers and other numbers
+ *     is int64 when every number is a whole value in the int64 range,
+ *     double when every integer is exact as a double (|n| <= 2^53, say),
+ *     and utf8 otherwise, so no value is rounded,
+ *   - bool when every value is a boolean,
+ *   - utf8 for strings, all-null columns and columns mixing other types;
+ *     such cells are rendered as text exactly like the CSV output.
+ * JSON null, missing keys and nested objects or arrays become nulls.
+ */
+
+#ifndef COLUMNAR_H
+#define COLUMNAR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "ast.h"
+#include "csv_writer.h"
+#include "number.h"
+
+typedef enum {
+    COLUMN_INT64,
+    COLUMN_DOUBLE,
+    COLUMN_BOOL,
+    COLUMN_UTF8
+} ColumnKind;
+
+// Where the cells of a column come from
+typedef enum {
+    SOURCE_ID,             // RowStore.ids
+    SOURCE_PARENT_ID,      // RowStore.parent_ids
+    SOURCE_SLOT,           // RowStore.columns[slot]
+    SOURCE_JUNCTION_OWNER, // JunctionRows.owner_ids
+    SOURCE_JUNCTION_INDEX, // JunctionRows.item_indexes
+    SOURCE_JUNCTION_VALUE  // JunctionRows.values
+} ColumnSource;
+
+typedef struct TableColumn {
+    char* name;            // Unique in the table: a repeated name gets a _2, _3, ... suffix
+    ColumnKind kind;
+    ColumnSource source;
+    int slot;              // SOURCE_SLOT only
+    int null_count;
+} TableColumn;
+
+// Growable byte buffer used to assemble pages, messages and footers
+typedef struct ByteBuffer {
+    uint8_t* data;
+    size_t length;
+    size_t capacity;
+} ByteBuffer;
+
+// Columns of a table, in CSV header order; free with free_table_columns()
+TableColumn* table_columns(const TableSchema* table, int* count);
+void free_table_columns(TableColumn* columns, int count);
+int table_rows(const TableSchema* table);
+Value_Node table_cell(const TableSchema* table, const TableColumn* column, int row);
+
+static inline bool cell_is_null(Value_Node value) {
+    return value.type == VALUE_NULL || value.type == VALUE_OBJECT || value.type == VALUE_ARRAY;
+}
+
+// Value of a non-null cell of an int64 or double column, which may hold
+// either kind of number (see the type rules above)
+static inline int64_t cell_int64(Value_Node value) {
+    return value.type == VALUE_NUMBER ? (int64_t)value.number_val : value.integer_val;
+}
+static inline double cell_double(Value_Node value) {
+    return value.type == VALUE_INTEGER ? (double)value.integer_val : value.number_val;
+}
+
+// Text of a non-null cell of a utf8 column; numbers are formatted into 'scratch'
+size_t cell_text(Value_Node value, char scratch[NUMBER_FORMAT_MAX + 1], const char** text);
+
+void buffer_reserve(ByteBuffer* buffer, size_t extra);
+void buffer_put(ByteBuffer* buffer, const void* data, size_t length);
+void buffer_put_zeros(ByteBuffer* buffer, size_t length);
+void buffer_pad(ByteBuffer* buffer, size_t alignment); // Zero-fill up to a multiple of 'alignment'
+void buffer_free(ByteBuffer* buffer);
+
+// Little-endian stores, independent of the host byte order
+static inline void buffer_put_u8(ByteBuffer* buffer, uint8_t value) {
+    buffer_reserve(buffer, 1);
+    buffer->data[buffer->length++] = value;
+}
+
+static inline void buffer_put_u16(ByteBuffer* buffer, uint16_t value) {
+    buffer_reserve(buffer, 2);
+    for (int i = 0; i < 2; i++) buffer->data[buffer->length++] = (uint8_t)(value >> (8 * i));
+}
+
+static inline void buffer_put_u32(ByteBuffer* buffer, uint32_t value) {
+    buffer_reserve(buffer, 4);
+    for (int i = 0; i < 4; i++) buffer->data[buffer->length++] = (uint8_t)(value >> (8 * i));
+}
+
+static inline void buffer_put_u64(ByteBuffer* buffer, uint64_t value) {
+    buffer_reserve(buffer, 8);
+    for (int i = 0; i < 8; i++) buffer->data[buffer->length++] = (uint8_t)(value >> (8 * i));
+}
+
+static inline void buffer_set_u32(ByteBuffer* buffer, size_t position, uint32_t value) {
+    for (int i = 0; i < 4; i++) buffer->data[position + i] = (uint8_t)(value >> (8 * i));
+}
+
+static inline void buffer_put_double(ByteBuffer* buffer, double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    buffer_put_u64(buffer, bits);
+}
+
+// One file per table: <out_dir>/<table>.parquet (parquet_writer.c),
+// <out_dir>/<table>.arrow (arrow_writer.c) or <out_dir>/<table>.pgcopy
+// (pgcopy_writer.c)
+void write_parquet_table(TableSchema* table, const OutputOptions* options);
+void write_arrow_table(TableSchema* table, const OutputOptions* options);
+void write_pgcopy_table(TableSchema* table, const OutputOptions* options);
+// <out_dir>/schema.sql: CREATE TABLE statements for the .pgcopy files
+void write_pgcopy_ddl(const Schema* schema, const OutputOptions* options);
+// The DDL and every table framed on stdout, for OutputOptions.to_stdout
+void write_pgcopy_stream(Schema* schema, const OutputOptions* options);
+
+// Write every table in options->format, on options->jobs threads
+void write_columnar_files(Schema* schema, const OutputOptions* options);
+
+#endif /* COLUMNAR_H */
@@ -0,0 +1,165 @@
+/**
+ * compress.c - Block compression of CSV output (--compress)
+ */
+
+#include "compress.h"
+#include "error.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#ifdef WITH_ZSTD
+#include <zstd.h>
+#endif
+
+#define GZIP_MAX_LEVEL 9
+#define ZSTD_MAX_LEVEL 22
+#define ZSTD_DEFAULT_LEVEL 3
+
+struct BlockCompressor {
+    Compression compression;
+    z_stream gzip;                // Reset for every member
+    bool gzip_ready;
+#ifdef WITH_ZSTD
+    ZSTD_CCtx* zstd;
+#endif
+    char* output;
+    size_t output_capacity;
+};
+
+bool parse_compression(const char* text, Compression* compression) {
+    const char* colon = strchr(text, ':');
+    size_t name_length = colon ? (size_t)(colon - text) : strlen(text);
+    int max_level;
+    if (name_length == 4 && strncmp(text, "gzip", 4) == 0) {
+        compression->codec = COMPRESS_GZIP;
+        max_level = GZIP_MAX_LEVEL;
+    } else if (name_length == 4 && strncmp(text, "zstd", 4) == 0) {
+        compression->codec = COMPRESS_ZSTD;
+        max_level = ZSTD_MAX_LEVEL;
+    } else {
+        return false;
+    }
+
+    compression->level = 0;
+    if (colon) {
+        char* end = NULL;
+        long level = strtol(colon + 1, &end, 10);
+        if (end == colon + 1 || *end != '\0' || level < 1 || level > max_level) return false;
+        compression->level = (int)level;
+    }
+    return true;
+}
+
+bool compression_available(CompressionCodec codec) {
+#ifdef WITH_ZSTD
+    (void)codec;
+    return true;
+#else
+    return codec != COMPRESS_ZSTD;
+#endif
+}
+
+const char* compression_extension(CompressionCodec codec) {
+    switch (codec) {
+        case COMPRESS_GZIP: return ".gz";
+        case COMPRESS_ZSTD: return ".zst";
+        default: return "";
+    }
+}
+
+const char* compression_name(CompressionCodec codec) {
+    switch (codec) {
+        case COMPRESS_GZIP: return "gzip";
+        case COMPRESS_ZSTD: return "zstd";
+        default: return "none";
+    }
+}
+
+BlockCompressor* create_block_compressor(const Compression* compression) {
+    BlockCompressor* compressor = (BlockCompressor*)calloc(1, sizeof(BlockCompressor));
+    if (!compressor) {
+        fatal_error("Error: Memory allocation failed for output compressor\n");
+    }
+    compressor->compression = *compression;
+    return compressor;
+}
+
+void free_block_compressor(BlockCompressor* compressor) {
+    if (!compressor) return;
+    if (compressor->gzip_ready) deflateEnd(&compressor->gzip);
+#ifdef WITH_ZSTD
+    ZSTD_freeCCtx(compressor->zstd);
+#endif
+    free(compressor->output);
+    free(compressor);
+}
+
+static void reserve_output(BlockCompressor* compressor, size_t size) {
+    if (size <= compressor->output_capacity) return;
+    char* output = (char*)realloc(compressor->output, size);
+    if (!output) {
+        fatal_error("Error: Memory allocation failed for compressed output\n");
+    }
+    compressor->output = output;
+    compressor->output_capacity = size;
+}
+
+static size_t gzip_block(BlockCompressor* compressor, const char* data, size_t length, const char* name) {
+    z_stream* stream = &compressor->gzip;
+    if (!compressor->gzip_ready) {
+        int level = compressor->compression.level ? compressor->compression.level : Z_DEFAULT_COMPRESSION;
+        // windowBits 15 + 16 writes a gzip member rather than a zlib stream
+        if (deflateInit2(stream, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            fatal_error("Error: Failed to start gzip compression for '%s'\n", name);
+        }
+        compressor->gzip_ready = true;
+    } else {
+        deflateReset(stream);
+    }
+    reserve_output(compressor, deflateBound(stream, length));
+    stream->next_in = (Bytef*)data;
+    stream->avail_in = (uInt)length;
+    stream->next_out = (Bytef*)compressor->output;
+    stream->avail_out = (uInt)compressor->output_capacity;
+    if (deflate(stream, Z_FINISH) != Z_STREAM_END) {
+        fatal_error("Error: gzip compression failed for '%s'\n", name);
+    }
+    return (size_t)stream->total_out;
+}
+
+#ifdef WITH_ZSTD
+static size_t zstd_block(BlockCompressor* compressor, const char* data, size_t length, const char* name) {
+    if (!compressor->zstd) {
+        compressor->zstd = ZSTD_createCCtx();
+        if (!compressor->zstd) {
+            fatal_error("Error: Failed to start zstd compression for '%s'\n", name);
+        }
+    }
+    int level = compressor->compression.level ? compressor->compression.level : ZSTD_DEFAULT_LEVEL;
+    reserve_output(compressor, ZSTD_compressBound(length));
+    size_t size = ZSTD_compressCCtx(compressor->zstd, compressor->output, compressor->output_capacity,
+                                    data, length, level);
+    if (ZSTD_isError(size)) {
+        fatal_error("Error: zstd compression failed for '%s': %s\n", name, ZSTD_getErrorName(size));
+    }
+    return size;
+}
+#endif
+
+const char* compress_block(BlockCompressor* compressor, const char* data, size_t length,
+                           size_t* compressed_length, const char* name) {
+    switch (compressor->compression.codec) {
+        case COMPRESS_GZIP:
+            *compressed_length = gzip_block(compressor, data, length, name);
+            break;
+#ifdef WITH_ZSTD
+        case COMPRESS_ZSTD:
+            *compressed_length = zstd_block(compressor, data, length, name);
+            break;
+#endif
+        default:
+            fatal_error("Error: Output compression for '%s' is not available in this build\n", name);
+    }
+    return compressor->output;
+}
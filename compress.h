@@ -0,0 +1,50 @@
+/**
+ * compress.h - Block compression of CSV output (--compress)
+ *
+ * Output is compressed in blocks, each a complete gzip member or zstd
+ * frame. Concatenated members and frames form one valid .gz or .zst file,
+ * so blocks can be compressed independently: with --jobs the chunks of a
+ * large table are compressed on the worker threads that render them.
+ * zstd is only available when built with WITH_ZSTD=1.
+ */
+
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+typedef enum {
+    COMPRESS_NONE,
+    COMPRESS_GZIP,
+    COMPRESS_ZSTD
+} CompressionCodec;
+
+typedef struct Compression {
+    CompressionCodec codec;
+    int level;                    // Codec level; 0 for the codec's default
+} Compression;
+
+// Parse a --compress argument: "gzip" or "zstd", optionally with ":level".
+// Returns false if the codec or level is not valid.
+bool parse_compression(const char* text, Compression* compression);
+// Whether this build can write 'codec' (zstd needs WITH_ZSTD)
+bool compression_available(CompressionCodec codec);
+// ".gz", ".zst", or "" for COMPRESS_NONE
+const char* compression_extension(CompressionCodec codec);
+// "gzip", "zstd" or "none"
+const char* compression_name(CompressionCodec codec);
+
+// Compression state reused across the blocks of one writer or thread
+typedef struct BlockCompressor BlockCompressor;
+
+BlockCompressor* create_block_compressor(const Compression* compression);
+void free_block_compressor(BlockCompressor* compressor);
+
+// Compress data[0..length) as one complete member or frame. The result is
+// owned by the compressor and valid until its next call; 'name' is for
+// error messages.
+const char* compress_block(BlockCompressor* compressor, const char* data, size_t length,
+                           size_t* compressed_length, const char* name);
+
+#endif /* COMPRESS_H */
@@ -0,0 +1,401 @@
+/**
+ * converter.c - Conversion contexts: the library interface of json2relcsv
+ */
+
+#include "converter.h"
+#include "ast.h"
+#include "arena.h"
+#include "input.h"
+#include "stats.h"
+#include "stream.h"
+#include "symbols.h"
+#include "parallel.h"
+#include "fast_parser.h"
+#include "schema_file.h"
+#include "error.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+extern _Thread_local AST_Node* ast_root;
+extern _Thread_local int parse_records;
+
+// What a run reads: a path (NULL for stdin), a stream or a buffer
+typedef struct InputSource {
+    const char* path;
+    FILE* stream;
+    const char* data;
+    size_t size;
+} InputSource;
+
+struct Converter {
+    ConverterOptions options;
+    OutputOptions output;       // options.output with this run's open_files
+    ErrorTrap trap;             // Of the current or last run; holds its error
+    Schema* known_schema;       // Read from options.schema_path, kept for later runs
+    // State of the current run, released when it ends
+    InputMap input_map;         // A mapped file or a copied buffer; string values point into it
+    FILE* input_file;           // A path that could not be mapped
+    Arena* arena;
+    KeyTable* keys;
+    OpenFiles open_files;
+    ParsePool* parallel;
+    StreamEmitter* emitter;     // --stream
+    RecordWriter* records;      // --ndjson and --memory-limit
+    SchemaBuilder* builder;
+    Schema* schema;
+    char* state_path;           // --append: the state file in the output directory
+    Schema* state;              // What it held when the run started; NULL on the first run
+};
+
+Converter* create_converter(const ConverterOptions* options) {
+    Converter* converter = (Converter*)calloc(1, sizeof(Converter));
+    if (!converter) return NULL;
+    converter->options = *options;
+    if (converter->options.buffer_size == 0) converter->options.buffer_size = INPUT_DEFAULT_BUFFER_SIZE;
+    init_open_files(&converter->open_files);
+    return converter;
+}
+
+void free_converter(Converter* converter) {
+    if (!converter) return;
+    free_open_files(&converter->open_files);
+    free_schema(converter->known_schema);
+    free(converter);
+}
+
+const char* converter_error(const Converter* converter) {
+    return converter->trap.failed ? converter->trap.message : "";
+}
+
+static void begin_phase(Converter* converter, const char* name) {
+    if (converter->options.stats) stats_begin_phase(name);
+}
+
+static void end_phase(Converter* converter) {
+    if (converter->options.stats) stats_end_phase();
+}
+
+// Point this thread's scanner at the input (mapped when possible)
+static void open_input(Converter* converter, const InputSource* source) {
+    if (source->data) {
+        if (!input_copy_buffer(source->data, source->size, &converter->input_map)) {
+            fatal_error("Error: Failed to copy input buffer: %s\n", strerror(errno));
+        }
+        parse_map_from(converter->options.parser, &converter->input_map, 0);
+        return;
+    }
+    if (source->path) {
+        if (input_map_file(source->path, &converter->input_map)) {
+            parse_map_from(converter->options.parser, &converter->input_map, 0);
+            return;
+        }
+        // Not mappable (a pipe, /dev/stdin, ...): read it like stdin, which
+        // only the flex/bison parser can
+        converter->input_file = fopen(source->path, "rb");
+        if (!converter->input_file) {
+            fatal_error("Error: Failed to open input '%s': %s\n", source->path, strerror(errno));
+        }
+        scanner_scan_stream(converter->input_file, converter->options.buffer_size);
+        return;
+    }
+    scanner_scan_stream(source->stream ? source->stream : stdin, converter->options.buffer_size);
+}
+
+// The tables a run starts from: the --append state, or the --schema file
+static const Schema* starting_schema(const Converter* converter) {
+    return converter->options.output.append ? converter->state : converter->known_schema;
+}
+
+// Write the tables of a successful run where --emit-schema and --append want them
+static void save_tables(Converter* converter, const Schema* schema) {
+    if (converter->options.emit_schema_path) write_schema_file(converter->options.emit_schema_path, schema);
+    if (converter->state_path) write_state_file(converter->state_path, schema, &converter->output);
+}
+
+static void ensure_out_dir(const Converter* converter) {
+    const char* out_dir = converter->output.out_dir;
+    if (out_dir && strlen(out_dir) > 0) ensure_directory(out_dir);
+}
+
+// Streaming mode: rows are written while parsing, no AST is kept
+static bool convert_stream(Converter* converter) {
+    ensure_out_dir(converter);
+    converter->emitter = create_stream_emitter(&converter->output, starting_schema(converter),
+                                               converter->options.projection);
+    stream_emitter = converter->emitter;
+    int status = parse_input();
+    stream_emitter = NULL;
+    if (status == 0) {
+        close_stream_files(converter->emitter); // Before the state that covers their rows
+        save_tables(converter, stream_emitter_tables(converter->emitter));
+    }
+    finish_stream_emitter(converter->emitter);
+    converter->emitter = NULL;
+    stats_record_arena(ast_arena);
+    end_phase(converter);
+    return status == 0;
+}
+
+// NDJSON: parse, convert and release one record at a time. Tables and IDs
+// are shared by all records, so the output matches that of the records
+// wrapped in one array.
+static bool convert_records(Converter* converter) {
+    ensure_out_dir(converter);
+    converter->builder = create_schema_builder(starting_schema(converter), converter->options.projection,
+                                               converter->options.dedup);
+    converter->records = create_record_writer(&converter->output);
+    ArenaMark record_start = arena_mark(ast_arena);
+
+    // --jobs parses a mapped input's records ahead on worker threads, as does
+    // --memory-limit, whose parts are copied rather than parsed in the map
+    int jobs = converter->output.jobs;
+    size_t memory_limit = converter->options.memory_limit;
+    if ((jobs > 1 || memory_limit) && converter->input_map.data) {
+        converter->parallel = parallel_records_start(&converter->input_map, jobs > 1 ? jobs : 1,
+                                                     converter->options.parser, memory_limit);
+    }
+
+    parse_records = 1;
+    int status;
+    bool records_ok = true;
+    while ((status = converter->parallel ? parallel_next_record(converter->parallel) : parse_input()) == 0 && ast_root) {
+        if (converter->options.print_ast) {
+            print_ast(ast_root, 0);
+            printf("\n");
+        }
+        if (!schema_add_record(converter->builder, ast_root)) {
+            records_ok = false;
+            break;
+        }
+        write_record_rows(converter->records, converter->builder);
+        schema_builder_clear_rows(converter->builder);
+        ast_root = NULL;
+        arena_release(ast_arena, record_start); // Drop the record's AST
+    }
+    ast_root = NULL;
+
+    // Records converted before an error keep their rows
+    converter->schema = finish_schema_builder(converter->builder);
+    converter->builder = NULL;
+    stats_set_table_count(converter->schema->table_count);
+    finish_record_writer(converter->records, converter->schema);
+    converter->records = NULL;
+    if (status == 0 && records_ok) save_tables(converter, converter->schema);
+    parallel_release(converter->parallel);
+    converter->parallel = NULL;
+    stats_record_arena(ast_arena);
+    end_phase(converter);
+    return status == 0 && records_ok;
+}
+
+// --memory-limit: convert a top-level array a part at a time, like NDJSON
+// records, writing each part's rows before the next part is parsed. Files
+// are created under temporary names and renamed once the whole array is
+// converted, so a failed run leaves no tables, as without the limit.
+static bool convert_array_parts(Converter* converter) {
+    ensure_out_dir(converter);
+    converter->output.staged = !converter->output.append; // --append restores its files itself
+    converter->builder = create_schema_builder(starting_schema(converter), converter->options.projection,
+                                               converter->options.dedup);
+    converter->records = create_record_writer(&converter->output);
+
+    int status;
+    int first_index = 0;
+    Array_Node* elements;
+    while ((status = parallel_next_elements(converter->parallel, &elements)) == 0 && elements) {
+        schema_add_elements(converter->builder, elements, first_index);
+        first_index += elements->size;
+        write_record_rows(converter->records, converter->builder);
+        schema_builder_clear_rows(converter->builder);
+    }
+
+    converter->schema = finish_schema_builder(converter->builder);
+    converter->builder = NULL;
+    stats_set_table_count(converter->schema->table_count);
+    finish_record_writer(converter->records, converter->schema);
+    converter->records = NULL;
+    if (status == 0) {
+        commit_staged_files(&converter->open_files);
+        save_tables(converter, converter->schema);
+    }
+    parallel_release(converter->parallel);
+    converter->parallel = NULL;
+    stats_record_arena(ast_arena);
+    end_phase(converter);
+    return status == 0;
+}
+
+// Whether a mapped input is a top-level array, the only document
+// --memory-limit can convert in parts
+static bool input_is_array(const InputMap* map) {
+    size_t i = 0;
+    while (i < map->size && (map->data[i] == ' ' || map->data[i] == '\t' || map->data[i] == '\n' || map->data[i] == '\r')) i++;
+    return i < map->size && map->data[i] == '[';
+}
+
+// One document: parse it whole, then build the schema and write the tables
+static bool convert_document(Converter* converter) {
+    size_t memory_limit = converter->options.memory_limit;
+    int jobs = converter->output.jobs;
+    if (memory_limit) {
+        if (converter->input_map.data && input_is_array(&converter->input_map)) {
+            // NULL if the array fits in one part
+            converter->parallel = parallel_array_start(&converter->input_map, jobs > 1 ? jobs : 1,
+                                                       converter->options.parser, memory_limit);
+            if (converter->parallel) return convert_array_parts(converter);
+        }
+        // Converted whole, so the limit is kept by failing: the AST may take
+        // half of it, and its rows are checked against the rest below
+        ast_arena->limit = memory_limit / 2;
+    }
+
+    // With --jobs a mapped top-level array is parsed in parts on worker
+    // threads; anything else, errors included, is parsed here.
+    if (jobs > 1 && converter->input_map.data) {
+        converter->parallel = parallel_parse_array(&converter->input_map, jobs, converter->options.parser);
+    }
+    if (!converter->parallel && parse_input() != 0) return false; // The parser reported it
+    end_phase(converter);
+    stats_record_arena(ast_arena);
+
+    if (!ast_root) {
+        fatal_error("Error: No AST generated\n");
+    }
+
+    if (converter->options.print_ast) {
+        begin_phase(converter, "print_ast");
+        print_ast(ast_root, 0);
+        printf("\n");
+        end_phase(converter);
+    }
+
+    begin_phase(converter, "schema");
+    converter->schema = generate_schema(ast_root, starting_schema(converter), converter->options.projection,
+                                        converter->options.dedup);
+    if (!converter->schema) {
+        fatal_error("Error: Failed to generate schema\n");
+    }
+    end_phase(converter);
+    stats_set_table_count(converter->schema->table_count);
+    if (memory_limit && ast_arena->block_bytes + schema_row_bytes(converter->schema) > memory_limit) {
+        fatal_error("Error: The input does not fit in --memory-limit; only a top-level array in an --input file is converted in parts\n");
+    }
+
+    begin_phase(converter, "write");
+    write_csv_files(converter->schema, &converter->output);
+    save_tables(converter, converter->schema);
+    end_phase(converter);
+    return true;
+}
+
+// Release everything the run still holds: all of it after a success, or
+// whatever was left when an error unwound the run. Runs outside the trap.
+static void end_run(Converter* converter, bool converted) {
+    stream_emitter = NULL; // Left set by an error
+    parse_records = 0;
+    ast_root = NULL;
+    parallel_release(converter->parallel); // Joins the workers first
+    converter->parallel = NULL;
+    free_stream_emitter(converter->emitter); // Their files are discarded below
+    converter->emitter = NULL;
+    free_record_writer(converter->records);
+    converter->records = NULL;
+    if (converter->builder) converter->schema = finish_schema_builder(converter->builder);
+    converter->builder = NULL;
+    free_schema(converter->schema);
+    converter->schema = NULL;
+    // After a success every file is closed already
+    discard_open_files(&converter->open_files);
+    // A failed --append run leaves the output as it found it
+    if (!converted) restore_appended_files(&converter->open_files);
+    forget_appended_files(&converter->open_files);
+    remove_staged_files(&converter->open_files);
+    free_schema(converter->state);
+    converter->state = NULL;
+    free(converter->state_path);
+    converter->state_path = NULL;
+
+    parse_finish();
+    arena_destroy(converter->arena); // Releases the whole AST
+    converter->arena = NULL;
+    input_unmap(&converter->input_map); // Unmaps the strings referenced by the AST
+    if (converter->input_file) fclose(converter->input_file);
+    converter->input_file = NULL;
+    free_key_table(converter->keys);
+    converter->keys = NULL;
+}
+
+static bool run_conversion(Converter* converter, const InputSource* source) {
+    // Per-thread parse state of the caller, restored at the end
+    Arena* outer_arena = ast_arena;
+    KeyTable* outer_keys = current_key_table();
+    const Projection* outer_projection = current_projection();
+    WarningHandler outer_warning;
+    void* outer_warning_context;
+    current_warning_handler(&outer_warning, &outer_warning_context);
+    set_warning_handler(converter->options.warning, converter->options.warning_context);
+
+    ErrorTrap* trap = &converter->trap;
+    error_trap_push(trap);
+    volatile bool converted = false;
+    if (setjmp(trap->jump) == 0) {
+        const ConverterOptions* options = &converter->options;
+        converter->output = options->output;
+        converter->output.open_files = &converter->open_files;
+        if (options->output.append) {
+            converter->state_path = state_file_path(options->output.out_dir);
+            converter->state = read_state_file(converter->state_path, &options->output, options->dedup);
+        } else if (options->schema_path && !converter->known_schema) {
+            converter->known_schema = read_schema_file(options->schema_path, options->dedup);
+            converter->known_schema->next_node_id = 0; // IDs start at 1; only --append continues them
+        }
+
+        // Opening (mapping) the input is timed as part of parsing
+        begin_phase(converter, options->stream ? "stream" : options->ndjson ? "ndjson" : "parse");
+        // All nodes and strings of this parse are allocated from one arena
+        converter->arena = arena_create(0);
+        ast_arena = converter->arena;
+        converter->keys = create_key_table();
+        use_key_table(converter->keys);
+        // The AST printed by --print-ast is the whole input, and --dedup
+        // compares whole objects, so neither lets the parser skim
+        use_projection(options->print_ast || options->dedup ? NULL : options->projection);
+
+        open_input(converter, source);
+        if (options->stream) converted = convert_stream(converter);
+        else if (options->ndjson) converted = convert_records(converter);
+        else converted = convert_document(converter);
+    }
+    error_trap_pop(trap);
+    end_run(converter, converted);
+    ast_arena = outer_arena;
+    use_key_table(outer_keys);
+    use_projection(outer_projection);
+    set_warning_handler(outer_warning, outer_warning_context);
+
+    if (!converted && !trap->failed) { // A parse error with no message of its own
+        trap->failed = true;
+        snprintf(trap->message, sizeof(trap->message), "Error: Conversion failed");
+    }
+    return !trap->failed;
+}
+
+bool converter_run_file(Converter* converter, const char* path) {
+    InputSource source = {0};
+    source.path = path;
+    return run_conversion(converter, &source);
+}
+
+bool converter_run_stream(Converter* converter, FILE* in) {
+    InputSource source = {0};
+    source.stream = in;
+    return run_conversion(converter, &source);
+}
+
+bool converter_run_buffer(Converter* converter, const char* data, size_t size) {
+    InputSource source = {0};
+    source.data = data;
+    source.size = size;
+    return run_conversion(converter, &source);
+}
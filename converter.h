@@ -0,0 +1,66 @@
+/**
+ * converter.h - Conversion contexts: the library interface of json2relcsv
+ *
+ * A Converter holds the options and per-run state of conversions: the input,
+ * the parse arena, the key table and the open output files. The parser and
+ * scanner keep their state per thread, so converters can run at the same
+ * time on different threads; each converter runs one conversion at a time.
+ *
+ * Errors are returned instead of ending the process: a run returns false and
+ * converter_error() gives the message the CLI would print. This includes
+ * errors on --jobs worker threads (out of memory, a failed write of a
+ * chunk), which the workers hand back to the caller's thread.
+ *
+ * Built into libjson2relcsv.a; main.c is the command-line front end.
+ */
+
+#ifndef CONVERTER_H
+#define CONVERTER_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "csv_writer.h"
+#include "fast_parser.h"
+#include "projection.h"
+#include "error.h"
+
+typedef struct ConverterOptions {
+    OutputOptions output;     // Directory, format, quoting and jobs; open_files is set per run
+    bool stream;              // Write rows while parsing; CSV only, no AST, a single thread
+    bool ndjson;              // One JSON value per record; CSV only
+    ParserKind parser;        // PARSER_FAST (the default) or the flex/bison reference;
+                              // streamed input always uses flex/bison
+    bool print_ast;           // Print the AST (every record with ndjson) on stdout
+    bool stats;               // Time phases and record stats.h totals; process-wide,
+                              // so for one conversion at a time (the CLI)
+    size_t buffer_size;       // Read size for streams; 0 for the default
+    size_t memory_limit;      // Convert a mapped top-level array or NDJSON in parts
+                              // sized for this many bytes, and fail on another
+                              // document that needs more; 0 for no limit
+    const char* schema_path;  // Tables to start from (schema_file.h); read by the first run
+    const char* emit_schema_path; // Where each successful run writes its tables
+    const Projection* projection; // Tables and columns to write (projection.h), owned by
+                                  // the caller; NULL for all
+    bool dedup;               // Share the rows of nested objects with equal content;
+                              // not with stream
+    WarningHandler warning;   // Gets each warning of a run (error.h); NULL drops them
+    void* warning_context;    // Passed to 'warning'
+} ConverterOptions;
+
+typedef struct Converter Converter;
+
+Converter* create_converter(const ConverterOptions* options); // Copies the options
+void free_converter(Converter* converter);
+
+// Convert a file, memory-mapped when possible (NULL reads stdin)
+bool converter_run_file(Converter* converter, const char* path);
+// Convert everything read from 'in', which the caller closes
+bool converter_run_stream(Converter* converter, FILE* in);
+// Convert 'size' bytes of JSON held by the caller; they are copied first
+bool converter_run_buffer(Converter* converter, const char* data, size_t size);
+
+// Message of the last failed run, or "" after a successful one
+const char* converter_error(const Converter* converter);
+
+#endif /* CONVERTER_H */
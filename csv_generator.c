@@ -3,81 +3,18 @@
  */
 
  #include "ast.h"
+ #include "csv_writer.h"
+ #include "columnar.h"
+ #include "error.h"
  #include <stdio.h>
  #include <stdlib.h>
  #include <string.h>
  #include <sys/stat.h>
  #include <errno.h>
- 
- // Function to escape CSV content
- static char* escape_csv_string(const char* str) {
-     if (!str) return NULL;
-     
-     // Calculate required size
-     size_t len = strlen(str);
-     size_t quote_count = 0;
-     
-     for (size_t i = 0; i < len; i++) {
-         if (str[i] == '"') {
-             quote_count++;
-         }
-     }
-     
-     // Allocate memory for escaped string (original + double quotes + potential quotes to escape + null terminator)
-     char* escaped = (char*)malloc(len + 2 + quote_count + 1);
-     if (!escaped) {
-         fprintf(stderr, "Error: Memory allocation failed for CSV escaping\n");
-         exit(EXIT_FAILURE);
-     }
-     
-     // Add opening quote
-     escaped[0] = '"';
-     size_t pos = 1;
-     
-     // Copy and escape content
-     for (size_t i = 0; i < len; i++) {
-         if (str[i] == '"') {
-             escaped[pos++] = '"'; // Escape by doubling
-         }
-         escaped[pos++] = str[i];
-     }
-     
-     // Add closing quote and null terminator
-     escaped[pos++] = '"';
-     escaped[pos] = '\0';
-     
-     return escaped;
- }
- 
- // Convert a value to CSV string format
- static char* value_to_csv_string(Value_Node value) {
-     char buffer[64]; // For numeric values
-     
-     switch (value.type) {
-         case VALUE_STRING:
-             return value.string_val ? escape_csv_string(value.string_val) : strdup("");
-         
-         case VALUE_NUMBER:
-             snprintf(buffer, sizeof(buffer), "%g", value.number_val);
-             return strdup(buffer);
-         
-         case VALUE_BOOLEAN:
-             return strdup(value.boolean_val ? "true" : "false");
-         
-         case VALUE_NULL:
-             return strdup("");
-         
-         case VALUE_OBJECT:
-         case VALUE_ARRAY:
-             // These should be handled separately
-             return strdup("");
-     }
-     
-     return strdup("");
- }
+ #include <pthread.h>
  
  // Create directory if it doesn't exist
- static int ensure_directory(const char* path) {
+ void ensure_directory(const char* path) {
      struct stat st = {0};
      
      if (stat(path, &st) == -1) {
@@ -86,224 +23,324 @@
          #else
          if (mkdir(path, 0755) != 0) {
          #endif
-             fprintf(stderr, "Error: Failed to create directory '%s': %s\n", 
+             fatal_error("Error: Failed to create directory '%s': %s\n", 
                     path, strerror(errno));
-             return 0;
          }
      }
-     
-     return 1;
  }
  
- // Write a single CSV file for a table
- static void write_table_csv(TableSchema* table, const char* out_dir) {
-     if (!table || !table->name) return;
-     
-     // Create path
-     char* filename;
-     if (out_dir && strlen(out_dir) > 0) {
-         filename = (char*)malloc(strlen(out_dir) + strlen(table->name) + 6); // path + / + name + .csv + \0
-         if (!filename) {
-             fprintf(stderr, "Error: Memory allocation failed for filename\n");
-             exit(EXIT_FAILURE);
+ // Write 'count' junction rows starting at row 'first'
+ static void write_junction_rows(CsvWriter* writer, TableSchema* table, int first, int count) {
+     const JunctionRows* rows = &table->junction;
+     for (int i = first; i < first + count; i++) {
+         csv_put_int(writer, rows->owner_ids[i]);
+         csv_put_separator(writer);
+         csv_put_int(writer, rows->item_indexes[i]);
+         csv_put_separator(writer);
+         csv_put_value(writer, rows->values[i]);
+         csv_end_row(writer);
+     }
+ }
+ 
+ // Write 'count' object rows starting at row 'first'
+ static void write_object_rows(CsvWriter* writer, TableSchema* table, int first, int count) {
+     const RowStore* rows = &table->rows;
+     int first_data_col = table->has_parent_fk ? 2 : 1;
+     for (int row = first; row < first + count; row++) {
+         // id, optional parent FK, then every data column from its slot's vector
+         csv_put_int(writer, rows->ids[row]);
+         if (table->has_parent_fk) {
+             csv_put_separator(writer);
+             csv_put_int(writer, rows->parent_ids[row]);
          }
-         sprintf(filename, "%s/%s.csv", out_dir, table->name);
-     } else {
-         filename = (char*)malloc(strlen(table->name) + 5); // name + .csv + \0
-         if (!filename) {
-             fprintf(stderr, "Error: Memory allocation failed for filename\n");
-             exit(EXIT_FAILURE);
+         for (int i = first_data_col; i < table->column_count; i++) {
+             csv_put_separator(writer);
+             csv_put_value(writer, row_store_value(rows, table->column_slots[i], row));
          }
-         sprintf(filename, "%s.csv", table->name);
+         csv_end_row(writer);
      }
-     
-     // Open file
-     FILE* file = fopen(filename, "w");
-     if (!file) {
-         fprintf(stderr, "Error: Failed to open file '%s' for writing: %s\n", 
-                filename, strerror(errno));
-         free(filename);
-         exit(EXIT_FAILURE);
+ }
+ 
+ // Rows held by a table, whichever kind it is
+ static int table_row_count(const TableSchema* table) {
+     return table->is_junction ? table->junction.count : table->rows.count;
+ }
+ 
+ // Write 'count' rows of either kind starting at row 'first'
+ static void write_table_rows(CsvWriter* writer, TableSchema* table, int first, int count) {
+     if (table->is_junction) {
+         write_junction_rows(writer, table, first, count);
+     } else {
+         write_object_rows(writer, table, first, count);
      }
+ }
+ 
+ // Write a single CSV file for a table
+ static void write_table_csv(TableSchema* table, const OutputOptions* options) {
+     if (!table || !table->name || table->omitted) return;
+     
+     CsvWriter* writer = csv_writer_open(options, table->name);
      
      // Write header row
-     for (int i = 0; i < table->column_count; i++) {
-         fprintf(file, "%s%s", table->columns[i], i < table->column_count - 1 ? "," : "\n");
+     csv_write_header(writer, table->columns, table->column_count);
+     
+     write_table_rows(writer, table, 0, table_row_count(table));
+     
+     csv_writer_close(writer);
+ }
+ 
+ // Rows rendered per task by the --jobs worker pool
+ #define CSV_CHUNK_ROWS 8192
+ 
+ // A table written by the worker pool. Chunks are rendered in any order and
+ // appended to the file strictly in row order.
+ typedef struct TableJob {
+     TableSchema* table;
+     CsvWriter* writer;       // Opened when the first chunk is appended, closed after the last
+     CsvWriter** chunks;      // Rendered chunks waiting for their predecessors
+     int chunk_count;
+     int next_chunk;          // Next chunk to append
+     pthread_mutex_t lock;
+ } TableJob;
+ 
+ typedef struct ChunkTask {
+     TableJob* job;
+     int index;
+     int first_row;
+     int row_count;
+ } ChunkTask;
+ 
+ typedef struct WriterPool {
+     const OutputOptions* options;
+     ChunkTask* tasks;
+     int task_count;
+     int next_task;
+     pthread_mutex_t lock;
+     WorkerErrors errors;     // Raised by write_tables_parallel() once the workers are joined
+ } WriterPool;
+ 
+ static void* writer_pool_worker(void* arg) {
+     WriterPool* pool = (WriterPool*)arg;
+     // What an error must release: the chunk being rendered and the job lock held
+     CsvWriter* volatile chunk = NULL;
+     TableJob* volatile locked = NULL;
+     ErrorTrap trap;
+     error_trap_push(&trap);
+     if (setjmp(trap.jump) != 0) {
+         if (locked) pthread_mutex_unlock(&locked->lock);
+         csv_writer_close(chunk); // In memory: only freed
+         error_trap_pop(&trap);
+         worker_errors_keep(&pool->errors, trap.message);
+         return NULL;
      }
      
-     // Special case for junction tables (arrays of scalars)
-     if (table->column_count == 3 && 
-         strcmp(table->columns[1], "index") == 0 && 
-         strcmp(table->columns[2], "value") == 0) {
-         
-         // Find the parent table and its objects
-         char parent_table_name[256];
-         strncpy(parent_table_name, table->columns[0], sizeof(parent_table_name) - 1);
-         parent_table_name[sizeof(parent_table_name) - 1] = '\0';
+     for (;;) {
+         pthread_mutex_lock(&pool->lock);
+         ChunkTask* task = pool->next_task < pool->task_count ? &pool->tasks[pool->next_task++] : NULL;
+         pthread_mutex_unlock(&pool->lock);
+         if (!task || worker_errors_failed(&pool->errors)) break;
          
-         // Remove "_id" suffix to get parent table name
-         char* id_suffix = strstr(parent_table_name, "_id");
-         if (id_suffix) {
-             *id_suffix = '\0';
+         TableJob* job = task->job;
+         chunk = csv_writer_open_memory(pool->options);
+         write_table_rows(chunk, job->table, task->first_row, task->row_count);
+         if (pool->options->compression.codec != COMPRESS_NONE) {
+             // Compress on this thread too, so a large table's chunks compress in parallel
+             csv_writer_compress(chunk, &pool->options->compression, job->table->name);
          }
          
-         // Get key name from table name
-         char* key_name = strdup(strrchr(table->name, '_') ? strrchr(table->name, '_') + 1 : table->name);
-         if (key_name) {
-             key_name++; // Skip the underscore
-         } else {
-             key_name = table->name; // Fallback
+         // Append every chunk that is now next in line
+         pthread_mutex_lock(&job->lock);
+         locked = job;
+         job->chunks[task->index] = chunk;
+         chunk = NULL;
+         while (job->next_chunk < job->chunk_count && job->chunks[job->next_chunk]) {
+             if (!job->writer) {
+                 job->writer = csv_writer_open(pool->options, job->table->name);
+                 csv_write_header(job->writer, job->table->columns, job->table->column_count);
+             }
+             csv_writer_append(job->writer, job->chunks[job->next_chunk]);
+             csv_writer_close(job->chunks[job->next_chunk]);
+             job->chunks[job->next_chunk] = NULL;
+             job->next_chunk++;
          }
-         free(key_name);
-         // Write array elements
-         // Note: We're not iterating through objects here as junction tables 
-         // don't store objects directly. Instead, we handle this when writing 
-         // parent object tables.
-         
-         free(filename);
-         fclose(file);
-         return;
+         if (job->next_chunk == job->chunk_count && job->writer) {
+             csv_writer_close(job->writer);
+             job->writer = NULL;
+         }
+         locked = NULL;
+         pthread_mutex_unlock(&job->lock);
+     }
+     error_trap_pop(&trap);
+     return NULL;
+ }
+ 
+ // Write all tables using 'jobs' threads, splitting tables into row ranges
+ static void write_tables_parallel(Schema* schema, const OutputOptions* options, int jobs) {
+     TableJob* table_jobs = (TableJob*)calloc(schema->table_count, sizeof(TableJob));
+     if (!table_jobs) {
+         fatal_error("Error: Memory allocation failed for table jobs\n");
      }
      
-     // Determine if this is a child table
-     bool is_child_table = (table->column_count >= 2 && 
-                             strstr(table->columns[1], "_id") == table->columns[1]);
-     
-     // Write object rows
-     Object_Node* obj = table->objects;
-     int seq = 0; // For child tables with array elements
-     
-     while (obj) {
-         // Start row with the object's ID
-         fprintf(file, "%d", obj->node_id);
+     // Cut every table's object list into chunks. Tables without rows are
+     // written here, since no task would ever open their file.
+     WriterPool pool = {0};
+     pool.options = options;
+     int task_capacity = 0;
+     for (int i = 0; i < schema->table_count; i++) {
+         TableJob* job = &table_jobs[i];
+         job->table = &schema->tables[i];
+         pthread_mutex_init(&job->lock, NULL);
+         int row_total = table_row_count(job->table);
+         if (row_total == 0 || job->table->omitted) {
+             write_table_csv(job->table, options);
+             continue;
+         }
          
-         // For each column (after ID)
-         for (int i = 1; i < table->column_count; i++) {
-             fprintf(file, ",");
-             
-             // Handle parent ID for child tables
-             if (i == 1 && is_child_table) {
-                 // Find parent ID from parent object reference
-                 // Note: In a full implementation, we would store parent references
-                 // This is simplified - actual parent IDs would need to be tracked
-                 int parent_id = obj->node_id; // Placeholder
-                 fprintf(file, "%d", parent_id);
-                 continue;
-             }
-             
-             // Handle sequence number column for array elements
-             if (i == 2 && is_child_table && strcmp(table->columns[2], "seq") == 0) {
-                 fprintf(file, "%d", seq);
-                 seq++;
-                 continue;
-             }
-             
-             // For regular columns, find the matching key in the object
-             bool found = false;
-             Pair_Node* pair = obj->pairs;
-             
-             while (pair) {
-                 if (strcmp(pair->key, table->columns[i]) == 0) {
-                     char* csv_value = value_to_csv_string(pair->value);
-                     fprintf(file, "%s", csv_value);
-                     free(csv_value);
-                     found = true;
-                     break;
+         for (int next_row = 0; next_row < row_total; next_row += CSV_CHUNK_ROWS) {
+             if (pool.task_count == task_capacity) {
+                 task_capacity = task_capacity ? task_capacity * 2 : 64;
+                 ChunkTask* tasks = (ChunkTask*)realloc(pool.tasks, task_capacity * sizeof(ChunkTask));
+                 if (!tasks) {
+                     fatal_error("Error: Memory reallocation failed for CSV chunk tasks\n");
                  }
-                 pair = pair->next;
-             }
-             
-             // If key not found, write empty value
-             if (!found) {
-                 fprintf(file, "");
+                 pool.tasks = tasks;
              }
+             ChunkTask* task = &pool.tasks[pool.task_count++];
+             task->job = job;
+             task->index = job->chunk_count++;
+             task->first_row = next_row;
+             task->row_count = row_total - next_row < CSV_CHUNK_ROWS ? row_total - next_row : CSV_CHUNK_ROWS;
          }
-         
-         fprintf(file, "\n");
-         obj = obj->next;
-         
-         // Reset sequence counter for next object
-         if (!obj) {
-             seq = 0;
+         job->chunks = (CsvWriter**)calloc(job->chunk_count, sizeof(CsvWriter*));
+         if (!job->chunks) {
+             fatal_error("Error: Memory allocation failed for chunks of table '%s'\n", job->table->name);
          }
      }
      
-     free(filename);
-     fclose(file);
+     if (jobs > pool.task_count) jobs = pool.task_count;
+     pthread_mutex_init(&pool.lock, NULL);
+     worker_errors_init(&pool.errors);
+     pthread_t* threads = (pthread_t*)malloc((jobs > 0 ? jobs : 1) * sizeof(pthread_t));
+     if (!threads) {
+         fatal_error("Error: Memory allocation failed for worker threads\n");
+     }
+     int started = 0;
+     for (; started < jobs; started++) {
+         if (pthread_create(&threads[started], NULL, writer_pool_worker, &pool) != 0) {
+             // The threads already started stop at their next task
+             worker_errors_keep(&pool.errors, "Error: Failed to start CSV worker thread");
+             break;
+         }
+     }
+     for (int i = 0; i < started; i++) {
+         pthread_join(threads[i], NULL);
+     }
+     
+     free(threads);
+     pthread_mutex_destroy(&pool.lock);
+     free(pool.tasks);
+     // Chunks are only left over after an error; the files are discarded with
+     // the conversion's other open files
+     for (int i = 0; i < schema->table_count; i++) {
+         pthread_mutex_destroy(&table_jobs[i].lock);
+         for (int c = 0; c < table_jobs[i].chunk_count; c++) {
+             csv_writer_close(table_jobs[i].chunks[c]);
+         }
+         free(table_jobs[i].chunks);
+     }
+     free(table_jobs);
+     worker_errors_raise(&pool.errors);
+ }
+ 
+ // One writer per table position; a file is opened with its table's first rows
+ struct RecordWriter {
+     const OutputOptions* options;
+     CsvWriter** writers;
+     int capacity;
+ };
+ 
+ RecordWriter* create_record_writer(const OutputOptions* options) {
+     RecordWriter* writer = (RecordWriter*)calloc(1, sizeof(RecordWriter));
+     if (!writer) {
+         fatal_error("Error: Memory allocation failed for record writer\n");
+     }
+     writer->options = options;
+     return writer;
+ }
+ 
+ // Grow the writer array to cover every table created so far
+ static void reserve_record_writers(RecordWriter* writer, int table_count) {
+     if (table_count <= writer->capacity) return;
+     int capacity = writer->capacity ? writer->capacity : 16;
+     while (capacity < table_count) capacity *= 2;
+     CsvWriter** grown = (CsvWriter**)realloc(writer->writers, capacity * sizeof(CsvWriter*));
+     if (!grown) {
+         fatal_error("Error: Memory reallocation failed for record writers\n");
+     }
+     memset(grown + writer->capacity, 0, (capacity - writer->capacity) * sizeof(CsvWriter*));
+     writer->writers = grown;
+     writer->capacity = capacity;
  }
  
- // Process arrays of scalars in object and write to junction tables
- static void write_scalar_arrays(AST_Node* root, Schema* schema, const char* out_dir) {
-     // This is a simplified implementation
-     // In a complete solution, we would traverse the AST again
-     // to find all arrays of scalars and write them to the junction tables
+ // Append the rows of the current record to each table that received any
+ void write_record_rows(RecordWriter* writer, SchemaBuilder* builder) {
+     Schema* schema = schema_builder_tables(builder);
+     reserve_record_writers(writer, schema->table_count);
      
-     // For each table in the schema
-     for (int i = 0; i < schema->table_count; i++) {
-         TableSchema* table = &schema->tables[i];
-         
-         // Skip non-junction tables
-         if (table->column_count != 3 || 
-             strcmp(table->columns[1], "index") != 0 || 
-             strcmp(table->columns[2], "value") != 0) {
-             continue;
+     const int* touched = NULL;
+     int touched_count = schema_builder_touched(builder, &touched);
+     for (int i = 0; i < touched_count; i++) {
+         TableSchema* table = &schema->tables[touched[i]];
+         CsvWriter** out = &writer->writers[touched[i]];
+         if (table->omitted) continue;
+         if (!*out) {
+             *out = csv_writer_open(writer->options, table->name);
+             csv_write_header(*out, table->columns, table->column_count);
          }
-         
-         // Create file for junction table
-         char* filename;
-         if (out_dir && strlen(out_dir) > 0) {
-             filename = (char*)malloc(strlen(out_dir) + strlen(table->name) + 6);
-             if (!filename) {
-                 fprintf(stderr, "Error: Memory allocation failed for filename\n");
-                 exit(EXIT_FAILURE);
-             }
-             sprintf(filename, "%s/%s.csv", out_dir, table->name);
+         write_table_rows(*out, table, 0, table_row_count(table));
+     }
+ }
+ 
+ void finish_record_writer(RecordWriter* writer, Schema* schema) {
+     reserve_record_writers(writer, schema->table_count);
+     for (int i = 0; i < schema->table_count; i++) {
+         if (writer->writers[i]) {
+             csv_writer_close(writer->writers[i]);
          } else {
-             filename = (char*)malloc(strlen(table->name) + 5);
-             if (!filename) {
-                 fprintf(stderr, "Error: Memory allocation failed for filename\n");
-                 exit(EXIT_FAILURE);
-             }
-             sprintf(filename, "%s.csv", table->name);
-         }
-         
-         // Open file
-         FILE* file = fopen(filename, "w");
-         if (!file) {
-             fprintf(stderr, "Error: Failed to open file '%s' for writing: %s\n", 
-                    filename, strerror(errno));
-             free(filename);
-             exit(EXIT_FAILURE);
+             write_table_csv(&schema->tables[i], writer->options); // Header only
          }
-         
-         // Write header row
-         for (int j = 0; j < table->column_count; j++) {
-             fprintf(file, "%s%s", table->columns[j], j < table->column_count - 1 ? "," : "\n");
-         }
-         
-         // Close file - in a complete solution, we would populate it with data
-         free(filename);
-         fclose(file);
      }
+     free_record_writer(writer);
+ }
+ 
+ void free_record_writer(RecordWriter* writer) {
+     if (!writer) return;
+     free(writer->writers);
+     free(writer);
  }
  
  // Main function to write all CSV files
- void write_csv_files(Schema* schema, const char* out_dir) {
+ void write_csv_files(Schema* schema, const OutputOptions* options) {
      if (!schema) return;
+     const char* out_dir = options->out_dir;
      
      // Create output directory if specified
      if (out_dir && strlen(out_dir) > 0) {
-         if (!ensure_directory(out_dir)) {
-             exit(EXIT_FAILURE);
-         }
+         ensure_directory(out_dir);
+     }
+     
+     if (options->format != OUTPUT_CSV) {
+         write_columnar_files(schema, options);
+         return;
+     }
+     
+     if (options->jobs > 1) {
+         write_tables_parallel(schema, options, options->jobs);
+         return;
      }
      
      // Write each table to a CSV file
      for (int i = 0; i < schema->table_count; i++) {
-         write_table_csv(&schema->tables[i], out_dir);
+         write_table_csv(&schema->tables[i], options);
      }
-     
-     // Handle arrays of scalars (junction tables)
-     // Note: In a complete solution, this would be part of the schema generation
-     // and would be handled during the schema processing
  }
\ No newline at end of file
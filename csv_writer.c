@@ -0,0 +1,590 @@
+/**
+ * csv_writer.c - Buffered CSV output for json2relcsv
+ */
+
+#include "csv_writer.h"
+#include "number.h"
+#include "stats.h"
+#include "error.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// Buffers start small, because --stream keeps every table open at once, and
+// double on each flush so busy tables end up writing large blocks
+#define CSV_WRITER_INITIAL_BUFFER (8 * 1024)
+#define CSV_WRITER_MAX_BUFFER (256 * 1024)
+// Compressed files flush in larger blocks, each compressed on its own
+#define CSV_WRITER_COMPRESSED_BUFFER (1024 * 1024)
+
+// Characters that force a cell to be quoted
+#define CSV_SPECIAL_CHARS ",\"\r\n"
+
+bool parse_quote_policy(const char* name, CsvQuotePolicy* policy) {
+    if (strcmp(name, "minimal") == 0) {
+        *policy = CSV_QUOTE_MINIMAL;
+    } else if (strcmp(name, "strings") == 0) {
+        *policy = CSV_QUOTE_STRINGS;
+    } else if (strcmp(name, "all") == 0) {
+        *policy = CSV_QUOTE_ALL;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool parse_output_format(const char* name, OutputFormat* format) {
+    if (strcmp(name, "csv") == 0) {
+        *format = OUTPUT_CSV;
+    } else if (strcmp(name, "parquet") == 0) {
+        *format = OUTPUT_PARQUET;
+    } else if (strcmp(name, "arrow") == 0) {
+        *format = OUTPUT_ARROW;
+    } else if (strcmp(name, "pgcopy") == 0) {
+        *format = OUTPUT_PGCOPY;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* quote_policy_name(CsvQuotePolicy policy) {
+    switch (policy) {
+        case CSV_QUOTE_STRINGS: return "strings";
+        case CSV_QUOTE_ALL: return "all";
+        default: return "minimal";
+    }
+}
+
+const char* output_format_name(OutputFormat format) {
+    switch (format) {
+        case OUTPUT_PARQUET: return "parquet";
+        case OUTPUT_ARROW: return "arrow";
+        case OUTPUT_PGCOPY: return "pgcopy";
+        default: return "csv";
+    }
+}
+
+CsvWriter* csv_writer_open(const OutputOptions* options, const char* table_name) {
+    const Compression* compression = &options->compression;
+    if (compression->codec == COMPRESS_NONE) return csv_writer_open_file(options, table_name, ".csv");
+
+    char extension[16];
+    snprintf(extension, sizeof(extension), ".csv%s", compression_extension(compression->codec));
+    CsvWriter* writer = csv_writer_open_file(options, table_name, extension);
+    writer->compressor = create_block_compressor(compression);
+    return writer;
+}
+
+// Open a writer's file for --append, first noting its size so a failed run
+// can undo what it adds
+static void open_for_append(CsvWriter* writer, OpenFiles* files) {
+    struct stat st;
+    off_t size = stat(writer->path, &st) == 0 ? st.st_size : -1;
+    char* path = strdup(writer->path);
+    pthread_mutex_lock(&files->lock);
+    if (path && files->appended_count == files->appended_capacity) {
+        int capacity = files->appended_capacity ? files->appended_capacity * 2 : 16;
+        AppendedFile* grown = (AppendedFile*)realloc(files->appended, capacity * sizeof(AppendedFile));
+        if (grown) {
+            files->appended = grown;
+            files->appended_capacity = capacity;
+        }
+    }
+    bool noted = path && files->appended_count < files->appended_capacity;
+    if (noted) {
+        files->appended[files->appended_count].path = path;
+        files->appended[files->appended_count].size = size;
+        files->appended_count++;
+    }
+    pthread_mutex_unlock(&files->lock);
+    if (!noted) {
+        free(path);
+        fatal_error("Error: Memory allocation failed for appended file '%s'\n", writer->path);
+    }
+
+    writer->fd = open(writer->path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (writer->fd < 0) {
+        fatal_error("Error: Failed to open file '%s' for appending: %s\n", writer->path, strerror(errno));
+    }
+    writer->has_header = size > 0;
+}
+
+// Note a new file of a staged run; returns the temporary name to write
+static const char* stage_file(CsvWriter* writer, OpenFiles* files) {
+    size_t length = strlen(writer->path);
+    char* path = strdup(writer->path);
+    char* temporary_path = (char*)malloc(length + 5);
+    if (temporary_path) {
+        memcpy(temporary_path, writer->path, length);
+        memcpy(temporary_path + length, ".tmp", 5);
+    }
+    pthread_mutex_lock(&files->lock);
+    if (path && temporary_path && files->staged_count == files->staged_capacity) {
+        int capacity = files->staged_capacity ? files->staged_capacity * 2 : 16;
+        StagedFile* grown = (StagedFile*)realloc(files->staged, capacity * sizeof(StagedFile));
+        if (grown) {
+            files->staged = grown;
+            files->staged_capacity = capacity;
+        }
+    }
+    bool noted = path && temporary_path && files->staged_count < files->staged_capacity;
+    if (noted) {
+        files->staged[files->staged_count].path = path;
+        files->staged[files->staged_count].temporary_path = temporary_path;
+        files->staged[files->staged_count].backup_path = NULL;
+        files->staged_count++;
+    }
+    pthread_mutex_unlock(&files->lock);
+    if (!noted) {
+        free(path);
+        free(temporary_path);
+        fatal_error("Error: Memory allocation failed for staged file '%s'\n", writer->path);
+    }
+    return temporary_path;
+}
+
+// Add a writer to the files of its conversion, if they are tracked
+static void register_writer(CsvWriter* writer, OpenFiles* files) {
+    if (!files) return;
+    pthread_mutex_lock(&files->lock);
+    writer->open_files = files;
+    writer->next_open = files->first;
+    if (files->first) files->first->prev_open = writer;
+    files->first = writer;
+    pthread_mutex_unlock(&files->lock);
+}
+
+CsvWriter* csv_writer_open_file(const OutputOptions* options, const char* table_name, const char* extension) {
+    const char* out_dir = options->out_dir;
+    size_t path_size = strlen(table_name) + strlen(extension) + 2; // name + / + extension + \0
+    if (out_dir && out_dir[0]) path_size += strlen(out_dir);
+
+    CsvWriter* writer = (CsvWriter*)calloc(1, sizeof(CsvWriter));
+    char* path = (char*)malloc(path_size);
+    char* buffer = (char*)malloc(CSV_WRITER_INITIAL_BUFFER);
+    char* name = strdup(table_name);
+    if (!writer || !path || !buffer || !name) {
+        fatal_error("Error: Memory allocation failed for CSV writer of table '%s'\n", table_name);
+    }
+    if (out_dir && out_dir[0]) {
+        snprintf(path, path_size, "%s/%s%s", out_dir, table_name, extension);
+    } else {
+        snprintf(path, path_size, "%s%s", table_name, extension);
+    }
+
+    writer->buffer = buffer;
+    writer->capacity = CSV_WRITER_INITIAL_BUFFER;
+    writer->quote_policy = options->quote_policy;
+    writer->path = path;
+    writer->table_name = name;
+
+    // Registered first, so a failed open leaves the writer to be freed
+    OpenFiles* files = options->open_files;
+    register_writer(writer, files);
+
+    if (options->append && files) {
+        open_for_append(writer, files);
+        return writer;
+    }
+    const char* target = options->staged && files ? stage_file(writer, files) : path;
+    writer->fd = open(target, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (writer->fd < 0) {
+        fatal_error("Error: Failed to open file '%s' for writing: %s\n", target, strerror(errno));
+    }
+    return writer;
+}
+
+CsvWriter* csv_writer_open_stdout(const OutputOptions* options) {
+    CsvWriter* writer = (CsvWriter*)calloc(1, sizeof(CsvWriter));
+    char* path = strdup("standard output");
+    char* buffer = (char*)malloc(CSV_WRITER_MAX_BUFFER);
+    if (!writer || !path || !buffer) {
+        fatal_error("Error: Memory allocation failed for the stdout writer\n");
+    }
+    writer->buffer = buffer;
+    writer->capacity = CSV_WRITER_MAX_BUFFER;
+    writer->quote_policy = options->quote_policy;
+    writer->path = path;
+    register_writer(writer, options->open_files);
+
+    fflush(stdout); // Anything printed before goes first
+    writer->fd = dup(STDOUT_FILENO); // Closing the writer leaves stdout open
+    if (writer->fd < 0) {
+        fatal_error("Error: Failed to open standard output for writing: %s\n", strerror(errno));
+    }
+    return writer;
+}
+
+static void unregister_writer(CsvWriter* writer) {
+    OpenFiles* files = writer->open_files;
+    if (!files) return;
+    pthread_mutex_lock(&files->lock);
+    if (writer->prev_open) writer->prev_open->next_open = writer->next_open;
+    else files->first = writer->next_open;
+    if (writer->next_open) writer->next_open->prev_open = writer->prev_open;
+    pthread_mutex_unlock(&files->lock);
+    writer->open_files = NULL;
+}
+
+static void free_writer(CsvWriter* writer) {
+    free_block_compressor(writer->compressor);
+    free(writer->buffer);
+    free(writer->path);
+    free(writer->table_name);
+    free(writer);
+}
+
+void init_open_files(OpenFiles* files) {
+    pthread_mutex_init(&files->lock, NULL);
+    files->first = NULL;
+    files->appended = NULL;
+    files->appended_count = 0;
+    files->appended_capacity = 0;
+    files->staged = NULL;
+    files->staged_count = 0;
+    files->staged_capacity = 0;
+}
+
+void discard_open_files(OpenFiles* files) {
+    CsvWriter* writer = files->first;
+    while (writer) {
+        CsvWriter* next = writer->next_open;
+        if (writer->fd >= 0) close(writer->fd);
+        free_writer(writer);
+        writer = next;
+    }
+    files->first = NULL;
+}
+
+void free_open_files(OpenFiles* files) {
+    discard_open_files(files);
+    forget_appended_files(files);
+    remove_staged_files(files);
+    pthread_mutex_destroy(&files->lock);
+}
+
+void restore_appended_files(OpenFiles* files) {
+    // Best effort: the run has failed already, so a file that cannot be
+    // restored is only reported
+    for (int i = 0; i < files->appended_count; i++) {
+        const AppendedFile* file = &files->appended[i];
+        int status = file->size < 0 ? unlink(file->path) : truncate(file->path, file->size);
+        if (status != 0 && errno != ENOENT) {
+            report_warning("Warning: Failed to restore '%s' after the failed run: %s\n", file->path, strerror(errno));
+        }
+    }
+}
+
+void forget_appended_files(OpenFiles* files) {
+    for (int i = 0; i < files->appended_count; i++) free(files->appended[i].path);
+    free(files->appended);
+    files->appended = NULL;
+    files->appended_count = 0;
+    files->appended_capacity = 0;
+}
+
+// Undo a commit that failed: the first 'renamed' files go back to their
+// temporary names, for remove_staged_files(), and the files they replaced
+// back to their own. Best effort, as in restore_appended_files().
+static void undo_commit(OpenFiles* files, int renamed) {
+    for (int i = 0; i < files->staged_count; i++) {
+        StagedFile* file = &files->staged[i];
+        if (i < renamed && rename(file->path, file->temporary_path) != 0) {
+            report_warning("Warning: Failed to restore '%s' after the failed run: %s\n", file->path, strerror(errno));
+        }
+        if (file->backup_path && rename(file->backup_path, file->path) != 0) {
+            report_warning("Warning: Failed to restore '%s' from '%s' after the failed run: %s\n",
+                           file->path, file->backup_path, strerror(errno));
+        }
+        free(file->backup_path);
+        file->backup_path = NULL;
+    }
+}
+
+// Move an existing file at 'file->path' aside; false with errno set if it
+// cannot be, or is a directory, which the rename would fail on anyway
+static bool back_up_file(StagedFile* file) {
+    struct stat st;
+    if (lstat(file->path, &st) != 0) return errno == ENOENT;
+    if (S_ISDIR(st.st_mode)) {
+        errno = EISDIR;
+        return false;
+    }
+    size_t size = strlen(file->path) + sizeof(".old");
+    char* backup_path = (char*)malloc(size);
+    if (!backup_path) {
+        errno = ENOMEM;
+        return false;
+    }
+    snprintf(backup_path, size, "%s.old", file->path);
+    if (rename(file->path, backup_path) != 0) {
+        free(backup_path);
+        return false;
+    }
+    file->backup_path = backup_path;
+    return true;
+}
+
+void commit_staged_files(OpenFiles* files) {
+    for (int i = 0; i < files->staged_count; i++) {
+        StagedFile* file = &files->staged[i];
+        if (!back_up_file(file)) {
+            int error = errno;
+            undo_commit(files, 0);
+            fatal_error("Error: Failed to replace '%s': %s\n", file->path, strerror(error));
+        }
+    }
+    for (int i = 0; i < files->staged_count; i++) {
+        StagedFile* file = &files->staged[i];
+        if (rename(file->temporary_path, file->path) != 0) {
+            int error = errno;
+            undo_commit(files, i);
+            fatal_error("Error: Failed to rename '%s' to '%s': %s\n", file->temporary_path, file->path, strerror(error));
+        }
+    }
+
+    // Committed: the replaced files can go
+    for (int i = 0; i < files->staged_count; i++) {
+        StagedFile* file = &files->staged[i];
+        if (file->backup_path && unlink(file->backup_path) != 0) {
+            report_warning("Warning: Failed to remove '%s': %s\n", file->backup_path, strerror(errno));
+        }
+        free(file->backup_path);
+        free(file->path);
+        free(file->temporary_path);
+    }
+    files->staged_count = 0;
+}
+
+void remove_staged_files(OpenFiles* files) {
+    for (int i = 0; i < files->staged_count; i++) {
+        const StagedFile* file = &files->staged[i];
+        if (unlink(file->temporary_path) != 0 && errno != ENOENT) {
+            report_warning("Warning: Failed to remove '%s' after the failed run: %s\n", file->temporary_path, strerror(errno));
+        }
+        free(file->path);
+        free(file->temporary_path);
+        free(file->backup_path);
+    }
+    free(files->staged);
+    files->staged = NULL;
+    files->staged_count = 0;
+    files->staged_capacity = 0;
+}
+
+CsvWriter* csv_writer_open_memory(const OutputOptions* options) {
+    CsvWriter* writer = (CsvWriter*)calloc(1, sizeof(CsvWriter));
+    char* buffer = (char*)malloc(CSV_WRITER_MAX_BUFFER);
+    if (!writer || !buffer) {
+        fatal_error("Error: Memory allocation failed for CSV chunk buffer\n");
+    }
+    writer->fd = -1;
+    writer->buffer = buffer;
+    writer->capacity = CSV_WRITER_MAX_BUFFER;
+    writer->quote_policy = options->quote_policy;
+    return writer;
+}
+
+static void write_all(CsvWriter* writer, const char* data, size_t remaining) {
+    writer->bytes_written += remaining;
+    while (remaining > 0) {
+        ssize_t written = write(writer->fd, data, remaining);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            fatal_error("Error: Failed to write '%s': %s\n", writer->path, strerror(errno));
+        }
+        data += written;
+        remaining -= (size_t)written;
+    }
+}
+
+// Write CSV bytes, as one compressed block when the writer compresses
+static void write_block(CsvWriter* writer, const char* data, size_t length) {
+    if (!writer->compressor) {
+        write_all(writer, data, length);
+        return;
+    }
+    if (length == 0) return;
+    size_t compressed_length;
+    const char* compressed = compress_block(writer->compressor, data, length, &compressed_length, writer->path);
+    write_all(writer, compressed, compressed_length);
+}
+
+void csv_flush(CsvWriter* writer) {
+    if (writer->fd < 0) { // In memory: make room instead of writing
+        char* bigger = (char*)realloc(writer->buffer, writer->capacity * 2);
+        if (!bigger) {
+            fatal_error("Error: Memory reallocation failed for CSV chunk buffer\n");
+        }
+        writer->buffer = bigger;
+        writer->capacity *= 2;
+        return;
+    }
+
+    write_block(writer, writer->buffer, writer->length);
+    writer->length = 0;
+
+    size_t max_capacity = writer->compressor ? CSV_WRITER_COMPRESSED_BUFFER : CSV_WRITER_MAX_BUFFER;
+    if (writer->capacity < max_capacity) {
+        char* bigger = (char*)realloc(writer->buffer, writer->capacity * 2);
+        if (bigger) { // Keep the old buffer if memory is tight
+            writer->buffer = bigger;
+            writer->capacity *= 2;
+        }
+    }
+}
+
+void csv_writer_append(CsvWriter* writer, const CsvWriter* chunk) {
+    writer->rows += chunk->rows;
+    if (chunk->compressed) {
+        // A block of its own, after the block of whatever is pending
+        csv_flush(writer);
+        write_all(writer, chunk->buffer, chunk->length);
+        return;
+    }
+    if (writer->capacity - writer->length >= chunk->length) {
+        memcpy(writer->buffer + writer->length, chunk->buffer, chunk->length);
+        writer->length += chunk->length;
+        return;
+    }
+    csv_flush(writer);
+    write_block(writer, chunk->buffer, chunk->length); // Large chunks skip the copy
+}
+
+void csv_writer_compress(CsvWriter* chunk, const Compression* compression, const char* table_name) {
+    if (chunk->length == 0) return;
+    BlockCompressor* compressor = create_block_compressor(compression);
+    size_t compressed_length;
+    const char* compressed = compress_block(compressor, chunk->buffer, chunk->length, &compressed_length, table_name);
+    if (compressed_length > chunk->capacity) {
+        char* bigger = (char*)realloc(chunk->buffer, compressed_length);
+        if (!bigger) {
+            fatal_error("Error: Memory reallocation failed for CSV chunk buffer\n");
+        }
+        chunk->buffer = bigger;
+        chunk->capacity = compressed_length;
+    }
+    memcpy(chunk->buffer, compressed, compressed_length);
+    chunk->length = compressed_length;
+    chunk->compressed = true;
+    free_block_compressor(compressor);
+}
+
+void csv_writer_close(CsvWriter* writer) {
+    if (!writer) return;
+    if (writer->fd >= 0) {
+        csv_flush(writer);
+        unregister_writer(writer);
+        if (close(writer->fd) != 0) {
+            fatal_error("Error: Failed to close '%s': %s\n", writer->path, strerror(errno));
+        }
+        if (writer->table_name) stats_record_table(writer->table_name, writer->rows, writer->bytes_written);
+    }
+    free_writer(writer);
+}
+
+// Copy raw bytes, flushing whenever the buffer fills up
+void csv_put_bytes(CsvWriter* writer, const char* data, size_t length) {
+    while (length > 0) {
+        if (writer->length == writer->capacity) csv_flush(writer);
+        size_t chunk = writer->capacity - writer->length;
+        if (chunk > length) chunk = length;
+        memcpy(writer->buffer + writer->length, data, chunk);
+        writer->length += chunk;
+        data += chunk;
+        length -= chunk;
+    }
+}
+
+// Write text inside double quotes, doubling embedded quotes
+static void csv_put_quoted(CsvWriter* writer, const char* text, size_t length) {
+    csv_put_char(writer, '"');
+    const char* end = text + length;
+    while (text < end) {
+        const char* quote = memchr(text, '"', (size_t)(end - text));
+        if (!quote) {
+            csv_put_bytes(writer, text, (size_t)(end - text));
+            break;
+        }
+        csv_put_bytes(writer, text, (size_t)(quote - text) + 1); // Up to and including the quote
+        csv_put_char(writer, '"');
+        text = quote + 1;
+    }
+    csv_put_char(writer, '"');
+}
+
+void csv_put_text(CsvWriter* writer, const char* text, size_t length, bool is_string_value) {
+    bool quote;
+    switch (writer->quote_policy) {
+        case CSV_QUOTE_ALL:
+            quote = true;
+            break;
+        case CSV_QUOTE_STRINGS:
+            quote = is_string_value || strcspn(text, CSV_SPECIAL_CHARS) < length;
+            break;
+        default:
+            // An unquoted empty cell means null, so empty strings keep their quotes
+            quote = (is_string_value && length == 0) || strcspn(text, CSV_SPECIAL_CHARS) < length;
+            break;
+    }
+    if (quote) {
+        csv_put_quoted(writer, text, length);
+    } else {
+        csv_put_bytes(writer, text, length);
+    }
+}
+
+void csv_put_int(CsvWriter* writer, int64_t value) {
+    char number[NUMBER_FORMAT_MAX + 1];
+    size_t length = (size_t)format_int64(value, number);
+    if (writer->quote_policy == CSV_QUOTE_ALL) {
+        csv_put_quoted(writer, number, length);
+    } else {
+        csv_put_bytes(writer, number, length);
+    }
+}
+
+void csv_put_value(CsvWriter* writer, Value_Node value) {
+    switch (value.type) {
+        case VALUE_STRING:
+            if (value.string_val) {
+                csv_put_text(writer, value.string_val, strlen(value.string_val), true);
+            }
+            break;
+        case VALUE_NUMBER: {
+            char number[NUMBER_FORMAT_MAX + 1];
+            int length = format_double(value.number_val, number);
+            csv_put_text(writer, number, (size_t)length, false);
+            break;
+        }
+        case VALUE_INTEGER:
+            csv_put_int(writer, value.integer_val);
+            break;
+        case VALUE_BOOLEAN:
+            if (value.boolean_val) {
+                csv_put_text(writer, "true", 4, false);
+            } else {
+                csv_put_text(writer, "false", 5, false);
+            }
+            break;
+        case VALUE_NULL:
+        case VALUE_OBJECT:
+        case VALUE_ARRAY:
+            // Empty cell
+            break;
+    }
+}
+
+void csv_write_header(CsvWriter* writer, char** columns, int column_count) {
+    if (writer->has_header) return;
+    for (int i = 0; i < column_count; i++) {
+        if (i > 0) csv_put_separator(writer);
+        csv_put_text(writer, columns[i], strlen(columns[i]), false);
+    }
+    csv_put_char(writer, '\n'); // Not a data row
+}
@@ -0,0 +1,161 @@
+/**
+ * csv_writer.h - Buffered CSV output for json2relcsv
+ *
+ * Cells are escaped and formatted straight into a large per-file buffer,
+ * which is flushed with write(2). No per-cell allocation or format string
+ * parsing happens on the hot path. With --compress each flush writes one
+ * compressed block (compress.h) instead.
+ */
+
+#ifndef CSV_WRITER_H
+#define CSV_WRITER_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include "ast.h"
+#include "compress.h"
+
+// When to wrap a cell in double quotes
+typedef enum {
+    CSV_QUOTE_MINIMAL, // Only cells containing ',', '"', CR or LF (and empty strings, to tell them from null)
+    CSV_QUOTE_STRINGS, // Every JSON string value; other cells only when needed
+    CSV_QUOTE_ALL      // Every non-null cell
+} CsvQuotePolicy;
+
+// File format of the batch output (--format)
+typedef enum {
+    OUTPUT_CSV,
+    OUTPUT_PARQUET,                // See columnar.h
+    OUTPUT_ARROW,
+    OUTPUT_PGCOPY                  // PostgreSQL binary COPY, see pgcopy_writer.c
+} OutputFormat;
+
+// A file an --append run writes to, and its size before the run
+typedef struct AppendedFile {
+    char* path;
+    off_t size;                   // -1 if the run created it
+} AppendedFile;
+
+// A file a staged run writes under a temporary name until it succeeds
+typedef struct StagedFile {
+    char* path;
+    char* temporary_path;         // "<path>.tmp"
+    char* backup_path;            // "<path>.old" while a commit replaces an existing file
+} StagedFile;
+
+// Files of one conversion that are still open, so they can be closed if
+// it fails part way (converter.c), with --append every file it opened, so
+// they can be put back as they were, and when staged every file it created
+typedef struct OpenFiles {
+    pthread_mutex_t lock;
+    struct CsvWriter* first;
+    AppendedFile* appended;
+    int appended_count;
+    int appended_capacity;
+    StagedFile* staged;
+    int staged_count;
+    int staged_capacity;
+} OpenFiles;
+
+// Settings shared by all writers of one conversion
+typedef struct OutputOptions {
+    const char* out_dir;          // NULL or "" for the current directory
+    bool to_stdout;               // --out-dir -: --format pgcopy writes one stream to stdout instead
+    OutputFormat format;
+    CsvQuotePolicy quote_policy;
+    Compression compression;      // --compress; applies to CSV files only
+    bool append;                  // --append: add to existing files, which keep their header
+    bool staged;                  // Create files as "<name>.tmp" until commit_staged_files()
+    int jobs;                     // Worker threads for batch output; 0 or 1 writes serially
+    OpenFiles* open_files;        // Where file writers are registered; NULL for nowhere
+} OutputOptions;
+
+typedef struct CsvWriter {
+    int fd;                       // -1 for an in-memory writer
+    char* buffer;
+    size_t length;                // Bytes pending in buffer
+    size_t capacity;
+    CsvQuotePolicy quote_policy;
+    char* path;                   // For error messages; NULL in memory
+    char* table_name;             // For --stats; NULL in memory
+    uint64_t rows;                // Data rows ended so far (the header is not counted)
+    uint64_t bytes_written;       // Bytes handed to write(2)
+    BlockCompressor* compressor;  // --compress: every flush writes one block
+    bool compressed;              // In memory: the buffer is one compressed block
+    bool has_header;              // Appends to a file that has its header already
+    OpenFiles* open_files;        // Registry the writer is in, if any
+    struct CsvWriter* prev_open;
+    struct CsvWriter* next_open;
+} CsvWriter;
+
+// Parse a --quote argument; returns false if it is not a known policy
+bool parse_quote_policy(const char* name, CsvQuotePolicy* policy);
+// Parse a --format argument; returns false if it is not a known format
+bool parse_output_format(const char* name, OutputFormat* format);
+const char* output_format_name(OutputFormat format); // As --format takes it
+const char* quote_policy_name(CsvQuotePolicy policy); // As --quote takes it
+
+// Create (truncate) <out_dir>/<table_name>.csv, or .csv.gz/.csv.zst with
+// --compress. With options->append the file is added to instead, and gets
+// no header again unless it is new or empty; with options->staged it is
+// written as "<path>.tmp" until commit_staged_files().
+CsvWriter* csv_writer_open(const OutputOptions* options, const char* table_name);
+// Same for another extension (e.g. ".parquet"); the binary formats use the
+// writer as a plain buffered file and set 'rows' themselves
+CsvWriter* csv_writer_open_file(const OutputOptions* options, const char* table_name, const char* extension);
+// Writer on a duplicate of stdout's descriptor, for output that is not a
+// table's file; its bytes are not counted for --stats
+CsvWriter* csv_writer_open_stdout(const OutputOptions* options);
+void csv_writer_close(CsvWriter* writer); // Flushes, closes and frees
+// Writer that keeps everything in its (growing) buffer, for rendering a chunk
+// of rows on a worker thread
+CsvWriter* csv_writer_open_memory(const OutputOptions* options);
+// Append the bytes held by an in-memory writer to 'writer'
+void csv_writer_append(CsvWriter* writer, const CsvWriter* chunk);
+// Compress an in-memory writer's bytes into one block on the calling thread,
+// for a compressing writer to append as they are
+void csv_writer_compress(CsvWriter* chunk, const Compression* compression, const char* table_name);
+
+void init_open_files(OpenFiles* files);
+// Close and free the writers still registered, dropping their pending
+// output; for a conversion that failed, once no thread uses them any more
+void discard_open_files(OpenFiles* files);
+void free_open_files(OpenFiles* files); // Discards, then destroys the registry
+// After a failed --append run: truncate the files it added to back to their
+// old size and remove the ones it created. Call after discard_open_files().
+void restore_appended_files(OpenFiles* files);
+void forget_appended_files(OpenFiles* files); // After any run; keeps the files as they are
+// Give the files of a staged run their final names, once it has succeeded.
+// All or nothing: the files they replace are moved aside first, and if one
+// cannot be renamed the renames done so far are undone before fatal_error().
+void commit_staged_files(OpenFiles* files);
+// Remove the temporary files a staged run leaves when it fails (none after a
+// commit). Call after discard_open_files().
+void remove_staged_files(OpenFiles* files);
+
+void csv_write_header(CsvWriter* writer, char** columns, int column_count); // Skipped if has_header
+void csv_put_value(CsvWriter* writer, Value_Node value); // Objects and arrays become empty cells
+void csv_put_int(CsvWriter* writer, int64_t value);
+void csv_put_text(CsvWriter* writer, const char* text, size_t length, bool is_string_value);
+void csv_put_bytes(CsvWriter* writer, const char* data, size_t length); // Raw, never quoted
+void csv_flush(CsvWriter* writer);
+
+// Inline so the separators of every cell do not cost a call
+static inline void csv_put_char(CsvWriter* writer, char c) {
+    if (writer->length == writer->capacity) csv_flush(writer);
+    writer->buffer[writer->length++] = c;
+}
+
+static inline void csv_put_separator(CsvWriter* writer) {
+    csv_put_char(writer, ',');
+}
+
+static inline void csv_end_row(CsvWriter* writer) {
+    csv_put_char(writer, '\n');
+    writer->rows++;
+}
+
+#endif /* CSV_WRITER_H */
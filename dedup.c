@@ -0,0 +1,366 @@
+/**
+ * dedup.c - Hash-consed content of nested objects for --dedup
+ */
+
+#include "dedup.h"
+#include "error.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CONTENT_INDEX_MIN_CAPACITY 64
+
+// Content id of a pair's or element's value, -1 for a scalar
+typedef struct ContentChild {
+    int key_id;           // The pair's key; -1 in an array
+    int id;
+} ContentChild;
+
+// One distinct encoding
+typedef struct ContentEntry {
+    uint64_t hash;
+    size_t offset;        // Encoding in 'bytes'
+    size_t length;
+    size_t children;      // First of its children in 'children', one per pair or element
+    int child_count;
+    bool keyed;           // An object whose children are sorted by key
+} ContentEntry;
+
+typedef struct RowSlot {
+    uint64_t key;         // Table position in the high half, content id in the low half
+    int row_id;           // 0 marks an empty slot; IDs start at 1
+} RowSlot;
+
+// An object or array being encoded
+typedef struct ContentFrame {
+    Value_Node value;
+    int key_id;           // Key of the pair holding it; -1 for an element or the root
+    size_t first_pair;    // Objects: its pairs in the scratch buffer, sorted by key
+    int pair_count;       // unless a key repeats
+    bool keyed;
+    int next;             // Next pair or element
+    size_t byte_start;    // Its encoding and children start here in the scratch buffers
+    size_t child_start;
+} ContentFrame;
+
+struct ContentTable {
+    ContentEntry* entries;
+    int count;
+    size_t capacity;
+    int* index;           // Open addressing over 'entries'; -1 marks an empty slot
+    int index_capacity;   // Power of two
+    uint8_t* bytes;       // Encodings of all entries
+    size_t bytes_length;
+    size_t bytes_capacity;
+    ContentChild* children;
+    size_t child_count;
+    size_t child_capacity;
+
+    RowSlot* rows;
+    int row_count;
+    int row_capacity;     // Power of two
+
+    // Scratch space of intern_content(): the encodings and pairs still open,
+    // nested ones after their parents', and the explicit stack of the walk
+    uint8_t* scratch;
+    size_t scratch_length;
+    size_t scratch_capacity;
+    ContentChild* scratch_children;
+    size_t scratch_child_count;
+    size_t scratch_child_capacity;
+    Pair_Node** pairs;
+    size_t pair_count;
+    size_t pair_capacity;
+    ContentFrame* frames;
+    int frame_count;
+    size_t frame_capacity;
+};
+
+// Grow '*data' (of elements of 'size' bytes) to hold 'needed' elements
+static void reserve(void** data, size_t* capacity, size_t needed, size_t size) {
+    if (needed <= *capacity) return;
+    size_t grown_capacity = *capacity ? *capacity : 256;
+    while (grown_capacity < needed) grown_capacity *= 2;
+    void* grown = realloc(*data, grown_capacity * size);
+    if (!grown) {
+        fatal_error("Error: Memory reallocation failed for --dedup content\n");
+    }
+    *data = grown;
+    *capacity = grown_capacity;
+}
+
+ContentTable* create_content_table(void) {
+    ContentTable* table = (ContentTable*)calloc(1, sizeof(ContentTable));
+    if (!table) {
+        fatal_error("Error: Memory allocation failed for --dedup content\n");
+    }
+    return table;
+}
+
+void free_content_table(ContentTable* table) {
+    if (!table) return;
+    free(table->entries);
+    free(table->index);
+    free(table->bytes);
+    free(table->children);
+    free(table->rows);
+    free(table->scratch);
+    free(table->scratch_children);
+    free(table->pairs);
+    free(table->frames);
+    free(table);
+}
+
+static void put_bytes(ContentTable* table, const void* data, size_t length) {
+    reserve((void**)&table->scratch, &table->scratch_capacity, table->scratch_length + length, 1);
+    memcpy(table->scratch + table->scratch_length, data, length);
+    table->scratch_length += length;
+}
+
+static void put_child(ContentTable* table, int key_id, int id) {
+    reserve((void**)&table->scratch_children, &table->scratch_child_capacity, table->scratch_child_count + 1, sizeof(ContentChild));
+    ContentChild* child = &table->scratch_children[table->scratch_child_count++];
+    child->key_id = key_id;
+    child->id = id;
+}
+
+// A scalar: its type, then its payload
+static void put_scalar(ContentTable* table, int key_id, Value_Node value) {
+    uint8_t type = (uint8_t)value.type;
+    put_bytes(table, &type, 1);
+    switch (value.type) {
+        case VALUE_STRING: {
+            const char* text = value.string_val ? value.string_val : "";
+            size_t length = strlen(text);
+            put_bytes(table, &length, sizeof(length));
+            put_bytes(table, text, length);
+            break;
+        }
+        case VALUE_NUMBER: put_bytes(table, &value.number_val, sizeof(value.number_val)); break;
+        case VALUE_INTEGER: put_bytes(table, &value.integer_val, sizeof(value.integer_val)); break;
+        case VALUE_BOOLEAN: put_bytes(table, &value.boolean_val, sizeof(value.boolean_val)); break;
+        default: break; // Null, and an object or array without a node
+    }
+    put_child(table, key_id, -1);
+}
+
+// A nested object or array, by the id it was interned as
+static void put_nested(ContentTable* table, int key_id, ValueType type, int id) {
+    uint8_t tag = (uint8_t)type;
+    put_bytes(table, &tag, 1);
+    put_bytes(table, &id, sizeof(id));
+    put_child(table, key_id, id);
+}
+
+static uint64_t hash_bytes(const uint8_t* data, size_t length) {
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= data[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// Slot of the entry with this encoding, or the empty slot where it belongs
+static int* find_entry(const ContentTable* table, uint64_t hash, const uint8_t* data, size_t length) {
+    int mask = table->index_capacity - 1;
+    int i = (int)(hash & (uint64_t)mask);
+    while (table->index[i] >= 0) {
+        const ContentEntry* entry = &table->entries[table->index[i]];
+        if (entry->hash == hash && entry->length == length && memcmp(table->bytes + entry->offset, data, length) == 0) {
+            return &table->index[i];
+        }
+        i = (i + 1) & mask;
+    }
+    return &table->index[i];
+}
+
+static void grow_index(ContentTable* table) {
+    int capacity = table->index_capacity ? table->index_capacity * 2 : CONTENT_INDEX_MIN_CAPACITY;
+    int* index = (int*)malloc(capacity * sizeof(int));
+    if (!index) {
+        fatal_error("Error: Memory allocation failed for --dedup content index\n");
+    }
+    memset(index, 0xFF, capacity * sizeof(int)); // All -1
+    free(table->index);
+    table->index = index;
+    table->index_capacity = capacity;
+    for (int id = 0; id < table->count; id++) {
+        const ContentEntry* entry = &table->entries[id];
+        *find_entry(table, entry->hash, table->bytes + entry->offset, entry->length) = id;
+    }
+}
+
+// Id of the encoding at the end of the scratch buffers, from 'frame' on,
+// adding it if it is new
+static int intern_encoding(ContentTable* table, const ContentFrame* frame) {
+    const uint8_t* data = table->scratch + frame->byte_start;
+    size_t length = table->scratch_length - frame->byte_start;
+    uint64_t hash = hash_bytes(data, length);
+    // Keep the load factor at or below 1/2 so probes stay short
+    if ((table->count + 1) * 2 > table->index_capacity) grow_index(table);
+    int* slot = find_entry(table, hash, data, length);
+    if (*slot >= 0) return *slot;
+
+    size_t child_count = table->scratch_child_count - frame->child_start;
+    reserve((void**)&table->entries, &table->capacity, (size_t)table->count + 1, sizeof(ContentEntry));
+    reserve((void**)&table->bytes, &table->bytes_capacity, table->bytes_length + length, 1);
+    reserve((void**)&table->children, &table->child_capacity, table->child_count + child_count, sizeof(ContentChild));
+    ContentEntry* entry = &table->entries[table->count];
+    entry->hash = hash;
+    entry->offset = table->bytes_length;
+    entry->length = length;
+    entry->children = table->child_count;
+    entry->child_count = (int)child_count;
+    entry->keyed = frame->keyed;
+    memcpy(table->bytes + table->bytes_length, data, length);
+    table->bytes_length += length;
+    if (child_count > 0) {
+        memcpy(table->children + table->child_count, table->scratch_children + frame->child_start, child_count * sizeof(ContentChild));
+    }
+    table->child_count += child_count;
+    *slot = table->count;
+    return table->count++;
+}
+
+static int compare_pair_keys(const void* a, const void* b) {
+    int key_a = (*(Pair_Node* const*)a)->key_id;
+    int key_b = (*(Pair_Node* const*)b)->key_id;
+    return (key_a > key_b) - (key_a < key_b);
+}
+
+// Copy the pairs of 'object' to the scratch buffer in source order
+static void list_pairs(ContentTable* table, Object_Node* object, size_t first) {
+    table->pair_count = first;
+    for (Pair_Node* pair = object->pairs; pair; pair = pair->next) {
+        reserve((void**)&table->pairs, &table->pair_capacity, table->pair_count + 1, sizeof(Pair_Node*));
+        table->pairs[table->pair_count++] = pair;
+    }
+}
+
+// Open the encoding of an object or array. An object's pairs are encoded in
+// key order, so objects that differ only in the order of their keys get the
+// same id. Where a key repeats the order is kept, since the schema pass
+// tells the pairs apart by position.
+static void push_content(ContentTable* table, int key_id, Value_Node value) {
+    reserve((void**)&table->frames, &table->frame_capacity, (size_t)table->frame_count + 1, sizeof(ContentFrame));
+    ContentFrame* frame = &table->frames[table->frame_count++];
+    frame->value = value;
+    frame->key_id = key_id;
+    frame->first_pair = table->pair_count;
+    frame->pair_count = 0;
+    frame->keyed = false;
+    frame->next = 0;
+    frame->byte_start = table->scratch_length;
+    frame->child_start = table->scratch_child_count;
+    if (value.type == VALUE_OBJECT) {
+        list_pairs(table, value.object_val, frame->first_pair);
+        Pair_Node** pairs = table->pairs + frame->first_pair;
+        frame->pair_count = (int)(table->pair_count - frame->first_pair);
+        qsort(pairs, (size_t)frame->pair_count, sizeof(Pair_Node*), compare_pair_keys);
+        frame->keyed = true;
+        for (int i = 1; i < frame->pair_count && frame->keyed; i++) {
+            frame->keyed = pairs[i - 1]->key_id != pairs[i]->key_id;
+        }
+        if (!frame->keyed) list_pairs(table, value.object_val, frame->first_pair);
+    }
+    uint8_t tag = (uint8_t)value.type;
+    put_bytes(table, &tag, 1);
+}
+
+static bool has_node(Value_Node value) {
+    return (value.type == VALUE_OBJECT && value.object_val) || (value.type == VALUE_ARRAY && value.array_val);
+}
+
+// Nested values are interned before the object or array holding them, with
+// an explicit stack, so nesting depth is not limited by the C stack
+int intern_content(ContentTable* table, Value_Node value) {
+    if (!has_node(value)) return -1;
+    int base = table->frame_count;
+    push_content(table, -1, value);
+    for (;;) {
+        ContentFrame* frame = &table->frames[table->frame_count - 1];
+        Value_Node item;
+        int key_id = -1;
+        if (frame->value.type == VALUE_OBJECT && frame->next < frame->pair_count) {
+            Pair_Node* pair = table->pairs[frame->first_pair + frame->next++];
+            key_id = pair->key_id;
+            put_bytes(table, &key_id, sizeof(key_id));
+            item = pair->value;
+        } else if (frame->value.type == VALUE_ARRAY && frame->next < frame->value.array_val->size) {
+            item = frame->value.array_val->elements[frame->next++];
+        } else {
+            // Done: replace its encoding in the parent's by its id
+            int id = intern_encoding(table, frame);
+            ValueType type = frame->value.type;
+            key_id = frame->key_id;
+            table->scratch_length = frame->byte_start;
+            table->scratch_child_count = frame->child_start;
+            table->pair_count = frame->first_pair;
+            if (--table->frame_count == base) return id;
+            put_nested(table, key_id, type, id);
+            continue;
+        }
+        if (has_node(item)) {
+            push_content(table, key_id, item); // May move the frames
+        } else {
+            put_scalar(table, key_id, item);
+        }
+    }
+}
+
+int content_element(const ContentTable* table, int id, int index) {
+    return table->children[table->entries[id].children + index].id;
+}
+
+int content_member(const ContentTable* table, int id, int key_id, int index) {
+    const ContentEntry* entry = &table->entries[id];
+    const ContentChild* children = table->children + entry->children;
+    if (!entry->keyed) return children[index].id;
+    int low = 0;
+    int high = entry->child_count - 1;
+    while (low <= high) {
+        int middle = low + (high - low) / 2;
+        if (children[middle].key_id == key_id) return children[middle].id;
+        if (children[middle].key_id < key_id) low = middle + 1;
+        else high = middle - 1;
+    }
+    return -1; // Not a key of the object
+}
+
+static uint64_t row_key(int table_index, int id) {
+    return (uint64_t)(uint32_t)table_index << 32 | (uint32_t)id;
+}
+
+// Slot of 'key', or the empty slot where it belongs
+static RowSlot* find_row(RowSlot* rows, int capacity, uint64_t key) {
+    int mask = capacity - 1;
+    int i = (int)((key * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+    while (rows[i].row_id && rows[i].key != key) i = (i + 1) & mask;
+    return &rows[i];
+}
+
+int content_row(const ContentTable* table, int table_index, int id) {
+    if (table->row_count == 0) return 0;
+    return find_row(table->rows, table->row_capacity, row_key(table_index, id))->row_id;
+}
+
+void set_content_row(ContentTable* table, int table_index, int id, int row_id) {
+    if ((table->row_count + 1) * 2 > table->row_capacity) {
+        int capacity = table->row_capacity ? table->row_capacity * 2 : CONTENT_INDEX_MIN_CAPACITY;
+        RowSlot* rows = (RowSlot*)calloc(capacity, sizeof(RowSlot));
+        if (!rows) {
+            fatal_error("Error: Memory allocation failed for --dedup row index\n");
+        }
+        for (int i = 0; i < table->row_capacity; i++) {
+            if (table->rows[i].row_id) *find_row(rows, capacity, table->rows[i].key) = table->rows[i];
+        }
+        free(table->rows);
+        table->rows = rows;
+        table->row_capacity = capacity;
+    }
+    RowSlot* slot = find_row(table->rows, table->row_capacity, row_key(table_index, id));
+    if (!slot->row_id) table->row_count++;
+    slot->key = row_key(table_index, id);
+    slot->row_id = row_id;
+}
@@ -0,0 +1,40 @@
+/**
+ * dedup.h - Hash-consed content of nested objects for --dedup
+ *
+ * Objects and arrays are interned bottom-up: the encoding of one lists its
+ * keys (symbols.h ids) and scalar values, and every object or array nested
+ * in it by the content id it was interned as. An object's pairs are listed
+ * in key order, so key order does not count. Equal subtrees therefore get
+ * equal ids, each distinct encoding is stored once, and comparing two
+ * subtrees costs one lookup. Encodings hold copies of their strings, so ids
+ * stay valid after the AST of an --ndjson record or --memory-limit part is
+ * released.
+ *
+ * Alongside, each table of shared objects maps a content id to the row ID
+ * of the first object that had it, for later objects to reuse.
+ */
+
+#ifndef DEDUP_H
+#define DEDUP_H
+
+#include "ast.h"
+
+typedef struct ContentTable ContentTable;
+
+ContentTable* create_content_table(void);
+void free_content_table(ContentTable* table);
+
+// Content id of 'value', an object or array, and everything below it
+int intern_content(ContentTable* table, Value_Node value);
+// Content id of the object or array under element 'index' of the interned
+// array 'id'; -1 for a scalar
+int content_element(const ContentTable* table, int id, int index);
+// The same for the pair with key 'key_id' at position 'index' of the object
+// 'id', whose pairs may be in another order than those it was interned from
+int content_member(const ContentTable* table, int id, int key_id, int index);
+
+// Row ID the table at 'table_index' gave content 'id', or 0 if none yet
+int content_row(const ContentTable* table, int table_index, int id);
+void set_content_row(ContentTable* table, int table_index, int id, int row_id);
+
+#endif /* DEDUP_H */
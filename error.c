@@ -0,0 +1,111 @@
+/**
+ * error.c - Errors of a conversion
+ */
+
+#include "error.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+
+static _Thread_local ErrorTrap* error_trap = NULL;
+static _Thread_local WarningHandler warning_handler = NULL;
+static _Thread_local void* warning_context = NULL;
+
+void error_trap_push(ErrorTrap* trap) {
+    trap->failed = false;
+    trap->message[0] = '\0';
+    trap->outer = error_trap;
+    error_trap = trap;
+}
+
+void error_trap_pop(ErrorTrap* trap) {
+    error_trap = trap->outer;
+}
+
+// Format into the current trap unless it already holds an error; print
+// instead when there is no trap. Returns false in the latter case.
+static bool keep_error(const char* format, va_list args) {
+    if (!error_trap) {
+        vfprintf(stderr, format, args);
+        return false;
+    }
+    if (!error_trap->failed) {
+        error_trap->failed = true;
+        vsnprintf(error_trap->message, sizeof(error_trap->message), format, args);
+        size_t length = strlen(error_trap->message);
+        if (length > 0 && error_trap->message[length - 1] == '\n') error_trap->message[length - 1] = '\0';
+    }
+    return true;
+}
+
+void fatal_error(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    bool trapped = keep_error(format, args);
+    va_end(args);
+    if (!trapped) exit(EXIT_FAILURE);
+    longjmp(error_trap->jump, 1);
+}
+
+void report_error(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    keep_error(format, args);
+    va_end(args);
+}
+
+bool error_reported(void) {
+    return error_trap && error_trap->failed;
+}
+
+void set_warning_handler(WarningHandler handler, void* context) {
+    warning_handler = handler;
+    warning_context = context;
+}
+
+void current_warning_handler(WarningHandler* handler, void** context) {
+    *handler = warning_handler;
+    *context = warning_context;
+}
+
+void report_warning(const char* format, ...) {
+    if (!warning_handler) return;
+    char message[ERROR_MESSAGE_SIZE];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+    size_t length = strlen(message);
+    if (length > 0 && message[length - 1] == '\n') message[length - 1] = '\0';
+    warning_handler(message, warning_context);
+}
+
+void worker_errors_init(WorkerErrors* errors) {
+    pthread_mutex_init(&errors->lock, NULL);
+    errors->failed = false;
+    errors->message[0] = '\0';
+}
+
+void worker_errors_keep(WorkerErrors* errors, const char* message) {
+    pthread_mutex_lock(&errors->lock);
+    if (!errors->failed) {
+        errors->failed = true;
+        snprintf(errors->message, sizeof(errors->message), "%s", message);
+    }
+    pthread_mutex_unlock(&errors->lock);
+}
+
+bool worker_errors_failed(WorkerErrors* errors) {
+    pthread_mutex_lock(&errors->lock);
+    bool failed = errors->failed;
+    pthread_mutex_unlock(&errors->lock);
+    return failed;
+}
+
+void worker_errors_raise(WorkerErrors* errors) {
+    pthread_mutex_destroy(&errors->lock);
+    if (errors->failed) {
+        fatal_error("%s\n", errors->message);
+    }
+}
@@ -0,0 +1,74 @@
+/**
+ * error.h - Errors of a conversion
+ *
+ * Code that cannot go on calls fatal_error() with the complete message, e.g.
+ * "Error: Failed to open file ...\n". A conversion (converter.c) runs under an
+ * ErrorTrap: the message is kept in the trap and control goes back to it with
+ * longjmp, so the caller gets the error instead of the process ending. With
+ * no trap on the thread, the message is printed on stderr and the process
+ * exits. --jobs workers run under traps of their own and hand what they
+ * catch to the thread that joins them, which raises it again.
+ *
+ * Errors in the input are reported with report_error() where the scanner or
+ * parser can still unwind by itself; only the first one of a parse is kept.
+ *
+ * Warnings do not stop a conversion. report_warning() passes them to the
+ * handler the conversion set on its thread (the CLI prints them on stderr).
+ */
+
+#ifndef ERROR_H
+#define ERROR_H
+
+#include <setjmp.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#define ERROR_MESSAGE_SIZE 1024
+
+typedef struct ErrorTrap {
+    jmp_buf jump;                       // Where fatal_error() returns to
+    bool failed;
+    char message[ERROR_MESSAGE_SIZE];   // First error, without the final newline
+    struct ErrorTrap* outer;            // Trap that was active before this one
+} ErrorTrap;
+
+// Make 'trap' this thread's current trap; the caller then calls setjmp() on
+// trap->jump itself, since the jump must land in the caller's frame
+void error_trap_push(ErrorTrap* trap);
+// Restore the trap that was active before 'trap'
+void error_trap_pop(ErrorTrap* trap);
+
+// Keep (or, without a trap, print) the message and unwind to the trap
+void fatal_error(const char* format, ...) __attribute__((noreturn, format(printf, 1, 2)));
+
+// Keep the message for the caller to unwind normally; only the first one
+// counts. Without a trap it is printed.
+void report_error(const char* format, ...) __attribute__((format(printf, 1, 2)));
+
+// Whether an error has been reported under the current trap
+bool error_reported(void);
+
+// Receives each warning, e.g. "Warning: ...", without the final newline
+typedef void (*WarningHandler)(const char* message, void* context);
+// Send this thread's warnings to 'handler'; NULL drops them
+void set_warning_handler(WarningHandler handler, void* context);
+void current_warning_handler(WarningHandler* handler, void** context);
+void report_warning(const char* format, ...) __attribute__((format(printf, 1, 2)));
+
+// First error caught by the workers of a pool
+typedef struct WorkerErrors {
+    pthread_mutex_t lock;
+    bool failed;
+    char message[ERROR_MESSAGE_SIZE];
+} WorkerErrors;
+
+void worker_errors_init(WorkerErrors* errors);
+// Keep 'message' (a trap's, without the final newline) unless one is kept already
+void worker_errors_keep(WorkerErrors* errors, const char* message);
+// Whether a worker has failed, so the others stop taking work
+bool worker_errors_failed(WorkerErrors* errors);
+// Once the workers are joined and their work is released: destroy 'errors'
+// and fatal_error() with the kept message, if any
+void worker_errors_raise(WorkerErrors* errors);
+
+#endif /* ERROR_H */
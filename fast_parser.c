@@ -0,0 +1,714 @@
+/**
+ * fast_parser.c - Hand-written JSON parser for mapped input
+ */
+
+#include "fast_parser.h"
+#include "ast.h"
+#include "arena.h"
+#include "number.h"
+#include "json_string.h"
+#include "stream.h"
+#include "stats.h"
+#include "symbols.h"
+#include "projection.h"
+#include "name_index.h"
+#include "error.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <limits.h>
+
+extern int yyparse();
+extern _Thread_local AST_Node* ast_root;
+extern _Thread_local int parse_records;
+
+// Tokens besides the punctuation characters themselves
+#define TOKEN_END 0
+#define TOKEN_STRING 256
+#define TOKEN_SCALAR 257   // Number, boolean or null
+#define TOKEN_ERROR 258    // Reported already, like the scanner's LEX_ERROR
+#define TOKEN_SKIPPED 259  // A member value the projection does not need, already checked
+
+// How the scanner's rules start, by first byte
+enum {
+    BYTE_OTHER,            // Unexpected character
+    BYTE_SPACE,
+    BYTE_PUNCT,
+    BYTE_QUOTE,
+    BYTE_NUMBER,           // '-' or a digit
+    BYTE_LITERAL           // true, false or null
+};
+
+static const unsigned char byte_class[256] = {
+    [' '] = BYTE_SPACE, ['\t'] = BYTE_SPACE, ['\n'] = BYTE_SPACE, ['\r'] = BYTE_SPACE,
+    ['{'] = BYTE_PUNCT, ['}'] = BYTE_PUNCT, ['['] = BYTE_PUNCT, [']'] = BYTE_PUNCT,
+    [':'] = BYTE_PUNCT, [','] = BYTE_PUNCT,
+    ['"'] = BYTE_QUOTE,
+    ['-'] = BYTE_NUMBER,
+    ['0'] = BYTE_NUMBER, ['1'] = BYTE_NUMBER, ['2'] = BYTE_NUMBER, ['3'] = BYTE_NUMBER, ['4'] = BYTE_NUMBER,
+    ['5'] = BYTE_NUMBER, ['6'] = BYTE_NUMBER, ['7'] = BYTE_NUMBER, ['8'] = BYTE_NUMBER, ['9'] = BYTE_NUMBER,
+    ['t'] = BYTE_LITERAL, ['f'] = BYTE_LITERAL, ['n'] = BYTE_LITERAL,
+};
+
+// Bytes that end the plain run of a string: the quote, a backslash, and NUL,
+// which is content unless it is the map's terminator
+static const unsigned char string_stop[256] = {
+    ['"'] = 1, ['\\'] = 1, ['\0'] = 1,
+};
+
+// An open object or array
+typedef struct ParseFrame {
+    bool is_object;
+    Object_Node* object;     // NULL when streaming
+    Pair_Node* last_pair;
+    Array_Node* array;       // NULL when streaming
+    char* key;               // Key of the member being parsed
+    int scope;               // Projection scope of the object's table or the array's
+                             // elements, -1 without a projection or table
+    int value_scope;         // Objects: scope of the member value being parsed
+} ParseFrame;
+
+// A table as the parser sees it under a projection (projection.h)
+typedef struct ParseScope {
+    char* table;             // Heap-allocated name
+    bool feeds;              // It or a table nested in it is written
+    bool all_columns;        // Written with every column
+} ParseScope;
+
+// This thread's input; all of it is per thread, like the flex scanner's
+static _Thread_local bool fast_active = false;
+static _Thread_local char* input_base = NULL;    // Start of the map, for positions
+static _Thread_local char* input_end = NULL;     // The map's first terminating NUL
+static _Thread_local char* cursor = NULL;
+static _Thread_local char* token_end = NULL;     // Just past the last token, for errors
+static _Thread_local ParseFrame* frames = NULL;
+static _Thread_local int frame_capacity = 0;
+static _Thread_local uint8_t* skim_values = NULL; // Open values of skim_value(), SKIM_* flags
+static _Thread_local int skim_capacity = 0;
+
+// The projection this thread parses for, and the tables seen under it
+static _Thread_local const Projection* active_projection = NULL;
+static _Thread_local ParseScope* scopes = NULL;
+static _Thread_local int scope_count = 0;
+static _Thread_local int scope_capacity = 0;
+static _Thread_local NameIndex scope_index;      // Table name -> position in 'scopes'
+static _Thread_local char* scope_path = NULL;    // Buffer for nested table names
+static _Thread_local size_t scope_path_capacity = 0;
+
+bool parse_parser_kind(const char* name, ParserKind* parser) {
+    if (strcmp(name, "fast") == 0) {
+        *parser = PARSER_FAST;
+    } else if (strcmp(name, "bison") == 0) {
+        *parser = PARSER_BISON;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static void error_position(int* line, int* column) {
+    input_position(input_base, (size_t)(token_end - input_base), line, column);
+}
+
+// The scanner's '.' rule: any byte no other rule matches
+static int unexpected_character(char* at) {
+    token_end = at + 1;
+    if (!scanner_quiet()) {
+        char text[2] = { *at, '\0' };
+        int line, column;
+        error_position(&line, &column);
+        report_error("Lexer Error: Unexpected character '%s' (ASCII: %d) at line %d, col %d\n",
+                     text, (int)text[0], line, column);
+    }
+    return TOKEN_ERROR;
+}
+
+// Report the escape at content[error_offset] of a string ending at 'end'
+static int invalid_escape(const char* content, size_t length, size_t error_offset, char* end) {
+    token_end = end;
+    if (!scanner_quiet()) {
+        int line, column;
+        error_position(&line, &column);
+        report_error("Lexer Error: Invalid escape sequence '\\%c' in string ending at line %d, col %d\n",
+                     error_offset + 1 < length ? content[error_offset + 1] : ' ', line, column);
+    }
+    return TOKEN_ERROR;
+}
+
+// The string opening at 'open'. Like the scanner's rule, a backslash escapes
+// any byte but a newline, and a string that is not closed does not match.
+// Strings without escapes are terminated in place; others are decoded into
+// ast_arena. With no 'value' the string is only checked and the map is left
+// as it is. Returns TOKEN_STRING, or 0 if the rule does not match.
+static int scan_string(char* open, char** end, Value_Node* value) {
+    char* p = open + 1;
+    char* first_escape = NULL;
+    for (;;) {
+        while (!string_stop[(unsigned char)*p]) p++;
+        if (*p == '"') break;
+        if (p == input_end) return 0;
+        if (*p == '\\') {
+            if (p[1] == '\n' || p + 1 == input_end) return 0;
+            if (!first_escape) first_escape = p;
+            p++;
+        }
+        p++;
+    }
+
+    char* content = open + 1;
+    size_t length = (size_t)(p - content);
+    *end = p + 1;
+    size_t error_offset;
+    if (!value) {
+        if (first_escape && !json_escapes_valid(content, length, (size_t)(first_escape - content), &error_offset)) {
+            return invalid_escape(content, length, error_offset, *end);
+        }
+        return TOKEN_STRING;
+    }
+    value->type = VALUE_STRING;
+    if (!first_escape) {
+        *p = '\0'; // Overwrite the closing quote
+        value->string_val = content;
+        return TOKEN_STRING;
+    }
+    char* decoded = (char*)arena_alloc(ast_arena, length + 1);
+    if (!json_unescape(content, length, (size_t)(first_escape - content), decoded, &error_offset)) {
+        return invalid_escape(content, length, error_offset, *end);
+    }
+    value->string_val = decoded;
+    return TOKEN_STRING;
+}
+
+// The scanner's out of range number, ending at 'end'
+static int number_out_of_range(char* end) {
+    token_end = end;
+    if (!scanner_quiet()) {
+        int line, column;
+        error_position(&line, &column);
+        report_error("Lexer Error: Number out of range ending at line %d, col %d\n", line, column);
+    }
+    return TOKEN_ERROR;
+}
+
+// The number at 'start', matched like the scanner: the longest of
+// -?[0-9]+ and -?[0-9]+(\.[0-9]+)?([eE][+-]?[0-9]+)?, the integer rule
+// winning ties. The map's terminating NULs stop every loop. With no 'value'
+// the number is only converted if it may be out of range.
+static int scan_number(char* start, char** end, Value_Node* value) {
+    char* p = start;
+    if (*p == '-') p++;
+    char* digits = p;
+    while (is_digit(*p)) p++;
+    if (p == digits) return 0;
+    char* integer_end = p;
+    if (p[0] == '.' && is_digit(p[1])) {
+        p += 2;
+        while (is_digit(*p)) p++;
+    }
+    if (*p == 'e' || *p == 'E') {
+        char* exponent = p + 1;
+        if (*exponent == '+' || *exponent == '-') exponent++;
+        if (is_digit(*exponent)) {
+            p = exponent + 1;
+            while (is_digit(*p)) p++;
+        }
+    }
+    *end = p;
+    size_t length = (size_t)(p - start);
+    if (!value) {
+        // Only an exponent or over 308 integer digits reach past DBL_MAX
+        bool may_overflow = p != integer_end || integer_end - digits > 308;
+        if (may_overflow && !isfinite(parse_json_double(start, length))) return number_out_of_range(p);
+        return TOKEN_SCALAR;
+    }
+
+    if (p == integer_end && parse_json_integer(start, length, &value->integer_val)) {
+        value->type = VALUE_INTEGER;
+    } else {
+        value->type = VALUE_NUMBER;
+        value->number_val = parse_json_double(start, length);
+        if (!isfinite(value->number_val)) return number_out_of_range(p);
+    }
+    return TOKEN_SCALAR;
+}
+
+// true, false or null; strncmp() stops at the map's terminator
+static int scan_literal(char* start, char** end, Value_Node* value) {
+    Value_Node literal;
+    if (strncmp(start, "true", 4) == 0) {
+        literal = create_boolean_value(true);
+        *end = start + 4;
+    } else if (strncmp(start, "false", 5) == 0) {
+        literal = create_boolean_value(false);
+        *end = start + 5;
+    } else if (strncmp(start, "null", 4) == 0) {
+        literal = create_null_value();
+        *end = start + 4;
+    } else {
+        return 0;
+    }
+    if (value) *value = literal;
+    return TOKEN_SCALAR;
+}
+
+// Scan the next token, counting it and the whitespace before it for --stats
+// as the scanner does. A string or scalar token sets *value; with a NULL
+// 'value' strings and scalars are only checked (see skim_value()).
+static int next_token(Value_Node* value) {
+    char* p = cursor;
+    while (byte_class[(unsigned char)*p] == BYTE_SPACE) p++;
+    if (p == input_end) {
+        parse_counters.bytes += (uint64_t)(p - cursor);
+        cursor = p;
+        token_end = p;
+        return TOKEN_END;
+    }
+
+    char* end = p + 1;
+    int token;
+    switch (byte_class[(unsigned char)*p]) {
+        case BYTE_PUNCT: token = *p; break;
+        case BYTE_QUOTE: token = scan_string(p, &end, value); break;
+        case BYTE_NUMBER: token = scan_number(p, &end, value); break;
+        case BYTE_LITERAL: token = scan_literal(p, &end, value); break;
+        default: token = 0; break;
+    }
+    if (token == 0) {
+        token = unexpected_character(p);
+        end = p + 1;
+    } else if (token != TOKEN_ERROR) {
+        token_end = end;
+    }
+    parse_counters.bytes += (uint64_t)(end - cursor);
+    parse_counters.tokens++;
+    cursor = end;
+    return token;
+}
+
+// yyerror() for the token just scanned; after a lexer error it only counts
+// when no error is being kept, as with the grammar
+static bool syntax_error(void) {
+    if (scanner_quiet() || error_reported()) return false;
+    int line, column;
+    error_position(&line, &column);
+    report_error("Parser Error: syntax error at line %d, column %d\n", line, column);
+    return false;
+}
+
+static ParseFrame* push_frame(int depth) {
+    if (depth == frame_capacity) {
+        int capacity = frame_capacity ? frame_capacity * 2 : 64;
+        ParseFrame* grown = (ParseFrame*)realloc(frames, (size_t)capacity * sizeof(ParseFrame));
+        if (!grown) {
+            fatal_error("Error: Memory allocation failed for parser stack\n");
+        }
+        frames = grown;
+        frame_capacity = capacity;
+    }
+    return &frames[depth];
+}
+
+static void free_scopes(void) {
+    for (int i = 0; i < scope_count; i++) free(scopes[i].table);
+    free(scopes);
+    scopes = NULL;
+    scope_count = 0;
+    scope_capacity = 0;
+    name_index_free(&scope_index);
+    free(scope_path);
+    scope_path = NULL;
+    scope_path_capacity = 0;
+}
+
+// Position of the scope of table 'name', added on first sight
+static int find_scope(const char* name) {
+    uint32_t hash = hash_name(name);
+    int position = name_index_get(&scope_index, name, hash);
+    if (position >= 0) return position;
+    if (scope_count == scope_capacity) {
+        int capacity = scope_capacity ? scope_capacity * 2 : 16;
+        ParseScope* grown = (ParseScope*)realloc(scopes, (size_t)capacity * sizeof(ParseScope));
+        if (!grown) {
+            fatal_error("Error: Memory allocation failed for parser table scopes\n");
+        }
+        scopes = grown;
+        scope_capacity = capacity;
+    }
+    ParseScope* scope = &scopes[scope_count];
+    scope->table = strdup(name);
+    if (!scope->table) {
+        fatal_error("Error: Memory allocation failed for parser table scopes\n");
+    }
+    scope->feeds = projection_feeds(active_projection, name);
+    scope->all_columns = projection_keeps_all_columns(active_projection, name);
+    name_index_put(&scope_index, scope->table, hash, scope_count);
+    return scope_count++;
+}
+
+// Scope of the table for 'key' in an object of scope 'parent', named as
+// get_table_name_for_array() names it
+static int child_scope(int parent, const char* key) {
+    const char* parent_name = scopes[parent].table;
+    bool under_root = strcmp(parent_name, "root") == 0;
+    size_t parent_length = under_root ? 0 : strlen(parent_name);
+    size_t key_length = strlen(key);
+    size_t needed = parent_length + key_length + 2;
+    if (needed > scope_path_capacity) {
+        size_t capacity = scope_path_capacity ? scope_path_capacity : 256;
+        while (capacity < needed) capacity *= 2;
+        char* grown = (char*)realloc(scope_path, capacity);
+        if (!grown) {
+            fatal_error("Error: Memory allocation failed for parser table scopes\n");
+        }
+        scope_path = grown;
+        scope_path_capacity = capacity;
+    }
+    if (!under_root) {
+        memcpy(scope_path, parent_name, parent_length);
+        scope_path[parent_length++] = '_';
+    }
+    memcpy(scope_path + parent_length, key, key_length + 1);
+    return find_scope(scope_path);
+}
+
+// Scope of an object or array opening at 'depth' with 'token'; 'top_scope'
+// is the one of the top-level value
+static int opening_scope(int depth, int token, int top_scope) {
+    if (depth == 0) return top_scope;
+    const ParseFrame* parent = &frames[depth - 1];
+    if (parent->is_object) return parent->value_scope;
+    return token == '{' ? parent->scope : -1; // Nested arrays map to no table
+}
+
+// Check "key" ':' of a skimmed object, or fail
+static bool skim_key(int token) {
+    if (token != TOKEN_STRING) return syntax_error();
+    if (next_token(NULL) != ':') return syntax_error();
+    return true;
+}
+
+// Flags of an open value of skim_value()
+#define SKIM_OBJECT 1   // An object rather than an array
+#define SKIM_COUNTED 2  // Walked by schema.c: the object has an ID, the array's objects do
+#define SKIM_FIRST 4    // An array before its first element
+#define SKIM_OBJECTS 8  // An array whose first element is an object
+
+// Whether a value opening at 'depth' of skim_value() would be walked by
+// schema.c; the first element of an array also decides the array's kind
+static bool skim_counted(int depth, bool is_object) {
+    if (depth == 0) return true; // The member value itself
+    uint8_t* parent = &skim_values[depth - 1];
+    if (*parent & SKIM_OBJECT) return (*parent & SKIM_COUNTED) != 0;
+    if (*parent & SKIM_FIRST) {
+        *parent &= (uint8_t)~SKIM_FIRST;
+        if (is_object) *parent |= SKIM_OBJECTS;
+    }
+    return (*parent & SKIM_COUNTED) && (*parent & SKIM_OBJECTS) && is_object;
+}
+
+// Accept or reject the value at the cursor exactly as parse_value() would,
+// but build nothing: strings are neither terminated nor decoded, numbers not
+// converted, keys not interned and no events reported. Tokens and bytes
+// still count for --stats. '*ids' gets the number of IDs the value's objects
+// would have had, for the IDs after it to match a run without the projection.
+static bool skim_value(int* ids) {
+    int depth = 0;
+    int token = next_token(NULL);
+    *ids = 0;
+    for (;;) {
+        bool counted = skim_counted(depth, token == '{');
+        if (token == '{' || token == '[') {
+            bool is_object = token == '{';
+            if (depth == skim_capacity) {
+                int capacity = skim_capacity ? skim_capacity * 2 : 64;
+                uint8_t* grown = (uint8_t*)realloc(skim_values, (size_t)capacity * sizeof(uint8_t));
+                if (!grown) {
+                    fatal_error("Error: Memory allocation failed for parser stack\n");
+                }
+                skim_values = grown;
+                skim_capacity = capacity;
+            }
+            if (is_object && counted && *ids < INT_MAX) (*ids)++; // Past it, take_node_ids() fails
+            skim_values[depth++] = (uint8_t)((is_object ? SKIM_OBJECT : SKIM_FIRST) | (counted ? SKIM_COUNTED : 0));
+            token = next_token(NULL);
+            if (token == (is_object ? '}' : ']')) {
+                depth--;
+            } else {
+                if (is_object) {
+                    if (!skim_key(token)) return false;
+                    token = next_token(NULL);
+                }
+                continue;
+            }
+        } else if (token != TOKEN_STRING && token != TOKEN_SCALAR) {
+            return syntax_error();
+        }
+
+        // A value is complete: close the values whose closing bracket follows
+        for (;;) {
+            if (depth == 0) return true;
+            bool is_object = (skim_values[depth - 1] & SKIM_OBJECT) != 0;
+            token = next_token(NULL);
+            if (token == ',') {
+                token = next_token(NULL);
+                if (is_object) {
+                    if (!skim_key(token)) return false;
+                    token = next_token(NULL);
+                }
+                break;
+            }
+            if (token != (is_object ? '}' : ']')) return syntax_error();
+            depth--;
+        }
+    }
+}
+
+// Scan the first token of the value of the member whose key was just read.
+// A value the projection does not need (a subtree that feeds no table, or a
+// scalar of a column that is not written) is skimmed instead: *value gets
+// a placeholder of its kind, empty or null, and TOKEN_SKIPPED is returned.
+// An empty placeholder holds the IDs the subtree would have used (ast.h).
+static int member_token(ParseFrame* frame, Value_Node* value) {
+    frame->value_scope = -1;
+    if (frame->scope < 0) return next_token(value);
+    char* p = cursor;
+    while (byte_class[(unsigned char)*p] == BYTE_SPACE) p++;
+    char first = *p;
+    const ParseScope* scope = &scopes[frame->scope];
+    if (first == '{' || first == '[') {
+        frame->value_scope = child_scope(frame->scope, frame->key); // May move 'scopes'
+        if (scopes[frame->value_scope].feeds) return next_token(value);
+    } else if (scope->all_columns || projection_keeps_column(active_projection, scope->table, frame->key)) {
+        return next_token(value);
+    }
+
+    int ids;
+    if (!skim_value(&ids)) return TOKEN_ERROR;
+    if (stream_emitter) {
+        stream_skipped_ids(stream_emitter, ids);
+        *value = create_null_value();
+        stream_scalar(stream_emitter, *value); // The key stays a column of the row
+    } else if (first == '{') {
+        Object_Node* placeholder = create_object_node();
+        placeholder->node_id = -ids;
+        *value = create_object_value(placeholder);
+    } else if (first == '[') {
+        Array_Node* placeholder = create_array_node(0);
+        placeholder->capacity = -ids;
+        *value = create_array_value(placeholder);
+    } else {
+        *value = create_null_value();
+    }
+    return TOKEN_SKIPPED;
+}
+
+// Scan "key" ':' after '{' or ',' into the frame, or fail
+static bool scan_key(ParseFrame* frame, int token, Value_Node* key) {
+    if (token != TOKEN_STRING) return syntax_error();
+    frame->key = key->string_val;
+    Value_Node ignored;
+    if (next_token(&ignored) != ':') return syntax_error();
+    if (stream_emitter) stream_key(stream_emitter, frame->key);
+    return true;
+}
+
+static void count_scalar(Value_Node value) {
+    parse_counters.values[value.type]++;
+    if (stream_emitter) stream_scalar(stream_emitter, value);
+}
+
+// Close the innermost object into *value
+static void end_object(ParseFrame* frame, Value_Node* value) {
+    if (stream_emitter) {
+        stream_end_object(stream_emitter);
+        *value = create_null_value();
+    } else {
+        *value = create_object_value(frame->object);
+    }
+    parse_counters.values[VALUE_OBJECT]++;
+}
+
+static void end_array(ParseFrame* frame, Value_Node* value) {
+    if (stream_emitter) {
+        stream_end_array(stream_emitter);
+        *value = create_null_value();
+    } else {
+        *value = create_array_value(frame->array);
+    }
+    parse_counters.values[VALUE_ARRAY]++;
+}
+
+// Parse the value that starts with 'token' into *value. Each open object or
+// array is a frame on an explicit stack, so depth is limited only by memory.
+// Nodes and events come in the order of the grammar's actions: a member's
+// key is interned once its value is complete. 'top_scope' is the projection
+// scope of the value if it is an object, or of its elements if an array.
+static bool parse_value(int token, Value_Node* value, int top_scope) {
+    int depth = 0;
+    for (;;) {
+        // A value starts with 'token'
+        if (token == '{' || token == '[') {
+            int scope = active_projection ? opening_scope(depth, token, top_scope) : -1;
+            ParseFrame* frame = push_frame(depth++);
+            frame->is_object = token == '{';
+            frame->object = NULL;
+            frame->last_pair = NULL;
+            frame->array = NULL;
+            frame->scope = scope;
+            frame->value_scope = -1;
+            if (frame->is_object) {
+                if (stream_emitter) stream_start_object(stream_emitter);
+                else frame->object = create_object_node();
+                token = next_token(value);
+                if (token == '}') {
+                    depth--;
+                    end_object(frame, value);
+                } else {
+                    if (!scan_key(frame, token, value)) return false;
+                    token = member_token(frame, value);
+                    continue;
+                }
+            } else {
+                if (stream_emitter) stream_start_array(stream_emitter);
+                else frame->array = create_array_node(0);
+                token = next_token(value);
+                if (token == ']') {
+                    depth--;
+                    end_array(frame, value);
+                } else {
+                    continue;
+                }
+            }
+        } else if (token == TOKEN_STRING || token == TOKEN_SCALAR) {
+            count_scalar(*value);
+        } else if (token != TOKEN_SKIPPED) {
+            return syntax_error();
+        }
+
+        // *value is complete: add it to the enclosing frames, closing them
+        // while their closing bracket follows
+        for (;;) {
+            if (depth == 0) return true;
+            ParseFrame* frame = &frames[depth - 1];
+            if (frame->is_object) {
+                if (!stream_emitter) {
+                    Pair_Node* pair = create_pair_node(intern_key(frame->key), *value);
+                    if (frame->last_pair) frame->last_pair->next = pair;
+                    else frame->object->pairs = pair;
+                    frame->last_pair = pair;
+                    frame->object->pair_count++;
+                }
+                parse_counters.pairs++;
+                token = next_token(value);
+                if (token == ',') {
+                    if (!scan_key(frame, next_token(value), value)) return false;
+                    token = member_token(frame, value);
+                    break;
+                }
+                if (token != '}') return syntax_error();
+                depth--;
+                end_object(frame, value);
+            } else {
+                if (!stream_emitter) append_element_to_array(frame->array, *value);
+                token = next_token(value);
+                if (token == ',') {
+                    token = next_token(value);
+                    break;
+                }
+                if (token != ']') return syntax_error();
+                depth--;
+                end_array(frame, value);
+            }
+        }
+    }
+}
+
+// The document's value as the AST root, as the grammar's 'json' rule does
+static AST_Node* root_node(Value_Node value) {
+    AST_Node* root = create_ast_node(NODE_NULL);
+    switch (value.type) {
+        case VALUE_OBJECT: root->type = NODE_OBJECT; root->object = value.object_val; break;
+        case VALUE_ARRAY: root->type = NODE_ARRAY; root->array = value.array_val; break;
+        case VALUE_STRING: root->type = NODE_STRING; root->string_val = value.string_val; break;
+        case VALUE_NUMBER: root->type = NODE_NUMBER; root->number_val = value.number_val; break;
+        case VALUE_INTEGER: root->type = NODE_INTEGER; root->integer_val = value.integer_val; break;
+        case VALUE_BOOLEAN: root->type = NODE_BOOLEAN; root->boolean_val = value.boolean_val; break;
+        case VALUE_NULL: break;
+    }
+    return root;
+}
+
+static int fast_parse(void) {
+    Value_Node value;
+    int token = next_token(&value);
+    if (token == TOKEN_END) {
+        // End of input; a document must have a value
+        if (!parse_records) {
+            syntax_error();
+            return 1;
+        }
+        ast_root = NULL;
+        return 0;
+    }
+    // Top-level objects are the "root" table, or "items" for records, as in
+    // schema.c; the elements of a top-level array are "items"
+    int top_scope = -1;
+    if (active_projection) top_scope = find_scope(token == '{' && !parse_records ? "root" : "items");
+    if (!parse_value(token, &value, top_scope)) return 1;
+    if (stream_emitter) return 0; // Every row has already been written
+    ast_root = root_node(value);
+    if (parse_records) return 0; // Leave the next record unread
+
+    Value_Node ignored;
+    if (next_token(&ignored) != TOKEN_END) {
+        syntax_error();
+        return 1;
+    }
+    return 0;
+}
+
+void parse_map_from(ParserKind parser, InputMap* map, size_t offset) {
+    if (parser == PARSER_BISON) {
+        fast_active = false;
+        scanner_scan_map_from(map, offset);
+        return;
+    }
+    fast_active = true;
+    input_base = map->data;
+    input_end = map->data + map->size;
+    cursor = map->data + offset;
+    token_end = cursor;
+}
+
+int parse_input(void) {
+    return fast_active ? fast_parse() : yyparse();
+}
+
+void parse_finish(void) {
+    scanner_finish();
+    fast_active = false;
+    input_base = NULL;
+    input_end = NULL;
+    cursor = NULL;
+    token_end = NULL;
+    free(frames);
+    frames = NULL;
+    frame_capacity = 0;
+    free(skim_values);
+    skim_values = NULL;
+    skim_capacity = 0;
+    free_scopes();
+}
+
+void use_projection(const Projection* projection) {
+    if (projection != active_projection) free_scopes(); // Decided under the old one
+    active_projection = projection;
+}
+
+const Projection* current_projection(void) {
+    return active_projection;
+}
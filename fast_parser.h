@@ -0,0 +1,53 @@
+/**
+ * fast_parser.h - Hand-written JSON parser for mapped input
+ *
+ * A state machine with an explicit stack of open objects and arrays that
+ * scans tokens straight from the mapped buffer, using a byte class table
+ * instead of flex's dispatch. It builds the same AST as parser.y, or reports
+ * the same events to stream_emitter, and accepts and rejects exactly the
+ * input the flex scanner and bison grammar do, with the same messages. The
+ * flex/bison parser stays the reference (--parser bison) and is the only one
+ * for streamed input (stdin, pipes).
+ *
+ * Under a projection (projection.h) member values that no selected table or
+ * column needs are skimmed: checked token by token, with the same errors,
+ * but not decoded, converted or built. The AST holds an empty object or
+ * array, or a null, in their place.
+ */
+
+#ifndef FAST_PARSER_H
+#define FAST_PARSER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "input.h"
+#include "projection.h"
+
+typedef enum ParserKind {
+    PARSER_FAST,     // This file, for mapped input
+    PARSER_BISON     // scanner.l and parser.y
+} ParserKind;
+
+// Parse a --parser name ("fast" or "bison"); returns false if unknown
+bool parse_parser_kind(const char* name, ParserKind* parser);
+
+// Set up the calling thread to parse 'map' with 'parser' from byte 'offset'
+// on. Either way strings are terminated in place in the map, and error
+// positions count from its start.
+void parse_map_from(ParserKind parser, InputMap* map, size_t offset);
+
+// Like yyparse(), with the parser this thread was set up for: yyparse()
+// itself unless the last parse_map_from() chose PARSER_FAST. Sets ast_root,
+// or reports to stream_emitter; with parse_records set it returns after each
+// top-level value. Returns 0 on success.
+int parse_input(void);
+
+// Release this thread's scanner and parser state
+void parse_finish(void);
+
+// Make 'projection' the one the calling thread's fast parser skims for; NULL
+// (the default) builds every value. Parse workers take the caller's.
+void use_projection(const Projection* projection);
+const Projection* current_projection(void);
+
+#endif /* FAST_PARSER_H */
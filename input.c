@@ -0,0 +1,96 @@
+/**
+ * input.c - Memory-mapped input files for json2relcsv
+ */
+
+#include "input.h"
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+bool input_map_file(const char* path, InputMap* map) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return false;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        close(fd);
+        errno = ENODEV;
+        return false;
+    }
+
+    // Reserve room for the file plus the two NULs flex needs at the end, then
+    // map the file over the start of it. Whatever follows the file is zero:
+    // the tail of its last page, or the anonymous page behind it.
+    size_t size = (size_t)st.st_size;
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t mapped_size = (size + 2 + page - 1) / page * page;
+    char* data = mmap(NULL, mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (data == MAP_FAILED) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return false;
+    }
+    if (size > 0 &&
+        mmap(data, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        int saved = errno;
+        munmap(data, mapped_size);
+        close(fd);
+        errno = saved;
+        return false;
+    }
+    close(fd); // The mapping keeps the file referenced
+
+#ifdef MADV_SEQUENTIAL
+    madvise(data, mapped_size, MADV_SEQUENTIAL);
+#endif
+
+    map->data = data;
+    map->size = size;
+    map->mapped_size = mapped_size;
+    return true;
+}
+
+bool input_copy_buffer(const char* data, size_t size, InputMap* map) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t mapped_size = (size + 2 + page - 1) / page * page;
+    char* copy = mmap(NULL, mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (copy == MAP_FAILED) return false;
+    memcpy(copy, data, size); // The anonymous pages supply the NULs
+    map->data = copy;
+    map->size = size;
+    map->mapped_size = mapped_size;
+    return true;
+}
+
+void input_unmap(InputMap* map) {
+    if (!map->data) return;
+    munmap(map->data, map->mapped_size);
+    map->data = NULL;
+    map->size = 0;
+    map->mapped_size = 0;
+}
+
+void input_position(const char* data, size_t offset, int* line, int* column) {
+    *line = 1;
+    *column = 1;
+    for (size_t i = 0; i < offset; i++) { // Same counting the scanner did per token
+        if (data[i] == '\n') {
+            (*line)++;
+            *column = 1;
+        } else if (data[i] == '\t') {
+            *column += 4;
+        } else {
+            (*column)++;
+        }
+    }
+}
@@ -0,0 +1,49 @@
+/**
+ * input.h - Input sources for the json2relcsv scanner
+ *
+ * A file given with --input is memory-mapped and scanned in place, so string
+ * tokens can point straight into the mapping instead of being copied. Other
+ * input (stdin, pipes) is read with large read(2) calls into one buffer.
+ */
+
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define INPUT_DEFAULT_BUFFER_SIZE (1024 * 1024)
+
+typedef struct InputMap {
+    char* data;          // File contents followed by two NUL bytes
+    size_t size;         // File size, not counting the NULs
+    size_t mapped_size;  // Length of the mapping
+} InputMap;
+
+// Map 'path' privately and writable (the scanner edits tokens in place).
+// Returns false, with errno set, if the file cannot be mapped, e.g. a pipe.
+bool input_map_file(const char* path, InputMap* map);
+// Copy 'size' bytes of 'data' into an anonymous mapping laid out like a
+// mapped file, for converting a buffer the caller keeps
+bool input_copy_buffer(const char* data, size_t size, InputMap* map);
+void input_unmap(InputMap* map);
+
+// Line and column of byte 'offset' of 'data', counting a tab as 4 columns.
+// Used to locate errors in a mapped input only once they happen.
+void input_position(const char* data, size_t offset, int* line, int* column);
+
+// Defined in scanner.l. The scanner state is per thread: each call sets up
+// or releases the calling thread's scanner.
+void scanner_scan_map(InputMap* map);                  // Strings then reference the mapping
+void scanner_scan_map_from(InputMap* map, size_t offset); // Scan from 'offset'; positions still count from the start
+void scanner_scan_stream(FILE* file, size_t buffer_size);
+void scanner_finish(void);
+// Quiet errors end the parse with a syntax error instead of being reported
+// (and exiting); --jobs workers use this and leave reporting to a serial reparse
+void scanner_set_quiet(bool quiet);
+bool scanner_quiet(void);
+// Line and column just past the last token scanned, for error messages
+void scanner_position(int* line, int* column);
+
+#endif /* INPUT_H */
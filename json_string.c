@@ -0,0 +1,211 @@
+/**
+ * json_string.c - Escape decoding for JSON string tokens
+ */
+
+#include "json_string.h"
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+// The AVX2 loop is built into every x86-64 GCC/Clang binary: with -mavx2 it
+// is always used, otherwise only on CPUs that report AVX2 at startup
+#if defined(__AVX2__)
+#define FIND_ESCAPE_AVX2 1
+#elif defined(__x86_64__) && defined(__GNUC__)
+#define FIND_ESCAPE_AVX2 1
+#define FIND_ESCAPE_DISPATCH 1
+#endif
+#if defined(FIND_ESCAPE_AVX2)
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#define REPLACEMENT_CHARACTER 0xFFFD
+
+// The search from offset 'i' on, 16 bytes at a time where the target allows
+static size_t find_escape_from(const char* text, size_t length, size_t i) {
+#if defined(__SSE2__)
+    const __m128i backslashes = _mm_set1_epi8('\\');
+    for (; i + 16 <= length; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)(text + i));
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, backslashes));
+        if (mask) return i + (size_t)__builtin_ctz(mask);
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    const uint8x16_t backslashes = vdupq_n_u8('\\');
+    for (; i + 16 <= length; i += 16) {
+        uint8x16_t matches = vceqq_u8(vld1q_u8((const uint8_t*)(text + i)), backslashes);
+        // Narrow each byte of the comparison to 4 bits of one 64-bit mask
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(matches), 4)), 0);
+        if (mask) return i + (size_t)(__builtin_ctzll(mask) >> 2);
+    }
+#endif
+    for (; i < length; i++) {
+        if (text[i] == '\\') return i;
+    }
+    return length;
+}
+
+#if defined(FIND_ESCAPE_AVX2)
+#if defined(FIND_ESCAPE_DISPATCH)
+__attribute__((target("avx2")))
+#endif
+static size_t find_escape_avx2(const char* text, size_t length) {
+    const __m256i backslashes = _mm256_set1_epi8('\\');
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i*)(text + i));
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, backslashes));
+        if (mask) return i + (size_t)__builtin_ctz(mask);
+    }
+    return find_escape_from(text, length, i);
+}
+#endif
+
+#if defined(FIND_ESCAPE_DISPATCH)
+static bool have_avx2 = false; // Set once, before main() and any parser thread
+
+__attribute__((constructor)) static void detect_avx2(void) {
+    __builtin_cpu_init();
+    have_avx2 = __builtin_cpu_supports("avx2") != 0;
+}
+#endif
+
+size_t json_find_escape(const char* text, size_t length) {
+#if defined(__AVX2__)
+    return find_escape_avx2(text, length);
+#else
+#if defined(FIND_ESCAPE_DISPATCH)
+    if (have_avx2) return find_escape_avx2(text, length);
+#endif
+    return find_escape_from(text, length, 0);
+#endif
+}
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// The code unit of a \uXXXX escape at text[0], or -1 if it is not one
+static int32_t read_unicode_escape(const char* text, size_t available) {
+    if (available < 6 || text[0] != '\\' || text[1] != 'u') return -1;
+    int32_t unit = 0;
+    for (int i = 2; i < 6; i++) {
+        int digit = hex_value(text[i]);
+        if (digit < 0) return -1;
+        unit = unit << 4 | digit;
+    }
+    return unit;
+}
+
+static size_t put_utf8(char* out, uint32_t code_point) {
+    if (code_point < 0x80) {
+        out[0] = (char)code_point;
+        return 1;
+    }
+    if (code_point < 0x800) {
+        out[0] = (char)(0xC0 | code_point >> 6);
+        out[1] = (char)(0x80 | (code_point & 0x3F));
+        return 2;
+    }
+    if (code_point < 0x10000) {
+        out[0] = (char)(0xE0 | code_point >> 12);
+        out[1] = (char)(0x80 | (code_point >> 6 & 0x3F));
+        out[2] = (char)(0x80 | (code_point & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | code_point >> 18);
+    out[1] = (char)(0x80 | (code_point >> 12 & 0x3F));
+    out[2] = (char)(0x80 | (code_point >> 6 & 0x3F));
+    out[3] = (char)(0x80 | (code_point & 0x3F));
+    return 4;
+}
+
+bool json_unescape(const char* text, size_t length, size_t first_escape, char* out, size_t* error_offset) {
+    size_t in = 0;
+    size_t written = 0;
+    size_t escape = first_escape;
+    while (escape < length) {
+        // Copy the plain run before the escape in one go
+        memcpy(out + written, text + in, escape - in);
+        written += escape - in;
+        in = escape;
+
+        size_t available = length - in;
+        char kind = available > 1 ? text[in + 1] : '\0';
+        switch (kind) {
+            case '"': out[written++] = '"'; in += 2; break;
+            case '\\': out[written++] = '\\'; in += 2; break;
+            case '/': out[written++] = '/'; in += 2; break;
+            case 'b': out[written++] = '\b'; in += 2; break;
+            case 'f': out[written++] = '\f'; in += 2; break;
+            case 'n': out[written++] = '\n'; in += 2; break;
+            case 'r': out[written++] = '\r'; in += 2; break;
+            case 't': out[written++] = '\t'; in += 2; break;
+            case 'u': {
+                int32_t unit = read_unicode_escape(text + in, available);
+                if (unit < 0) {
+                    *error_offset = in;
+                    return false;
+                }
+                if (unit == 0) {
+                    memcpy(out + written, text + in, 6);
+                    written += 6;
+                    in += 6;
+                    break;
+                }
+                in += 6;
+                uint32_t code_point = (uint32_t)unit;
+                if (unit >= 0xD800 && unit <= 0xDBFF) {
+                    int32_t low = read_unicode_escape(text + in, length - in);
+                    if (low >= 0xDC00 && low <= 0xDFFF) {
+                        code_point = 0x10000 + ((uint32_t)(unit - 0xD800) << 10) + (uint32_t)(low - 0xDC00);
+                        in += 6;
+                    } else {
+                        code_point = REPLACEMENT_CHARACTER; // The next escape is decoded on its own
+                    }
+                } else if (unit >= 0xDC00 && unit <= 0xDFFF) {
+                    code_point = REPLACEMENT_CHARACTER;
+                }
+                written += put_utf8(out + written, code_point);
+                break;
+            }
+            default:
+                *error_offset = in;
+                return false;
+        }
+        escape = in + json_find_escape(text + in, length - in);
+    }
+    memcpy(out + written, text + in, length - in);
+    written += length - in;
+    out[written] = '\0';
+    return true;
+}
+
+// Each escape decodes on its own (a surrogate pair is two valid \u escapes),
+// so checking them one by one fails where json_unescape() does
+bool json_escapes_valid(const char* text, size_t length, size_t first_escape, size_t* error_offset) {
+    size_t escape = first_escape;
+    while (escape < length) {
+        size_t available = length - escape;
+        char kind = available > 1 ? text[escape + 1] : '\0';
+        size_t in;
+        if (strchr("\"\\/bfnrt", kind) && kind != '\0') {
+            in = escape + 2;
+        } else if (kind == 'u' && read_unicode_escape(text + escape, available) >= 0) {
+            in = escape + 6;
+        } else {
+            *error_offset = escape;
+            return false;
+        }
+        escape = in + json_find_escape(text + in, length - in);
+    }
+    return true;
+}
@@ -0,0 +1,32 @@
+/**
+ * json_string.h - Escape decoding for JSON string tokens
+ *
+ * The scanner hands over the raw text between the quotes. Text without a
+ * backslash is used as is; the search for one runs 16 or 32 bytes at a time
+ * (SSE2 or NEON, AVX2 on x86-64 CPUs found to have it at startup, plain
+ * bytes elsewhere), so only strings that contain escapes pay for decoding. Decoding turns \uXXXX escapes, surrogate pairs
+ * included, into UTF-8.
+ */
+
+#ifndef JSON_STRING_H
+#define JSON_STRING_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+// Offset of the first backslash in text[0..length), or length if there is none
+size_t json_find_escape(const char* text, size_t length);
+
+// Decode text[0..length) into 'out' (length + 1 bytes, not overlapping 'text')
+// and NUL-terminate it; 'first_escape' is json_find_escape()'s result.
+// - A surrogate without its other half becomes U+FFFD.
+// - \u0000 is kept as the six characters, since values are C strings.
+// Returns false, with *error_offset at the backslash, for an unknown escape
+// or a \u without four hex digits.
+bool json_unescape(const char* text, size_t length, size_t first_escape, char* out, size_t* error_offset);
+
+// Check the escapes of text[0..length) as json_unescape() would, without
+// decoding; false, with the same *error_offset, where it would fail
+bool json_escapes_valid(const char* text, size_t length, size_t first_escape, size_t* error_offset);
+
+#endif /* JSON_STRING_H */
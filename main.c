@@ -5,26 +5,73 @@
  #include <stdio.h>
  #include <stdlib.h>
  #include <string.h>
- #include "ast.h"
- 
- // External declarations for flex/bison
- extern FILE* yyin;
- extern int yyparse();
- extern AST_Node* ast_root;
+ #include <unistd.h>
+ #include <errno.h>
+ #include "input.h"
+ #include "stats.h"
+ #include "csv_writer.h"
+ #include "fast_parser.h"
+ #include "converter.h"
+ #include "projection.h"
  
  // Command line argument parsing
  typedef struct {
      int print_ast;
-     char* out_dir;
+     int stream;
+     int ndjson;               // One JSON value per record (line), converted one at a time
+     int timing;               // Report phase times and peak RSS on stderr
+     int stats;                // Full statistics report
+     char* stats_path;         // JSON report file ("-" for stdout); NULL prints text to stderr
+     char* out_dir;            // "-" frames the tables on stdout (--format pgcopy)
+     OutputFormat format;      // --format; the binary formats need the whole schema
+     CsvQuotePolicy quote_policy;
+     Compression compression;  // --compress; CSV output only
+     ParserKind parser;        // --parser; bison is the reference implementation
+     int jobs;
+     char* input_path;         // NULL reads stdin
+     size_t buffer_size;       // Read size for stdin and pipes
+     size_t memory_limit;      // --memory-limit; 0 for none
+     char* schema_path;        // --schema: tables to start from
+     char* emit_schema_path;   // --emit-schema: where to save the tables
+     int append;               // Add to the tables in --out-dir, continuing its IDs
+     Projection* projection;   // --tables, --exclude-tables, --columns; NULL writes everything
+     int dedup;                // Share the rows of nested objects with equal content
  } CommandLineArgs;
  
+ // Parse a byte count with an optional K, M or G suffix; 0 if invalid
+ static size_t parse_size(const char* text) {
+     char* end = NULL;
+     errno = 0;
+     unsigned long long value = strtoull(text, &end, 10);
+     if (errno || end == text || text[0] == '-') return 0;
+     switch (*end) {
+         case 'K': case 'k': value <<= 10; end++; break;
+         case 'M': case 'm': value <<= 20; end++; break;
+         case 'G': case 'g': value <<= 30; end++; break;
+         default: break;
+     }
+     return *end == '\0' ? (size_t)value : 0;
+ }
+ 
  // Parse command line arguments
  static CommandLineArgs parse_args(int argc, char** argv) {
      CommandLineArgs args = {0};
+     args.buffer_size = INPUT_DEFAULT_BUFFER_SIZE;
      
      for (int i = 1; i < argc; i++) {
          if (strcmp(argv[i], "--print-ast") == 0) {
              args.print_ast = 1;
+         } else if (strcmp(argv[i], "--stream") == 0) {
+             args.stream = 1;
+         } else if (strcmp(argv[i], "--ndjson") == 0) {
+             args.ndjson = 1;
+         } else if (strcmp(argv[i], "--timing") == 0) {
+             args.timing = 1;
+         } else if (strcmp(argv[i], "--stats") == 0) {
+             args.stats = 1;
+         } else if (strncmp(argv[i], "--stats=", 8) == 0 && argv[i][8] != '\0') {
+             args.stats = 1;
+             args.stats_path = argv[i] + 8;
          } else if (strcmp(argv[i], "--out-dir") == 0) {
              if (i + 1 < argc) {
                  args.out_dir = argv[++i];
@@ -32,56 +79,240 @@
                  fprintf(stderr, "Error: --out-dir requires a directory path\n");
                  exit(EXIT_FAILURE);
              }
+         } else if (strcmp(argv[i], "--format") == 0) {
+             if (i + 1 >= argc || !parse_output_format(argv[i + 1], &args.format)) {
+                 fprintf(stderr, "Error: --format requires one of: csv, parquet, arrow, pgcopy\n");
+                 exit(EXIT_FAILURE);
+             }
+             i++;
+         } else if (strcmp(argv[i], "--quote") == 0) {
+             if (i + 1 >= argc || !parse_quote_policy(argv[i + 1], &args.quote_policy)) {
+                 fprintf(stderr, "Error: --quote requires one of: minimal, strings, all\n");
+                 exit(EXIT_FAILURE);
+             }
+             i++;
+         } else if (strcmp(argv[i], "--compress") == 0) {
+             if (i + 1 >= argc || !parse_compression(argv[i + 1], &args.compression)) {
+                 fprintf(stderr, "Error: --compress requires gzip or zstd, optionally with :LEVEL (gzip 1-9, zstd 1-22)\n");
+                 exit(EXIT_FAILURE);
+             }
+             if (!compression_available(args.compression.codec)) {
+                 fprintf(stderr, "Error: --compress zstd needs a build with zstd support (make WITH_ZSTD=1)\n");
+                 exit(EXIT_FAILURE);
+             }
+             i++;
+         } else if (strcmp(argv[i], "--parser") == 0) {
+             if (i + 1 >= argc || !parse_parser_kind(argv[i + 1], &args.parser)) {
+                 fprintf(stderr, "Error: --parser requires one of: fast, bison\n");
+                 exit(EXIT_FAILURE);
+             }
+             i++;
+         } else if (strcmp(argv[i], "--jobs") == 0) {
+             char* end = NULL;
+             long jobs = i + 1 < argc ? strtol(argv[i + 1], &end, 10) : -1;
+             if (i + 1 >= argc || *end != '\0' || jobs < 0 || jobs > 1024) {
+                 fprintf(stderr, "Error: --jobs requires a thread count between 0 (all CPUs) and 1024\n");
+                 exit(EXIT_FAILURE);
+             }
+             args.jobs = jobs > 0 ? (int)jobs : (int)sysconf(_SC_NPROCESSORS_ONLN);
+             i++;
+         } else if (strcmp(argv[i], "--input") == 0) {
+             if (i + 1 < argc) {
+                 args.input_path = argv[++i];
+             } else {
+                 fprintf(stderr, "Error: --input requires a file path\n");
+                 exit(EXIT_FAILURE);
+             }
+         } else if (strcmp(argv[i], "--append") == 0) {
+             args.append = 1;
+         } else if (strcmp(argv[i], "--dedup") == 0) {
+             args.dedup = 1;
+         } else if (strcmp(argv[i], "--schema") == 0) {
+             if (i + 1 < argc) {
+                 args.schema_path = argv[++i];
+             } else {
+                 fprintf(stderr, "Error: --schema requires a schema file path\n");
+                 exit(EXIT_FAILURE);
+             }
+         } else if (strcmp(argv[i], "--emit-schema") == 0) {
+             if (i + 1 < argc) {
+                 args.emit_schema_path = argv[++i];
+             } else {
+                 fprintf(stderr, "Error: --emit-schema requires a file path\n");
+                 exit(EXIT_FAILURE);
+             }
+         } else if (strcmp(argv[i], "--tables") == 0 || strcmp(argv[i], "--exclude-tables") == 0) {
+             bool exclude = strcmp(argv[i], "--exclude-tables") == 0;
+             if (!args.projection) args.projection = create_projection();
+             bool added = i + 1 < argc && (exclude ? projection_exclude_tables(args.projection, argv[i + 1])
+                                                   : projection_add_tables(args.projection, argv[i + 1]));
+             if (!added) {
+                 fprintf(stderr, "Error: %s requires a comma-separated list of table names\n", argv[i]);
+                 exit(EXIT_FAILURE);
+             }
+             i++;
+         } else if (strcmp(argv[i], "--columns") == 0) {
+             if (!args.projection) args.projection = create_projection();
+             if (i + 1 >= argc || !projection_add_columns(args.projection, argv[i + 1])) {
+                 fprintf(stderr, "Error: --columns requires TABLE:COLUMN[,COLUMN...]\n");
+                 exit(EXIT_FAILURE);
+             }
+             i++;
+         } else if (strcmp(argv[i], "--buffer-size") == 0) {
+             args.buffer_size = i + 1 < argc ? parse_size(argv[i + 1]) : 0;
+             if (args.buffer_size < 1024 || args.buffer_size > (1u << 30)) {
+                 fprintf(stderr, "Error: --buffer-size requires a size between 1K and 1G (suffixes K, M, G)\n");
+                 exit(EXIT_FAILURE);
+             }
+             i++;
+         } else if (strcmp(argv[i], "--memory-limit") == 0) {
+             args.memory_limit = i + 1 < argc ? parse_size(argv[i + 1]) : 0;
+             if (args.memory_limit < (1u << 20)) {
+                 fprintf(stderr, "Error: --memory-limit requires a size of at least 1M (suffixes K, M, G)\n");
+                 exit(EXIT_FAILURE);
+             }
+             i++;
          } else {
              fprintf(stderr, "Error: Unknown option '%s'\n", argv[i]);
-             fprintf(stderr, "Usage: %s [--print-ast] [--out-dir DIR]\n", argv[0]);
+             fprintf(stderr, "Usage: %s [--print-ast] [--stream] [--ndjson] [--timing] [--stats[=FILE]] [--out-dir DIR] [--input FILE] [--buffer-size SIZE] [--format csv|parquet|arrow|pgcopy] [--quote minimal|strings|all] [--compress gzip|zstd[:LEVEL]] [--parser fast|bison] [--jobs N] [--schema FILE] [--emit-schema FILE] [--append] [--memory-limit SIZE] [--tables T,...] [--exclude-tables T,...] [--columns TABLE:COL,...] [--dedup]\n", argv[0]);
              exit(EXIT_FAILURE);
          }
      }
      
+     if (args.stream && args.print_ast) {
+         fprintf(stderr, "Error: --print-ast needs the full AST and cannot be combined with --stream\n");
+         exit(EXIT_FAILURE);
+     }
+     if (args.stream && args.ndjson) {
+         fprintf(stderr, "Error: --ndjson cannot be combined with --stream\n");
+         exit(EXIT_FAILURE);
+     }
+     if (args.stream && args.dedup) {
+         fprintf(stderr, "Error: --dedup compares whole nested objects and cannot be combined with --stream\n");
+         exit(EXIT_FAILURE);
+     }
+     if (args.stream && args.jobs > 1) {
+         fprintf(stderr, "Error: --stream writes rows while parsing and cannot be combined with --jobs\n");
+         exit(EXIT_FAILURE);
+     }
+     if (args.format != OUTPUT_CSV && (args.stream || args.ndjson)) {
+         fprintf(stderr, "Error: --format %s writes whole tables and cannot be combined with %s\n",
+                 output_format_name(args.format), args.stream ? "--stream" : "--ndjson");
+         exit(EXIT_FAILURE);
+     }
+     if (args.append && args.format != OUTPUT_CSV) {
+         fprintf(stderr, "Error: --append adds rows to CSV files and cannot be combined with --format %s\n",
+                 output_format_name(args.format));
+         exit(EXIT_FAILURE);
+     }
+     if (args.append && args.schema_path) {
+         fprintf(stderr, "Error: --append keeps its tables in the output directory and cannot be combined with --schema\n");
+         exit(EXIT_FAILURE);
+     }
+     if (args.append && args.projection) {
+         // A narrower run would write short rows under the existing headers
+         // and save the narrowed columns in the state
+         fprintf(stderr, "Error: --append writes every column of its tables and cannot be combined with --tables, --exclude-tables or --columns\n");
+         exit(EXIT_FAILURE);
+     }
+     if (args.memory_limit && !args.stream && !args.ndjson) {
+         if (args.print_ast) {
+             fprintf(stderr, "Error: --print-ast needs the full AST and cannot be combined with --memory-limit\n");
+             exit(EXIT_FAILURE);
+         }
+         if (args.format != OUTPUT_CSV) {
+             fprintf(stderr, "Error: --format %s writes whole tables and cannot be combined with --memory-limit\n",
+                     output_format_name(args.format));
+             exit(EXIT_FAILURE);
+         }
+     }
+     if (args.out_dir && strcmp(args.out_dir, "-") == 0) {
+         if (args.format != OUTPUT_PGCOPY) {
+             fprintf(stderr, "Error: --out-dir - writes the tables to stdout and needs --format pgcopy\n");
+             exit(EXIT_FAILURE);
+         }
+         if (args.print_ast || (args.stats_path && strcmp(args.stats_path, "-") == 0)) {
+             fprintf(stderr, "Error: --out-dir - writes the tables to stdout and cannot be combined with %s\n",
+                     args.print_ast ? "--print-ast" : "--stats=-");
+             exit(EXIT_FAILURE);
+         }
+     }
+     if (args.format != OUTPUT_CSV && args.compression.codec != COMPRESS_NONE) {
+         fprintf(stderr, "Error: --compress applies to CSV output and cannot be combined with --format %s\n",
+                 output_format_name(args.format));
+         exit(EXIT_FAILURE);
+     }
+     
      return args;
  }
  
+ // Print whatever --timing and --stats asked for
+ static void report_stats(const CommandLineArgs* args) {
+     if (args->timing) stats_print_timing(stderr);
+     if (!args->stats) return;
+     
+     if (!args->stats_path) {
+         stats_print_report(stderr, false);
+     } else if (strcmp(args->stats_path, "-") == 0) {
+         stats_print_report(stdout, true);
+     } else {
+         FILE* out = fopen(args->stats_path, "w");
+         if (!out) {
+             fprintf(stderr, "Error: Failed to open stats file '%s': %s\n", args->stats_path, strerror(errno));
+             exit(EXIT_FAILURE);
+         }
+         stats_print_report(out, true);
+         fclose(out);
+     }
+     stats_free();
+ }
+ 
+ // Library warnings are printed as they come
+ static void print_warning(const char* message, void* context) {
+     (void)context;
+     fprintf(stderr, "%s\n", message);
+ }
+ 
  int main(int argc, char** argv) {
      // Parse command line arguments
      CommandLineArgs args = parse_args(argc, argv);
+     if (args.stats) stats_enable();
      
-     // Use stdin for JSON input
-     yyin = stdin;
+     ConverterOptions options = {0};
+     options.output.to_stdout = args.out_dir && strcmp(args.out_dir, "-") == 0;
+     options.output.out_dir = options.output.to_stdout ? NULL : args.out_dir;
+     options.output.format = args.format;
+     options.output.quote_policy = args.quote_policy;
+     options.output.compression = args.compression;
+     options.output.append = args.append;
+     options.output.jobs = args.jobs;
+     options.parser = args.parser;
+     options.stream = args.stream;
+     options.ndjson = args.ndjson;
+     options.print_ast = args.print_ast;
+     options.stats = true; // Phases are always timed, for --timing
+     options.buffer_size = args.buffer_size;
+     options.memory_limit = args.memory_limit;
+     options.schema_path = args.schema_path;
+     options.emit_schema_path = args.emit_schema_path;
+     options.projection = args.projection;
+     options.dedup = args.dedup;
+     options.warning = print_warning;
      
-     // Parse JSON input
-     if (yyparse() != 0) {
-         // Error handling is done in yyerror, just exit
+     Converter* converter = create_converter(&options);
+     if (!converter) {
+         fprintf(stderr, "Error: Memory allocation failed for converter\n");
          return EXIT_FAILURE;
      }
-
-         
-     // Check if we have a valid AST
-     if (!ast_root) {
-         fprintf(stderr, "Error: No AST generated\n");
+     if (!converter_run_file(converter, args.input_path)) { // NULL reads stdin
+         fprintf(stderr, "%s\n", converter_error(converter));
+         free_converter(converter);
+         free_projection(args.projection);
          return EXIT_FAILURE;
      }
+     free_converter(converter);
+     free_projection(args.projection);
      
-     // Print AST if requested
-     if (args.print_ast) {
-         print_ast(ast_root, 0);
-         printf("\n");
-     }
-     
-     // Generate schema from AST
-     Schema* schema = generate_schema(ast_root);
-     if (!schema) {
-         fprintf(stderr, "Error: Failed to generate schema\n");
-         free_ast(ast_root);
-         return EXIT_FAILURE;
-     }
-     
-     // Write CSV files
-     write_csv_files(schema, args.out_dir);
-     
-     // Cleanup
-     if (schema) free_schema(schema);
-     if (ast_root) free_ast(ast_root);
-     
+     report_stats(&args);
      return EXIT_SUCCESS;
- }
\ No newline at end of file
+ }
@@ -0,0 +1,80 @@
+/**
+ * name_index.c - Open-addressing hash index from names to integer ids
+ */
+
+#include "name_index.h"
+#include "error.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NAME_INDEX_MIN_CAPACITY 16
+
+uint32_t hash_name(const char* name) {
+    uint32_t hash = 2166136261u;
+    for (const unsigned char* p = (const unsigned char*)name; *p; p++) {
+        hash ^= *p;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+void name_index_init(NameIndex* index) {
+    index->slots = NULL;
+    index->capacity = 0;
+    index->count = 0;
+}
+
+void name_index_free(NameIndex* index) {
+    free(index->slots);
+    name_index_init(index);
+}
+
+// Linear probe for 'key'; returns its slot or the empty slot where it belongs
+static NameIndexSlot* find_slot(NameIndexSlot* slots, int capacity, const char* key, uint32_t hash) {
+    int mask = capacity - 1;
+    int i = (int)(hash & (uint32_t)mask);
+    while (slots[i].key) {
+        if (slots[i].hash == hash && strcmp(slots[i].key, key) == 0) {
+            return &slots[i];
+        }
+        i = (i + 1) & mask;
+    }
+    return &slots[i];
+}
+
+static void grow(NameIndex* index) {
+    int new_capacity = index->capacity ? index->capacity * 2 : NAME_INDEX_MIN_CAPACITY;
+    NameIndexSlot* new_slots = (NameIndexSlot*)calloc(new_capacity, sizeof(NameIndexSlot));
+    if (!new_slots) {
+        fatal_error("Error: Memory allocation failed for name index\n");
+    }
+    for (int i = 0; i < index->capacity; i++) {
+        if (index->slots[i].key) {
+            *find_slot(new_slots, new_capacity, index->slots[i].key, index->slots[i].hash) = index->slots[i];
+        }
+    }
+    free(index->slots);
+    index->slots = new_slots;
+    index->capacity = new_capacity;
+}
+
+int name_index_get(const NameIndex* index, const char* key, uint32_t hash) {
+    if (index->count == 0) return -1;
+    NameIndexSlot* slot = find_slot(index->slots, index->capacity, key, hash);
+    return slot->key ? slot->value : -1;
+}
+
+void name_index_put(NameIndex* index, const char* key, uint32_t hash, int value) {
+    // Keep the load factor at or below 1/2 so probes stay short
+    if ((index->count + 1) * 2 > index->capacity) {
+        grow(index);
+    }
+    NameIndexSlot* slot = find_slot(index->slots, index->capacity, key, hash);
+    if (!slot->key) {
+        slot->key = key;
+        slot->hash = hash;
+        index->count++;
+    }
+    slot->value = value;
+}
@@ -0,0 +1,39 @@
+/**
+ * name_index.h - Open-addressing hash index from names to integer ids
+ *
+ * The index stores ids (e.g. positions in a growable array) rather than
+ * pointers, so it stays valid when the indexed array is reallocated. Keys are
+ * borrowed: each key string must outlive the index.
+ */
+
+#ifndef NAME_INDEX_H
+#define NAME_INDEX_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef struct NameIndexSlot {
+    const char* key;   // NULL marks an empty slot
+    uint32_t hash;
+    int value;
+} NameIndexSlot;
+
+typedef struct NameIndex {
+    NameIndexSlot* slots;
+    int capacity;      // Power of two
+    int count;
+} NameIndex;
+
+// FNV-1a hash of a NUL-terminated name
+uint32_t hash_name(const char* name);
+
+void name_index_init(NameIndex* index);
+void name_index_free(NameIndex* index);
+
+// Returns the id stored for 'key', or -1 if absent. 'hash' must be hash_name(key).
+int name_index_get(const NameIndex* index, const char* key, uint32_t hash);
+
+// Store 'value' for 'key', replacing any previous value
+void name_index_put(NameIndex* index, const char* key, uint32_t hash, int value);
+
+#endif /* NAME_INDEX_H */
@@ -0,0 +1,419 @@
+/**
+ * number.c - JSON number parsing and formatting for json2relcsv
+ */
+
+#include "number.h"
+#include "error.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <locale.h>
+#include <math.h>
+
+// Mantissas up to 2^53 and powers of ten up to 1e22 are exact doubles, so
+// one multiplication or division gives the correctly rounded result
+#define MAX_EXACT_MANTISSA (1ULL << 53)
+#define MAX_EXACT_POW10 22
+
+static const double exact_pow10[MAX_EXACT_POW10 + 1] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+bool parse_json_integer(const char* text, size_t len, int64_t* value) {
+    const char* p = text;
+    const char* end = text + len;
+    bool negative = false;
+    if (p < end && *p == '-') {
+        negative = true;
+        p++;
+    }
+    if (p == end) return false;
+
+    uint64_t limit = negative ? (uint64_t)INT64_MAX + 1 : (uint64_t)INT64_MAX;
+    uint64_t magnitude = 0;
+    for (; p < end; p++) {
+        unsigned digit = (unsigned)(*p - '0');
+        if (digit > 9) return false;
+        if (magnitude > (limit - digit) / 10) return false; // Would overflow
+        magnitude = magnitude * 10 + digit;
+    }
+    if (negative && magnitude == 0) return false; // Keep the sign of -0
+
+    *value = negative ? (int64_t)(0 - magnitude) : (int64_t)magnitude;
+    return true;
+}
+
+// Slow path: strtod, with '.' swapped for the radix character of the current
+// locale since strtod honours LC_NUMERIC
+static double parse_double_slow(const char* text, size_t len) {
+    char stack_buffer[128];
+    char* copy = len < sizeof(stack_buffer) ? stack_buffer : (char*)malloc(len + 1);
+    if (!copy) {
+        fatal_error("Error: Memory allocation failed for number\n");
+    }
+    memcpy(copy, text, len);
+    copy[len] = '\0';
+
+    const char* radix = localeconv()->decimal_point;
+    if (radix[0] != '.' && radix[0] != '\0' && radix[1] == '\0') {
+        char* point = strchr(copy, '.');
+        if (point) *point = radix[0];
+    }
+
+    double value = strtod(copy, NULL);
+    if (copy != stack_buffer) free(copy);
+    return value;
+}
+
+double parse_json_double(const char* text, size_t len) {
+    const char* p = text;
+    const char* end = text + len;
+    bool negative = false;
+    if (p < end && *p == '-') {
+        negative = true;
+        p++;
+    }
+
+    // Collect up to 19 significant digits; more than that cannot take the fast path
+    uint64_t mantissa = 0;
+    int significant = 0;
+    int exponent = 0;
+    for (; p < end && (unsigned)(*p - '0') <= 9; p++) {
+        if (mantissa == 0 && *p == '0') continue; // Leading zeros
+        if (++significant > 19) return parse_double_slow(text, len);
+        mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+    }
+    if (p < end && *p == '.') {
+        for (p++; p < end && (unsigned)(*p - '0') <= 9; p++) {
+            exponent--;
+            if (mantissa == 0 && *p == '0') continue;
+            if (++significant > 19) return parse_double_slow(text, len);
+            mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+        }
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+        bool negative_exponent = false;
+        if (p < end && (*p == '+' || *p == '-')) {
+            negative_exponent = (*p == '-');
+            p++;
+        }
+        int explicit_exponent = 0;
+        for (; p < end && (unsigned)(*p - '0') <= 9; p++) {
+            if (explicit_exponent < 100000) explicit_exponent = explicit_exponent * 10 + (*p - '0');
+        }
+        exponent += negative_exponent ? -explicit_exponent : explicit_exponent;
+    }
+
+    if (mantissa == 0) return negative ? -0.0 : 0.0;
+    if (mantissa > MAX_EXACT_MANTISSA) return parse_double_slow(text, len);
+
+    // Clinger's fast path. Exponents just above 22 still qualify when the
+    // excess powers of ten fold into the mantissa without exceeding 2^53.
+    double value;
+    if (exponent < -MAX_EXACT_POW10) {
+        return parse_double_slow(text, len);
+    } else if (exponent < 0) {
+        value = (double)mantissa / exact_pow10[-exponent];
+    } else {
+        while (exponent > MAX_EXACT_POW10) {
+            if (mantissa > MAX_EXACT_MANTISSA / 10) return parse_double_slow(text, len);
+            mantissa *= 10;
+            exponent--;
+        }
+        value = (double)mantissa * exact_pow10[exponent];
+    }
+    return negative ? -value : value;
+}
+
+int format_int64(int64_t value, char* out) {
+    char digits[24];
+    char* p = digits + sizeof(digits);
+    uint64_t magnitude = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+    do {
+        *--p = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude);
+    if (value < 0) *--p = '-';
+
+    int len = (int)(digits + sizeof(digits) - p);
+    memcpy(out, p, (size_t)len);
+    out[len] = '\0';
+    return len;
+}
+
+// Shortest digits by Grisu3 (Loitsch, "Printing Floating-Point Numbers Quickly
+// and Accurately with Integers", 2010): the double's rounding interval is
+// scaled by a cached power of ten into 64-bit fixed point and its digits are
+// generated until they single out the double. It proves its result for about
+// 99.5% of doubles; the rest take the exact fallback below.
+
+// A value f * 2^e with a 64-bit significand
+typedef struct DiyFp {
+    uint64_t f;
+    int e;
+} DiyFp;
+
+// 10^decimal_exponent ~= significand * 2^binary_exponent, rounded to nearest,
+// for every eighth decimal exponent from -348 to 340
+typedef struct CachedPower {
+    uint64_t significand;
+    int binary_exponent;
+    int decimal_exponent;
+} CachedPower;
+
+static const CachedPower cached_powers[] = {
+    {0xfa8fd5a0081c0288ull, -1220, -348}, {0xbaaee17fa23ebf76ull, -1193, -340},
+    {0x8b16fb203055ac76ull, -1166, -332}, {0xcf42894a5dce35eaull, -1140, -324},
+    {0x9a6bb0aa55653b2dull, -1113, -316}, {0xe61acf033d1a45dfull, -1087, -308},
+    {0xab70fe17c79ac6caull, -1060, -300}, {0xff77b1fcbebcdc4full, -1034, -292},
+    {0xbe5691ef416bd60cull, -1007, -284}, {0x8dd01fad907ffc3cull, -980, -276},
+    {0xd3515c2831559a83ull, -954, -268}, {0x9d71ac8fada6c9b5ull, -927, -260},
+    {0xea9c227723ee8bcbull, -901, -252}, {0xaecc49914078536dull, -874, -244},
+    {0x823c12795db6ce57ull, -847, -236}, {0xc21094364dfb5637ull, -821, -228},
+    {0x9096ea6f3848984full, -794, -220}, {0xd77485cb25823ac7ull, -768, -212},
+    {0xa086cfcd97bf97f4ull, -741, -204}, {0xef340a98172aace5ull, -715, -196},
+    {0xb23867fb2a35b28eull, -688, -188}, {0x84c8d4dfd2c63f3bull, -661, -180},
+    {0xc5dd44271ad3cdbaull, -635, -172}, {0x936b9fcebb25c996ull, -608, -164},
+    {0xdbac6c247d62a584ull, -582, -156}, {0xa3ab66580d5fdaf6ull, -555, -148},
+    {0xf3e2f893dec3f126ull, -529, -140}, {0xb5b5ada8aaff80b8ull, -502, -132},
+    {0x87625f056c7c4a8bull, -475, -124}, {0xc9bcff6034c13053ull, -449, -116},
+    {0x964e858c91ba2655ull, -422, -108}, {0xdff9772470297ebdull, -396, -100},
+    {0xa6dfbd9fb8e5b88full, -369, -92}, {0xf8a95fcf88747d94ull, -343, -84},
+    {0xb94470938fa89bcfull, -316, -76}, {0x8a08f0f8bf0f156bull, -289, -68},
+    {0xcdb02555653131b6ull, -263, -60}, {0x993fe2c6d07b7facull, -236, -52},
+    {0xe45c10c42a2b3b06ull, -210, -44}, {0xaa242499697392d3ull, -183, -36},
+    {0xfd87b5f28300ca0eull, -157, -28}, {0xbce5086492111aebull, -130, -20},
+    {0x8cbccc096f5088ccull, -103, -12}, {0xd1b71758e219652cull, -77, -4},
+    {0x9c40000000000000ull, -50, 4}, {0xe8d4a51000000000ull, -24, 12},
+    {0xad78ebc5ac620000ull, 3, 20}, {0x813f3978f8940984ull, 30, 28},
+    {0xc097ce7bc90715b3ull, 56, 36}, {0x8f7e32ce7bea5c70ull, 83, 44},
+    {0xd5d238a4abe98068ull, 109, 52}, {0x9f4f2726179a2245ull, 136, 60},
+    {0xed63a231d4c4fb27ull, 162, 68}, {0xb0de65388cc8ada8ull, 189, 76},
+    {0x83c7088e1aab65dbull, 216, 84}, {0xc45d1df942711d9aull, 242, 92},
+    {0x924d692ca61be758ull, 269, 100}, {0xda01ee641a708deaull, 295, 108},
+    {0xa26da3999aef774aull, 322, 116}, {0xf209787bb47d6b85ull, 348, 124},
+    {0xb454e4a179dd1877ull, 375, 132}, {0x865b86925b9bc5c2ull, 402, 140},
+    {0xc83553c5c8965d3dull, 428, 148}, {0x952ab45cfa97a0b3ull, 455, 156},
+    {0xde469fbd99a05fe3ull, 481, 164}, {0xa59bc234db398c25ull, 508, 172},
+    {0xf6c69a72a3989f5cull, 534, 180}, {0xb7dcbf5354e9beceull, 561, 188},
+    {0x88fcf317f22241e2ull, 588, 196}, {0xcc20ce9bd35c78a5ull, 614, 204},
+    {0x98165af37b2153dfull, 641, 212}, {0xe2a0b5dc971f303aull, 667, 220},
+    {0xa8d9d1535ce3b396ull, 694, 228}, {0xfb9b7cd9a4a7443cull, 720, 236},
+    {0xbb764c4ca7a44410ull, 747, 244}, {0x8bab8eefb6409c1aull, 774, 252},
+    {0xd01fef10a657842cull, 800, 260}, {0x9b10a4e5e9913129ull, 827, 268},
+    {0xe7109bfba19c0c9dull, 853, 276}, {0xac2820d9623bf429ull, 880, 284},
+    {0x80444b5e7aa7cf85ull, 907, 292}, {0xbf21e44003acdd2dull, 933, 300},
+    {0x8e679c2f5e44ff8full, 960, 308}, {0xd433179d9c8cb841ull, 986, 316},
+    {0x9e19db92b4e31ba9ull, 1013, 324}, {0xeb96bf6ebadf77d9ull, 1039, 332},
+    {0xaf87023b9bf0ee6bull, 1066, 340},
+};
+
+#define CACHED_POWERS_OFFSET 348   // -decimal_exponent of the first entry
+#define CACHED_POWERS_STEP 8
+// Exponent range of the scaled values, so that digit generation can keep the
+// integral part in 32 bits and the fraction in the rest
+#define GRISU_MIN_EXPONENT (-60)
+#define GRISU_MAX_EXPONENT (-32)
+
+// Product rounded to 64 bits
+static DiyFp diy_multiply(DiyFp x, DiyFp y) {
+    const uint64_t mask = 0xFFFFFFFFu;
+    uint64_t a = x.f >> 32, b = x.f & mask, c = y.f >> 32, d = y.f & mask;
+    uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+    uint64_t middle = (bd >> 32) + (ad & mask) + (bc & mask) + (1u << 31);
+    DiyFp product = {ac + (ad >> 32) + (bc >> 32) + (middle >> 32), x.e + y.e + 64};
+    return product;
+}
+
+static DiyFp diy_normalize(DiyFp x) {
+    while (!(x.f & (1ull << 63))) {
+        x.f <<= 1;
+        x.e--;
+    }
+    return x;
+}
+
+// Nudge the last digit towards 'w' while the digits stay inside the interval,
+// then check that the result is safely the closest; false if it cannot tell
+static bool round_weed(char* digits, int length, uint64_t distance_too_high_w, uint64_t unsafe_interval,
+                       uint64_t rest, uint64_t ten_kappa, uint64_t unit) {
+    uint64_t small_distance = distance_too_high_w - unit;
+    uint64_t big_distance = distance_too_high_w + unit;
+    while (rest < small_distance && unsafe_interval - rest >= ten_kappa &&
+           (rest + ten_kappa < small_distance || small_distance - rest >= rest + ten_kappa - small_distance)) {
+        digits[length - 1]--;
+        rest += ten_kappa;
+    }
+    if (rest < big_distance && unsafe_interval - rest >= ten_kappa &&
+        (rest + ten_kappa < big_distance || big_distance - rest > rest + ten_kappa - big_distance)) {
+        return false;
+    }
+    return 2 * unit <= rest && rest <= unsafe_interval - 4 * unit;
+}
+
+// Digits of the scaled 'w' between 'low' and 'high' (all with the same
+// exponent); w ~= digits * 10^kappa
+static bool grisu_digits(DiyFp low, DiyFp w, DiyFp high, char* digits, int* length, int* kappa) {
+    uint64_t unit = 1;
+    uint64_t too_low = low.f - unit;
+    uint64_t too_high = high.f + unit;
+    uint64_t unsafe_interval = too_high - too_low;
+    int shift = -w.e;
+    uint64_t one = 1ull << shift;
+    uint32_t integrals = (uint32_t)(too_high >> shift);
+    uint64_t fractionals = too_high & (one - 1);
+
+    uint32_t divisor = 1;
+    *kappa = integrals ? 1 : 0;
+    while (integrals / 10 >= divisor) {
+        divisor *= 10;
+        (*kappa)++;
+    }
+    *length = 0;
+    while (*kappa > 0) {
+        digits[(*length)++] = (char)('0' + integrals / divisor);
+        integrals %= divisor;
+        (*kappa)--;
+        uint64_t rest = ((uint64_t)integrals << shift) + fractionals;
+        if (rest < unsafe_interval) {
+            return round_weed(digits, *length, too_high - w.f, unsafe_interval, rest, (uint64_t)divisor << shift, unit);
+        }
+        divisor /= 10;
+    }
+    for (;;) {
+        fractionals *= 10;
+        unit *= 10;
+        unsafe_interval *= 10;
+        digits[(*length)++] = (char)('0' + (fractionals >> shift));
+        fractionals &= one - 1;
+        (*kappa)--;
+        if (fractionals < unsafe_interval) {
+            return round_weed(digits, *length, (too_high - w.f) * unit, unsafe_interval, fractionals, one, unit);
+        }
+    }
+}
+
+// Shortest digits of a positive finite 'value', which is digits * 10^*exponent;
+// false if Grisu3 cannot guarantee them
+static bool grisu3(double value, char* digits, int* length, int* exponent) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint64_t mantissa = bits & ((1ull << 52) - 1);
+    int biased = (int)(bits >> 52);
+    DiyFp v = {biased ? mantissa | 1ull << 52 : mantissa, (biased ? biased : 1) - 1075};
+
+    // The interval of numbers that read back as 'value': halfway to each
+    // neighbour, which is closer below at a power of two
+    DiyFp high = diy_normalize((DiyFp){(v.f << 1) + 1, v.e - 1});
+    DiyFp low = mantissa == 0 && biased > 1 ? (DiyFp){(v.f << 2) - 1, v.e - 2} : (DiyFp){(v.f << 1) - 1, v.e - 1};
+    low.f <<= low.e - high.e;
+    low.e = high.e;
+    DiyFp w = diy_normalize(v);
+
+    // A cached power that brings the exponent into the target range
+    int min_exponent = GRISU_MIN_EXPONENT - (w.e + 64);
+    int k = (int)ceil((min_exponent + 63) * 0.30102999566398114);
+    int index = (CACHED_POWERS_OFFSET + k - 1) / CACHED_POWERS_STEP + 1;
+    if (index < 0 || index >= (int)(sizeof(cached_powers) / sizeof(cached_powers[0]))) return false;
+    const CachedPower* power = &cached_powers[index];
+    DiyFp scale = {power->significand, power->binary_exponent};
+    int scaled_exponent = w.e + scale.e + 64;
+    if (scaled_exponent < GRISU_MIN_EXPONENT || scaled_exponent > GRISU_MAX_EXPONENT) return false;
+
+    int kappa;
+    if (!grisu_digits(diy_multiply(low, scale), diy_multiply(w, scale), diy_multiply(high, scale), digits, length, &kappa)) {
+        return false;
+    }
+    *exponent = kappa - power->decimal_exponent;
+    return true;
+}
+
+// Exact fallback: the first precision whose correctly rounded digits read back
+static void shortest_by_readback(double value, char* digits, int* length, int* exponent) {
+    char text[NUMBER_FORMAT_MAX + 1];
+    for (int precision = 1; precision <= 17; precision++) {
+        snprintf(text, sizeof(text), "%.*e", precision - 1, value);
+        if (precision < 17 && parse_double_slow(text, strlen(text)) != value) continue;
+        // d[.ddd]e±XX, with the locale's radix character
+        const char* p = text;
+        *length = 0;
+        for (; *p != 'e'; p++) {
+            if (*p >= '0' && *p <= '9') digits[(*length)++] = *p;
+        }
+        *exponent = atoi(p + 1) - (*length - 1);
+        while (*length > 1 && digits[*length - 1] == '0') { // Trailing zeros of %e
+            (*length)--;
+            (*exponent)++;
+        }
+        return;
+    }
+}
+
+int format_double(double value, char* out) {
+    // Whole numbers in the exact range print like integers, without exponent
+    if (value == floor(value) && fabs(value) < (double)MAX_EXACT_MANTISSA && !(value == 0 && signbit(value))) {
+        return format_int64((int64_t)value, out);
+    }
+    // The parsers reject numbers out of the double range, so values from
+    // JSON are finite; anything else prints in C's spelling
+    if (!isfinite(value)) {
+        const char* text = isnan(value) ? "nan" : (value < 0 ? "-inf" : "inf");
+        strcpy(out, text);
+        return (int)strlen(text);
+    }
+    if (value == 0) {
+        strcpy(out, "-0");
+        return 2;
+    }
+
+    char digits[24];
+    int length;
+    int exponent; // value = digits * 10^exponent
+    char* p = out;
+    if (value < 0) *p++ = '-';
+    if (!grisu3(fabs(value), digits, &length, &exponent)) {
+        shortest_by_readback(fabs(value), digits, &length, &exponent);
+    }
+
+    // Laid out as "%.*g" would with the precision the digits need (at least
+    // 15): plain below 1e15 and down to 1e-4, otherwise d.ddde±XX
+    int point = exponent + length; // Digits before the decimal point
+    int precision = length > 15 ? length : 15;
+    if (point - 1 < -4 || point - 1 >= precision) {
+        *p++ = digits[0];
+        if (length > 1) {
+            *p++ = '.';
+            memcpy(p, digits + 1, (size_t)(length - 1));
+            p += length - 1;
+        }
+        int decimal_exponent = point - 1;
+        *p++ = 'e';
+        *p++ = decimal_exponent < 0 ? '-' : '+';
+        int magnitude = abs(decimal_exponent);
+        if (magnitude >= 100) *p++ = (char)('0' + magnitude / 100);
+        *p++ = (char)('0' + magnitude / 10 % 10);
+        *p++ = (char)('0' + magnitude % 10);
+    } else if (point <= 0) {
+        *p++ = '0';
+        *p++ = '.';
+        memset(p, '0', (size_t)-point);
+        p += -point;
+        memcpy(p, digits, (size_t)length);
+        p += length;
+    } else if (point >= length) {
+        memcpy(p, digits, (size_t)length);
+        p += length;
+        memset(p, '0', (size_t)(point - length));
+        p += point - length;
+    } else {
+        memcpy(p, digits, (size_t)point);
+        p += point;
+        *p++ = '.';
+        memcpy(p, digits + point, (size_t)(length - point));
+        p += length - point;
+    }
+    *p = '\0';
+    return (int)(p - out);
+}
@@ -0,0 +1,34 @@
+/**
+ * number.h - JSON number parsing and formatting for json2relcsv
+ *
+ * Integers that fit in int64_t are kept exact. Other numbers are parsed to
+ * the correctly rounded double and printed with the fewest digits that read
+ * back to the same double (Grisu3, with an exact fallback), the closest such
+ * digits when there is a choice. Neither direction depends on the C locale.
+ * Numbers beyond the range of a double, such as 1e400, are rejected by both
+ * parsers, so parsed values are always finite.
+ */
+
+#ifndef NUMBER_H
+#define NUMBER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Longest text produced by format_int64/format_double, without terminator
+#define NUMBER_FORMAT_MAX 32
+
+// 'text' holds a JSON integer token (-?[0-9]+). Returns false when it does not
+// fit in int64_t or is "-0"; parse it with parse_json_double() instead.
+bool parse_json_integer(const char* text, size_t len, int64_t* value);
+
+// 'text' holds a JSON number token; it need not be NUL-terminated
+double parse_json_double(const char* text, size_t len);
+
+// Write the number to 'out' (at least NUMBER_FORMAT_MAX + 1 bytes, NUL-terminated)
+// and return its length
+int format_int64(int64_t value, char* out);
+int format_double(double value, char* out);
+
+#endif /* NUMBER_H */
@@ -0,0 +1,494 @@
+/**
+ * parallel.c - Parse a mapped input with --jobs threads
+ */
+
+#include "parallel.h"
+#include "arena.h"
+#include "stats.h"
+#include "symbols.h"
+#include "error.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+extern _Thread_local AST_Node* ast_root;
+extern _Thread_local int parse_records;
+
+// Parts are at least this large, so small inputs are parsed serially
+#define PARALLEL_MIN_PART (1024 * 1024)
+// --ndjson keeps at most 2 * jobs parts in memory, each at most this large
+#define PARALLEL_MAX_RECORD_PART (8 * 1024 * 1024)
+// Parts per thread when the input allows, so threads finishing early pick up more
+#define PARALLEL_PARTS_PER_JOB 4
+// --memory-limit: the AST and rows of a part take several times its text,
+// and up to 2 * jobs parts are held at once
+#define PARALLEL_LIMIT_SHARE 8
+#define PARALLEL_MIN_LIMITED_PART (64 * 1024)
+
+// A piece of the input parsed by one worker
+typedef struct ParsePart {
+    size_t start;            // Offset in the input
+    size_t length;
+    Arena* arena;            // Nodes and strings of the part
+    Array_Node* elements;    // Top-level array: the part's elements
+    AST_Node** records;      // NDJSON: the part's records in order
+    int record_count;
+    int record_capacity;
+    ParseCounters counters;
+    bool done;
+    bool failed;
+    char* error;             // A fatal_error() of its worker, e.g. out of memory
+} ParsePart;
+
+struct ParsePool {
+    InputMap* map;
+    KeyTable* keys;          // The conversion's key table, shared by the workers
+    const Projection* projection; // The caller's, for the workers' parsers
+    ParserKind parser;
+    bool records;            // NDJSON rather than one top-level array
+    ParsePart* parts;
+    int part_count;
+    int part_capacity;
+    int next_part;           // Next part for a worker to claim
+    int window;              // Parts parsed ahead of the consumer, 0 for no limit
+    int consumed;            // Parts the consumer is done with
+    bool stop;               // A part failed or the consumer gave up
+    pthread_t* threads;
+    int thread_count;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;  // A part finished, or the consumer moved on
+    // NDJSON and array part consumer position
+    int current;             // Part records or elements are taken from
+    int next_record;         // Array parts: 1 once the current part was handed out
+    bool serial;             // A part failed: parse_input() continues from it
+};
+
+static bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static void add_part(ParsePool* pool, size_t start, size_t end) {
+    if (pool->part_count == pool->part_capacity) {
+        pool->part_capacity = pool->part_capacity ? pool->part_capacity * 2 : 64;
+        ParsePart* parts = (ParsePart*)realloc(pool->parts, pool->part_capacity * sizeof(ParsePart));
+        if (!parts) {
+            fatal_error("Error: Memory reallocation failed for parse parts\n");
+        }
+        pool->parts = parts;
+    }
+    ParsePart* part = &pool->parts[pool->part_count++];
+    memset(part, 0, sizeof(ParsePart));
+    part->start = start;
+    part->length = end - start;
+}
+
+// Cut the input into parts of at least 'part_size' bytes: at commas between
+// the elements of a top-level array, or at newlines between NDJSON records.
+// Only strings and nesting are tracked; whether the parts are valid JSON is
+// left to the parser. Returns false if there are fewer than two parts, or if
+// the input is plainly not what the cuts assume.
+static bool find_parts(ParsePool* pool, size_t part_size) {
+    const char* data = pool->map->data;
+    size_t size = pool->map->size;
+    size_t i = 0;
+    size_t start = 0;
+    int depth = 0;
+    if (!pool->records) {
+        while (i < size && is_space(data[i])) i++;
+        if (i == size || data[i] != '[') return false;
+        depth = 1;
+        start = ++i;
+    }
+
+    for (; i < size; i++) {
+        switch (data[i]) {
+            case '"':
+                // Skip the string; a backslash escapes the next byte
+                for (i++; i < size && data[i] != '"'; i++) {
+                    if (data[i] == '\\') i++;
+                }
+                break;
+            case '[':
+            case '{':
+                depth++;
+                break;
+            case ']':
+            case '}':
+                if (--depth < 0) return false;
+                if (depth == 0 && !pool->records) {
+                    // The array's end: only whitespace may follow
+                    add_part(pool, start, i);
+                    for (i++; i < size; i++) {
+                        if (!is_space(data[i])) return false;
+                    }
+                    return pool->part_count >= 2;
+                }
+                break;
+            case ',':
+                if (depth == 1 && !pool->records && i - start >= part_size) {
+                    add_part(pool, start, i);
+                    start = i + 1;
+                }
+                break;
+            case '\n':
+                if (depth == 0 && pool->records && i + 1 - start >= part_size) {
+                    add_part(pool, start, i + 1);
+                    start = i + 1;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    if (!pool->records) return false; // The array is never closed
+    if (start < size) add_part(pool, start, size);
+    return pool->part_count >= 2;
+}
+
+static void add_record(ParsePart* part, AST_Node* record) {
+    if (part->record_count == part->record_capacity) {
+        part->record_capacity = part->record_capacity ? part->record_capacity * 2 : 256;
+        AST_Node** records = (AST_Node**)realloc(part->records, part->record_capacity * sizeof(AST_Node*));
+        if (!records) {
+            fatal_error("Error: Memory reallocation failed for parsed records\n");
+        }
+        part->records = records;
+    }
+    part->records[part->record_count++] = record;
+}
+
+// Parse one part with this thread's parser. The part is copied
+// into its arena, with the two NULs the scanner needs, and an array part is
+// wrapped in brackets to parse as an array of its own.
+static void parse_part(ParsePool* pool, ParsePart* part) {
+    size_t wrap = pool->records ? 0 : 1;
+    part->arena = arena_create(0);
+    ast_arena = part->arena;
+
+    InputMap view = {0};
+    view.size = part->length + 2 * wrap;
+    view.data = (char*)arena_alloc(ast_arena, view.size + 2);
+    memcpy(view.data + wrap, pool->map->data + part->start, part->length);
+    if (wrap) {
+        view.data[0] = '[';
+        view.data[view.size - 1] = ']';
+    }
+    view.data[view.size] = '\0';
+    view.data[view.size + 1] = '\0';
+
+    memset(&parse_counters, 0, sizeof(ParseCounters));
+    parse_records = pool->records;
+    parse_map_from(pool->parser, &view, 0);
+    bool ok;
+    if (pool->records) {
+        int status;
+        while ((status = parse_input()) == 0 && ast_root) {
+            add_record(part, ast_root);
+            ast_root = NULL;
+        }
+        ok = status == 0;
+    } else {
+        // An empty part means a missing element, which the array rule
+        // would accept as "[]"
+        ok = parse_input() == 0 && ast_root && ast_root->type == NODE_ARRAY && ast_root->array->size > 0;
+        if (ok) part->elements = ast_root->array;
+    }
+    ast_root = NULL;
+    parse_finish();
+    part->counters = parse_counters;
+    part->failed = !ok;
+    ast_arena = NULL;
+}
+
+// After a fatal_error() in parse_part(): drop the parse, keeping the message
+// for the consumer. If it cannot be kept, the part only fails to parse.
+static void abandon_part(ParsePart* part, const char* message) {
+    ast_root = NULL;
+    parse_finish();
+    ast_arena = NULL;
+    part->failed = true;
+    part->error = strdup(message);
+}
+
+static void* parse_worker(void* arg) {
+    ParsePool* pool = (ParsePool*)arg;
+    scanner_set_quiet(true);
+    use_key_table(pool->keys);
+    use_projection(pool->projection);
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->stop && pool->next_part < pool->part_count &&
+               pool->window && pool->next_part >= pool->consumed + pool->window) {
+            pthread_cond_wait(&pool->changed, &pool->lock);
+        }
+        if (pool->stop || pool->next_part == pool->part_count) break;
+        ParsePart* part = &pool->parts[pool->next_part++];
+        pthread_mutex_unlock(&pool->lock);
+
+        ErrorTrap trap;
+        error_trap_push(&trap);
+        if (setjmp(trap.jump) == 0) {
+            parse_part(pool, part);
+        } else {
+            abandon_part(part, trap.message);
+        }
+        error_trap_pop(&trap);
+
+        pthread_mutex_lock(&pool->lock);
+        part->done = true;
+        // Parts are claimed in order, so every part before a failed one is
+        // already being parsed and still completes
+        if (part->failed) pool->stop = true;
+        pthread_cond_broadcast(&pool->changed);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    use_key_table(NULL);
+    use_projection(NULL);
+    return NULL;
+}
+
+static ParsePool* create_pool(InputMap* map, int jobs, ParserKind parser, bool records, size_t memory_limit) {
+    ParsePool* pool = (ParsePool*)calloc(1, sizeof(ParsePool));
+    if (!pool) {
+        fatal_error("Error: Memory allocation failed for parse pool\n");
+    }
+    pool->map = map;
+    pool->keys = current_key_table();
+    pool->projection = current_projection();
+    pool->parser = parser;
+    pool->records = records;
+
+    size_t part_size = map->size / ((size_t)jobs * PARALLEL_PARTS_PER_JOB);
+    if (part_size < PARALLEL_MIN_PART) part_size = PARALLEL_MIN_PART;
+    if (records && part_size > PARALLEL_MAX_RECORD_PART) part_size = PARALLEL_MAX_RECORD_PART;
+    if (memory_limit) {
+        size_t limited = memory_limit / ((size_t)PARALLEL_LIMIT_SHARE * 2 * jobs);
+        if (limited < PARALLEL_MIN_LIMITED_PART) limited = PARALLEL_MIN_LIMITED_PART;
+        if (part_size > limited) part_size = limited;
+    }
+    if (!find_parts(pool, part_size)) {
+        free(pool->parts);
+        free(pool);
+        return NULL;
+    }
+    if (records || memory_limit) pool->window = 2 * jobs;
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->changed, NULL);
+    pool->thread_count = jobs < pool->part_count ? jobs : pool->part_count;
+    pool->threads = (pthread_t*)malloc(pool->thread_count * sizeof(pthread_t));
+    if (!pool->threads) {
+        fatal_error("Error: Memory allocation failed for worker threads\n");
+    }
+    for (int i = 0; i < pool->thread_count; i++) {
+        if (pthread_create(&pool->threads[i], NULL, parse_worker, pool) != 0) {
+            pool->thread_count = i;
+            parallel_release(pool);
+            fatal_error("Error: Failed to start parse worker thread\n");
+        }
+    }
+    return pool;
+}
+
+static void join_workers(ParsePool* pool) {
+    for (int i = 0; i < pool->thread_count; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    pool->thread_count = 0;
+}
+
+// Let the workers finish their current part and wait for them
+static void stop_workers(ParsePool* pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = true;
+    pthread_cond_broadcast(&pool->changed);
+    pthread_mutex_unlock(&pool->lock);
+    join_workers(pool);
+}
+
+static void release_part(ParsePart* part) {
+    if (part->arena) {
+        stats_record_arena(part->arena);
+        arena_destroy(part->arena);
+        part->arena = NULL;
+    }
+    free(part->records);
+    part->records = NULL;
+    free(part->error);
+    part->error = NULL;
+}
+
+ParsePool* parallel_parse_array(InputMap* map, int jobs, ParserKind parser) {
+    ParsePool* pool = create_pool(map, jobs, parser, false, 0);
+    if (!pool) return NULL;
+
+    // Workers exit once every part is parsed, or after the first failure
+    join_workers(pool);
+
+    size_t total = 0;
+    ParseCounters counters = {0};
+    for (int i = 0; i < pool->part_count; i++) {
+        ParsePart* part = &pool->parts[i];
+        if (part->error) {
+            char message[ERROR_MESSAGE_SIZE];
+            snprintf(message, sizeof(message), "%s", part->error);
+            parallel_release(pool);
+            fatal_error("%s\n", message);
+        }
+        if (!part->done || part->failed) {
+            parallel_release(pool);
+            return NULL;
+        }
+        total += (size_t)part->elements->size;
+        counters.bytes += part->counters.bytes;
+        counters.tokens += part->counters.tokens;
+        for (int type = 0; type <= VALUE_ARRAY; type++) counters.values[type] += part->counters.values[type];
+        counters.pairs += part->counters.pairs;
+    }
+
+    // One array of all elements, in the main thread's arena
+    Array_Node* array = create_array_node(0);
+    array->elements = (Value_Node*)arena_alloc(ast_arena, total * sizeof(Value_Node));
+    array->size = (int)total;
+    array->capacity = (int)total;
+    size_t next = 0;
+    for (int i = 0; i < pool->part_count; i++) {
+        Array_Node* elements = pool->parts[i].elements;
+        memcpy(array->elements + next, elements->elements, elements->size * sizeof(Value_Node));
+        next += (size_t)elements->size;
+    }
+    ast_root = create_ast_node(NODE_ARRAY);
+    ast_root->array = array;
+
+    // Count as a serial parse would: every part added its own brackets and
+    // outer array, and the commas between parts were not scanned
+    int parts = pool->part_count;
+    size_t scanned = 0;
+    for (int i = 0; i < parts; i++) scanned += pool->parts[i].length;
+    counters.bytes = counters.bytes - 2 * (uint64_t)parts + (map->size - scanned);
+    counters.tokens = counters.tokens - (uint64_t)parts + 1;
+    counters.values[VALUE_ARRAY] = counters.values[VALUE_ARRAY] - (uint64_t)parts + 1;
+    stats_add_counters(&counters);
+    return pool;
+}
+
+ParsePool* parallel_records_start(InputMap* map, int jobs, ParserKind parser, size_t memory_limit) {
+    return create_pool(map, jobs, parser, true, memory_limit);
+}
+
+int parallel_next_record(ParsePool* pool) {
+    if (pool->serial) return parse_input();
+    while (pool->current < pool->part_count) {
+        ParsePart* part = &pool->parts[pool->current];
+        pthread_mutex_lock(&pool->lock);
+        while (!part->done) pthread_cond_wait(&pool->changed, &pool->lock);
+        pthread_mutex_unlock(&pool->lock);
+        if (part->error) {
+            stop_workers(pool);
+            fatal_error("%s\n", part->error); // The pool is released with the run
+        }
+        if (part->failed) {
+            // Parse from the failed part on serially, which reports the error.
+            // The workers must be done with the input first: the parser
+            // terminates strings in it.
+            stop_workers(pool);
+            pool->serial = true;
+            parse_map_from(pool->parser, pool->map, part->start);
+            return parse_input();
+        }
+        if (pool->next_record == 0) stats_add_counters(&part->counters);
+        if (pool->next_record < part->record_count) {
+            ast_root = part->records[pool->next_record++];
+            return 0;
+        }
+
+        // The part's last record has been converted
+        release_part(part);
+        pthread_mutex_lock(&pool->lock);
+        pool->current++;
+        pool->consumed = pool->current;
+        pool->next_record = 0;
+        pthread_cond_broadcast(&pool->changed);
+        pthread_mutex_unlock(&pool->lock);
+    }
+    ast_root = NULL;
+    return 0;
+}
+
+ParsePool* parallel_array_start(InputMap* map, int jobs, ParserKind parser, size_t memory_limit) {
+    return create_pool(map, jobs, parser, false, memory_limit);
+}
+
+int parallel_next_elements(ParsePool* pool, Array_Node** elements) {
+    *elements = NULL;
+    if (pool->serial) return 0; // The serial parse took the rest of the array
+    if (pool->next_record) {
+        // The consumer is done with the current part
+        release_part(&pool->parts[pool->current]);
+        pthread_mutex_lock(&pool->lock);
+        pool->current++;
+        pool->consumed = pool->current;
+        pool->next_record = 0;
+        pthread_cond_broadcast(&pool->changed);
+        pthread_mutex_unlock(&pool->lock);
+    }
+    if (pool->current == pool->part_count) return 0;
+
+    ParsePart* part = &pool->parts[pool->current];
+    pthread_mutex_lock(&pool->lock);
+    while (!part->done) pthread_cond_wait(&pool->changed, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+    if (part->error) {
+        stop_workers(pool);
+        fatal_error("%s\n", part->error); // The pool is released with the run
+    }
+    if (part->failed) {
+        // Parse the rest of the array serially, which reports the error. The
+        // byte before the part is the array's '[' or a comma after a valid
+        // element; as '[' it starts an array the parser sees exactly as the
+        // rest of the whole one, so errors keep their message and position.
+        stop_workers(pool);
+        pool->serial = true;
+        pool->map->data[part->start - 1] = '[';
+        parse_map_from(pool->parser, pool->map, part->start - 1);
+        int status = parse_input();
+        if (status == 0 && ast_root) *elements = ast_root->array;
+        ast_root = NULL;
+        return status;
+    }
+
+    // Count as a serial parse would, as parallel_parse_array() does: no
+    // brackets and outer array per part, but the bytes between the parts
+    ParseCounters counters = part->counters;
+    counters.bytes -= 2;
+    counters.tokens -= 1;
+    counters.values[VALUE_ARRAY] -= 1;
+    size_t end = pool->current + 1 < pool->part_count ? pool->parts[pool->current + 1].start : pool->map->size;
+    counters.bytes += end - (part->start + part->length);
+    if (pool->current == 0) {
+        counters.bytes += part->start;
+        counters.tokens += 1;
+        counters.values[VALUE_ARRAY] += 1;
+    }
+    stats_add_counters(&counters);
+    pool->next_record = 1;
+    *elements = part->elements;
+    return 0;
+}
+
+void parallel_release(ParsePool* pool) {
+    if (!pool) return;
+    if (pool->thread_count) stop_workers(pool);
+    for (int i = 0; i < pool->part_count; i++) {
+        release_part(&pool->parts[i]);
+    }
+    free(pool->parts);
+    free(pool->threads);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->changed);
+    free(pool);
+}
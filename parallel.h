@@ -0,0 +1,54 @@
+/**
+ * parallel.h - Parse a mapped input with --jobs threads
+ *
+ * A top-level array is cut at commas between its elements, and NDJSON at
+ * newlines between records, by one quick pass that only tracks strings and
+ * nesting. Each part is parsed by a worker thread into an arena of its own.
+ * The schema pass stays serial and sees the values in document order, so
+ * tables, columns and IDs are the same as with one thread.
+ *
+ * Workers report no errors in the input. If any part fails to parse, the
+ * input from that part on is parsed again serially, which reports the error
+ * exactly as without --jobs. Other errors of a worker, such as running out
+ * of memory, are raised with fatal_error() on the thread that takes the part.
+ */
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "ast.h"
+#include "input.h"
+#include "fast_parser.h"
+
+typedef struct ParsePool ParsePool;
+
+// Parse the top-level array in 'map' and set ast_root to it. Returns NULL,
+// with nothing parsed, if the input is too small to split or is not one
+// array, or if a part fails to parse; the caller then parses it itself.
+// The pool owns the elements' arenas: release it after the AST.
+ParsePool* parallel_parse_array(InputMap* map, int jobs, ParserKind parser);
+
+// --ndjson: start parsing the records of 'map' in the background, a few
+// parts ahead of the consumer. A 'memory_limit' (0 for none) makes the parts
+// small enough for it. Returns NULL if the input is too small to split.
+ParsePool* parallel_records_start(InputMap* map, int jobs, ParserKind parser, size_t memory_limit);
+
+// Like parse_input() with parse_records set: sets ast_root to the next record,
+// or to NULL at the end of the input. A record is valid until the next call.
+int parallel_next_record(ParsePool* pool);
+
+// --memory-limit: start parsing the top-level array in 'map' in parts small
+// enough for 'memory_limit', in the background and a few parts ahead of the
+// consumer. Returns NULL, with nothing parsed, if the input is not one array
+// or fits in one part.
+ParsePool* parallel_array_start(InputMap* map, int jobs, ParserKind parser, size_t memory_limit);
+
+// Set *elements to the elements of the next part of the array, or to NULL at
+// its end; they are valid until the next call. If a part fails to parse, the
+// rest of the array is parsed serially and its status returned.
+int parallel_next_elements(ParsePool* pool, Array_Node** elements);
+
+// Stop the workers and free every part, recording the arenas for --stats
+void parallel_release(ParsePool* pool);
+
+#endif /* PARALLEL_H */
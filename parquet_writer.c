@@ -0,0 +1,317 @@
+/**
+ * parquet_writer.c - Apache Parquet output for json2relcsv (--format parquet)
+ *
+ * Each table becomes one file with a single row group. A column chunk is a
+ * run of PLAIN-encoded data pages of up to PARQUET_PAGE_ROWS rows, each
+ * compressed with GZIP. Columns without nulls are REQUIRED; the others are
+ * OPTIONAL and their pages start with bit-packed definition levels. Page
+ * headers and the footer are Thrift compact protocol, encoded by hand.
+ */
+
+#include "columnar.h"
+#include "error.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#define PARQUET_MAGIC "PAR1"
+#define PARQUET_PAGE_ROWS 65536
+#define PARQUET_GZIP_LEVEL 6
+#define PARQUET_CREATED_BY "json2relcsv"
+
+// Enum values from parquet.thrift
+enum { PARQUET_BOOLEAN = 0, PARQUET_INT64 = 2, PARQUET_DOUBLE = 5, PARQUET_BYTE_ARRAY = 6 };
+enum { REPETITION_REQUIRED = 0, REPETITION_OPTIONAL = 1 };
+enum { ENCODING_PLAIN = 0, ENCODING_RLE = 3 };
+enum { CONVERTED_UTF8 = 0 };
+enum { CODEC_GZIP = 2 };
+enum { PAGE_DATA = 0 };
+
+// Field types of the Thrift compact protocol
+enum { THRIFT_I32 = 5, THRIFT_I64 = 6, THRIFT_BINARY = 8, THRIFT_LIST = 9, THRIFT_STRUCT = 12 };
+
+#define THRIFT_MAX_DEPTH 8
+
+typedef struct ThriftWriter {
+    ByteBuffer* out;
+    int last_field[THRIFT_MAX_DEPTH]; // Last field id of each open struct
+    int depth;                        // -1 before the root struct
+} ThriftWriter;
+
+typedef struct ColumnChunkInfo {
+    int64_t offset;                   // File offset of the first page header
+    int64_t uncompressed_size;        // Headers included
+    int64_t compressed_size;
+} ColumnChunkInfo;
+
+static void put_varint(ByteBuffer* out, uint64_t value) {
+    while (value >= 0x80) {
+        buffer_put_u8(out, (uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    buffer_put_u8(out, (uint8_t)value);
+}
+
+static uint64_t zigzag(int64_t value) {
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+// Field ids are delta-encoded against the previous field of the same struct
+static void thrift_field(ThriftWriter* thrift, int id, int type) {
+    int delta = id - thrift->last_field[thrift->depth];
+    if (delta > 0 && delta <= 15) {
+        buffer_put_u8(thrift->out, (uint8_t)(delta << 4 | type));
+    } else {
+        buffer_put_u8(thrift->out, (uint8_t)type);
+        put_varint(thrift->out, zigzag(id));
+    }
+    thrift->last_field[thrift->depth] = id;
+}
+
+static void thrift_i32(ThriftWriter* thrift, int id, int32_t value) {
+    thrift_field(thrift, id, THRIFT_I32);
+    put_varint(thrift->out, zigzag(value));
+}
+
+static void thrift_i64(ThriftWriter* thrift, int id, int64_t value) {
+    thrift_field(thrift, id, THRIFT_I64);
+    put_varint(thrift->out, zigzag(value));
+}
+
+// A string field, or a list element when 'id' is 0
+static void thrift_string(ThriftWriter* thrift, int id, const char* text) {
+    size_t length = strlen(text);
+    if (id > 0) thrift_field(thrift, id, THRIFT_BINARY);
+    put_varint(thrift->out, length);
+    buffer_put(thrift->out, text, length);
+}
+
+static void thrift_list(ThriftWriter* thrift, int id, int element_type, int size) {
+    thrift_field(thrift, id, THRIFT_LIST);
+    if (size < 15) {
+        buffer_put_u8(thrift->out, (uint8_t)(size << 4 | element_type));
+    } else {
+        buffer_put_u8(thrift->out, (uint8_t)(0xF0 | element_type));
+        put_varint(thrift->out, (uint64_t)size);
+    }
+}
+
+// A struct field, or the root struct or a list element when 'id' is 0
+static void thrift_struct_begin(ThriftWriter* thrift, int id) {
+    if (id > 0) thrift_field(thrift, id, THRIFT_STRUCT);
+    if (++thrift->depth == THRIFT_MAX_DEPTH) {
+        fatal_error("Error: Parquet metadata nested too deeply\n");
+    }
+    thrift->last_field[thrift->depth] = 0;
+}
+
+static void thrift_struct_end(ThriftWriter* thrift) {
+    buffer_put_u8(thrift->out, 0); // Stop field
+    thrift->depth--;
+}
+
+static int parquet_type(ColumnKind kind) {
+    switch (kind) {
+        case COLUMN_INT64: return PARQUET_INT64;
+        case COLUMN_DOUBLE: return PARQUET_DOUBLE;
+        case COLUMN_BOOL: return PARQUET_BOOLEAN;
+        default: return PARQUET_BYTE_ARRAY;
+    }
+}
+
+// Definition levels (1 = present) as a single bit-packed run, behind the
+// 4-byte length prefix of data page v1
+static void encode_definition_levels(const TableSchema* table, const TableColumn* column,
+                                     int first, int count, ByteBuffer* page) {
+    size_t length_position = page->length;
+    buffer_put_u32(page, 0);
+    int groups = (count + 7) / 8;
+    put_varint(page, (uint64_t)groups << 1 | 1);
+    buffer_put_zeros(page, groups);
+    uint8_t* bits = page->data + page->length - groups;
+    for (int i = 0; i < count; i++) {
+        if (!cell_is_null(table_cell(table, column, first + i))) bits[i / 8] |= (uint8_t)(1 << (i % 8));
+    }
+    buffer_set_u32(page, length_position, (uint32_t)(page->length - length_position - 4));
+}
+
+// Uncompressed body of one data page: levels, then the non-null values
+static void encode_page(const TableSchema* table, const TableColumn* column,
+                        int first, int count, ByteBuffer* page) {
+    page->length = 0;
+    if (column->null_count > 0) encode_definition_levels(table, column, first, count, page);
+
+    size_t bool_start = page->length;
+    int bool_count = 0;
+    char scratch[NUMBER_FORMAT_MAX + 1];
+    for (int i = 0; i < count; i++) {
+        Value_Node value = table_cell(table, column, first + i);
+        if (cell_is_null(value)) continue;
+        switch (column->kind) {
+            case COLUMN_INT64:
+                buffer_put_u64(page, (uint64_t)cell_int64(value));
+                break;
+            case COLUMN_DOUBLE:
+                buffer_put_double(page, cell_double(value));
+                break;
+            case COLUMN_BOOL: // Bit-packed, least significant bit first
+                if (bool_count % 8 == 0) buffer_put_u8(page, 0);
+                if (value.boolean_val) page->data[bool_start + bool_count / 8] |= (uint8_t)(1 << (bool_count % 8));
+                bool_count++;
+                break;
+            case COLUMN_UTF8: {
+                const char* text;
+                size_t length = cell_text(value, scratch, &text);
+                buffer_put_u32(page, (uint32_t)length);
+                buffer_put(page, text, length);
+                break;
+            }
+        }
+    }
+}
+
+static void gzip_page(const ByteBuffer* page, ByteBuffer* compressed, const char* table_name) {
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    // windowBits 15 + 16 selects the gzip wrapper the GZIP codec expects
+    if (deflateInit2(&stream, PARQUET_GZIP_LEVEL, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        fatal_error("Error: Failed to initialize compression for table '%s'\n", table_name);
+    }
+    compressed->length = 0;
+    buffer_reserve(compressed, deflateBound(&stream, page->length));
+    stream.next_in = page->data;
+    stream.avail_in = (uInt)page->length;
+    stream.next_out = compressed->data;
+    stream.avail_out = (uInt)compressed->capacity;
+    if (deflate(&stream, Z_FINISH) != Z_STREAM_END) {
+        fatal_error("Error: Failed to compress a page of table '%s'\n", table_name);
+    }
+    compressed->length = stream.total_out;
+    deflateEnd(&stream);
+}
+
+static int64_t file_offset(const CsvWriter* writer) {
+    return (int64_t)(writer->bytes_written + writer->length);
+}
+
+static void write_column_chunk(CsvWriter* writer, const TableSchema* table, const TableColumn* column,
+                               ColumnChunkInfo* info, ByteBuffer* page, ByteBuffer* compressed,
+                               ByteBuffer* header) {
+    int rows = table_rows(table);
+    info->offset = file_offset(writer);
+    info->uncompressed_size = 0;
+    info->compressed_size = 0;
+
+    for (int first = 0; first < rows; first += PARQUET_PAGE_ROWS) {
+        int count = rows - first < PARQUET_PAGE_ROWS ? rows - first : PARQUET_PAGE_ROWS;
+        encode_page(table, column, first, count, page);
+        gzip_page(page, compressed, table->name);
+
+        header->length = 0;
+        ThriftWriter thrift = {header, {0}, -1};
+        thrift_struct_begin(&thrift, 0); // PageHeader
+        thrift_i32(&thrift, 1, PAGE_DATA);
+        thrift_i32(&thrift, 2, (int32_t)page->length);
+        thrift_i32(&thrift, 3, (int32_t)compressed->length);
+        thrift_struct_begin(&thrift, 5); // DataPageHeader
+        thrift_i32(&thrift, 1, count);
+        thrift_i32(&thrift, 2, ENCODING_PLAIN);
+        thrift_i32(&thrift, 3, ENCODING_RLE);
+        thrift_i32(&thrift, 4, ENCODING_RLE);
+        thrift_struct_end(&thrift);
+        thrift_struct_end(&thrift);
+
+        csv_put_bytes(writer, (const char*)header->data, header->length);
+        csv_put_bytes(writer, (const char*)compressed->data, compressed->length);
+        info->uncompressed_size += (int64_t)(header->length + page->length);
+        info->compressed_size += (int64_t)(header->length + compressed->length);
+    }
+}
+
+static void encode_file_metadata(const TableSchema* table, const TableColumn* columns, int column_count,
+                                 const ColumnChunkInfo* chunks, ByteBuffer* out) {
+    int rows = table_rows(table);
+    ThriftWriter thrift = {out, {0}, -1};
+    thrift_struct_begin(&thrift, 0); // FileMetaData
+    thrift_i32(&thrift, 1, 1);
+
+    // Flat schema: the root element, then one leaf per column
+    thrift_list(&thrift, 2, THRIFT_STRUCT, column_count + 1);
+    thrift_struct_begin(&thrift, 0);
+    thrift_string(&thrift, 4, "schema");
+    thrift_i32(&thrift, 5, column_count);
+    thrift_struct_end(&thrift);
+    for (int i = 0; i < column_count; i++) {
+        thrift_struct_begin(&thrift, 0);
+        thrift_i32(&thrift, 1, parquet_type(columns[i].kind));
+        thrift_i32(&thrift, 3, columns[i].null_count > 0 ? REPETITION_OPTIONAL : REPETITION_REQUIRED);
+        thrift_string(&thrift, 4, columns[i].name);
+        if (columns[i].kind == COLUMN_UTF8) thrift_i32(&thrift, 6, CONVERTED_UTF8);
+        thrift_struct_end(&thrift);
+    }
+    thrift_i64(&thrift, 3, rows);
+
+    thrift_list(&thrift, 4, THRIFT_STRUCT, rows > 0 ? 1 : 0);
+    if (rows > 0) {
+        int64_t total_size = 0;
+        thrift_struct_begin(&thrift, 0); // RowGroup
+        thrift_list(&thrift, 1, THRIFT_STRUCT, column_count);
+        for (int i = 0; i < column_count; i++) {
+            thrift_struct_begin(&thrift, 0); // ColumnChunk
+            thrift_i64(&thrift, 2, chunks[i].offset);
+            thrift_struct_begin(&thrift, 3); // ColumnMetaData
+            thrift_i32(&thrift, 1, parquet_type(columns[i].kind));
+            thrift_list(&thrift, 2, THRIFT_I32, 2);
+            put_varint(out, zigzag(ENCODING_PLAIN));
+            put_varint(out, zigzag(ENCODING_RLE));
+            thrift_list(&thrift, 3, THRIFT_BINARY, 1);
+            thrift_string(&thrift, 0, columns[i].name);
+            thrift_i32(&thrift, 4, CODEC_GZIP);
+            thrift_i64(&thrift, 5, rows);
+            thrift_i64(&thrift, 6, chunks[i].uncompressed_size);
+            thrift_i64(&thrift, 7, chunks[i].compressed_size);
+            thrift_i64(&thrift, 9, chunks[i].offset);
+            thrift_struct_end(&thrift);
+            thrift_struct_end(&thrift);
+            total_size += chunks[i].uncompressed_size;
+        }
+        thrift_i64(&thrift, 2, total_size);
+        thrift_i64(&thrift, 3, rows);
+        thrift_struct_end(&thrift);
+    }
+    thrift_string(&thrift, 6, PARQUET_CREATED_BY);
+    thrift_struct_end(&thrift);
+}
+
+void write_parquet_table(TableSchema* table, const OutputOptions* options) {
+    // Opened first: a file that cannot be opened fails before anything is allocated
+    CsvWriter* writer = csv_writer_open_file(options, table->name, ".parquet");
+    int column_count;
+    TableColumn* columns = table_columns(table, &column_count);
+    ColumnChunkInfo* chunks = (ColumnChunkInfo*)calloc(column_count, sizeof(ColumnChunkInfo));
+    if (!chunks) {
+        fatal_error("Error: Memory allocation failed for column chunks of table '%s'\n", table->name);
+    }
+
+    ByteBuffer page = {0}, compressed = {0}, header = {0};
+    csv_put_bytes(writer, PARQUET_MAGIC, 4);
+    for (int i = 0; i < column_count; i++) {
+        write_column_chunk(writer, table, &columns[i], &chunks[i], &page, &compressed, &header);
+    }
+
+    ByteBuffer footer = {0};
+    encode_file_metadata(table, columns, column_count, chunks, &footer);
+    buffer_put_u32(&footer, (uint32_t)footer.length);
+    buffer_put(&footer, PARQUET_MAGIC, 4);
+    csv_put_bytes(writer, (const char*)footer.data, footer.length);
+
+    writer->rows = (uint64_t)table_rows(table);
+    csv_writer_close(writer);
+    buffer_free(&page);
+    buffer_free(&compressed);
+    buffer_free(&header);
+    buffer_free(&footer);
+    free(chunks);
+    free_table_columns(columns, column_count);
+}
@@ -0,0 +1,305 @@
+/**
+ * pgcopy_writer.c - PostgreSQL binary COPY output for json2relcsv (--format pgcopy)
+ *
+ * Each table becomes <table>.pgcopy, for COPY ... FROM ... WITH (FORMAT
+ * binary): the signature, flags and header extension, one tuple per row (a
+ * field count, then each field as its length and big-endian bytes, or -1
+ * for null) and the -1 trailer. Columns are typed as in columnar.h: bigint
+ * (int8), double precision (float8), boolean and text. schema.sql creates
+ * the tables with those types, in the order they are to be loaded.
+ *
+ * With OutputOptions.to_stdout everything goes to stdout instead, one
+ * table after the other, framed by text lines like a schema file's:
+ *     json2relcsv-pgcopy 1
+ *     sql<TAB>BYTES          then the BYTES of schema.sql
+ *     copy<TAB>NAME<TAB>BYTES then BYTES more of table NAME's COPY data
+ *     end
+ * A table's copy frames follow each other; their bytes, joined, are its
+ * .pgcopy file. Names are escaped as in schema files (schema_file.h).
+ */
+
+#include "columnar.h"
+#include "stats.h"
+#include "error.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#define PGCOPY_SIGNATURE "PGCOPY\n\377\r\n" // Followed by a NUL, 11 bytes in all
+#define PGCOPY_FRAME_BYTES (1 << 20)        // Rows are encoded and written this much at a time
+#define PGCOPY_STREAM_HEADER "json2relcsv-pgcopy 1"
+#define PGCOPY_DDL_FILE "schema.sql"
+
+// Network byte order stores
+static void put_be16(ByteBuffer* out, uint16_t value) {
+    buffer_reserve(out, 2);
+    for (int i = 1; i >= 0; i--) out->data[out->length++] = (uint8_t)(value >> (8 * i));
+}
+
+static void put_be32(ByteBuffer* out, uint32_t value) {
+    buffer_reserve(out, 4);
+    for (int i = 3; i >= 0; i--) out->data[out->length++] = (uint8_t)(value >> (8 * i));
+}
+
+static void put_be64(ByteBuffer* out, uint64_t value) {
+    buffer_reserve(out, 8);
+    for (int i = 7; i >= 0; i--) out->data[out->length++] = (uint8_t)(value >> (8 * i));
+}
+
+static void put_string(ByteBuffer* out, const char* text) {
+    buffer_put(out, text, strlen(text));
+}
+
+// A name with tab, CR, LF and backslash escaped, for the stream's frame lines
+static void put_frame_name(ByteBuffer* out, const char* name) {
+    for (const char* p = name; *p; p++) {
+        switch (*p) {
+            case '\\': put_string(out, "\\\\"); break;
+            case '\t': put_string(out, "\\t"); break;
+            case '\r': put_string(out, "\\r"); break;
+            case '\n': put_string(out, "\\n"); break;
+            default: buffer_put_u8(out, (uint8_t)*p); break;
+        }
+    }
+}
+
+// Write 'data' as one frame of the stdout stream: a "sql" frame without a
+// table name, a "copy" frame of 'table_name' with one
+static void write_frame(CsvWriter* writer, const char* table_name, const ByteBuffer* data) {
+    ByteBuffer line = {0};
+    put_string(&line, table_name ? "copy\t" : "sql\t");
+    if (table_name) {
+        put_frame_name(&line, table_name);
+        buffer_put_u8(&line, '\t');
+    }
+    char length[32];
+    snprintf(length, sizeof(length), "%zu\n", data->length);
+    put_string(&line, length);
+    csv_put_bytes(writer, (const char*)line.data, line.length);
+    csv_put_bytes(writer, (const char*)data->data, data->length);
+    buffer_free(&line);
+}
+
+static const char* pg_type(ColumnKind kind) {
+    switch (kind) {
+        case COLUMN_INT64: return "bigint";
+        case COLUMN_DOUBLE: return "double precision";
+        case COLUMN_BOOL: return "boolean";
+        default: return "text";
+    }
+}
+
+// A quoted identifier, so any table or column name is taken as it is
+static void put_identifier(ByteBuffer* out, const char* name) {
+    buffer_put_u8(out, '"');
+    for (const char* p = name; *p; p++) {
+        if (*p == '"') buffer_put_u8(out, '"');
+        buffer_put_u8(out, (uint8_t)*p);
+    }
+    buffer_put_u8(out, '"');
+}
+
+static int compare_ids(const void* a, const void* b) {
+    int x = *(const int*)a, y = *(const int*)b;
+    return (x > y) - (x < y);
+}
+
+// Whether every FK value of 'table' is an id of 'parent'. Not always so:
+// tables are named by path, so "a_b" holds both the array "a_b" of the
+// root and the array "b" of the objects of "a".
+static bool fk_values_in(const TableSchema* table, const TableSchema* parent) {
+    int count = table->is_junction ? table->junction.count : table->rows.count;
+    const int* fks = table->is_junction ? table->junction.owner_ids : table->rows.parent_ids;
+    int* ids = (int*)malloc((parent->rows.count ? parent->rows.count : 1) * sizeof(int));
+    if (!ids) {
+        fatal_error("Error: Memory allocation failed for ids of table '%s'\n", parent->name);
+    }
+    if (parent->rows.count > 0) memcpy(ids, parent->rows.ids, parent->rows.count * sizeof(int));
+    qsort(ids, parent->rows.count, sizeof(int), compare_ids);
+    bool found = true;
+    for (int row = 0; row < count && found; row++) {
+        found = bsearch(&fks[row], ids, parent->rows.count, sizeof(int), compare_ids) != NULL;
+    }
+    free(ids);
+    return found;
+}
+
+// The table the FK column of 'table' ("<parent>_id") references, if it is
+// written before 'table' and has the id of every row's parent; NULL otherwise
+static const TableSchema* fk_parent(const Schema* schema, int index) {
+    const TableSchema* table = &schema->tables[index];
+    const char* fk = table->is_junction ? table->columns[0] : table->has_parent_fk ? table->columns[1] : NULL;
+    if (!fk) return NULL;
+    size_t length = strlen(fk) - 3; // Without "_id"
+    for (int i = 0; i < index; i++) {
+        const TableSchema* parent = &schema->tables[i];
+        if (!parent->omitted && !parent->is_junction && strlen(parent->name) == length &&
+            strncmp(parent->name, fk, length) == 0) {
+            return fk_values_in(table, parent) ? parent : NULL;
+        }
+    }
+    return NULL;
+}
+
+// CREATE TABLE statements for the written tables, parents before the
+// tables that reference them. Junction tables get no key: an object with a
+// repeated key adds each array's items from index 0 again.
+static void encode_ddl(const Schema* schema, ByteBuffer* out) {
+    put_string(out, "-- Tables of a json2relcsv run; load the .pgcopy files in this order\n");
+    for (int i = 0; i < schema->table_count; i++) {
+        const TableSchema* table = &schema->tables[i];
+        if (table->omitted) continue;
+        int column_count;
+        TableColumn* columns = table_columns(table, &column_count);
+        const TableSchema* parent = fk_parent(schema, i);
+
+        put_string(out, "\nCREATE TABLE ");
+        put_identifier(out, table->name);
+        put_string(out, " (\n");
+        for (int j = 0; j < column_count; j++) {
+            const TableColumn* column = &columns[j];
+            put_string(out, "    ");
+            put_identifier(out, column->name);
+            buffer_put_u8(out, ' ');
+            put_string(out, pg_type(column->kind));
+            if (column->source == SOURCE_ID) put_string(out, " PRIMARY KEY");
+            if (parent && (column->source == SOURCE_PARENT_ID || column->source == SOURCE_JUNCTION_OWNER)) {
+                put_string(out, " REFERENCES ");
+                put_identifier(out, parent->name);
+                put_string(out, " (\"id\")");
+            }
+            if (j + 1 < column_count) buffer_put_u8(out, ',');
+            buffer_put_u8(out, '\n');
+        }
+        put_string(out, ");\n");
+        free_table_columns(columns, column_count);
+    }
+}
+
+void write_pgcopy_ddl(const Schema* schema, const OutputOptions* options) {
+    const char* out_dir = options->out_dir;
+    size_t path_size = sizeof("/" PGCOPY_DDL_FILE) + (out_dir ? strlen(out_dir) : 0);
+    char* path = (char*)malloc(path_size);
+    if (!path) {
+        fatal_error("Error: Memory allocation failed for the DDL file name\n");
+    }
+    snprintf(path, path_size, "%s%s" PGCOPY_DDL_FILE, out_dir && out_dir[0] ? out_dir : "",
+             out_dir && out_dir[0] ? "/" : "");
+
+    ByteBuffer ddl = {0};
+    encode_ddl(schema, &ddl);
+    FILE* out = fopen(path, "w");
+    if (!out) {
+        buffer_free(&ddl);
+        fatal_error("Error: Failed to open DDL file '%s': %s\n", path, strerror(errno));
+    }
+    bool failed = fwrite(ddl.data, 1, ddl.length, out) != ddl.length;
+    failed = fclose(out) != 0 || failed;
+    buffer_free(&ddl);
+    if (failed) {
+        fatal_error("Error: Failed to write DDL file '%s': %s\n", path, strerror(errno));
+    }
+    free(path);
+}
+
+// One field of a tuple; 'value' is not null
+static void encode_field(ByteBuffer* out, ColumnKind kind, Value_Node value) {
+    switch (kind) {
+        case COLUMN_INT64:
+            put_be32(out, 8);
+            put_be64(out, (uint64_t)cell_int64(value));
+            return;
+        case COLUMN_DOUBLE: {
+            double number = cell_double(value);
+            uint64_t bits;
+            memcpy(&bits, &number, sizeof(bits));
+            put_be32(out, 8);
+            put_be64(out, bits);
+            return;
+        }
+        case COLUMN_BOOL:
+            put_be32(out, 1);
+            buffer_put_u8(out, value.boolean_val ? 1 : 0);
+            return;
+        case COLUMN_UTF8: {
+            char scratch[NUMBER_FORMAT_MAX + 1];
+            const char* text;
+            size_t length = cell_text(value, scratch, &text);
+            put_be32(out, (uint32_t)length);
+            buffer_put(out, text, length);
+            return;
+        }
+    }
+}
+
+// Hand the encoded bytes to the table's file, or to stdout as a frame
+static void flush_copy_data(CsvWriter* writer, const TableSchema* table, bool framed, ByteBuffer* data) {
+    if (framed) {
+        write_frame(writer, table->name, data);
+    } else {
+        csv_put_bytes(writer, (const char*)data->data, data->length);
+    }
+    data->length = 0;
+}
+
+// The COPY data of 'table'; returns the number of bytes written
+static uint64_t write_copy_data(CsvWriter* writer, const TableSchema* table, bool framed) {
+    int column_count;
+    TableColumn* columns = table_columns(table, &column_count);
+    int rows = table_rows(table);
+    uint64_t bytes = 0;
+
+    ByteBuffer data = {0};
+    buffer_put(&data, PGCOPY_SIGNATURE, 11);
+    put_be32(&data, 0); // Flags: no OIDs
+    put_be32(&data, 0); // No header extension
+    for (int row = 0; row < rows; row++) {
+        put_be16(&data, (uint16_t)column_count);
+        for (int i = 0; i < column_count; i++) {
+            Value_Node value = table_cell(table, &columns[i], row);
+            if (cell_is_null(value)) {
+                put_be32(&data, 0xFFFFFFFFu);
+            } else {
+                encode_field(&data, columns[i].kind, value);
+            }
+        }
+        if (data.length >= PGCOPY_FRAME_BYTES) {
+            bytes += data.length;
+            flush_copy_data(writer, table, framed, &data);
+        }
+    }
+    put_be16(&data, 0xFFFF); // Trailer
+    bytes += data.length;
+    flush_copy_data(writer, table, framed, &data);
+
+    buffer_free(&data);
+    free_table_columns(columns, column_count);
+    return bytes;
+}
+
+void write_pgcopy_table(TableSchema* table, const OutputOptions* options) {
+    CsvWriter* writer = csv_writer_open_file(options, table->name, ".pgcopy");
+    write_copy_data(writer, table, false);
+    writer->rows = (uint64_t)table_rows(table);
+    csv_writer_close(writer);
+}
+
+void write_pgcopy_stream(Schema* schema, const OutputOptions* options) {
+    CsvWriter* writer = csv_writer_open_stdout(options);
+    csv_put_bytes(writer, PGCOPY_STREAM_HEADER "\n", sizeof(PGCOPY_STREAM_HEADER));
+
+    ByteBuffer ddl = {0};
+    encode_ddl(schema, &ddl);
+    write_frame(writer, NULL, &ddl);
+    buffer_free(&ddl);
+
+    for (int i = 0; i < schema->table_count; i++) {
+        TableSchema* table = &schema->tables[i];
+        if (table->omitted) continue;
+        uint64_t bytes = write_copy_data(writer, table, true);
+        stats_record_table(table->name, (uint64_t)table_rows(table), bytes);
+    }
+    csv_put_bytes(writer, "end\n", 4);
+    csv_writer_close(writer);
+}
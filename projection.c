@@ -0,0 +1,214 @@
+/**
+ * projection.c - Selected tables and columns (--tables, --exclude-tables, --columns)
+ */
+
+#include "projection.h"
+#include "name_index.h"
+#include "error.h"
+#include <stdlib.h>
+#include <string.h>
+
+// A growable list of owned names
+typedef struct NameList {
+    char** names;
+    int count;
+    int capacity;
+} NameList;
+
+// The --columns selection of one table
+typedef struct ColumnSelection {
+    char* table;
+    NameList columns;
+    NameIndex index;   // Column name -> position in 'columns'
+} ColumnSelection;
+
+struct Projection {
+    NameList tables;   // --tables; empty for every table
+    NameList excluded; // --exclude-tables
+    ColumnSelection* selections;
+    int selection_count;
+    int selection_capacity;
+};
+
+Projection* create_projection(void) {
+    Projection* projection = (Projection*)calloc(1, sizeof(Projection));
+    if (!projection) {
+        fatal_error("Error: Memory allocation failed for table selection\n");
+    }
+    return projection;
+}
+
+static void free_name_list(NameList* list) {
+    for (int i = 0; i < list->count; i++) free(list->names[i]);
+    free(list->names);
+}
+
+void free_projection(Projection* projection) {
+    if (!projection) return;
+    free_name_list(&projection->tables);
+    free_name_list(&projection->excluded);
+    for (int i = 0; i < projection->selection_count; i++) {
+        free(projection->selections[i].table);
+        free_name_list(&projection->selections[i].columns);
+        name_index_free(&projection->selections[i].index);
+    }
+    free(projection->selections);
+    free(projection);
+}
+
+// Append a copy of text[0..length); returns its position
+static int add_name(NameList* list, const char* text, size_t length) {
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 8;
+        char** grown = (char**)realloc(list->names, list->capacity * sizeof(char*));
+        if (!grown) {
+            fatal_error("Error: Memory reallocation failed for table selection\n");
+        }
+        list->names = grown;
+    }
+    char* name = (char*)malloc(length + 1);
+    if (!name) {
+        fatal_error("Error: Memory allocation failed for table selection\n");
+    }
+    memcpy(name, text, length);
+    name[length] = '\0';
+    list->names[list->count] = name;
+    return list->count++;
+}
+
+// Add each non-empty name of a comma-separated list; returns how many there were
+static int add_name_list(NameList* list, const char* text) {
+    int added = 0;
+    while (*text) {
+        const char* comma = strchr(text, ',');
+        size_t length = comma ? (size_t)(comma - text) : strlen(text);
+        if (length > 0) {
+            add_name(list, text, length);
+            added++;
+        }
+        text += length + (comma ? 1 : 0);
+    }
+    return added;
+}
+
+bool projection_add_tables(Projection* projection, const char* list) {
+    return add_name_list(&projection->tables, list) > 0;
+}
+
+bool projection_exclude_tables(Projection* projection, const char* list) {
+    return add_name_list(&projection->excluded, list) > 0;
+}
+
+static ColumnSelection* find_selection(const Projection* projection, const char* table) {
+    for (int i = 0; projection && i < projection->selection_count; i++) {
+        if (strcmp(projection->selections[i].table, table) == 0) return &projection->selections[i];
+    }
+    return NULL;
+}
+
+bool projection_add_columns(Projection* projection, const char* spec) {
+    const char* colon = strchr(spec, ':');
+    if (!colon || colon == spec) return false;
+
+    size_t table_length = (size_t)(colon - spec);
+    char* table = (char*)malloc(table_length + 1);
+    if (!table) {
+        fatal_error("Error: Memory allocation failed for column selection\n");
+    }
+    memcpy(table, spec, table_length);
+    table[table_length] = '\0';
+
+    ColumnSelection* selection = find_selection(projection, table);
+    if (selection) {
+        free(table);
+    } else {
+        if (projection->selection_count == projection->selection_capacity) {
+            projection->selection_capacity = projection->selection_capacity ? projection->selection_capacity * 2 : 4;
+            ColumnSelection* grown = (ColumnSelection*)realloc(projection->selections,
+                                                               projection->selection_capacity * sizeof(ColumnSelection));
+            if (!grown) {
+                fatal_error("Error: Memory reallocation failed for column selection\n");
+            }
+            projection->selections = grown;
+        }
+        selection = &projection->selections[projection->selection_count++];
+        memset(selection, 0, sizeof(ColumnSelection));
+        selection->table = table;
+        name_index_init(&selection->index);
+    }
+
+    int first = selection->columns.count;
+    int added = add_name_list(&selection->columns, colon + 1);
+    for (int i = first; i < selection->columns.count; i++) {
+        const char* column = selection->columns.names[i];
+        name_index_put(&selection->index, column, hash_name(column), i);
+    }
+    return added > 0;
+}
+
+// Whether 'name' is 'table' itself or a table nested in it
+static bool within(const char* name, const char* table) {
+    if (strcmp(table, "root") == 0) return true;
+    size_t length = strlen(table);
+    return strncmp(name, table, length) == 0 && (name[length] == '\0' || name[length] == '_');
+}
+
+static bool excluded(const Projection* projection, const char* table) {
+    for (int i = 0; i < projection->excluded.count; i++) {
+        if (within(table, projection->excluded.names[i])) return true;
+    }
+    return false;
+}
+
+bool projection_keeps_table(const Projection* projection, const char* table) {
+    if (!projection) return true;
+    if (excluded(projection, table)) return false;
+    if (projection->tables.count == 0) return true;
+    for (int i = 0; i < projection->tables.count; i++) {
+        if (strcmp(projection->tables.names[i], table) == 0) return true;
+    }
+    return false;
+}
+
+bool projection_feeds(const Projection* projection, const char* table) {
+    if (!projection) return true;
+    if (excluded(projection, table)) return false;
+    if (projection->tables.count == 0) return true;
+    for (int i = 0; i < projection->tables.count; i++) {
+        const char* selected = projection->tables.names[i];
+        if (within(selected, table) && !excluded(projection, selected)) return true;
+    }
+    return false;
+}
+
+bool projection_keeps_column(const Projection* projection, const char* table, const char* column) {
+    if (!projection_keeps_table(projection, table)) return false;
+    const ColumnSelection* selection = find_selection(projection, table);
+    return !selection || name_index_get(&selection->index, column, hash_name(column)) >= 0;
+}
+
+bool projection_keeps_all_columns(const Projection* projection, const char* table) {
+    return projection_keeps_table(projection, table) && !find_selection(projection, table);
+}
+
+void project_table_layout(const Projection* projection, TableSchema* table) {
+    if (!projection) return;
+    table->omitted = !projection_keeps_table(projection, table->name);
+    if (table->is_junction) return;
+
+    // Data columns follow the id and FK columns
+    int first_data = table->has_parent_fk ? 2 : 1;
+    int kept = first_data;
+    for (int i = first_data; i < table->column_count; i++) {
+        if (!table->omitted && projection_keeps_column(projection, table->name, table->columns[i])) {
+            table->columns[kept++] = table->columns[i];
+        } else {
+            free(table->columns[i]);
+        }
+    }
+    if (kept == table->column_count) return;
+    table->column_count = kept;
+    name_index_free(&table->column_index);
+    free(table->column_slots);
+    build_column_map(table);
+}
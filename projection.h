@@ -0,0 +1,57 @@
+/**
+ * projection.h - Selected tables and columns (--tables, --exclude-tables, --columns)
+ *
+ * A projection names the tables and columns a conversion writes. Tables are
+ * named as in the output (see get_table_name_for_array()), so the tables
+ * nested in a table T are those whose names start with "T_", or every table
+ * for "root", whose children carry no prefix.
+ *   - With a --tables list only the listed tables are written; without one,
+ *     every table.
+ *   - An --exclude-tables entry drops that table and the tables nested in it.
+ *   - A --columns TABLE:COLUMN,... selection limits the object table TABLE
+ *     to its id and FK columns plus the listed ones, in the order the data
+ *     gives them. Junction tables always have their three columns.
+ * A table "feeds" the selection if it is written or one of the tables nested
+ * in it is. A subtree that feeds nothing is skipped by the parser
+ * (fast_parser.h) and by schema generation, so it gets no tables or rows,
+ * but its objects use up the IDs they would have had, and IDs match a run
+ * without the projection. --dedup skips nothing. A table that only feeds is walked for the IDs and names of its nested
+ * tables, with no data columns, and is not written.
+ *
+ * All functions take NULL as the projection that keeps everything.
+ */
+
+#ifndef PROJECTION_H
+#define PROJECTION_H
+
+#include <stdbool.h>
+#include "ast.h"
+
+typedef struct Projection Projection;
+
+Projection* create_projection(void);
+void free_projection(Projection* projection);
+
+// Add the comma-separated table names of a --tables or --exclude-tables
+// argument; false if it names no table
+bool projection_add_tables(Projection* projection, const char* list);
+bool projection_exclude_tables(Projection* projection, const char* list);
+// Add a --columns "TABLE:COLUMN[,COLUMN...]" argument; selections of one
+// table add up. False if it has no table or no column.
+bool projection_add_columns(Projection* projection, const char* spec);
+
+// Whether 'table' is written
+bool projection_keeps_table(const Projection* projection, const char* table);
+// Whether 'table' or a table nested in it is written
+bool projection_feeds(const Projection* projection, const char* table);
+// Whether the data column 'column' of 'table' is written
+bool projection_keeps_column(const Projection* projection, const char* table, const char* column);
+// Whether 'table' is written with all of its data columns
+bool projection_keeps_all_columns(const Projection* projection, const char* table);
+
+// Apply the projection to a loaded layout (schema_file.h): drop the data
+// columns it does not keep, or all of them and set 'omitted' if the table is
+// not written, and rebuild the column map
+void project_table_layout(const Projection* projection, TableSchema* table);
+
+#endif /* PROJECTION_H */
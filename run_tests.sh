@@ -94,4 +94,455 @@ for i in {1..5}; do
     echo ""
 done
 
+# Differential tests: the hand-written parser must match the flex/bison one
+echo "Comparing --parser fast with --parser bison..."
+
+for i in {1..5}; do
+    echo -n "Test $i: "
+    rm -rf "test_out/fast$i" "test_out/bison$i"
+    mkdir -p "test_out/fast$i" "test_out/bison$i"
+    
+    ./json2relcsv --parser fast --input "tests/test$i.json" --out-dir "test_out/fast$i" > "test_out/fast$i.log" 2>&1
+    fast_status=$?
+    ./json2relcsv --parser bison --input "tests/test$i.json" --out-dir "test_out/bison$i" > "test_out/bison$i.log" 2>&1
+    bison_status=$?
+    
+    if [ $fast_status -eq $bison_status ] && diff -r "test_out/fast$i" "test_out/bison$i" > /dev/null && cmp -s "test_out/fast$i.log" "test_out/bison$i.log"; then
+        echo "PASS - same tables and messages"
+    else
+        echo "FAIL - parsers differ"
+    fi
+done
+
+# Malformed input must fail with the same message from both parsers
+bad_inputs=(
+    ''
+    '{"a": 1,}'
+    '[1 2]'
+    '{"a" 1}'
+    '{"a": tru}'
+    '{"a": "\q"}'
+    '{"a": "open'
+    '[1.]'
+    '[-]'
+    '{} {}'
+    '[1e400]'
+)
+for n in "${!bad_inputs[@]}"; do
+    echo -n "Malformed $n: "
+    printf '%s' "${bad_inputs[$n]}" > "test_out/bad$n.json"
+    fast_error=$(./json2relcsv --parser fast --input "test_out/bad$n.json" --out-dir test_out/bad 2>&1)
+    fast_status=$?
+    bison_error=$(./json2relcsv --parser bison --input "test_out/bad$n.json" --out-dir test_out/bad 2>&1)
+    bison_status=$?
+    
+    if [ $fast_status -ne 0 ] && [ $fast_status -eq $bison_status ] && [ "$fast_error" = "$bison_error" ]; then
+        echo "PASS - $fast_error"
+    else
+        echo "FAIL - fast: '$fast_error', bison: '$bison_error'"
+    fi
+done
+
+# Numbers: doubles print with the fewest digits that read back, subnormals included
+echo -n "Shortest numbers: "
+printf '{"v": [5e-324, 0.1, 0.3, 1e21, 1.7976931348623157e308, 1e-7, 123.456, 2.5e-05, -0.0]}' > test_out/numbers.json
+rm -rf test_out/numbers
+./json2relcsv --input test_out/numbers.json --out-dir test_out/numbers
+printf 'root_id,item_index,value\n1,0,5e-324\n1,1,0.1\n1,2,0.3\n1,3,1e+21\n1,4,1.7976931348623157e+308\n1,5,1e-07\n1,6,123.456\n1,7,2.5e-05\n1,8,-0\n' > test_out/numbers_v.csv
+if cmp -s test_out/numbers/v.csv test_out/numbers_v.csv; then
+    echo "PASS - shortest round-trip digits"
+else
+    echo "FAIL - unexpected number text"
+fi
+
+# Round trip: a run with its own --emit-schema file as --schema writes the same tables
+echo "Comparing runs with --schema against the runs that emitted it..."
+
+for i in {1..5}; do
+    echo -n "Test $i: "
+    rm -rf "test_out/emit$i" "test_out/schema$i" "test_out/stream$i"
+    mkdir -p "test_out/emit$i" "test_out/schema$i" "test_out/stream$i"
+
+    ./json2relcsv --input "tests/test$i.json" --out-dir "test_out/emit$i" --emit-schema "test_out/test$i.schema"
+    ./json2relcsv --input "tests/test$i.json" --out-dir "test_out/schema$i" --schema "test_out/test$i.schema" > "test_out/schema$i.log" 2>&1
+    ./json2relcsv --stream --input "tests/test$i.json" --out-dir "test_out/stream$i" --schema "test_out/test$i.schema" >> "test_out/schema$i.log" 2>&1
+
+    if diff -r "test_out/emit$i" "test_out/schema$i" > /dev/null && diff -r "test_out/emit$i" "test_out/stream$i" > /dev/null && [ ! -s "test_out/schema$i.log" ]; then
+        echo "PASS - same tables, nothing reported"
+    else
+        echo "FAIL - tables or messages differ"
+    fi
+done
+
+# Append: three --append runs of a record give the same tables as one run over the three records
+echo "Comparing --append runs against one --ndjson run..."
+
+for i in {1..5}; do
+    echo -n "Test $i: "
+    rm -rf "test_out/append$i" "test_out/once$i"
+    mkdir -p "test_out/append$i" "test_out/once$i"
+    tr -d '\n' < "tests/test$i.json" > "test_out/record$i.ndjson"
+    echo >> "test_out/record$i.ndjson"
+    cat "test_out/record$i.ndjson" "test_out/record$i.ndjson" "test_out/record$i.ndjson" > "test_out/records$i.ndjson"
+
+    ./json2relcsv --ndjson --input "test_out/records$i.ndjson" --out-dir "test_out/once$i"
+    for run in 1 2 3; do
+        ./json2relcsv --ndjson --append --input "test_out/record$i.ndjson" --out-dir "test_out/append$i"
+    done
+    rm -f "test_out/append$i/.json2relcsv-state"
+
+    if diff -r "test_out/once$i" "test_out/append$i" > /dev/null; then
+        echo "PASS - same tables"
+    else
+        echo "FAIL - tables differ"
+    fi
+done
+
+# Append with a selection is refused and leaves the tables and state as they were
+echo -n "Append with --columns: "
+rm -rf test_out/append_projected
+mkdir -p test_out/append_projected
+./json2relcsv --append --input tests/test5.json --out-dir test_out/append_projected
+cp -r test_out/append_projected test_out/append_projected.before
+if ! ./json2relcsv --append --columns store_books:title --input tests/test5.json --out-dir test_out/append_projected 2> /dev/null &&
+   diff -r test_out/append_projected.before test_out/append_projected > /dev/null; then
+    echo "PASS - refused, tables unchanged"
+else
+    echo "FAIL - a narrowed --append run was accepted"
+fi
+rm -rf test_out/append_projected.before
+
+# Append keeps the codec and quoting of the files it adds to
+echo -n "Append with other --compress or --quote: "
+rm -rf test_out/append_settings
+mkdir -p test_out/append_settings
+./json2relcsv --append --compress gzip --quote strings --input tests/test3.json --out-dir test_out/append_settings
+cp -r test_out/append_settings test_out/append_settings.before
+if ! ./json2relcsv --append --quote strings --input tests/test3.json --out-dir test_out/append_settings 2> /dev/null &&
+   ! ./json2relcsv --append --compress gzip --input tests/test3.json --out-dir test_out/append_settings 2> /dev/null &&
+   diff -r test_out/append_settings.before test_out/append_settings > /dev/null &&
+   ./json2relcsv --append --compress gzip --quote strings --input tests/test3.json --out-dir test_out/append_settings &&
+   [ ! -e test_out/append_settings/items.csv ] && [ "$(gzip -dc test_out/append_settings/items.csv.gz | wc -l)" -eq 5 ]; then
+    echo "PASS - mismatches refused, same settings appended"
+else
+    echo "FAIL - settings not kept"
+fi
+rm -rf test_out/append_settings.before
+
+# IDs are ints: a state close to the last one fails cleanly and is left as it was
+echo -n "Append out of IDs: "
+rm -rf test_out/append_ids test_out/append_ids.before
+mkdir -p test_out/append_ids
+./json2relcsv --append --input tests/test3.json --out-dir test_out/append_ids
+sed -i 's/^next_id\t.*/next_id\t2147483646/' test_out/append_ids/.json2relcsv-state
+cp -r test_out/append_ids test_out/append_ids.before
+if ! ./json2relcsv --append --input tests/test3.json --out-dir test_out/append_ids 2> test_out/append_ids.log &&
+   grep -q "Out of row IDs" test_out/append_ids.log && diff -r test_out/append_ids.before test_out/append_ids > /dev/null; then
+    echo "PASS - refused, tables and state unchanged"
+else
+    echo "FAIL - IDs wrapped or the state changed"
+fi
+rm -rf test_out/append_ids.before
+
+# Selection: skipping unselected subtrees must not change the selected tables,
+# and their IDs and FKs must be those of a run without the selection
+echo "Comparing --parser fast with --parser bison under --exclude-tables and --columns..."
+
+for i in {1..5}; do
+    echo -n "Test $i: "
+    rm -rf "test_out/pfast$i" "test_out/pbison$i" "test_out/pstream$i"
+    mkdir -p "test_out/pfast$i" "test_out/pbison$i" "test_out/pstream$i"
+
+    ./json2relcsv --parser fast --input "tests/test$i.json" --out-dir "test_out/pfast$i" --exclude-tables author,store_location --columns store_books:title,price > "test_out/pfast$i.log" 2>&1
+    ./json2relcsv --parser bison --input "tests/test$i.json" --out-dir "test_out/pbison$i" --exclude-tables author,store_location --columns store_books:title,price > "test_out/pbison$i.log" 2>&1
+    ./json2relcsv --stream --input "tests/test$i.json" --out-dir "test_out/pstream$i" --exclude-tables author,store_location --columns store_books:title,price 2> /dev/null
+
+    same_ids=yes
+    for file in "test_out/pfast$i"/*.csv "test_out/pstream$i"/*.csv; do
+        cmp -s <(cut -d, -f1 "$file") <(cut -d, -f1 "test_out/fast$i/$(basename "$file")") || same_ids=no
+    done
+    if diff -r "test_out/pfast$i" "test_out/pbison$i" > /dev/null && cmp -s "test_out/pfast$i.log" "test_out/pbison$i.log" &&
+       [ ! -e "test_out/pfast$i/author.csv" ] && [ ! -e "test_out/pfast$i/store_location.csv" ] && [ $same_ids = yes ]; then
+        echo "PASS - same tables, IDs of a full run"
+    else
+        echo "FAIL - parsers differ or IDs changed (IDs kept: $same_ids)"
+    fi
+done
+
+# PostgreSQL binary COPY: files written on worker threads match a serial run, and stdout is one framed stream
+echo "Checking --format pgcopy files and stream..."
+
+for i in {1..5}; do
+    echo -n "Test $i: "
+    rm -rf "test_out/pgcopy$i" "test_out/pgjobs$i"
+    mkdir -p "test_out/pgcopy$i" "test_out/pgjobs$i"
+
+    ./json2relcsv --format pgcopy --input "tests/test$i.json" --out-dir "test_out/pgcopy$i"
+    ./json2relcsv --format pgcopy --jobs 4 --input "tests/test$i.json" --out-dir "test_out/pgjobs$i"
+    ./json2relcsv --format pgcopy --input "tests/test$i.json" --out-dir - > "test_out/pgcopy$i.stream"
+
+    if diff -r "test_out/pgcopy$i" "test_out/pgjobs$i" > /dev/null && [ -s "test_out/pgcopy$i/schema.sql" ] &&
+       [ "$(head -n 1 "test_out/pgcopy$i.stream")" = "json2relcsv-pgcopy 1" ] && [ "$(tail -c 4 "test_out/pgcopy$i.stream")" = "end" ]; then
+        echo "PASS - same files, framed stream"
+    else
+        echo "FAIL - files or stream differ"
+    fi
+done
+
+# Mixed integer and other number columns keep every value exactly: int64 when the
+# other numbers are whole, double when the integers fit one, text otherwise
+echo -n "Lossless number columns: "
+cat > test_out/mixed.json << EOF
+[
+  {"whole": 1, "exact": 1, "wide": 1},
+  {"whole": 2.0, "exact": 2.5, "wide": 2.5},
+  {"whole": 9223372036854775807, "exact": 9007199254740992, "wide": 9007199254740993}
+]
+EOF
+rm -rf test_out/mixed test_out/mixed_pg test_out/mixed_parquet test_out/mixed_arrow
+mkdir -p test_out/mixed test_out/mixed_pg test_out/mixed_parquet test_out/mixed_arrow
+./json2relcsv --input test_out/mixed.json --out-dir test_out/mixed
+./json2relcsv --format pgcopy --input test_out/mixed.json --out-dir test_out/mixed_pg
+./json2relcsv --format parquet --input test_out/mixed.json --out-dir test_out/mixed_parquet
+./json2relcsv --format arrow --input test_out/mixed.json --out-dir test_out/mixed_arrow
+# Decode the binary COPY file and compare each value with the CSV cell
+if ! command -v python3 > /dev/null; then
+    echo "SKIP - python3 not installed"
+elif grep -q '"whole" bigint' test_out/mixed_pg/schema.sql && grep -q '"exact" double precision' test_out/mixed_pg/schema.sql &&
+     grep -q '"wide" text' test_out/mixed_pg/schema.sql && grep -aq 9007199254740993 test_out/mixed_arrow/items.arrow &&
+     python3 - test_out/mixed/items.csv test_out/mixed_pg/items.pgcopy << 'EOF'
+import csv, struct, sys
+rows = list(csv.reader(open(sys.argv[1])))[1:]
+data = open(sys.argv[2], "rb").read()
+pos = 19 + struct.unpack(">I", data[15:19])[0]
+kinds = [int, int, float, str] # id, whole, exact, wide
+for row in rows:
+    count = struct.unpack(">h", data[pos:pos + 2])[0]
+    pos += 2
+    for kind, text in zip(kinds, row[:count]):
+        size = struct.unpack(">i", data[pos:pos + 4])[0]
+        field = data[pos + 4:pos + 4 + size]
+        pos += 4 + size
+        if kind is int: ok = struct.unpack(">q", field)[0] == int(text)
+        elif kind is float: ok = struct.unpack(">d", field)[0] == float(text)
+        else: ok = field.decode() == text
+        if not ok: sys.exit(1)
+sys.exit(0 if data[pos:] == b"\xff\xff" else 1)
+EOF
+then
+    echo "PASS - int64, double and text hold the CSV values"
+else
+    echo "FAIL - a value was rounded"
+fi
+
+# The same values read back from Parquet and Arrow, where pyarrow is installed
+echo -n "Lossless Parquet and Arrow: "
+if ! python3 -c "import pyarrow" 2> /dev/null; then
+    echo "SKIP - pyarrow not installed"
+elif python3 - test_out/mixed/items.csv test_out/mixed_parquet/items.parquet test_out/mixed_arrow/items.arrow << 'EOF'
+import csv, sys
+import pyarrow.ipc, pyarrow.parquet
+rows = list(csv.reader(open(sys.argv[1])))
+expected = {name: [row[i] for row in rows[1:]] for i, name in enumerate(rows[0])}
+tables = [pyarrow.parquet.read_table(sys.argv[2]), pyarrow.ipc.open_file(sys.argv[3]).read_all()]
+for table in tables:
+    for name, cells in expected.items():
+        kind = str(table.schema.field(name).type)
+        values = table.column(name).to_pylist()
+        convert = {"int64": int, "double": float}.get(kind, str)
+        if kind not in ("int64", "double", "string") or values != [convert(cell) for cell in cells]:
+            sys.exit(1)
+EOF
+then
+    echo "PASS - values read back unchanged"
+else
+    echo "FAIL - values differ after a round trip"
+fi
+
+# Dedup: repeated nested objects share one row, referenced from the parent's column
+echo "Checking --dedup..."
+
+cat > test_out/dedup.json << EOF
+[
+  {"postId": 1, "author": {"uid": "u1", "org": {"name": "A"}}},
+  {"postId": 2, "author": {"uid": "u2", "org": {"name": "A"}}},
+  {"postId": 3, "author": {"uid": "u1", "org": {"name": "A"}}}
+]
+EOF
+rm -rf test_out/dedup test_out/dedup_bison
+mkdir -p test_out/dedup test_out/dedup_bison
+./json2relcsv --dedup --input test_out/dedup.json --out-dir test_out/dedup
+./json2relcsv --dedup --parser bison --input test_out/dedup.json --out-dir test_out/dedup_bison
+printf 'id,postId,author\n1,1,2\n4,2,5\n6,3,2\n' > test_out/dedup_items.csv
+printf 'id,uid,org\n2,u1,3\n5,u2,3\n' > test_out/dedup_author.csv
+
+echo -n "Shared rows: "
+if cmp -s test_out/dedup/items.csv test_out/dedup_items.csv && cmp -s test_out/dedup/items_author.csv test_out/dedup_author.csv &&
+   [ "$(wc -l < test_out/dedup/items_author_org.csv)" -eq 2 ] && diff -r test_out/dedup test_out/dedup_bison > /dev/null; then
+    echo "PASS - one row per distinct object"
+else
+    echo "FAIL - unexpected rows"
+fi
+
+# Objects that differ only in the order of their keys share a row too
+cat > test_out/dedup_order.json << EOF
+[
+  {"postId": 1, "author": {"uid": "u1", "org": {"name": "A", "city": "X"}}},
+  {"postId": 2, "author": {"org": {"city": "X", "name": "A"}, "uid": "u1"}},
+  {"postId": 3, "author": {"uid": "u2", "org": {"city": "X", "name": "A"}}}
+]
+EOF
+rm -rf test_out/dedup_order
+./json2relcsv --dedup --input test_out/dedup_order.json --out-dir test_out/dedup_order
+printf 'id,postId,author\n1,1,2\n4,2,2\n5,3,6\n' > test_out/dedup_order_items.csv
+
+echo -n "Reordered keys: "
+if cmp -s test_out/dedup_order/items.csv test_out/dedup_order_items.csv &&
+   [ "$(wc -l < test_out/dedup_order/items_author_org.csv)" -eq 2 ]; then
+    echo "PASS - key order does not split rows"
+else
+    echo "FAIL - reordered objects got rows of their own"
+fi
+
+# Schema and state files record --dedup, and runs with the other setting are refused
+echo -n "Dedup in schema files: "
+rm -rf test_out/dedup_append test_out/dedup_schema
+mkdir -p test_out/dedup_append test_out/dedup_schema
+./json2relcsv --dedup --append --input test_out/dedup.json --out-dir test_out/dedup_append
+./json2relcsv --dedup --emit-schema test_out/dedup.schema --input test_out/dedup.json --out-dir test_out/dedup_schema
+./json2relcsv --emit-schema test_out/plain.schema --input test_out/dedup.json --out-dir test_out/dedup_schema
+cp -r test_out/dedup_append test_out/dedup_append.before
+if ! ./json2relcsv --append --input test_out/dedup.json --out-dir test_out/dedup_append 2> /dev/null &&
+   diff -r test_out/dedup_append.before test_out/dedup_append > /dev/null &&
+   ! ./json2relcsv --schema test_out/dedup.schema --input test_out/dedup.json --out-dir test_out/dedup_schema 2> /dev/null &&
+   ! ./json2relcsv --dedup --schema test_out/plain.schema --input test_out/dedup.json --out-dir test_out/dedup_schema 2> /dev/null &&
+   ./json2relcsv --dedup --schema test_out/dedup.schema --input test_out/dedup.json --out-dir test_out/dedup_schema &&
+   cmp -s test_out/dedup_schema/items.csv test_out/dedup_items.csv &&
+   ./json2relcsv --dedup --append --input test_out/dedup.json --out-dir test_out/dedup_append; then
+    echo "PASS - mismatches refused, same setting accepted"
+else
+    echo "FAIL - dedup setting not kept"
+fi
+rm -rf test_out/dedup_append.before
+
+# Memory limit: an input converted in several parts gives the tables of a run without the limit
+echo "Comparing --memory-limit runs against a run without the limit..."
+awk 'BEGIN {
+    printf "[";
+    for (i = 1; i <= 6000; i++) {
+        if (i > 1) printf ",\n";
+        printf "{\"id\": %d, \"name\": \"user %d\", \"score\": %d.5, \"tags\": [\"t%d\", \"t%d\"], \"address\": {\"city\": \"c%d\", \"zip\": %d}}", i, i, i, i % 5, i % 3, i % 17, 10000 + i;
+    }
+    print "]";
+}' > test_out/large.json
+rm -rf test_out/limit_whole test_out/limit_parts
+./json2relcsv --input test_out/large.json --out-dir test_out/limit_whole
+./json2relcsv --input test_out/large.json --out-dir test_out/limit_parts --memory-limit 1M
+
+echo -n "Parts: "
+if diff -r test_out/limit_whole test_out/limit_parts > /dev/null; then
+    echo "PASS - same tables"
+else
+    echo "FAIL - tables differ"
+fi
+
+# A table that cannot be put in place fails the run and leaves every earlier table as it was
+echo -n "Parts with a blocked table: "
+echo old > test_out/limit_parts/items.csv
+rm test_out/limit_parts/items_address.csv
+mkdir test_out/limit_parts/items_address.csv
+./json2relcsv --input test_out/large.json --out-dir test_out/limit_parts --memory-limit 1M 2> /dev/null
+status=$?
+if [ $status -ne 0 ] && [ "$(cat test_out/limit_parts/items.csv)" = "old" ] &&
+   [ -z "$(ls test_out/limit_parts | grep -e '\.tmp$' -e '\.old$')" ]; then
+    echo "PASS - no table replaced"
+else
+    echo "FAIL - status $status, tables partly replaced"
+fi
+rmdir test_out/limit_parts/items_address.csv
+
+# A document that cannot be split fails rather than exceed the limit, and one that fits converts
+echo -n "Limit on a top-level object: "
+{ printf '{"meta": {"version": 1}, "data": '; cat test_out/large.json; printf '}'; } > test_out/large_object.json
+rm -rf test_out/limit_object test_out/limit_small
+if ! ./json2relcsv --input test_out/large_object.json --out-dir test_out/limit_object --memory-limit 1M 2> test_out/limit_object.log &&
+   grep -q "does not fit in --memory-limit" test_out/limit_object.log && [ ! -e test_out/limit_object ] &&
+   ./json2relcsv --input tests/test1.json --out-dir test_out/limit_small --memory-limit 1M &&
+   diff -r test_out/limit_small test_out/fast1 > /dev/null; then
+    echo "PASS - refused over the limit, converted within it"
+else
+    echo "FAIL - limit not kept"
+fi
+
+# Threads: an input large enough to be parsed in parts and written in chunks
+# gives the same tables with --jobs 4 as with --jobs 1
+echo "Comparing --jobs 4 against --jobs 1..."
+awk 'BEGIN {
+    for (i = 1; i <= 30000; i++) {
+        printf "{\"id\": %d, \"name\": \"user \\\"%d\\\"\", \"score\": %d.25, \"tags\": [\"t%d\", %d, null], \"address\": {\"city\": \"c%d\", \"zip\": %d}}\n", i, i, i, i % 5, i % 3, i % 17, 10000 + i;
+    }
+}' > test_out/jobs.ndjson
+awk 'BEGIN { printf "[" } NR > 1 { printf ",\n" } { printf "%s", $0 } END { print "]" }' test_out/jobs.ndjson > test_out/jobs.json
+
+for mode in csv ndjson compress; do
+    case $mode in
+        csv) input=test_out/jobs.json; options="" ;;
+        ndjson) input=test_out/jobs.ndjson; options="--ndjson" ;;
+        compress) input=test_out/jobs.json; options="--compress gzip" ;;
+    esac
+    rm -rf "test_out/jobs1_$mode" "test_out/jobs4_$mode"
+    ./json2relcsv --input $input $options --jobs 1 --out-dir "test_out/jobs1_$mode"
+    ./json2relcsv --input $input $options --jobs 4 --out-dir "test_out/jobs4_$mode"
+    
+    echo -n "Jobs ($mode): "
+    if [ $mode = compress ]; then
+        # Chunks compressed on several threads make other gzip members; the content must match
+        same=yes
+        for file in test_out/jobs1_$mode/*.csv.gz; do
+            cmp -s <(gzip -dc "$file") <(gzip -dc "test_out/jobs4_$mode/$(basename "$file")") || same=no
+        done
+        [ "$(ls test_out/jobs1_$mode)" = "$(ls test_out/jobs4_$mode)" ] || same=no
+    else
+        diff -r "test_out/jobs1_$mode" "test_out/jobs4_$mode" > /dev/null && same=yes || same=no
+    fi
+    if [ $same = yes ] && [ -n "$(ls test_out/jobs1_$mode)" ]; then
+        echo "PASS - same tables"
+    else
+        echo "FAIL - tables differ"
+    fi
+done
+
+# Compressed files decompress to the uncompressed tables, over several blocks;
+# zstd is checked only where the binary was built with it and zstd is installed
+for codec in gzip gzip:1 zstd zstd:19; do
+    echo -n "Compress ($codec): "
+    case $codec in
+        gzip*) suffix=gz; decompress="gzip -dc" ;;
+        zstd*) suffix=zst; decompress="zstd -dcq" ;;
+    esac
+    rm -rf test_out/compress
+    if ! ./json2relcsv --input test_out/jobs.json --compress $codec --out-dir test_out/compress 2> test_out/compress.log; then
+        if [ $suffix = zst ] && grep -q "needs a build with zstd support" test_out/compress.log; then
+            echo "SKIP - built without zstd"
+        else
+            echo "FAIL - run failed"
+        fi
+        continue
+    fi
+    if ! command -v ${decompress%% *} > /dev/null; then
+        echo "SKIP - ${decompress%% *} not installed"
+        continue
+    fi
+    same=yes
+    for file in test_out/jobs1_csv/*.csv; do
+        cmp -s "$file" <($decompress "test_out/compress/$(basename "$file").$suffix") || same=no
+    done
+    [ "$(ls test_out/compress | sed "s/\.$suffix\$//")" = "$(ls test_out/jobs1_csv)" ] || same=no
+    if [ $same = yes ]; then
+        echo "PASS - decompresses to the CSV tables"
+    else
+        echo "FAIL - decompressed tables differ"
+    fi
+done
+
 echo "Tests completed."
\ No newline at end of file
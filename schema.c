@@ -1,176 +1,181 @@
 #include "ast.h"
+#include "name_index.h"
+#include "schema_file.h"
+#include "projection.h"
+#include "dedup.h"
+#include "error.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <limits.h>
+
+// Upper bound of cached shapes per table. Objects of a table whose keys
+// vary more than this get a shape that is built and dropped per object.
+#define SHAPE_CACHE_LIMIT 16
+
+// Cached table position of a subtree that feeds no selected table (projection.h)
+#define SKIPPED_TABLE -2
+
+// Layout of objects with one sequence of keys within one table, resolved the
+// first time the sequence is seen there. Objects matching it fill their row
+// by position, with no key hashing, and find their nested tables directly.
+typedef struct ObjectShape {
+    int pair_count;
+    int* key_ids;       // Key of each pair, in order
+    int* slots;         // Column slot each pair fills, or -1 (no column, repeated key, junction table)
+    int* missing;       // Slots no pair fills, set to null
+    int missing_count;
+    int* child_tables;  // Table of the object or array under each pair, -1 until first needed,
+                        // SKIPPED_TABLE if the projection needs nothing below it
+} ObjectShape;
+
+// Shapes seen in one table. Shapes are never evicted: an object can nest
+// under its own table (key "root" in table "root"), so an outer object may
+// still be using any of them.
+typedef struct ShapeList {
+    ObjectShape** shapes;
+    int count;
+    int last;           // Most recently matched, tried first
+    bool declared;      // Table loaded from a schema file (--schema)
+    ReportedKeys unknown_keys; // Keys of its objects it has no column for
+} ShapeList;
 
 // Tables collection for schema generation
 typedef struct TableCollection {
     TableSchema* tables;
+    ShapeList* shapes;    // Parallel to 'tables'
     int table_count;
     int capacity;
+    NameIndex name_index; // Table name -> position in 'tables'
+    int* touched;         // Positions of tables that were empty when an object or junction row was added
+    int touched_count;
+    int touched_capacity;
+    struct TraversalFrame* frames; // Explicit stack of the AST walk, kept between --ndjson records
+    int frame_count;
+    int frame_capacity;
+    Value_Node* skipped;  // Stack of skipped_ids()
+    int skipped_capacity;
+    char* path;           // Reusable buffer for composite table names
+    size_t path_capacity;
+    int next_node_id;     // For globally unique IDs across all tables
+    bool fixed;           // Started from a --schema file: new tables are reported
+    const Projection* projection; // Tables and columns to keep; NULL for all
+    ContentTable* dedup;  // --dedup: content of the objects below the ones shared; NULL without
 } TableCollection;
 
-// Key list for comparing object schemas
-typedef struct KeyList {
-    char** keys;
-    int count;
-} KeyList;
+// One open object or array of the AST walk. Nesting only grows this stack, so
+// the depth of a document is bounded by memory rather than by the C stack.
+typedef struct TraversalFrame {
+    Object_Node* obj;     // Object whose pairs are visited, or NULL for an array of objects
+    Pair_Node* next_pair;
+    int pair_index;       // Position of next_pair in the object
+    ObjectShape* shape;
+    bool transient_shape; // Shape to free when the object is done
+    Array_Node* arr;      // Array whose elements are visited
+    int next_element;
+    int first_index;      // Array position of arr->elements[0]; not 0 for later --memory-limit parts
+    int owner_id;         // ID of the object holding the array
+    int table_index;      // Table of the object, or of the array's elements
+    int row;              // Row of obj in its table, -1 if it has none
+    int content_id;       // --dedup content of obj or arr (dedup.h), -1 if not interned
+} TraversalFrame;
 
 // Forward declarations of internal functions
-// static void collect_table_schemas(AST_Node* root, TableCollection* tables, char* parent_table_name, int parent_id); // Not used in provided code, can be removed if not needed elsewhere
-static TableSchema* find_or_create_table(TableCollection* tables, const char* name, KeyList* keys, const char* current_parent_table_name_for_fk); // Added param for FK
-static KeyList* collect_object_keys(Object_Node* obj);
-static bool compare_key_lists(KeyList* list1, KeyList* list2); // Not used in provided code, can be removed if not needed elsewhere
-static void free_key_list(KeyList* list);
-static char* get_table_name_for_array(const char* parent_name, const char* key);
-static void add_object_to_table(TableSchema* table, Object_Node* obj); // Consider if obj->node_id needs to be globally unique or per-table unique
-static void process_object_node(AST_Node* node, TableCollection* tables, char* current_table_name, int parent_id_value, const char* parent_table_name_for_fk);
-static void process_array_node(AST_Node* node, TableCollection* tables, char* parent_table_name_of_array_owner, const char* key_of_array, int parent_id_value_of_array_owner);
-
-// Initialize a new table collection
-static TableCollection* create_table_collection() {
+static int find_or_create_table(TableCollection* tables, const char* name, Object_Node* obj, const char* current_parent_table_name_for_fk); // Returns the table's position
+
+static int add_table(TableCollection* collection, TableSchema table);
+static void init_row_store(TableSchema* table);
+
+// Initialize a new table collection, holding the tables of 'known' if given
+static TableCollection* create_table_collection(const Schema* known, const Projection* projection, bool dedup) {
     TableCollection* collection = (TableCollection*)calloc(1, sizeof(TableCollection)); // Use calloc
     if (!collection) {
-        fprintf(stderr, "Error: Memory allocation failed for table collection\n");
-        exit(EXIT_FAILURE);
+        fatal_error("Error: Memory allocation failed for table collection\n");
     }
     
     collection->capacity = 10;
+    collection->next_node_id = 1; // IDs keep increasing across all records of an --ndjson run
     // collection->table_count = 0; // Done by calloc
+    collection->projection = projection;
+    if (dedup) collection->dedup = create_content_table();
+    name_index_init(&collection->name_index);
     collection->tables = (TableSchema*)calloc(collection->capacity, sizeof(TableSchema)); // Use calloc
-    if (!collection->tables) {
-        fprintf(stderr, "Error: Memory allocation failed for tables array\n");
+    collection->shapes = (ShapeList*)calloc(collection->capacity, sizeof(ShapeList));
+    if (!collection->tables || !collection->shapes) {
         free(collection);
-        exit(EXIT_FAILURE);
+        fatal_error("Error: Memory allocation failed for tables array\n");
     }
     
+    for (int i = 0; known && i < known->table_count; i++) {
+        TableSchema table = copy_table_layout(&known->tables[i]);
+        project_table_layout(projection, &table);
+        if (!table.is_junction) init_row_store(&table);
+        int position = add_table(collection, table); // May move 'shapes'
+        collection->shapes[position].declared = true;
+    }
+    // A --schema run reports tables its file does not list. The state of an
+    // --append run sets next_node_id, and new tables are expected there.
+    collection->fixed = known && known->next_node_id == 0;
+    if (known && known->next_node_id > 0) collection->next_node_id = known->next_node_id;
     return collection;
 }
 
-// Add a new table to the collection, resizing if necessary
-static void add_table(TableCollection* collection, TableSchema table) {
+// Add a new table to the collection, resizing if necessary.
+// Returns the table's position. TableSchema pointers into the collection are
+// invalidated by the realloc below; positions and the name index are not.
+static int add_table(TableCollection* collection, TableSchema table) {
     if (collection->table_count >= collection->capacity) {
         collection->capacity *= 2;
         TableSchema* new_tables_ptr = (TableSchema*)realloc(collection->tables, 
                                                collection->capacity * sizeof(TableSchema));
         if (!new_tables_ptr) {
-            fprintf(stderr, "Error: Memory reallocation failed for tables array\n");
-            // Consider freeing existing collection->tables and table's contents if realloc fails and we exit
-            exit(EXIT_FAILURE);
+            fatal_error("Error: Memory reallocation failed for tables array\n");
         }
         collection->tables = new_tables_ptr;
+        ShapeList* new_shapes = (ShapeList*)realloc(collection->shapes, collection->capacity * sizeof(ShapeList));
+        if (!new_shapes) {
+            fatal_error("Error: Memory reallocation failed for table shapes\n");
+        }
+        collection->shapes = new_shapes;
     }
     
-    collection->tables[collection->table_count++] = table; // table is copied
+    collection->tables[collection->table_count] = table; // table is copied
+    collection->shapes[collection->table_count] = (ShapeList){0};
+    // The key is the heap-allocated name, which does not move with the array
+    name_index_put(&collection->name_index, table.name, hash_name(table.name), collection->table_count);
+    return collection->table_count++;
 }
 
-// Collect keys from an object into a KeyList
-static KeyList* collect_object_keys(Object_Node* obj) {
-    if (!obj) { // Handle null object node gracefully
-        KeyList* list = (KeyList*)calloc(1, sizeof(KeyList));
-        if (!list) {
-            fprintf(stderr, "Error: Memory allocation failed for empty key list\n");
-            exit(EXIT_FAILURE);
+// Remember that a table received its first object or junction row since the last clear
+static void mark_touched(TableCollection* collection, int position) {
+    if (collection->touched_count == collection->touched_capacity) {
+        collection->touched_capacity = collection->touched_capacity ? collection->touched_capacity * 2 : 16;
+        int* grown = (int*)realloc(collection->touched, collection->touched_capacity * sizeof(int));
+        if (!grown) {
+            fatal_error("Error: Memory reallocation failed for touched tables\n");
         }
-        list->count = 0;
-        list->keys = NULL;
-        return list;
+        collection->touched = grown;
     }
+    collection->touched[collection->touched_count++] = position;
+}
 
-    KeyList* list = (KeyList*)calloc(1, sizeof(KeyList)); // Use calloc
-    if (!list) {
-        fprintf(stderr, "Error: Memory allocation failed for key list\n");
-        exit(EXIT_FAILURE);
-    }
-    
-    list->count = obj->pair_count;
-    if (list->count > 0) {
-        list->keys = (char**)calloc(list->count, sizeof(char*)); // Use calloc
-        if (!list->keys) {
-            fprintf(stderr, "Error: Memory allocation failed for key array\n");
-            free(list);
-            exit(EXIT_FAILURE);
-        }
-        
-        Pair_Node* current = obj->pairs;
-        int i = 0;
-        while (current && i < list->count) {
-            if (current->key) { // Ensure key is not null
-                list->keys[i] = strdup(current->key);
-                if (!list->keys[i]) {
-                    fprintf(stderr, "Error: Memory allocation failed for key string strdup\n");
-                    // Free previously strdup'd keys in this list
-                    for (int k = 0; k < i; k++) free(list->keys[k]);
-                    free(list->keys);
-                    free(list);
-                    exit(EXIT_FAILURE);
-                }
-            } else {
-                // Handle null key if that's possible by parser, e.g., assign a placeholder or error
-                list->keys[i] = strdup(""); // Or some other placeholder
-                 fprintf(stderr, "Warning: Object key is null, using empty string.\n");
-            }
-            current = current->next;
-            i++;
-        }
-    } else {
-        list->keys = NULL;
-    }
-    
-    return list;
-}
-
-// Compare two key lists for equality (order insensitive)
-// Not directly used by the schema generation logic as find_or_create_table uses a more complex match
-// static bool compare_key_lists(KeyList* list1, KeyList* list2) {
-//     if (!list1 || !list2 || list1->count != list2->count) {
-//         return false;
-//     }
-//     if (list1->count == 0) return true; // Both empty
-
-//     for (int i = 0; i < list1->count; i++) {
-//         bool found = false;
-//         for (int j = 0; j < list2->count; j++) {
-//             if (list1->keys[i] && list2->keys[j] && strcmp(list1->keys[i], list2->keys[j]) == 0) {
-//                 found = true;
-//                 break;
-//             }
-//         }
-//         if (!found) {
-//             return false;
-//         }
-//     }
-//     return true;
-// }
-
-// Free a key list
-static void free_key_list(KeyList* list) {
-    if (!list) return;
-    
-    if (list->keys) {
-        for (int i = 0; i < list->count; i++) {
-            if (list->keys[i]) {
-                free(list->keys[i]);
-            }
-        }
-        free(list->keys);
-    }
-    free(list);
+// Look up a table position by name, or -1
+static int find_table(TableCollection* collection, const char* name) {
+    return name_index_get(&collection->name_index, name, hash_name(name));
 }
 
 // Generate a table name for an array based on parent table and key
-static char* get_table_name_for_array(const char* parent_name, const char* key) {
+char* get_table_name_for_array(const char* parent_name, const char* key) {
     if (!key) { // Handle null key
         key = "unknown_array_key"; 
-        fprintf(stderr, "Warning: Null key provided for array table name, using '%s'.\n", key);
+        report_warning("Warning: Null key provided for array table name, using '%s'.\n", key);
     }
     // Special case for root object's arrays
     if (parent_name == NULL || strcmp(parent_name, "root") == 0) {
         char* new_name = strdup(key);
         if (!new_name) {
-            fprintf(stderr, "Error: strdup failed for array table name (root parent)\n");
-            exit(EXIT_FAILURE);
+            fatal_error("Error: strdup failed for array table name (root parent)\n");
         }
         return new_name;
     }
@@ -181,73 +186,265 @@ static char* get_table_name_for_array(const char* parent_name, const char* key)
     size_t key_len = strlen(key);
     char* name = (char*)malloc(parent_len + key_len + 2); // +1 for '_' and +1 for '\0'
     if (!name) {
-        fprintf(stderr, "Error: Memory allocation failed for array table name\n");
-        exit(EXIT_FAILURE);
+        fatal_error("Error: Memory allocation failed for array table name\n");
     }
     
     sprintf(name, "%s_%s", parent_name, key);
     return name;
 }
 
+// Heap-allocated "<table>_id", the FK column pointing at 'table_name'
+char* get_fk_column_name(const char* table_name) {
+    size_t length = strlen(table_name);
+    char* name = (char*)malloc(length + 4);
+    if (!name) {
+        fatal_error("Error: Memory allocation failed for FK column name\n");
+    }
+    memcpy(name, table_name, length);
+    memcpy(name + length, "_id", 4);
+    return name;
+}
+
+// Build the column ordinal map of a table once, when it is created.
+// Columns with the same name (e.g. a data key called "id") share one slot.
+void build_column_map(TableSchema* table) {
+    name_index_init(&table->column_index);
+    table->column_slots = (int*)malloc(table->column_count * sizeof(int));
+    if (!table->column_slots) {
+        fatal_error("Error: Memory allocation failed for column slots of table '%s'\n", table->name);
+    }
+    for (int i = 0; i < table->column_count; i++) {
+        uint32_t hash = hash_name(table->columns[i]);
+        int slot = name_index_get(&table->column_index, table->columns[i], hash);
+        if (slot < 0) {
+            slot = i;
+            name_index_put(&table->column_index, table->columns[i], hash, slot);
+        }
+        table->column_slots[i] = slot;
+    }
+}
+
+#define ROW_STORE_INITIAL_ROWS 16
+
+// Resize the row store of a table to 'capacity' rows
+static void resize_row_store(TableSchema* table, int capacity) {
+    RowStore* rows = &table->rows;
+    int* ids = (int*)realloc(rows->ids, capacity * sizeof(int));
+    int* parent_ids = ids ? (int*)realloc(rows->parent_ids, capacity * sizeof(int)) : NULL;
+    if (!parent_ids) {
+        fatal_error("Error: Memory reallocation failed for rows of table '%s'\n", table->name);
+    }
+    rows->ids = ids;
+    rows->parent_ids = parent_ids;
+    for (int slot = 0; slot < table->column_count; slot++) {
+        ColumnVector* column = &rows->columns[slot];
+        if (!column->types) continue;
+        uint8_t* types = (uint8_t*)realloc(column->types, capacity * sizeof(uint8_t));
+        ColumnCell* cells = types ? (ColumnCell*)realloc(column->cells, capacity * sizeof(ColumnCell)) : NULL;
+        if (!cells) {
+            fatal_error("Error: Memory reallocation failed for columns of table '%s'\n", table->name);
+        }
+        column->types = types;
+        column->cells = cells;
+    }
+    rows->capacity = capacity;
+}
+
+// Set up the row store of a new table: a vector for every slot a data column
+// reads. The id and FK columns come from 'ids' and 'parent_ids' instead.
+static void init_row_store(TableSchema* table) {
+    RowStore* rows = &table->rows;
+    rows->columns = (ColumnVector*)calloc(table->column_count, sizeof(ColumnVector));
+    if (!rows->columns) {
+        fatal_error("Error: Memory allocation failed for columns of table '%s'\n", table->name);
+    }
+    for (int i = table->has_parent_fk ? 2 : 1; i < table->column_count; i++) {
+        ColumnVector* column = &rows->columns[table->column_slots[i]];
+        if (column->types) continue;
+        column->types = (uint8_t*)malloc(ROW_STORE_INITIAL_ROWS * sizeof(uint8_t));
+        column->cells = (ColumnCell*)malloc(ROW_STORE_INITIAL_ROWS * sizeof(ColumnCell));
+        if (!column->types || !column->cells) {
+            fatal_error("Error: Memory allocation failed for columns of table '%s'\n", table->name);
+        }
+    }
+    resize_row_store(table, ROW_STORE_INITIAL_ROWS);
+}
+
+// Resolve the layout of 'obj' in 'table': the slot of each pair, where the
+// first pair with a key wins and keys without a column are dropped, and the
+// slots left for null.
+static ObjectShape* create_shape(const TableSchema* table, Object_Node* obj) {
+    ObjectShape* shape = (ObjectShape*)calloc(1, sizeof(ObjectShape));
+    int pair_count = obj->pair_count;
+    int alloc_count = pair_count ? pair_count : 1;
+    if (shape) {
+        shape->pair_count = pair_count;
+        shape->key_ids = (int*)malloc(alloc_count * sizeof(int));
+        shape->slots = (int*)malloc(alloc_count * sizeof(int));
+        shape->child_tables = (int*)malloc(alloc_count * sizeof(int));
+        shape->missing = (int*)malloc((table->column_count ? table->column_count : 1) * sizeof(int));
+    }
+    bool* filled = (bool*)calloc(table->column_count ? table->column_count : 1, sizeof(bool));
+    if (!shape || !shape->key_ids || !shape->slots || !shape->child_tables || !shape->missing || !filled) {
+        fatal_error("Error: Memory allocation failed for object shape of table '%s'\n", table->name);
+    }
+
+    const ColumnVector* columns = table->rows.columns; // NULL for a junction table
+    int i = 0;
+    for (Pair_Node* pair = obj->pairs; pair; pair = pair->next, i++) {
+        shape->key_ids[i] = pair->key_id;
+        shape->child_tables[i] = -1;
+        int slot = columns ? name_index_get(&table->column_index, pair->key, hash_name(pair->key)) : -1;
+        if (slot >= 0 && (!columns[slot].types || filled[slot])) slot = -1;
+        if (slot >= 0) filled[slot] = true;
+        shape->slots[i] = slot;
+    }
+    for (int slot = 0; columns && slot < table->column_count; slot++) {
+        if (columns[slot].types && !filled[slot]) shape->missing[shape->missing_count++] = slot;
+    }
+    free(filled);
+    return shape;
+}
+
+static void free_shape(ObjectShape* shape) {
+    free(shape->key_ids);
+    free(shape->slots);
+    free(shape->missing);
+    free(shape->child_tables);
+    free(shape);
+}
+
+static bool shape_matches(const ObjectShape* shape, const Object_Node* obj) {
+    if (shape->pair_count != obj->pair_count) return false;
+    int i = 0;
+    for (const Pair_Node* pair = obj->pairs; pair; pair = pair->next, i++) {
+        if (shape->key_ids[i] != pair->key_id) return false;
+    }
+    return true;
+}
+
+// The cached shape of 'obj' in a table, added on first sight. Once the cache
+// is full an unseen layout gets a new shape with *transient set; the caller
+// frees it after the object.
+static ObjectShape* find_shape(TableCollection* tables, int table_index, Object_Node* obj, bool* transient) {
+    ShapeList* list = &tables->shapes[table_index];
+    *transient = false;
+    if (list->count > 0 && shape_matches(list->shapes[list->last], obj)) return list->shapes[list->last];
+    for (int i = 0; i < list->count; i++) {
+        if (shape_matches(list->shapes[i], obj)) {
+            list->last = i;
+            return list->shapes[i];
+        }
+    }
+
+    const TableSchema* table = &tables->tables[table_index];
+    ObjectShape* shape = create_shape(table, obj);
+    if (list->declared && !table->is_junction && !table->omitted) {
+        // Reported once per key; shapes are only built for unseen layouts.
+        // Keys the projection drops are not expected to have a column.
+        for (Pair_Node* pair = obj->pairs; pair; pair = pair->next) {
+            if (name_index_get(&table->column_index, pair->key, hash_name(pair->key)) < 0 &&
+                projection_keeps_column(tables->projection, table->name, pair->key)) {
+                report_unknown_key(&list->unknown_keys, table->name, pair->key);
+            }
+        }
+    }
+    if (list->count == SHAPE_CACHE_LIMIT) {
+        *transient = true;
+        return shape;
+    }
+    if (!list->shapes) {
+        list->shapes = (ObjectShape**)malloc(SHAPE_CACHE_LIMIT * sizeof(ObjectShape*));
+        if (!list->shapes) {
+            fatal_error("Error: Memory allocation failed for shapes of table '%s'\n", tables->tables[table_index].name);
+        }
+    }
+    list->last = list->count;
+    list->shapes[list->count++] = shape;
+    return shape;
+}
+
+// Append an object's row: its ids, then each pair in the slot its shape gives it
+static void add_row(TableSchema* table, const ObjectShape* shape, Object_Node* obj, int parent_id) {
+    RowStore* rows = &table->rows;
+    if (rows->count == rows->capacity) resize_row_store(table, rows->capacity * 2);
+    int row = rows->count++;
+    rows->ids[row] = obj->node_id;
+    rows->parent_ids[row] = parent_id;
+    
+    int i = 0;
+    for (Pair_Node* pair = obj->pairs; pair; pair = pair->next, i++) {
+        int slot = shape->slots[i];
+        if (slot < 0) continue;
+        ColumnVector* column = &rows->columns[slot];
+        column->types[row] = (uint8_t)pair->value.type;
+        switch (pair->value.type) {
+            case VALUE_STRING: column->cells[row].string_val = pair->value.string_val; break;
+            case VALUE_NUMBER: column->cells[row].number_val = pair->value.number_val; break;
+            case VALUE_INTEGER: column->cells[row].integer_val = pair->value.integer_val; break;
+            case VALUE_BOOLEAN: column->cells[row].integer_val = pair->value.boolean_val; break;
+            default: column->cells[row].integer_val = 0; break;
+        }
+    }
+    for (int m = 0; m < shape->missing_count; m++) {
+        ColumnVector* column = &rows->columns[shape->missing[m]];
+        column->types[row] = VALUE_NULL; // Key missing from this object
+        column->cells[row].integer_val = 0;
+    }
+}
+
 // Find a table by schema or create a new one.
 // 'name_candidate' is the proposed name for the table if it's newly created.
 // 'current_parent_table_name_for_fk' is the name of the table that would be the parent in a FK relationship.
-static TableSchema* find_or_create_table(TableCollection* tables, const char* name_candidate, KeyList* keys, const char* current_parent_table_name_for_fk) {
-    // Try to find an existing table with the same set of keys (column names, excluding PK/FKs)
-    for (int i = 0; i < tables->table_count; i++) {
-        TableSchema* existing_table = &tables->tables[i];
-        // A simple heuristic: if names match, assume schema matches.
-        // A more robust check would compare KeyList 'keys' against existing_table's columns.
-        // For now, if name_candidate matches an existing table name, we use that.
-        // This part needs careful consideration for how schemas are truly identified as "the same".
-        // The original logic compared key counts and key names.
-        if (strcmp(existing_table->name, name_candidate) == 0) {
-            // TODO: Add a more robust schema comparison here if needed,
-            // e.g., comparing 'keys' with existing_table->columns.
-            // For now, if name matches, we assume it's the correct table.
-            return existing_table;
-        }
+// Returns the table's position in the collection, which stays valid across add_table() reallocs.
+static int find_or_create_table(TableCollection* tables, const char* name_candidate, Object_Node* obj, const char* current_parent_table_name_for_fk) {
+    // Try to find an existing table via the name index.
+    // A simple heuristic: if names match, assume schema matches.
+    // A more robust check would compare the keys of 'obj' against existing_table's columns.
+    // TODO: Add a more robust schema comparison here if needed,
+    // e.g., comparing the keys of 'obj' with existing_table->columns.
+    int existing = find_table(tables, name_candidate);
+    if (existing >= 0) {
+        return existing;
     }
     
     // If not found, create a new table
-    TableSchema new_table;
+    if (tables->fixed) report_unknown_table(name_candidate);
+    TableSchema new_table = {0};
     new_table.name = strdup(name_candidate);
     if (!new_table.name) {
-        fprintf(stderr, "Error: strdup failed for new table name '%s'\n", name_candidate);
-        exit(EXIT_FAILURE);
+        fatal_error("Error: strdup failed for new table name '%s'\n", name_candidate);
     }
     
     // Determine if this table is a "root" table (no parent FK)
     // A table is effectively a root table in its own context if current_parent_table_name_for_fk is NULL or "root"
     bool has_parent_fk = (current_parent_table_name_for_fk != NULL && strcmp(current_parent_table_name_for_fk, "root") != 0);
+    // A table that is not written keeps only its ids; others the keys the projection keeps
+    new_table.omitted = !projection_keeps_table(tables->projection, new_table.name);
+    int data_columns = 0;
+    for (Pair_Node* pair = obj->pairs; pair && !new_table.omitted; pair = pair->next) {
+        if (projection_keeps_column(tables->projection, new_table.name, pair->key)) data_columns++;
+    }
     
-    new_table.column_count = keys->count + 1 + (has_parent_fk ? 1 : 0); // +1 for 'id', +1 for 'parent_id' if applicable
+    new_table.column_count = data_columns + 1 + (has_parent_fk ? 1 : 0); // +1 for 'id', +1 for 'parent_id' if applicable
     
+    new_table.has_parent_fk = has_parent_fk;
     new_table.columns = (char**)calloc(new_table.column_count, sizeof(char*)); // Use calloc
     if (!new_table.columns) {
-        fprintf(stderr, "Error: Memory allocation failed for columns array for table '%s'\n", new_table.name);
-        free(new_table.name);
-        exit(EXIT_FAILURE);
+        fatal_error("Error: Memory allocation failed for columns array for table '%s'\n", new_table.name);
     }
     
     int current_col_idx = 0;
     new_table.columns[current_col_idx++] = strdup("id"); // Primary Key
 
     if (has_parent_fk) {
-        // Max length for FK column name: parent_name + "_id" + \0
-        char fk_col_name[256]; // Assuming table names won't make this overflow
-        sprintf(fk_col_name, "%s_id", current_parent_table_name_for_fk);
-        new_table.columns[current_col_idx++] = strdup(fk_col_name);
+        new_table.columns[current_col_idx++] = get_fk_column_name(current_parent_table_name_for_fk);
     }
     
-    // Add actual data columns from keys
-    for (int i = 0; i < keys->count; i++) {
-        if (keys->keys[i]) { // Ensure key string is not null
-             new_table.columns[current_col_idx + i] = strdup(keys->keys[i]);
-        } else {
-            // This case should ideally be prevented by collect_object_keys
-            new_table.columns[current_col_idx + i] = strdup(""); // Placeholder for null key
-            fprintf(stderr, "Warning: Null key encountered when creating table columns for '%s'.\n", new_table.name);
+    // Add actual data columns from the object's keys
+    for (Pair_Node* pair = obj->pairs; pair && !new_table.omitted; pair = pair->next) {
+        if (projection_keeps_column(tables->projection, new_table.name, pair->key)) {
+            new_table.columns[current_col_idx++] = strdup(pair->key);
         }
     }
 
@@ -261,205 +458,380 @@ static TableSchema* find_or_create_table(TableCollection* tables, const char* na
     }
 
     if (!col_alloc_ok) {
-        fprintf(stderr, "Error: Memory allocation failed for one or more column names for table '%s'\n", new_table.name);
-        for (int j = 0; j < new_table.column_count; j++) { // Free successfully allocated columns
-            if(new_table.columns[j]) free(new_table.columns[j]);
-        }
-        free(new_table.columns);
-        free(new_table.name);
-        exit(EXIT_FAILURE);
+        fatal_error("Error: Memory allocation failed for one or more column names for table '%s'\n", new_table.name);
     }
     
-    new_table.objects = NULL; // Initialize list of objects belonging to this table
-    add_table(tables, new_table); // Adds a copy of new_table
-    
-    return &tables->tables[tables->table_count - 1]; // Return pointer to the table in the collection
+    build_column_map(&new_table);
+    init_row_store(&new_table);
+    return add_table(tables, new_table); // Adds a copy of new_table
+}
+
+// Append one row to a junction table, growing its columns together
+static void add_junction_row(TableCollection* tables, int table_index, int owner_id, int item_index, Value_Node value) {
+    TableSchema* table = &tables->tables[table_index];
+    JunctionRows* rows = &table->junction;
+    if (rows->count == 0 && table->rows.count == 0) mark_touched(tables, table_index);
+    if (rows->count == rows->capacity) {
+        int capacity = rows->capacity ? rows->capacity * 2 : 64;
+        int* owner_ids = (int*)realloc(rows->owner_ids, capacity * sizeof(int));
+        int* item_indexes = owner_ids ? (int*)realloc(rows->item_indexes, capacity * sizeof(int)) : NULL;
+        Value_Node* values = item_indexes ? (Value_Node*)realloc(rows->values, capacity * sizeof(Value_Node)) : NULL;
+        if (!values) {
+            fatal_error("Error: Memory reallocation failed for rows of junction table '%s'\n", table->name);
+        }
+        rows->owner_ids = owner_ids;
+        rows->item_indexes = item_indexes;
+        rows->values = values;
+        rows->capacity = capacity;
+    }
+    rows->owner_ids[rows->count] = owner_id;
+    rows->item_indexes[rows->count] = item_index;
+    rows->values[rows->count] = value;
+    rows->count++;
 }
 
-// Add an object to a table's linked list of objects
-static int global_next_node_id = 1; // For globally unique IDs across all tables
+// Name of the table for 'key' under the table 'parent_name', built in the
+// collection's path buffer: valid until the next call. Same rule as
+// get_table_name_for_array(), without a heap string per lookup.
+static const char* table_path(TableCollection* tables, const char* parent_name, const char* key) {
+    bool under_root = parent_name == NULL || strcmp(parent_name, "root") == 0;
+    size_t parent_len = under_root ? 0 : strlen(parent_name);
+    size_t key_len = strlen(key);
+    size_t needed = parent_len + key_len + 2; // +1 for '_' and +1 for '\0'
+    if (needed > tables->path_capacity) {
+        size_t capacity = tables->path_capacity ? tables->path_capacity : 256;
+        while (capacity < needed) capacity *= 2;
+        char* grown = (char*)realloc(tables->path, capacity);
+        if (!grown) {
+            fatal_error("Error: Memory reallocation failed for table name buffer\n");
+        }
+        tables->path = grown;
+        tables->path_capacity = capacity;
+    }
+    if (!under_root) {
+        memcpy(tables->path, parent_name, parent_len);
+        tables->path[parent_len++] = '_';
+    }
+    memcpy(tables->path + parent_len, key, key_len + 1);
+    return tables->path;
+}
 
-static void add_object_to_table(TableSchema* table, Object_Node* obj) {
-    if (!table || !obj) return;
-    
-    obj->node_id = global_next_node_id++; // Assign a globally unique ID
-    
-    // Add to the head of the table's objects list
-    obj->next = table->objects;
-    table->objects = obj;
+// Push a frame; the caller sets every field it uses
+static TraversalFrame* push_frame(TableCollection* tables) {
+    if (tables->frame_count == tables->frame_capacity) {
+        tables->frame_capacity = tables->frame_capacity ? tables->frame_capacity * 2 : 64;
+        TraversalFrame* grown = (TraversalFrame*)realloc(tables->frames, tables->frame_capacity * sizeof(TraversalFrame));
+        if (!grown) {
+            fatal_error("Error: Memory reallocation failed for schema traversal stack\n");
+        }
+        tables->frames = grown;
+    }
+    return &tables->frames[tables->frame_count++];
 }
 
-// Process an object node.
-// 'current_table_name' is the name of the table this object belongs to.
-// 'parent_id_value' is the ID of the parent object if this object is nested.
-// 'parent_table_name_for_fk' is the name of the direct parent table for FK generation purposes.
-static void process_object_node(AST_Node* node, TableCollection* tables, char* current_table_name, int parent_id_value, const char* parent_table_name_for_fk) {
-    if (!node || node->type != NODE_OBJECT || !node->object) {
-        return;
+int take_node_ids(int* next_node_id, int64_t count) {
+    if (count > (int64_t)INT_MAX - *next_node_id) {
+        fatal_error("Error: Out of row IDs: a run, or the runs of an --append directory, can number at most %d objects\n",
+                    INT_MAX - 1);
     }
-    Object_Node* obj = node->object;
-    
-    KeyList* keys = collect_object_keys(obj);
-    TableSchema* table = find_or_create_table(tables, current_table_name, keys, parent_table_name_for_fk);
-    // 'table' now points to the schema this object conforms to.
-    
-    add_object_to_table(table, obj); // obj gets its node_id here
-    // Note: parent_id_value might need to be stored in obj if it's to be written to CSV for this object.
-    // This is typically handled by CSV generator by looking up the FK column.
-
-    Pair_Node* current_pair = obj->pairs;
-    while (current_pair) {
-        if (current_pair->key == NULL) { // Skip null keys
-            fprintf(stderr, "Warning: Skipping null key in object processing for table '%s'.\n", table->name);
-            current_pair = current_pair->next;
-            continue;
+    int first = *next_node_id;
+    *next_node_id += (int)count;
+    return first;
+}
+
+// Whether the subtree of table 'name' is walked: it feeds a selected table,
+// or --dedup needs it, since whether an object shares a row depends on all
+// of its content
+static bool walks_table(TableCollection* tables, const char* name) {
+    return tables->dedup || projection_feeds(tables->projection, name);
+}
+
+static void push_skipped(TableCollection* tables, int* count, Value_Node value) {
+    if (*count == tables->skipped_capacity) {
+        tables->skipped_capacity = tables->skipped_capacity ? tables->skipped_capacity * 2 : 64;
+        Value_Node* grown = (Value_Node*)realloc(tables->skipped, tables->skipped_capacity * sizeof(Value_Node));
+        if (!grown) {
+            fatal_error("Error: Memory reallocation failed for schema traversal stack\n");
         }
-        switch (current_pair->value.type) {
-            case VALUE_OBJECT: {
-                if (current_pair->value.object_val) {
-                    AST_Node nested_ast_node;
-                    nested_ast_node.type = NODE_OBJECT;
-                    nested_ast_node.object = current_pair->value.object_val;
-                    
-                    // The nested object forms a new table, named based on its key and parent table (current_table_name)
-                    char* nested_obj_table_name = get_table_name_for_array(table->name /* parent is current table */, current_pair->key);
-                    // The parent for FK purposes for this nested object's table is 'table->name'
-                    process_object_node(&nested_ast_node, tables, nested_obj_table_name, obj->node_id /* PK of current obj is FK for nested */, table->name);
-                    free(nested_obj_table_name);
-                }
-                break;
+        tables->skipped = grown;
+    }
+    tables->skipped[(*count)++] = value;
+}
+
+// IDs the objects of a subtree the projection skips would have had, as
+// run_traversal() hands them out: the object, objects under its keys, and
+// the objects of arrays whose first element is an object. Skipping uses
+// them up all the same, so IDs do not depend on the projection. The empty
+// placeholder of a subtree the fast parser skimmed holds its count (ast.h).
+static int64_t skipped_ids(TableCollection* tables, Value_Node value) {
+    int64_t ids = 0;
+    int count = 0;
+    push_skipped(tables, &count, value);
+    while (count > 0) {
+        Value_Node next = tables->skipped[--count];
+        if (next.type == VALUE_OBJECT && next.object_val) {
+            Object_Node* obj = next.object_val;
+            if (obj->node_id < 0) {
+                ids -= obj->node_id;
+                continue;
             }
-            case VALUE_ARRAY: {
-                if (current_pair->value.array_val) {
-                    AST_Node nested_ast_node;
-                    nested_ast_node.type = NODE_ARRAY;
-                    nested_ast_node.array = current_pair->value.array_val; // Correct member access
-                    // The parent table of the array owner is 'table->name'.
-                    // The parent ID for elements of the array (or its junction table) is 'obj->node_id'.
-                    process_array_node(&nested_ast_node, tables, table->name, current_pair->key, obj->node_id);
+            ids++;
+            for (Pair_Node* pair = obj->pairs; pair; pair = pair->next) {
+                if (pair->value.type == VALUE_OBJECT || pair->value.type == VALUE_ARRAY) {
+                    push_skipped(tables, &count, pair->value);
                 }
-                break;
             }
-            default:
-                // Scalar values are handled by populating the current object's row in its table.
-                break;
+        } else if (next.type == VALUE_ARRAY && next.array_val) {
+            Array_Node* arr = next.array_val;
+            if (arr->capacity < 0) {
+                ids -= arr->capacity;
+                continue;
+            }
+            if (arr->size == 0 || arr->elements[0].type != VALUE_OBJECT) continue;
+            for (int i = 0; i < arr->size; i++) {
+                if (arr->elements[i].type == VALUE_OBJECT) push_skipped(tables, &count, arr->elements[i]);
+            }
         }
-        current_pair = current_pair->next;
     }
-    free_key_list(keys);
+    return ids;
 }
 
-// Process an array node.
-// 'parent_table_name_of_array_owner' is the name of the table that owns the object containing this array.
-// 'key_of_array' is the key under which this array is found in its parent object.
-// 'parent_id_value_of_array_owner' is the ID of the object that owns this array (for FKs).
-static void process_array_node(AST_Node* node, TableCollection* tables, char* parent_table_name_of_array_owner, const char* key_of_array, int parent_id_value_of_array_owner) {
-    if (!node || node->type != NODE_ARRAY || !node->array) { // Correct member access
+// Add an object's row to the table at 'table_index' and open a frame for its
+// nested values. 'parent_id' is the ID of the parent object if this object is nested.
+// 'content_id' is its --dedup content if already interned, else -1.
+static void enter_object(TableCollection* tables, int table_index, Object_Node* obj, int parent_id, int content_id) {
+    if (!obj) {
         return;
     }
-    Array_Node* arr = node->array; // Correct member access
-    if (arr->size == 0 || !arr->elements) {
+    TableSchema* table = &tables->tables[table_index];
+    if (table->rows.count == 0 && table->junction.count == 0) {
+        mark_touched(tables, table_index);
+    }
+    bool transient;
+    ObjectShape* shape = find_shape(tables, table_index, obj, &transient);
+    obj->node_id = take_node_ids(&tables->next_node_id, 1); // Assign a globally unique ID
+    int row = -1;
+    if (!table->is_junction) {            // Name first taken by an array of scalars
+        add_row(table, shape, obj, parent_id); // Appended, so rows stay in input order
+        row = table->rows.count - 1;
+    }
+    // Objects without nested values need no frame
+    Pair_Node* pair = obj->pairs;
+    int pair_index = 0;
+    while (pair && pair->value.type != VALUE_OBJECT && pair->value.type != VALUE_ARRAY) {
+        pair = pair->next;
+        pair_index++;
+    }
+    if (!pair) {
+        if (transient) free_shape(shape);
         return;
     }
+    TraversalFrame* frame = push_frame(tables);
+    frame->obj = obj;
+    frame->next_pair = pair;
+    frame->pair_index = pair_index;
+    frame->shape = shape;
+    frame->transient_shape = transient;
+    frame->table_index = table_index;
+    frame->row = row;
+    frame->content_id = content_id;
+}
 
-    // This name is for the table representing the array's contents or a junction table.
-    char* table_name_for_array_elements = get_table_name_for_array(parent_table_name_of_array_owner, key_of_array);
-    if (!table_name_for_array_elements) { exit(EXIT_FAILURE); }
-
-    // Determine if array contains objects or scalars by checking the first element
-    if (arr->elements[0].type == VALUE_OBJECT) {
-        // Array of objects: each object goes into the table 'table_name_for_array_elements'
-        // The parent for FK purposes for this table is 'parent_table_name_of_array_owner'.
-        for (int i = 0; i < arr->size; i++) {
-            if (arr->elements[i].type == VALUE_OBJECT && arr->elements[i].object_val) {
-                AST_Node element_obj_node;
-                element_obj_node.type = NODE_OBJECT;
-                element_obj_node.object = arr->elements[i].object_val;
-                // Each object in the array belongs to the 'table_name_for_array_elements' table.
-                // Its parent for FK is the owner of the array.
-                process_object_node(&element_obj_node, tables, table_name_for_array_elements, parent_id_value_of_array_owner, parent_table_name_of_array_owner);
-            } else {
-                // Handle mixed-type arrays or non-object elements if necessary.
-                // Current logic assumes if first is object, all relevant ones are.
-                 fprintf(stderr, "Warning: Array '%s' expected objects but found non-object at index %d.\n", table_name_for_array_elements, i);
-            }
+// Start on elements of an array found under 'key' in an object of the table
+// 'owner_table_name': the whole array, or with first_index > 0 a later part
+// of it. 'objects' is whether the array's first element is an object.
+// 'owner_id' is the ID of the object that owns this array (for FKs).
+// '*table_index' caches the position of the array's table: -1 until it is known.
+// 'content_id' is the array's --dedup content if interned, else -1.
+// Scalars are added to the junction table at once; an array of objects gets a
+// frame that visits its elements. An array whose table feeds no selected
+// table is skipped, with SKIPPED_TABLE cached, but its objects use up IDs.
+static void enter_elements(TableCollection* tables, Array_Node* arr, bool objects, const char* owner_table_name, const char* key, int owner_id, int* table_index, int first_index, int content_id) {
+    if (*table_index == -1 && !walks_table(tables, table_path(tables, owner_table_name, key))) {
+        *table_index = SKIPPED_TABLE;
+    }
+    if (*table_index == SKIPPED_TABLE) {
+        for (int i = 0; objects && i < arr->size; i++) {
+            if (arr->elements[i].type == VALUE_OBJECT) take_node_ids(&tables->next_node_id, skipped_ids(tables, arr->elements[i]));
         }
-    } else {
-        // Array of scalars: create a junction table.
-        // Table name is 'table_name_for_array_elements'.
-        TableSchema junction_table;
-        junction_table.name = strdup(table_name_for_array_elements);
-        if (!junction_table.name) {
-            fprintf(stderr, "Error: strdup failed for junction table name '%s'\n", table_name_for_array_elements);
-            free(table_name_for_array_elements);
-            exit(EXIT_FAILURE);
+        return;
+    }
+    if (objects) {
+        // Array of objects: each object goes into the table named after the
+        // key, whose parent for FK purposes is 'owner_table_name'. The table
+        // is resolved once for the whole array.
+        if (*table_index < 0) {
+            *table_index = find_or_create_table(tables, table_path(tables, owner_table_name, key),
+                                                arr->elements[0].object_val, owner_table_name);
         }
+        TraversalFrame* frame = push_frame(tables);
+        frame->obj = NULL;
+        frame->arr = arr;
+        frame->next_element = 0;
+        frame->first_index = first_index;
+        frame->owner_id = owner_id;
+        frame->table_index = *table_index;
+        frame->content_id = content_id;
+    } else {
+        // Array of scalars: rows go to a junction table, created once per name.
+        if (*table_index < 0) *table_index = find_table(tables, table_path(tables, owner_table_name, key));
+        if (*table_index < 0) {
+            const char* table_name = tables->path;
+            if (tables->fixed) report_unknown_table(table_name);
+            TableSchema junction_table = {0};
+            junction_table.name = strdup(table_name);
+            if (!junction_table.name) {
+                fatal_error("Error: strdup failed for junction table name '%s'\n", table_name);
+            }
 
-        junction_table.column_count = 3; // parent_id, index, value
-        junction_table.columns = (char**)calloc(junction_table.column_count, sizeof(char*));
-        if (!junction_table.columns) {
-            fprintf(stderr, "Error: calloc failed for junction table columns for '%s'\n", junction_table.name);
-            free(junction_table.name);
-            free(table_name_for_array_elements);
-            exit(EXIT_FAILURE);
-        }
+            junction_table.column_count = 3; // parent_id, index, value
+            junction_table.columns = (char**)calloc(junction_table.column_count, sizeof(char*));
+            if (!junction_table.columns) {
+                fatal_error("Error: calloc failed for junction table columns for '%s'\n", junction_table.name);
+            }
         
-        char fk_col_name_buffer[256]; // Buffer for FK column name
-        // The FK points to the table that owns the object which has this array.
-        sprintf(fk_col_name_buffer, "%s_id", parent_table_name_of_array_owner); 
+            // The FK points to the table that owns the object which has this array.
+            junction_table.columns[0] = get_fk_column_name(owner_table_name);
+            junction_table.columns[1] = strdup("item_index"); // Renamed from "index" to avoid SQL keyword clash
+            junction_table.columns[2] = strdup("value");
+
+            bool cols_ok = junction_table.columns[0] && junction_table.columns[1] && junction_table.columns[2];
+            if (!cols_ok) {
+                fatal_error("Error: strdup failed for one or more junction table column names for '%s'\n", junction_table.name);
+            }
         
-        junction_table.columns[0] = strdup(fk_col_name_buffer);
-        junction_table.columns[1] = strdup("item_index"); // Renamed from "index" to avoid SQL keyword clash
-        junction_table.columns[2] = strdup("value");
-
-        bool cols_ok = junction_table.columns[0] && junction_table.columns[1] && junction_table.columns[2];
-        if (!cols_ok) {
-            fprintf(stderr, "Error: strdup failed for one or more junction table column names for '%s'\n", junction_table.name);
-            for(int c=0; c<3; ++c) if(junction_table.columns[c]) free(junction_table.columns[c]);
-            free(junction_table.columns);
-            free(junction_table.name);
-            free(table_name_for_array_elements);
-            exit(EXIT_FAILURE);
+            build_column_map(&junction_table);
+            junction_table.is_junction = true; // Rows go to 'junction', the row store stays empty
+            junction_table.omitted = !projection_keeps_table(tables->projection, junction_table.name);
+            *table_index = add_table(tables, junction_table); // Adds a copy of junction_table
         }
         
-        junction_table.objects = NULL; // Junction tables for scalars don't directly store Object_Nodes from AST.
-                                       // Their rows are generated during CSV writing.
-        add_table(tables, junction_table); // Adds a copy of junction_table
+        // One row per scalar, keeping its position in the array. Nested objects
+        // and arrays inside a scalar array do not map to any table, and neither
+        // do scalars whose name was first taken by a table of objects.
+        const TableSchema* table = &tables->tables[*table_index];
+        for (int i = 0; i < arr->size && table->is_junction && !table->omitted; i++) {
+            if (arr->elements[i].type == VALUE_OBJECT || arr->elements[i].type == VALUE_ARRAY) continue;
+            add_junction_row(tables, *table_index, owner_id, first_index + i, arr->elements[i]);
+        }
     }
-    
-    // The local_array_table_name was either strdup'd by find_or_create_table (via process_object_node)
-    // or strdup'd directly for junction_table.name. So, the original can be freed.
-    free(table_name_for_array_elements);
 }
- 
-// Main schema generation function
-Schema* generate_schema(AST_Node* root) {
-    if (!root) {
-        return NULL;
+
+// Start on a whole array; its first element decides the kind of its table
+static void enter_array(TableCollection* tables, Array_Node* arr, const char* owner_table_name, const char* key, int owner_id, int* table_index, int content_id) {
+    if (arr && arr->capacity < 0) { // Skimmed by the fast parser
+        take_node_ids(&tables->next_node_id, -(int64_t)arr->capacity);
+        return;
     }
-    
-    TableCollection* collection = create_table_collection();
-    global_next_node_id = 1; // Reset global ID for each schema generation run
+    if (!arr || arr->size == 0 || !arr->elements) {
+        return;
+    }
+    bool objects = arr->elements[0].type == VALUE_OBJECT;
+    enter_elements(tables, arr, objects, owner_table_name, key, owner_id, table_index, 0, content_id);
+}
 
-    if (root->type == NODE_OBJECT) {
-        // The root object belongs to a table named "root". It has no parent FK.
-        process_object_node(root, collection, "root", 0, NULL); // NULL for parent_table_name_for_fk
-    } else if (root->type == NODE_ARRAY) {
-        // A root array. Elements will go into a table named "root_items" (or similar, based on key "items").
-        // The parent context for this array is "root".
-        process_array_node(root, collection, "root", "items", 0);
-    } else {
-        fprintf(stderr, "Error: Root of JSON data must be an object or an array.\n");
-        // Free collection before exiting
-        free(collection->tables);
-        free(collection);
-        exit(EXIT_FAILURE);
+// A nested object, under the key whose column is 'slot' in the row
+// 'parent_row' of 'parent_table'. With --dedup an object whose table has no
+// FK column is shared: it gets a row, and its subtree is converted, only if
+// no earlier object of the table had the same content. The ID of the row it
+// gets or reuses goes in its key's column of the parent row instead of null.
+static void enter_nested_object(TableCollection* tables, int table_index, Value_Node value, int parent_id,
+                                int content_id, int parent_table, int parent_row, int slot) {
+    if (!tables->dedup || tables->tables[table_index].has_parent_fk) {
+        enter_object(tables, table_index, value.object_val, parent_id, content_id);
+        return;
     }
-    
+    if (content_id < 0) content_id = intern_content(tables->dedup, value);
+    int id = content_row(tables->dedup, table_index, content_id);
+    if (id == 0) {
+        enter_object(tables, table_index, value.object_val, parent_id, content_id);
+        id = value.object_val->node_id;
+        set_content_row(tables->dedup, table_index, content_id, id);
+    }
+    if (slot < 0 || parent_row < 0) return;
+    ColumnVector* column = &tables->tables[parent_table].rows.columns[slot];
+    column->types[parent_row] = VALUE_INTEGER;
+    column->cells[parent_row].integer_val = id;
+}
+
+// Visit everything below the frames opened by enter_object()/enter_array(),
+// depth first and in document order, so IDs and rows come out as a
+// recursive walk would produce them. A frame pointer is only used until the
+// next push, which may move the stack.
+static void run_traversal(TableCollection* tables) {
+    while (tables->frame_count > 0) {
+        TraversalFrame* frame = &tables->frames[tables->frame_count - 1];
+
+        if (!frame->obj) { // Array of objects: the next element
+            if (frame->next_element == frame->arr->size) {
+                tables->frame_count--;
+                continue;
+            }
+            int i = frame->next_element++;
+            Value_Node* element = &frame->arr->elements[i];
+            if (element->type == VALUE_OBJECT && element->object_val) {
+                int content_id = frame->content_id >= 0 ? content_element(tables->dedup, frame->content_id, i) : -1;
+                enter_object(tables, frame->table_index, element->object_val, frame->owner_id, content_id);
+            } else {
+                // Handle mixed-type arrays or non-object elements if necessary.
+                // Current logic assumes if first is object, all relevant ones are.
+                 report_warning("Warning: Array '%s' expected objects but found non-object at index %d.\n",
+                         tables->tables[frame->table_index].name, frame->first_index + i);
+            }
+            continue;
+        }
+
+        // Object: skip to the next pair holding an object or an array.
+        // Scalar values were stored in the object's row by enter_object().
+        Pair_Node* pair = frame->next_pair;
+        int i = frame->pair_index;
+        while (pair && pair->value.type != VALUE_OBJECT && pair->value.type != VALUE_ARRAY) {
+            pair = pair->next;
+            i++;
+        }
+        if (!pair) {
+            if (frame->transient_shape) free_shape(frame->shape);
+            tables->frame_count--;
+            continue;
+        }
+        frame->next_pair = pair->next;
+        frame->pair_index = i + 1;
+
+        ObjectShape* shape = frame->shape;
+        int owner_id = frame->obj->node_id;
+        int table_index = frame->table_index;
+        int row = frame->row;
+        int content_id = frame->content_id >= 0 ? content_member(tables->dedup, frame->content_id, pair->key_id, i) : -1;
+        // Table names are heap-allocated and do not move with tables->tables
+        const char* table_name = tables->tables[table_index].name;
+        if (pair->value.type == VALUE_OBJECT) {
+            if (pair->value.object_val) {
+                // The nested object forms a table named after its key and this
+                // table, with this object's PK as its FK (none with --dedup,
+                // whose objects are shared)
+                if (shape->child_tables[i] == -1) {
+                    const char* child_name = table_path(tables, table_name, pair->key);
+                    shape->child_tables[i] = !walks_table(tables, child_name) ? SKIPPED_TABLE :
+                        find_or_create_table(tables, child_name, pair->value.object_val, tables->dedup ? NULL : table_name);
+                }
+                if (shape->child_tables[i] != SKIPPED_TABLE) {
+                    enter_nested_object(tables, shape->child_tables[i], pair->value, owner_id, content_id,
+                                        table_index, row, shape->slots[i]);
+                } else {
+                    take_node_ids(&tables->next_node_id, skipped_ids(tables, pair->value));
+                }
+            }
+        } else {
+            // The parent ID for elements of the array (or its junction table) is the object's ID
+            enter_array(tables, pair->value.array_val, table_name, pair->key, owner_id, &shape->child_tables[i], content_id);
+        }
+    }
+}
+// Move the tables of a collection into a Schema and free the collection
+static Schema* collection_to_schema(TableCollection* collection) {
     Schema* schema = (Schema*)malloc(sizeof(Schema));
     if (!schema) {
-        fprintf(stderr, "Error: Memory allocation failed for schema structure\n");
-        // Free collection & its tables before exiting
+        // Free collection & its tables before unwinding
         for (int i = 0; i < collection->table_count; i++) {
             if (collection->tables[i].name) free(collection->tables[i].name);
             if (collection->tables[i].columns) {
@@ -468,20 +840,157 @@ Schema* generate_schema(AST_Node* root) {
                 }
                 free(collection->tables[i].columns);
             }
+            name_index_free(&collection->tables[i].column_index);
+            free(collection->tables[i].column_slots);
         }
+        name_index_free(&collection->name_index);
         free(collection->tables);
         free(collection);
-        exit(EXIT_FAILURE);
+        fatal_error("Error: Memory allocation failed for schema structure\n");
     }
     
     schema->tables = collection->tables;       // Transfer ownership of tables array
     schema->table_count = collection->table_count;
+    schema->next_node_id = collection->next_node_id;
+    schema->dedup = collection->dedup != NULL;
     
+    // Shapes, the traversal stack and the name buffer only serve schema generation
+    for (int i = 0; i < collection->table_count; i++) {
+        for (int j = 0; j < collection->shapes[i].count; j++) free_shape(collection->shapes[i].shapes[j]);
+        free(collection->shapes[i].shapes);
+        free_reported_keys(&collection->shapes[i].unknown_keys);
+    }
+    free(collection->shapes);
+    free(collection->frames);
+    free(collection->skipped);
+    free(collection->path);
+    name_index_free(&collection->name_index);
+    free(collection->touched);
+    free_content_table(collection->dedup);
     free(collection); // Free the collection shell, not the tables array itself.
     
     return schema;
 }
+
+// Main schema generation function
+Schema* generate_schema(AST_Node* root, const Schema* known, const Projection* projection, bool dedup) {
+    if (!root) {
+        return NULL;
+    }
+    
+    TableCollection* collection = create_table_collection(known, projection, dedup);
+
+    if (root->type == NODE_OBJECT) {
+        // The root object belongs to a table named "root". It has no parent FK.
+        int root_table = find_or_create_table(collection, "root", root->object, NULL); // NULL for parent_table_name_for_fk
+        enter_object(collection, root_table, root->object, 0, -1);
+    } else if (root->type == NODE_ARRAY) {
+        // A root array. Elements will go into a table named "root_items" (or similar, based on key "items").
+        // The parent context for this array is "root".
+        int items_table = -1;
+        enter_array(collection, root->array, "root", "items", 0, &items_table, -1);
+    } else {
+        // Free collection before unwinding
+        name_index_free(&collection->name_index);
+        free(collection->tables);
+        free(collection->shapes);
+        free_content_table(collection->dedup);
+        free(collection);
+        fatal_error("Error: Root of JSON data must be an object or an array.\n");
+    }
+    run_traversal(collection);
+    
+    return collection_to_schema(collection);
+}
  
+// Incremental schema generation for --ndjson
+struct SchemaBuilder {
+    TableCollection* collection;
+    Schema view;      // Current tables, refreshed after every record
+    long records;     // Records added so far, for error messages
+    int items_table;  // Position of the "items" table, -1 until the first record,
+                      // SKIPPED_TABLE if the projection needs nothing from the records
+    bool element_objects; // --memory-limit: the array's first element is an object
+};
+
+SchemaBuilder* create_schema_builder(const Schema* known, const Projection* projection, bool dedup) {
+    SchemaBuilder* builder = (SchemaBuilder*)calloc(1, sizeof(SchemaBuilder));
+    if (!builder) {
+        fatal_error("Error: Memory allocation failed for schema builder\n");
+    }
+    builder->collection = create_table_collection(known, projection, dedup);
+    builder->view.dedup = dedup;
+    builder->items_table = -1;
+    return builder;
+}
+
+// Expose the tables as they are after a record or part
+static void refresh_view(SchemaBuilder* builder) {
+    builder->view.tables = builder->collection->tables;
+    builder->view.table_count = builder->collection->table_count;
+}
+
+// Each record is treated like one element of a top-level array, so the tables
+// and IDs match those of the same records wrapped in [ ... ]
+bool schema_add_record(SchemaBuilder* builder, AST_Node* record) {
+    builder->records++;
+    if (record->type == NODE_OBJECT) {
+        if (builder->items_table == -1) {
+            builder->items_table = !walks_table(builder->collection, "items") ? SKIPPED_TABLE :
+                find_or_create_table(builder->collection, "items", record->object, "root");
+        }
+        if (builder->items_table != SKIPPED_TABLE) {
+            enter_object(builder->collection, builder->items_table, record->object, 0, -1);
+        } else {
+            take_node_ids(&builder->collection->next_node_id,
+                          skipped_ids(builder->collection, create_object_value(record->object)));
+        }
+    } else if (record->type == NODE_ARRAY) {
+        enter_array(builder->collection, record->array, "root", "items", 0, &builder->items_table, -1);
+    } else {
+        // Reported rather than raised, so the rows of earlier records are still written
+        report_error("Error: NDJSON record %ld must be an object or an array.\n", builder->records);
+        return false;
+    }
+    run_traversal(builder->collection);
+    refresh_view(builder);
+    return true;
+}
+
+void schema_add_elements(SchemaBuilder* builder, Array_Node* elements, int first_index) {
+    if (elements->size == 0) return;
+    if (first_index == 0) builder->element_objects = elements->elements[0].type == VALUE_OBJECT;
+    enter_elements(builder->collection, elements, builder->element_objects, "root", "items", 0,
+                   &builder->items_table, first_index, -1);
+    run_traversal(builder->collection);
+    refresh_view(builder);
+}
+
+Schema* schema_builder_tables(SchemaBuilder* builder) {
+    return &builder->view;
+}
+
+int schema_builder_touched(SchemaBuilder* builder, const int** positions) {
+    *positions = builder->collection->touched;
+    return builder->collection->touched_count;
+}
+
+void schema_builder_clear_rows(SchemaBuilder* builder) {
+    TableCollection* collection = builder->collection;
+    for (int i = 0; i < collection->touched_count; i++) {
+        collection->tables[collection->touched[i]].rows.count = 0;
+        collection->tables[collection->touched[i]].junction.count = 0;
+    }
+    collection->touched_count = 0;
+}
+
+Schema* finish_schema_builder(SchemaBuilder* builder) {
+    schema_builder_clear_rows(builder);
+    Schema* schema = collection_to_schema(builder->collection);
+    free(builder);
+    return schema;
+}
+
 // Free schema memory
 void free_schema(Schema* schema) {
     if (!schema) return;
@@ -505,13 +1014,41 @@ void free_schema(Schema* schema) {
                 free(table->columns);
                 table->columns = NULL;
             }
-            // Objects (Object_Node linked list in table->objects) are part of the main AST.
-            // The AST is freed separately by free_ast().
-            // TableSchema does not own the Object_Node data itself, only pointers to them.
-            table->objects = NULL; // Clear the pointer
+            name_index_free(&table->column_index);
+            free(table->column_slots);
+            table->column_slots = NULL;
+            free(table->junction.owner_ids);
+            free(table->junction.item_indexes);
+            free(table->junction.values);
+            // String cells point into the AST, which is freed separately by free_ast()
+            if (table->rows.columns) {
+                for (int j = 0; j < table->column_count; j++) {
+                    free(table->rows.columns[j].types);
+                    free(table->rows.columns[j].cells);
+                }
+                free(table->rows.columns);
+                table->rows.columns = NULL;
+            }
+            free(table->rows.ids);
+            free(table->rows.parent_ids);
         }
         free(schema->tables); // Free the array of TableSchema structs
         schema->tables = NULL;
     }
     free(schema); // Free the Schema struct itself
 }
+
+size_t schema_row_bytes(const Schema* schema) {
+    size_t bytes = 0;
+    for (int i = 0; i < schema->table_count; i++) {
+        const TableSchema* table = &schema->tables[i];
+        size_t junction_row = 2 * sizeof(int) + sizeof(Value_Node);
+        bytes += (size_t)table->junction.capacity * junction_row;
+        size_t row = 2 * sizeof(int); // ids, parent_ids
+        for (int j = 0; table->rows.columns && j < table->column_count; j++) {
+            if (table->rows.columns[j].types) row += sizeof(uint8_t) + sizeof(ColumnCell);
+        }
+        bytes += (size_t)table->rows.capacity * row;
+    }
+    return bytes;
+}
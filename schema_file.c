@@ -0,0 +1,451 @@
+/**
+ * schema_file.c - Saved table layouts (--emit-schema, --schema)
+ */
+
+#include "schema_file.h"
+#include "error.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SCHEMA_FILE_HEADER "json2relcsv-schema 1"
+#define STATE_FILE_NAME ".json2relcsv-state"
+
+// Write a name with tab, CR, LF and backslash escaped
+static void write_name(FILE* out, const char* name, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        switch (name[i]) {
+            case '\\': fputs("\\\\", out); break;
+            case '\t': fputs("\\t", out); break;
+            case '\r': fputs("\\r", out); break;
+            case '\n': fputs("\\n", out); break;
+            default: fputc(name[i], out); break;
+        }
+    }
+}
+
+// The FK column of a table ("<parent>_id"), or NULL
+static const char* fk_column(const TableSchema* table) {
+    if (table->is_junction) return table->columns[0];
+    return table->has_parent_fk ? table->columns[1] : NULL;
+}
+
+// Write the schema, and the output settings of a state file if given;
+// returns false if the file could not be written
+static bool write_schema_to(FILE* out, const Schema* schema, const OutputOptions* options) {
+    fputs(SCHEMA_FILE_HEADER "\n", out);
+    if (schema->next_node_id > 0) fprintf(out, "next_id\t%d\n", schema->next_node_id);
+    fprintf(out, "dedup\t%s\n", schema->dedup ? "yes" : "no");
+    if (options) {
+        fprintf(out, "compress\t%s\n", compression_name(options->compression.codec));
+        fprintf(out, "quote\t%s\n", quote_policy_name(options->quote_policy));
+    }
+    for (int i = 0; i < schema->table_count; i++) {
+        const TableSchema* table = &schema->tables[i];
+        if (table->omitted) continue; // Not written, so not part of the output's layout
+        fputs("table\t", out);
+        write_name(out, table->name, strlen(table->name));
+        fputs(table->is_junction ? "\tjunction\t" : "\tobject\t", out);
+        const char* fk = fk_column(table);
+        if (fk) write_name(out, fk, strlen(fk) - 3); // Without "_id"
+        fputc('\n', out);
+        for (int j = 0; j < table->column_count; j++) {
+            fputs("column\t", out);
+            write_name(out, table->columns[j], strlen(table->columns[j]));
+            fputc('\n', out);
+        }
+    }
+    bool failed = ferror(out) != 0;
+    return fclose(out) == 0 && !failed;
+}
+
+void write_schema_file(const char* path, const Schema* schema) {
+    FILE* out = fopen(path, "w");
+    if (!out) {
+        fatal_error("Error: Failed to open schema file '%s': %s\n", path, strerror(errno));
+    }
+    if (!write_schema_to(out, schema, NULL)) {
+        fatal_error("Error: Failed to write schema file '%s': %s\n", path, strerror(errno));
+    }
+}
+
+// State of reading one schema file; everything is released on an error
+typedef struct SchemaReader {
+    const char* path;
+    int line;
+    char* text;               // The whole file; names are unescaped in place
+    Schema* schema;
+    int table_capacity;
+    int column_capacity;      // Of the last table
+    const char* parent;       // Of the last table; NULL while there is none
+    int table_line;           // Line of the last table, for errors in its columns
+    NameIndex table_names;    // Name -> position, to reject repeated tables
+    bool has_codec;           // A compress line was read
+    CompressionCodec codec;
+    bool has_quote_policy;    // A quote line was read
+    CsvQuotePolicy quote_policy;
+} SchemaReader;
+
+static void reader_fail(SchemaReader* reader, const char* format, ...) __attribute__((noreturn, format(printf, 2, 3)));
+
+static void reader_fail(SchemaReader* reader, const char* format, ...) {
+    char problem[512];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(problem, sizeof(problem), format, args);
+    va_end(args);
+    free_schema(reader->schema);
+    name_index_free(&reader->table_names);
+    free(reader->text);
+    fatal_error("Error: Schema file '%s', line %d: %s\n", reader->path, reader->line, problem);
+}
+
+// Read all of 'path' into a NUL-terminated buffer
+static char* read_whole_file(const char* path) {
+    FILE* in = fopen(path, "rb");
+    if (!in) {
+        fatal_error("Error: Failed to open schema file '%s': %s\n", path, strerror(errno));
+    }
+    size_t length = 0;
+    size_t capacity = 4096;
+    char* text = (char*)malloc(capacity);
+    while (text) {
+        length += fread(text + length, 1, capacity - length - 1, in);
+        if (length < capacity - 1) break;
+        capacity *= 2;
+        char* grown = (char*)realloc(text, capacity);
+        if (!grown) free(text);
+        text = grown;
+    }
+    bool failed = ferror(in) != 0;
+    fclose(in);
+    if (!text) {
+        fatal_error("Error: Memory allocation failed for schema file '%s'\n", path);
+    }
+    if (failed) {
+        free(text);
+        fatal_error("Error: Failed to read schema file '%s'\n", path);
+    }
+    text[length] = '\0';
+    return text;
+}
+
+// Unescape a name in place; returns false on an unknown escape
+static bool unescape_name(char* name) {
+    char* out = name;
+    for (const char* in = name; *in; in++) {
+        if (*in != '\\') {
+            *out++ = *in;
+            continue;
+        }
+        switch (*++in) {
+            case '\\': *out++ = '\\'; break;
+            case 't': *out++ = '\t'; break;
+            case 'r': *out++ = '\r'; break;
+            case 'n': *out++ = '\n'; break;
+            default: return false;
+        }
+    }
+    *out = '\0';
+    return true;
+}
+
+// Split the next tab-separated field off '*rest'; NULL if there is none
+static char* next_field(SchemaReader* reader, char** rest) {
+    char* field = *rest;
+    if (!field) return NULL;
+    char* tab = strchr(field, '\t');
+    *rest = tab ? tab + 1 : NULL;
+    if (tab) *tab = '\0';
+    if (!unescape_name(field)) reader_fail(reader, "invalid escape in '%s'", field);
+    return field;
+}
+
+static char* copy_name(SchemaReader* reader, const char* name) {
+    char* copy = strdup(name);
+    if (!copy) reader_fail(reader, "out of memory");
+    return copy;
+}
+
+static bool is_fk_of(const char* column, const char* parent) {
+    size_t length = strlen(parent);
+    return strncmp(column, parent, length) == 0 && strcmp(column + length, "_id") == 0;
+}
+
+// Check that the last table's columns fit its kind and parent, then index them
+static void finish_table(SchemaReader* reader) {
+    if (reader->schema->table_count == 0) return;
+    TableSchema* table = &reader->schema->tables[reader->schema->table_count - 1];
+    const char* parent = reader->parent;
+    reader->line = reader->table_line;
+    if (table->is_junction) {
+        if (table->column_count != 3 || !is_fk_of(table->columns[0], parent) ||
+            strcmp(table->columns[1], "item_index") != 0 || strcmp(table->columns[2], "value") != 0) {
+            reader_fail(reader, "junction table '%s' must have the columns %s_id, item_index, value", table->name, parent);
+        }
+    } else {
+        if (table->column_count < 1 || strcmp(table->columns[0], "id") != 0) {
+            reader_fail(reader, "the first column of table '%s' must be id", table->name);
+        }
+        if (parent) {
+            if (table->column_count < 2 || !is_fk_of(table->columns[1], parent)) {
+                reader_fail(reader, "the second column of table '%s' must be %s_id", table->name, parent);
+            }
+            table->has_parent_fk = true;
+        }
+    }
+    build_column_map(table);
+}
+
+static void read_table_line(SchemaReader* reader, char* rest) {
+    char* name = next_field(reader, &rest);
+    char* kind = next_field(reader, &rest);
+    char* parent = next_field(reader, &rest);
+    if (!name || !kind || !parent || rest) reader_fail(reader, "expected table, name, kind and parent");
+    if (!*name) reader_fail(reader, "empty table name");
+    bool is_junction = strcmp(kind, "junction") == 0;
+    if (!is_junction && strcmp(kind, "object") != 0) {
+        reader_fail(reader, "table kind must be object or junction, not '%s'", kind);
+    }
+    if (is_junction && !*parent) reader_fail(reader, "junction table '%s' needs a parent", name);
+    if (name_index_get(&reader->table_names, name, hash_name(name)) >= 0) {
+        reader_fail(reader, "table '%s' is listed twice", name);
+    }
+
+    Schema* schema = reader->schema;
+    if (schema->table_count == reader->table_capacity) {
+        reader->table_capacity = reader->table_capacity ? reader->table_capacity * 2 : 16;
+        TableSchema* grown = (TableSchema*)realloc(schema->tables, reader->table_capacity * sizeof(TableSchema));
+        if (!grown) reader_fail(reader, "out of memory");
+        schema->tables = grown;
+    }
+    TableSchema* table = &schema->tables[schema->table_count];
+    memset(table, 0, sizeof(TableSchema));
+    table->name = copy_name(reader, name);
+    table->is_junction = is_junction;
+    schema->table_count++;
+    name_index_put(&reader->table_names, table->name, hash_name(table->name), schema->table_count - 1);
+    reader->column_capacity = 0;
+    reader->parent = *parent ? parent : NULL;
+    reader->table_line = reader->line;
+}
+
+static void read_column_line(SchemaReader* reader, char* rest) {
+    char* name = next_field(reader, &rest);
+    if (!name || rest) reader_fail(reader, "expected column and name");
+    if (reader->schema->table_count == 0) reader_fail(reader, "column before the first table");
+    TableSchema* table = &reader->schema->tables[reader->schema->table_count - 1];
+    if (table->column_count == reader->column_capacity) {
+        reader->column_capacity = reader->column_capacity ? reader->column_capacity * 2 : 8;
+        char** grown = (char**)realloc(table->columns, reader->column_capacity * sizeof(char*));
+        if (!grown) reader_fail(reader, "out of memory");
+        table->columns = grown;
+    }
+    table->columns[table->column_count] = copy_name(reader, name);
+    table->column_count++;
+}
+
+// Read a schema file; 'settings', if given, gets its compress and quote lines
+static Schema* read_schema(const char* path, SchemaReader* settings) {
+    SchemaReader reader = {0};
+    reader.path = path;
+    reader.text = read_whole_file(path);
+    name_index_init(&reader.table_names);
+    reader.schema = (Schema*)calloc(1, sizeof(Schema));
+    if (!reader.schema) reader_fail(&reader, "out of memory");
+
+    char* next_line = reader.text;
+    while (next_line && *next_line) {
+        char* line = next_line;
+        reader.line++;
+        char* newline = strchr(line, '\n');
+        next_line = newline ? newline + 1 : NULL;
+        if (newline) *newline = '\0';
+        size_t length = strlen(line);
+        if (length > 0 && line[length - 1] == '\r') line[--length] = '\0'; // Written on Windows
+
+        if (reader.line == 1) {
+            if (strcmp(line, SCHEMA_FILE_HEADER) != 0) {
+                reader_fail(&reader, "not a schema file (expected \"" SCHEMA_FILE_HEADER "\")");
+            }
+            continue;
+        }
+        if (length == 0) continue;
+        char* rest = line;
+        char* record = next_field(&reader, &rest);
+        if (strcmp(record, "table") == 0) {
+            int line_number = reader.line;
+            finish_table(&reader);
+            reader.line = line_number;
+            read_table_line(&reader, rest);
+        } else if (strcmp(record, "column") == 0) {
+            read_column_line(&reader, rest);
+        } else if (strcmp(record, "next_id") == 0) {
+            char* value = next_field(&reader, &rest);
+            char* end = NULL;
+            long next_id = value ? strtol(value, &end, 10) : 0;
+            if (!value || rest || *end != '\0' || next_id < 1 || next_id > INT_MAX) {
+                reader_fail(&reader, "next_id must be a positive integer");
+            }
+            reader.schema->next_node_id = (int)next_id;
+        } else if (strcmp(record, "dedup") == 0) {
+            char* value = next_field(&reader, &rest);
+            if (!value || rest || (strcmp(value, "yes") != 0 && strcmp(value, "no") != 0)) {
+                reader_fail(&reader, "dedup must be yes or no");
+            }
+            reader.schema->dedup = strcmp(value, "yes") == 0;
+        } else if (strcmp(record, "compress") == 0) {
+            char* value = next_field(&reader, &rest);
+            Compression compression = {0};
+            if (!value || rest || (strcmp(value, "none") != 0 && !parse_compression(value, &compression))) {
+                reader_fail(&reader, "compress must be gzip, zstd or none");
+            }
+            reader.has_codec = true;
+            reader.codec = compression.codec;
+        } else if (strcmp(record, "quote") == 0) {
+            char* value = next_field(&reader, &rest);
+            if (!value || rest || !parse_quote_policy(value, &reader.quote_policy)) {
+                reader_fail(&reader, "quote must be minimal, strings or all");
+            }
+            reader.has_quote_policy = true;
+        } else {
+            reader_fail(&reader, "unknown line '%s'", record);
+        }
+    }
+    if (reader.line == 0) {
+        reader.line = 1;
+        reader_fail(&reader, "empty file");
+    }
+    finish_table(&reader);
+
+    name_index_free(&reader.table_names);
+    free(reader.text);
+    if (settings) *settings = reader;
+    return reader.schema;
+}
+
+// Refuse tables laid out with --dedup for a run without it, or the reverse;
+// 'use' names the option the run loads them with
+static void check_dedup(const char* path, Schema* schema, bool dedup, const char* use) {
+    if (schema->dedup == dedup) return;
+    bool written = schema->dedup;
+    free_schema(schema);
+    fatal_error("Error: The tables of '%s' are laid out %s --dedup; %s run must %s it\n",
+                path, written ? "with" : "without", use, written ? "use" : "not use");
+}
+
+Schema* read_schema_file(const char* path, bool dedup) {
+    Schema* schema = read_schema(path, NULL);
+    check_dedup(path, schema, dedup, "a --schema");
+    return schema;
+}
+
+TableSchema copy_table_layout(const TableSchema* table) {
+    TableSchema copy = {0};
+    copy.name = strdup(table->name);
+    copy.columns = (char**)calloc(table->column_count ? table->column_count : 1, sizeof(char*));
+    if (!copy.name || !copy.columns) {
+        fatal_error("Error: Memory allocation failed for schema table '%s'\n", table->name);
+    }
+    copy.column_count = table->column_count;
+    for (int i = 0; i < table->column_count; i++) {
+        copy.columns[i] = strdup(table->columns[i]);
+        if (!copy.columns[i]) {
+            fatal_error("Error: Memory allocation failed for columns of schema table '%s'\n", table->name);
+        }
+    }
+    copy.has_parent_fk = table->has_parent_fk;
+    copy.is_junction = table->is_junction;
+    build_column_map(&copy);
+    return copy;
+}
+
+void report_unknown_key(ReportedKeys* reported, const char* table_name, const char* key) {
+    uint32_t hash = hash_name(key);
+    if (name_index_get(&reported->index, key, hash) >= 0) return;
+    if (reported->count == reported->capacity) {
+        reported->capacity = reported->capacity ? reported->capacity * 2 : 8;
+        char** grown = (char**)realloc(reported->keys, reported->capacity * sizeof(char*));
+        if (!grown) {
+            fatal_error("Error: Memory reallocation failed for unknown keys of table '%s'\n", table_name);
+        }
+        reported->keys = grown;
+    }
+    char* copy = strdup(key);
+    if (!copy) {
+        fatal_error("Error: Memory allocation failed for unknown keys of table '%s'\n", table_name);
+    }
+    reported->keys[reported->count++] = copy;
+    name_index_put(&reported->index, copy, hash, 0);
+    report_warning("Warning: Key '%s' of table '%s' is not in the schema; its values are dropped.\n", key, table_name);
+}
+
+void free_reported_keys(ReportedKeys* reported) {
+    for (int i = 0; i < reported->count; i++) free(reported->keys[i]);
+    free(reported->keys);
+    name_index_free(&reported->index);
+    memset(reported, 0, sizeof(ReportedKeys));
+}
+
+void report_unknown_table(const char* table_name) {
+    report_warning("Warning: Table '%s' is not in the schema; its columns are taken from the data.\n", table_name);
+}
+
+char* state_file_path(const char* out_dir) {
+    if (!out_dir || !out_dir[0]) out_dir = ".";
+    size_t size = strlen(out_dir) + sizeof("/" STATE_FILE_NAME);
+    char* path = (char*)malloc(size);
+    if (!path) {
+        fatal_error("Error: Memory allocation failed for state file path\n");
+    }
+    snprintf(path, size, "%s/" STATE_FILE_NAME, out_dir);
+    return path;
+}
+
+Schema* read_state_file(const char* path, const OutputOptions* options, bool dedup) {
+    struct stat st;
+    if (stat(path, &st) != 0 && errno == ENOENT) return NULL; // First run
+    SchemaReader settings;
+    Schema* schema = read_schema(path, &settings);
+    if (schema->next_node_id == 0) {
+        free_schema(schema);
+        fatal_error("Error: State file '%s' has no next_id\n", path);
+    }
+    // States written before these lines existed are taken as they are
+    if (settings.has_codec && settings.codec != options->compression.codec) {
+        free_schema(schema);
+        fatal_error("Error: The tables of '%s' are written with --compress %s; an --append run must use the same\n",
+                    path, compression_name(settings.codec));
+    }
+    if (settings.has_quote_policy && settings.quote_policy != options->quote_policy) {
+        free_schema(schema);
+        fatal_error("Error: The tables of '%s' are written with --quote %s; an --append run must use the same\n",
+                    path, quote_policy_name(settings.quote_policy));
+    }
+    check_dedup(path, schema, dedup, "an --append");
+    return schema;
+}
+
+void write_state_file(const char* path, const Schema* schema, const OutputOptions* options) {
+    // Written next to the old state and renamed over it, so a crash leaves one or the other
+    size_t size = strlen(path) + sizeof(".tmp");
+    char* temporary = (char*)malloc(size);
+    if (!temporary) {
+        fatal_error("Error: Memory allocation failed for state file path\n");
+    }
+    snprintf(temporary, size, "%s.tmp", path);
+    FILE* out = fopen(temporary, "w");
+    bool written = out && write_schema_to(out, schema, options) && rename(temporary, path) == 0;
+    if (!written) {
+        int error = errno;
+        unlink(temporary);
+        free(temporary);
+        fatal_error("Error: Failed to write state file '%s': %s\n", path, strerror(error));
+    }
+    free(temporary);
+}
@@ -0,0 +1,78 @@
+/**
+ * schema_file.h - Saved table layouts (--emit-schema, --schema)
+ *
+ * A schema file lists the tables of a conversion. The first line is
+ * "json2relcsv-schema 1"; then each table has one line
+ *     table<TAB>NAME<TAB>object|junction<TAB>PARENT
+ * followed by one "column<TAB>NAME" line per CSV column, id and FK columns
+ * included, so the columns are exactly the table's header. PARENT is the
+ * table its FK column references and is empty for a table without one.
+ * Backslash, tab, CR and LF in names are written as \\, \t, \r and \n.
+ * A "next_id<TAB>N" line after the first gives the first ID the run did not
+ * hand out; --schema ignores it. A "dedup<TAB>yes|no" line tells whether the
+ * tables were laid out by a --dedup run, whose shared tables have no FK
+ * column and whose parents hold the shared row's ID in the key's column;
+ * --schema and --append refuse a file of the other kind, since its rows
+ * could not be joined to the new ones. A file without the line was written
+ * without --dedup.
+ *
+ * Tables loaded with --schema exist before the first object is seen, with
+ * the columns and slots of the file, so no table is inferred from the data
+ * and every table of the file is written, empty or not. Keys a loaded table
+ * has no column for, and tables the file does not list, are reported once
+ * each as warnings (error.h); the keys' values are dropped and the tables
+ * are inferred.
+ *
+ * --append keeps a schema file in the output directory, its state file:
+ * each run starts from its tables and next_id and replaces it when it is
+ * done, so IDs and columns stay consistent over runs. It also records how
+ * the files are written, in "compress<TAB>gzip|zstd|none" and
+ * "quote<TAB>minimal|strings|all" lines, which --schema ignores.
+ */
+
+#ifndef SCHEMA_FILE_H
+#define SCHEMA_FILE_H
+
+#include "ast.h"
+#include "name_index.h"
+#include "csv_writer.h"
+
+// Write the tables of 'schema' to 'path'; fatal_error() if it cannot be written
+void write_schema_file(const char* path, const Schema* schema);
+
+// Read a schema file into tables with their names, columns, column maps and
+// FK flags, but no rows; free with free_schema(). fatal_error() on a file
+// that cannot be read or is not a valid schema, or whose dedup line differs
+// from 'dedup' (the run's --dedup).
+Schema* read_schema_file(const char* path, bool dedup);
+
+// "<out_dir>/.json2relcsv-state", heap-allocated
+char* state_file_path(const char* out_dir);
+// The state at 'path', or NULL if there is none yet; like read_schema_file()
+// but the file must give next_id. fatal_error() if the files were written
+// with another --compress codec or --quote policy than 'options' asks for,
+// which would split a table over two files or mix quoting in one, or with
+// another --dedup than 'dedup'.
+Schema* read_state_file(const char* path, const OutputOptions* options, bool dedup);
+// Replace the state at 'path' (write a new file, then rename it over the old)
+void write_state_file(const char* path, const Schema* schema, const OutputOptions* options);
+
+// A copy of the name, columns and column map of 'table', with no rows
+TableSchema copy_table_layout(const TableSchema* table);
+
+// Keys found in objects of one loaded table without a column of their own
+typedef struct ReportedKeys {
+    NameIndex index;
+    char** keys;       // Owned copies, the index's keys
+    int count;
+    int capacity;
+} ReportedKeys;
+
+// Warn that 'key' is not a column of the loaded table 'table_name', unless
+// already reported for it
+void report_unknown_key(ReportedKeys* reported, const char* table_name, const char* key);
+void free_reported_keys(ReportedKeys* reported);
+// Warn that the table 'table_name' is not in the loaded schema
+void report_unknown_table(const char* table_name);
+
+#endif /* SCHEMA_FILE_H */
@@ -0,0 +1,235 @@
+/**
+ * stats.c - Run statistics for json2relcsv
+ */
+
+#include "stats.h"
+#include "error.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/resource.h>
+
+_Thread_local ParseCounters parse_counters = {0};
+
+static bool enabled = false;
+static double run_start = -1;
+
+static PhaseStats phases[STATS_MAX_PHASES];
+static int phase_count = 0;
+static double phase_wall_start = 0;
+static double phase_cpu_start = 0;
+
+static TableStats* tables = NULL;
+static int table_stats_count = 0;
+static int table_stats_capacity = 0;
+static int tables_created = -1;      // -1 until the conversion reports it
+static pthread_mutex_t tables_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static ArenaStats arena_stats = {0};
+static bool arena_recorded = false;
+
+static double wall_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double cpu_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static long peak_rss_kb(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss; // Kilobytes on Linux
+}
+
+void stats_enable(void) {
+    enabled = true;
+}
+
+bool stats_enabled(void) {
+    return enabled;
+}
+
+void stats_begin_phase(const char* name) {
+    if (phase_count == STATS_MAX_PHASES) return;
+    phase_wall_start = wall_now();
+    phase_cpu_start = cpu_now();
+    if (run_start < 0) run_start = phase_wall_start;
+    phases[phase_count].name = name;
+}
+
+void stats_end_phase(void) {
+    if (phase_count == STATS_MAX_PHASES) return;
+    PhaseStats* phase = &phases[phase_count++];
+    phase->wall_seconds = wall_now() - phase_wall_start;
+    phase->cpu_seconds = cpu_now() - phase_cpu_start;
+    phase->peak_rss_kb = peak_rss_kb();
+}
+
+void stats_record_table(const char* name, uint64_t rows, uint64_t bytes) {
+    if (!enabled) return;
+    pthread_mutex_lock(&tables_lock);
+    if (table_stats_count == table_stats_capacity) {
+        table_stats_capacity = table_stats_capacity ? table_stats_capacity * 2 : 16;
+        TableStats* grown = (TableStats*)realloc(tables, table_stats_capacity * sizeof(TableStats));
+        if (!grown) {
+            pthread_mutex_unlock(&tables_lock);
+            fatal_error("Error: Memory reallocation failed for table statistics\n");
+        }
+        tables = grown;
+    }
+    TableStats* table = &tables[table_stats_count++];
+    table->name = strdup(name);
+    if (!table->name) {
+        pthread_mutex_unlock(&tables_lock);
+        fatal_error("Error: strdup failed for table statistics\n");
+    }
+    table->rows = rows;
+    table->bytes = bytes;
+    pthread_mutex_unlock(&tables_lock);
+}
+
+void stats_add_counters(const ParseCounters* counters) {
+    parse_counters.bytes += counters->bytes;
+    parse_counters.tokens += counters->tokens;
+    for (int t = 0; t <= VALUE_ARRAY; t++) parse_counters.values[t] += counters->values[t];
+    parse_counters.pairs += counters->pairs;
+}
+
+void stats_record_arena(const Arena* arena) {
+    if (!enabled || !arena) return;
+    arena_stats.allocations += arena->allocations;
+    arena_stats.bytes += arena->bytes_requested;
+    arena_stats.blocks += arena->blocks_allocated;
+    arena_stats.peak_block_bytes += arena->peak_block_bytes; // Arenas of parallel chunks can be alive at once
+    arena_recorded = true;
+}
+
+void stats_set_table_count(int count) {
+    if (!enabled) return;
+    tables_created = count;
+}
+
+static int compare_table_names(const void* a, const void* b) {
+    return strcmp(((const TableStats*)a)->name, ((const TableStats*)b)->name);
+}
+
+static double total_seconds(void) {
+    return run_start < 0 ? 0 : wall_now() - run_start;
+}
+
+void stats_print_timing(FILE* out) {
+    fprintf(out, "Timing:");
+    for (int i = 0; i < phase_count; i++) {
+        fprintf(out, " %s=%.6f", phases[i].name, phases[i].wall_seconds);
+    }
+    fprintf(out, " total=%.6f peak_rss_kb=%ld\n", total_seconds(), peak_rss_kb());
+}
+
+// Table names come from JSON keys, so escape them like JSON strings
+static void print_json_string(FILE* out, const char* text) {
+    fputc('"', out);
+    for (const unsigned char* p = (const unsigned char*)text; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            fprintf(out, "\\%c", *p);
+        } else if (*p < 0x20) {
+            fprintf(out, "\\u%04x", *p);
+        } else {
+            fputc(*p, out);
+        }
+    }
+    fputc('"', out);
+}
+
+static const char* value_type_names[VALUE_ARRAY + 1] = {
+    [VALUE_STRING] = "strings",
+    [VALUE_NUMBER] = "numbers",
+    [VALUE_INTEGER] = "integers",
+    [VALUE_BOOLEAN] = "booleans",
+    [VALUE_NULL] = "nulls",
+    [VALUE_OBJECT] = "objects",
+    [VALUE_ARRAY] = "arrays"
+};
+
+void stats_print_report(FILE* out, bool json) {
+    // Writers close in completion order under --jobs; report in name order
+    qsort(tables, table_stats_count, sizeof(TableStats), compare_table_names);
+    uint64_t total_rows = 0;
+    uint64_t total_bytes = 0;
+    for (int i = 0; i < table_stats_count; i++) {
+        total_rows += tables[i].rows;
+        total_bytes += tables[i].bytes;
+    }
+    int table_total = tables_created >= 0 ? tables_created : table_stats_count;
+
+    if (!json) {
+        fprintf(out, "Statistics:\n");
+        fprintf(out, "  %-10s %10s %10s %12s\n", "phase", "wall_s", "cpu_s", "peak_rss_kb");
+        for (int i = 0; i < phase_count; i++) {
+            fprintf(out, "  %-10s %10.6f %10.6f %12ld\n", phases[i].name,
+                    phases[i].wall_seconds, phases[i].cpu_seconds, phases[i].peak_rss_kb);
+        }
+        fprintf(out, "  total wall %.6f s, peak RSS %ld KiB\n", total_seconds(), peak_rss_kb());
+        fprintf(out, "  input: %llu bytes, %llu tokens\n",
+                (unsigned long long)parse_counters.bytes, (unsigned long long)parse_counters.tokens);
+        fprintf(out, "  values:");
+        for (int t = 0; t <= VALUE_ARRAY; t++) {
+            fprintf(out, " %s=%llu", value_type_names[t], (unsigned long long)parse_counters.values[t]);
+        }
+        fprintf(out, " pairs=%llu\n", (unsigned long long)parse_counters.pairs);
+        if (arena_recorded) {
+            fprintf(out, "  arena: %llu allocations, %llu bytes, %llu blocks, peak %llu block bytes\n",
+                    (unsigned long long)arena_stats.allocations, (unsigned long long)arena_stats.bytes,
+                    (unsigned long long)arena_stats.blocks, (unsigned long long)arena_stats.peak_block_bytes);
+        }
+        fprintf(out, "  tables: %d, %llu rows, %llu bytes\n", table_total,
+                (unsigned long long)total_rows, (unsigned long long)total_bytes);
+        for (int i = 0; i < table_stats_count; i++) {
+            fprintf(out, "    %-30s %12llu rows %14llu bytes\n", tables[i].name,
+                    (unsigned long long)tables[i].rows, (unsigned long long)tables[i].bytes);
+        }
+        return;
+    }
+
+    fprintf(out, "{\n  \"phases\": [");
+    for (int i = 0; i < phase_count; i++) {
+        fprintf(out, "%s\n    {\"name\": \"%s\", \"wall_seconds\": %.6f, \"cpu_seconds\": %.6f, \"peak_rss_kb\": %ld}",
+                i ? "," : "", phases[i].name, phases[i].wall_seconds, phases[i].cpu_seconds, phases[i].peak_rss_kb);
+    }
+    fprintf(out, "\n  ],\n");
+    fprintf(out, "  \"total_wall_seconds\": %.6f,\n  \"peak_rss_kb\": %ld,\n", total_seconds(), peak_rss_kb());
+    fprintf(out, "  \"input\": {\"bytes\": %llu, \"tokens\": %llu},\n",
+            (unsigned long long)parse_counters.bytes, (unsigned long long)parse_counters.tokens);
+    fprintf(out, "  \"values\": {");
+    for (int t = 0; t <= VALUE_ARRAY; t++) {
+        fprintf(out, "\"%s\": %llu, ", value_type_names[t], (unsigned long long)parse_counters.values[t]);
+    }
+    fprintf(out, "\"pairs\": %llu},\n", (unsigned long long)parse_counters.pairs);
+    fprintf(out, "  \"arena\": {\"allocations\": %llu, \"bytes\": %llu, \"blocks\": %llu, \"peak_block_bytes\": %llu},\n",
+            (unsigned long long)arena_stats.allocations, (unsigned long long)arena_stats.bytes,
+            (unsigned long long)arena_stats.blocks, (unsigned long long)arena_stats.peak_block_bytes);
+    fprintf(out, "  \"tables\": {\n    \"count\": %d,\n    \"rows\": %llu,\n    \"bytes\": %llu,\n    \"per_table\": [",
+            table_total, (unsigned long long)total_rows, (unsigned long long)total_bytes);
+    for (int i = 0; i < table_stats_count; i++) {
+        fprintf(out, "%s\n      {\"name\": ", i ? "," : "");
+        print_json_string(out, tables[i].name);
+        fprintf(out, ", \"rows\": %llu, \"bytes\": %llu}",
+                (unsigned long long)tables[i].rows, (unsigned long long)tables[i].bytes);
+    }
+    fprintf(out, "\n    ]\n  }\n}\n");
+}
+
+void stats_free(void) {
+    for (int i = 0; i < table_stats_count; i++) {
+        free(tables[i].name);
+    }
+    free(tables);
+    tables = NULL;
+    table_stats_count = 0;
+    table_stats_capacity = 0;
+}
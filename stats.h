@@ -0,0 +1,74 @@
+/**
+ * stats.h - Run statistics for json2relcsv (--stats, --timing)
+ *
+ * Phases are timed with begin/end calls from converter.c when its options
+ * ask for stats; like the totals below they are process-wide. The scanner
+ * and parser bump plain counters in parse_counters on every token and value,
+ * and each CSV writer reports its row and byte totals when it is closed.
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "ast.h"
+
+#define STATS_MAX_PHASES 8
+
+// Updated by the scanner and the grammar actions
+typedef struct ParseCounters {
+    uint64_t bytes;                   // Input bytes matched by the scanner
+    uint64_t tokens;                  // Tokens handed to the parser
+    uint64_t values[VALUE_ARRAY + 1]; // Values parsed, by ValueType
+    uint64_t pairs;                   // Object members
+} ParseCounters;
+
+// Per thread: --jobs parse workers count separately and the totals are
+// added to the main thread's counters with stats_add_counters()
+extern _Thread_local ParseCounters parse_counters;
+
+void stats_add_counters(const ParseCounters* counters);
+
+typedef struct PhaseStats {
+    const char* name;
+    double wall_seconds;
+    double cpu_seconds;               // All threads of the process
+    long peak_rss_kb;                 // Process peak at the end of the phase
+} PhaseStats;
+
+typedef struct TableStats {
+    char* name;
+    uint64_t rows;
+    uint64_t bytes;
+} TableStats;
+
+typedef struct ArenaStats {
+    uint64_t allocations;
+    uint64_t bytes;                   // Requested, including abandoned arena_grow copies
+    uint64_t blocks;                  // Blocks obtained from malloc
+    uint64_t peak_block_bytes;        // Most block memory held at once
+} ArenaStats;
+
+// Start collecting per-table totals (phases are always timed)
+void stats_enable(void);
+bool stats_enabled(void);
+
+void stats_begin_phase(const char* name);
+void stats_end_phase(void);
+
+// Thread-safe; ignored unless stats are enabled
+void stats_record_table(const char* name, uint64_t rows, uint64_t bytes);
+// Also ignored unless stats are enabled, and then for one conversion at a
+// time: call before destroying each arena, totals are summed
+void stats_record_arena(const Arena* arena);
+void stats_set_table_count(int count);
+
+// "Timing: parse=... total=... peak_rss_kb=..." on one line
+void stats_print_timing(FILE* out);
+// Human-readable report, or JSON when 'json' is set
+void stats_print_report(FILE* out, bool json);
+void stats_free(void);
+
+#endif /* STATS_H */
@@ -0,0 +1,576 @@
+/**
+ * stream.c - Incremental schema/row emitter for --stream mode
+ *
+ * The emitter applies the same table rules as schema.c (see
+ * process_object_node/process_array_node), but it works on parser events
+ * instead of a finished AST:
+ *   - every open object or array has a frame on an explicit stack,
+ *   - an object's scalar fields are buffered in its frame and written as a
+ *     CSV row when the object closes, then released,
+ *   - a table is created (and its header written) when the first object
+ *     belonging to it closes, so its columns come from that object's keys,
+ *   - scalars inside arrays are written to their junction table at once.
+ * Tables of a --schema file are created, with their headers, up front.
+ * Subtrees of tables that feed no table of a projection get FRAME_IGNORED
+ * frames, and tables the projection does not keep get no file.
+ * IDs are handed out when an object opens, which gives the same pre-order
+ * numbering as generate_schema(). Objects of ignored subtrees that
+ * generate_schema() would walk use up their IDs all the same, so the IDs do
+ * not depend on the projection.
+ *
+ * Keys and strings come from ast_arena. Each frame records an arena mark when
+ * it is pushed and releases back to it when popped; because parsing is
+ * strictly nested, everything allocated after the mark belongs to the
+ * closed subtree.
+ */
+
+#include "stream.h"
+#include "name_index.h"
+#include "csv_writer.h"
+#include "schema_file.h"
+#include "projection.h"
+#include "stats.h"
+#include "error.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+// A table whose header has been written and whose file stays open
+typedef struct StreamTable {
+    TableSchema schema;            // Name, columns, column map and FK flag; 'objects' is unused
+    CsvWriter* writer;             // NULL for a table the projection omits
+    bool declared;                 // Loaded from a schema file (--schema)
+    ReportedKeys unknown_keys;     // Keys of its objects it has no column for
+} StreamTable;
+
+// A key/value buffered for the row of an open object
+typedef struct StreamField {
+    char* key;
+    Value_Node value; // VALUE_NULL for nested objects and arrays
+} StreamField;
+
+typedef enum {
+    FRAME_OBJECT,
+    FRAME_ARRAY,
+    FRAME_IGNORED  // Subtree that does not map to any table (e.g. objects inside scalar arrays)
+                   // or that the projection does not need
+} FrameKind;
+
+typedef enum {
+    ELEMENTS_UNKNOWN,
+    ELEMENTS_OBJECTS,
+    ELEMENTS_SCALARS
+} ElementKind;
+
+typedef struct StreamFrame {
+    FrameKind kind;
+    ArenaMark mark;                // ast_arena position when the frame was pushed
+    char* table_name;              // Object: table of its row. Array: table of its elements
+    bool owns_table_name;
+    const char* parent_table_name; // Table referenced by the FK column
+    int node_id;                   // Objects only
+    int parent_id;                 // Value of the FK column
+    // Objects
+    StreamField* fields;           // Buffer is kept when the frame is popped and reused
+    int field_count;
+    int field_capacity;
+    char* pending_key;
+    // Arrays
+    ElementKind element_kind;
+    int element_index;
+    // Ignored frames
+    bool is_array;
+    bool counted;                  // Walked by generate_schema() without the projection:
+                                   // an object has an ID, an array's objects do
+} StreamFrame;
+
+struct StreamEmitter {
+    const OutputOptions* options;
+    const Projection* projection;  // Tables and columns to keep; NULL for all
+    StreamTable* tables;
+    int table_count;
+    int table_capacity;
+    NameIndex table_index;         // Table name -> position in 'tables'
+    StreamField** row_fields;      // Scratch: field for each column slot of the row being written
+    int row_capacity;
+    StreamFrame* frames;
+    int depth;
+    int frame_capacity;
+    int next_node_id;
+    bool fixed;                    // Started from a --schema file: new tables are reported
+    Schema view;                   // Shallow copies of the tables' layouts, for stream_emitter_tables()
+};
+
+_Thread_local StreamEmitter* stream_emitter = NULL;
+
+static StreamTable* add_stream_table(StreamEmitter* emitter, const char* name, char** columns, int column_count, bool has_parent_fk);
+
+StreamEmitter* create_stream_emitter(const OutputOptions* options, const Schema* known, const Projection* projection) {
+    StreamEmitter* emitter = (StreamEmitter*)calloc(1, sizeof(StreamEmitter));
+    if (!emitter) {
+        fatal_error("Error: Memory allocation failed for stream emitter\n");
+    }
+    emitter->options = options;
+    emitter->projection = projection;
+    emitter->next_node_id = 1;
+    name_index_init(&emitter->table_index);
+    
+    for (int i = 0; known && i < known->table_count; i++) {
+        TableSchema layout = copy_table_layout(&known->tables[i]);
+        project_table_layout(projection, &layout);
+        name_index_free(&layout.column_index); // Rebuilt by add_stream_table
+        free(layout.column_slots);
+        StreamTable* table = add_stream_table(emitter, layout.name, layout.columns, layout.column_count,
+                                              layout.has_parent_fk || layout.is_junction);
+        free(layout.name);
+        table->schema.is_junction = layout.is_junction;
+        table->declared = true;
+    }
+    // As in schema.c: new tables are reported for --schema, not for --append
+    emitter->fixed = known && known->next_node_id == 0;
+    if (known && known->next_node_id > 0) emitter->next_node_id = known->next_node_id;
+    return emitter;
+}
+
+void close_stream_files(StreamEmitter* emitter) {
+    for (int i = 0; i < emitter->table_count; i++) {
+        csv_writer_close(emitter->tables[i].writer);
+        emitter->tables[i].writer = NULL;
+    }
+}
+
+const Schema* stream_emitter_tables(StreamEmitter* emitter) {
+    Schema* view = &emitter->view;
+    free(view->tables);
+    view->table_count = emitter->table_count;
+    view->next_node_id = emitter->next_node_id;
+    view->tables = (TableSchema*)malloc((emitter->table_count ? emitter->table_count : 1) * sizeof(TableSchema));
+    if (!view->tables) {
+        fatal_error("Error: Memory allocation failed for stream schema\n");
+    }
+    for (int i = 0; i < emitter->table_count; i++) {
+        view->tables[i] = emitter->tables[i].schema;
+        // Junction tables carry the FK flag here; schema.c leaves it unset
+        if (view->tables[i].is_junction) view->tables[i].has_parent_fk = false;
+    }
+    return view;
+}
+
+void finish_stream_emitter(StreamEmitter* emitter) {
+    if (!emitter) return;
+    stats_set_table_count(emitter->table_count);
+    close_stream_files(emitter);
+    free_stream_emitter(emitter);
+}
+
+void free_stream_emitter(StreamEmitter* emitter) {
+    if (!emitter) return;
+    for (int i = 0; i < emitter->table_count; i++) {
+        StreamTable* table = &emitter->tables[i];
+        for (int j = 0; j < table->schema.column_count; j++) {
+            free(table->schema.columns[j]);
+        }
+        free(table->schema.columns);
+        free(table->schema.name);
+        name_index_free(&table->schema.column_index);
+        free(table->schema.column_slots);
+        free_reported_keys(&table->unknown_keys);
+    }
+    free(emitter->tables);
+    free(emitter->view.tables);
+    free(emitter->row_fields);
+    name_index_free(&emitter->table_index);
+
+    // Frames are only left over if the parse was aborted
+    for (int i = 0; i < emitter->frame_capacity; i++) {
+        StreamFrame* frame = &emitter->frames[i];
+        if (i < emitter->depth && frame->owns_table_name) free(frame->table_name);
+        free(frame->fields);
+    }
+    free(emitter->frames);
+    free(emitter);
+}
+
+// Look up a table by name. The pointer is valid until the next table is added.
+static StreamTable* find_stream_table(StreamEmitter* emitter, const char* name) {
+    int position = name_index_get(&emitter->table_index, name, hash_name(name));
+    return position >= 0 ? &emitter->tables[position] : NULL;
+}
+
+// Register a table, open its file and write the header row, unless the
+// projection omits it. 'columns' is taken over by the table.
+static StreamTable* add_stream_table(StreamEmitter* emitter, const char* name, char** columns, int column_count, bool has_parent_fk) {
+    if (emitter->table_count >= emitter->table_capacity) {
+        emitter->table_capacity = emitter->table_capacity ? emitter->table_capacity * 2 : 10;
+        StreamTable* new_tables = (StreamTable*)realloc(emitter->tables, emitter->table_capacity * sizeof(StreamTable));
+        if (!new_tables) {
+            fatal_error("Error: Memory reallocation failed for stream tables\n");
+        }
+        emitter->tables = new_tables;
+    }
+
+    StreamTable* table = &emitter->tables[emitter->table_count++];
+    memset(table, 0, sizeof(StreamTable));
+    table->schema.name = strdup(name);
+    if (!table->schema.name) {
+        fatal_error("Error: strdup failed for stream table name '%s'\n", name);
+    }
+    table->schema.columns = columns;
+    table->schema.column_count = column_count;
+    build_column_map(&table->schema);
+    table->schema.has_parent_fk = has_parent_fk;
+    name_index_put(&emitter->table_index, table->schema.name, hash_name(table->schema.name), emitter->table_count - 1);
+    table->schema.omitted = !projection_keeps_table(emitter->projection, name);
+    if (table->schema.omitted) return table;
+    table->writer = csv_writer_open(emitter->options, table->schema.name);
+    csv_write_header(table->writer, table->schema.columns, table->schema.column_count);
+    return table;
+}
+
+// Duplicate a column name, exiting on allocation failure
+static char* dup_column(const char* name) {
+    char* column = strdup(name ? name : "");
+    if (!column) {
+        fatal_error("Error: strdup failed for stream column name\n");
+    }
+    return column;
+}
+
+static bool is_fk_parent(const char* parent_table_name) {
+    return parent_table_name != NULL && strcmp(parent_table_name, "root") != 0;
+}
+
+// Build a table from the first object that closes with its name
+static StreamTable* create_object_table(StreamEmitter* emitter, StreamFrame* frame) {
+    if (emitter->fixed) report_unknown_table(frame->table_name);
+    bool has_parent_fk = is_fk_parent(frame->parent_table_name);
+    int data_columns = 0;
+    for (int i = 0; i < frame->field_count; i++) {
+        if (projection_keeps_column(emitter->projection, frame->table_name, frame->fields[i].key)) data_columns++;
+    }
+    int column_count = data_columns + 1 + (has_parent_fk ? 1 : 0);
+    char** columns = (char**)calloc(column_count, sizeof(char*));
+    if (!columns) {
+        fatal_error("Error: Memory allocation failed for columns array for table '%s'\n", frame->table_name);
+    }
+
+    int col = 0;
+    columns[col++] = dup_column("id");
+    if (has_parent_fk) {
+        columns[col++] = get_fk_column_name(frame->parent_table_name);
+    }
+    for (int i = 0; i < frame->field_count; i++) {
+        if (projection_keeps_column(emitter->projection, frame->table_name, frame->fields[i].key)) {
+            columns[col++] = dup_column(frame->fields[i].key);
+        }
+    }
+    return add_stream_table(emitter, frame->table_name, columns, column_count, has_parent_fk);
+}
+
+// Create the junction table for an array of scalars, once per name
+static void ensure_junction_table(StreamEmitter* emitter, StreamFrame* frame) {
+    if (find_stream_table(emitter, frame->table_name)) return;
+    if (emitter->fixed) report_unknown_table(frame->table_name);
+
+    char** columns = (char**)calloc(3, sizeof(char*));
+    if (!columns) {
+        fatal_error("Error: calloc failed for junction table columns for '%s'\n", frame->table_name);
+    }
+    columns[0] = get_fk_column_name(frame->parent_table_name);
+    columns[1] = dup_column("item_index");
+    columns[2] = dup_column("value");
+    StreamTable* table = add_stream_table(emitter, frame->table_name, columns, 3, true);
+    table->schema.is_junction = true;
+}
+
+static StreamFrame* top_frame(StreamEmitter* emitter) {
+    return emitter->depth > 0 ? &emitter->frames[emitter->depth - 1] : NULL;
+}
+
+// Push a new frame, reusing the field buffer left at that depth
+static StreamFrame* push_frame(StreamEmitter* emitter, FrameKind kind) {
+    if (emitter->depth >= emitter->frame_capacity) {
+        int new_capacity = emitter->frame_capacity ? emitter->frame_capacity * 2 : 16;
+        StreamFrame* new_frames = (StreamFrame*)realloc(emitter->frames, new_capacity * sizeof(StreamFrame));
+        if (!new_frames) {
+            fatal_error("Error: Memory reallocation failed for stream frames\n");
+        }
+        memset(new_frames + emitter->frame_capacity, 0, (new_capacity - emitter->frame_capacity) * sizeof(StreamFrame));
+        emitter->frames = new_frames;
+        emitter->frame_capacity = new_capacity;
+    }
+
+    StreamFrame* frame = &emitter->frames[emitter->depth++];
+    StreamField* fields = frame->fields;
+    int field_capacity = frame->field_capacity;
+    memset(frame, 0, sizeof(StreamFrame));
+    frame->fields = fields;
+    frame->field_capacity = field_capacity;
+    frame->kind = kind;
+    frame->mark = arena_mark(ast_arena);
+    return frame;
+}
+
+static void pop_frame(StreamEmitter* emitter) {
+    StreamFrame* frame = top_frame(emitter);
+    if (!frame) return;
+    if (frame->owns_table_name) free(frame->table_name);
+    frame->table_name = NULL;
+    frame->pending_key = NULL;
+    frame->field_count = 0;
+    // Drops the keys and strings of the closed subtree
+    arena_release(ast_arena, frame->mark);
+    emitter->depth--;
+}
+
+// Buffer a field for the row of an object frame
+static void add_field(StreamFrame* frame, char* key, Value_Node value) {
+    if (frame->field_count >= frame->field_capacity) {
+        int new_capacity = frame->field_capacity ? frame->field_capacity * 2 : 8;
+        StreamField* new_fields = (StreamField*)realloc(frame->fields, new_capacity * sizeof(StreamField));
+        if (!new_fields) {
+            fatal_error("Error: Memory reallocation failed for stream fields\n");
+        }
+        frame->fields = new_fields;
+        frame->field_capacity = new_capacity;
+    }
+    frame->fields[frame->field_count].key = key;
+    frame->fields[frame->field_count].value = value;
+    frame->field_count++;
+}
+
+// Take the key announced for the next value of an object frame
+static char* take_pending_key(StreamFrame* frame) {
+    char* key = frame->pending_key;
+    frame->pending_key = NULL;
+    if (!key) {
+        key = arena_strndup(ast_arena, "unknown_array_key", strlen("unknown_array_key"));
+        report_warning("Warning: Value without key in stream, using '%s'.\n", key);
+    }
+    return key;
+}
+
+// Classify the next element of an array frame; returns the element's index
+static int next_array_element(StreamEmitter* emitter, StreamFrame* array_frame, bool is_object) {
+    int index = array_frame->element_index++;
+    if (array_frame->element_kind == ELEMENTS_UNKNOWN) {
+        // As in process_array_node, the first element decides the array's table kind
+        array_frame->element_kind = is_object ? ELEMENTS_OBJECTS : ELEMENTS_SCALARS;
+        if (!is_object) ensure_junction_table(emitter, array_frame);
+    } else if (array_frame->element_kind == ELEMENTS_OBJECTS && !is_object) {
+        report_warning("Warning: Array '%s' expected objects but found non-object at index %d.\n", array_frame->table_name, index);
+    }
+    return index;
+}
+
+// Whether a value opening in the ignored frame 'parent' would be walked by
+// generate_schema(); the first element of an array decides its kind
+static bool ignored_counted(StreamFrame* parent, bool is_object) {
+    if (!parent->is_array) return parent->counted;
+    if (parent->element_kind == ELEMENTS_UNKNOWN) {
+        parent->element_kind = is_object ? ELEMENTS_OBJECTS : ELEMENTS_SCALARS;
+    }
+    return parent->counted && parent->element_kind == ELEMENTS_OBJECTS && is_object;
+}
+
+// An ignored frame for a value opening under 'parent' (NULL at the top)
+static void push_ignored(StreamEmitter* emitter, StreamFrame* parent, bool is_array) {
+    bool counted = parent && parent->kind == FRAME_IGNORED && ignored_counted(parent, !is_array);
+    if (counted && !is_array) take_node_ids(&emitter->next_node_id, 1);
+    StreamFrame* frame = push_frame(emitter, FRAME_IGNORED); // May move 'parent'
+    frame->is_array = is_array;
+    frame->counted = counted;
+}
+
+// Set up a frame for a nested object or array found under the pending key of
+// 'parent'; it becomes FRAME_IGNORED if the projection needs nothing from it
+static void bind_to_parent_object(StreamEmitter* emitter, StreamFrame* child, StreamFrame* parent) {
+    char* key = take_pending_key(parent);
+    child->table_name = get_table_name_for_array(parent->table_name, key);
+    child->owns_table_name = true;
+    child->parent_table_name = parent->table_name;
+    child->parent_id = parent->node_id;
+    // The key still becomes a (empty) column of the parent row
+    add_field(parent, key, create_null_value());
+    if (!projection_feeds(emitter->projection, child->table_name)) {
+        child->kind = FRAME_IGNORED;
+        child->counted = true;
+    }
+}
+
+void stream_start_object(StreamEmitter* emitter) {
+    StreamFrame* parent = top_frame(emitter);
+
+    if (parent && parent->kind == FRAME_IGNORED) {
+        push_ignored(emitter, parent, false);
+        return;
+    }
+    if (parent && parent->kind == FRAME_ARRAY) {
+        next_array_element(emitter, parent, true);
+        if (parent->element_kind != ELEMENTS_OBJECTS) {
+            push_ignored(emitter, parent, false); // Not walked, so no ID
+            return;
+        }
+    }
+
+    // push_frame may move the stack, so re-read the parent afterwards
+    int parent_index = emitter->depth - 1;
+    StreamFrame* frame = push_frame(emitter, FRAME_OBJECT);
+    parent = parent_index >= 0 ? &emitter->frames[parent_index] : NULL;
+
+    if (!parent) {
+        // The root object belongs to a table named "root". It has no parent FK.
+        frame->table_name = "root";
+        frame->parent_table_name = NULL;
+        frame->parent_id = 0;
+    } else if (parent->kind == FRAME_OBJECT) {
+        bind_to_parent_object(emitter, frame, parent); // An ignored object still takes its ID
+    } else {
+        // Element of an array of objects: joins the array's table, FK to the array owner
+        frame->table_name = parent->table_name;
+        frame->parent_table_name = parent->parent_table_name;
+        frame->parent_id = parent->parent_id;
+    }
+    frame->node_id = take_node_ids(&emitter->next_node_id, 1);
+}
+
+void stream_end_object(StreamEmitter* emitter) {
+    StreamFrame* frame = top_frame(emitter);
+    if (!frame) return;
+    if (frame->kind != FRAME_OBJECT) {
+        pop_frame(emitter);
+        return;
+    }
+
+    StreamTable* table = find_stream_table(emitter, frame->table_name);
+    if (!table) {
+        table = create_object_table(emitter, frame);
+    }
+    if (table->schema.is_junction || table->schema.omitted) {
+        pop_frame(emitter); // Name first taken by an array of scalars, or not written
+        return;
+    }
+
+    // Place each field under its column slot (first occurrence of a key wins)
+    TableSchema* schema = &table->schema;
+    if (schema->column_count > emitter->row_capacity) {
+        emitter->row_capacity = schema->column_count;
+        free(emitter->row_fields);
+        emitter->row_fields = (StreamField**)malloc(emitter->row_capacity * sizeof(StreamField*));
+        if (!emitter->row_fields) {
+            fatal_error("Error: Memory allocation failed for stream row\n");
+        }
+    }
+    memset(emitter->row_fields, 0, schema->column_count * sizeof(StreamField*));
+    for (int j = 0; j < frame->field_count; j++) {
+        StreamField* field = &frame->fields[j];
+        int slot = name_index_get(&schema->column_index, field->key, hash_name(field->key));
+        if (slot >= 0 && !emitter->row_fields[slot]) emitter->row_fields[slot] = field;
+        else if (slot < 0 && table->declared && projection_keeps_column(emitter->projection, schema->name, field->key)) {
+            report_unknown_key(&table->unknown_keys, schema->name, field->key);
+        }
+    }
+
+    // Write the row: id, optional parent FK, then data columns by slot
+    CsvWriter* writer = table->writer;
+    csv_put_int(writer, frame->node_id);
+    int first_data_col = 1;
+    if (schema->has_parent_fk) {
+        csv_put_separator(writer);
+        csv_put_int(writer, frame->parent_id);
+        first_data_col = 2;
+    }
+    for (int i = first_data_col; i < schema->column_count; i++) {
+        csv_put_separator(writer);
+        StreamField* field = emitter->row_fields[schema->column_slots[i]];
+        if (field) csv_put_value(writer, field->value);
+    }
+    csv_end_row(writer);
+
+    pop_frame(emitter);
+}
+
+void stream_start_array(StreamEmitter* emitter) {
+    StreamFrame* parent = top_frame(emitter);
+
+    if (parent && parent->kind == FRAME_IGNORED) {
+        push_ignored(emitter, parent, true);
+        return;
+    }
+    if (parent && parent->kind == FRAME_ARRAY) {
+        // Nested arrays are not mapped to tables
+        next_array_element(emitter, parent, false);
+        push_ignored(emitter, parent, true);
+        return;
+    }
+
+    int parent_index = emitter->depth - 1;
+    StreamFrame* frame = push_frame(emitter, FRAME_ARRAY);
+    parent = parent_index >= 0 ? &emitter->frames[parent_index] : NULL;
+    frame->is_array = true;
+
+    if (!parent) {
+        // A root array. Elements go into the "items" table, with "root" as parent context.
+        frame->table_name = get_table_name_for_array("root", "items");
+        frame->owns_table_name = true;
+        frame->parent_table_name = "root";
+        frame->parent_id = 0;
+        if (!projection_feeds(emitter->projection, frame->table_name)) {
+            frame->kind = FRAME_IGNORED;
+            frame->counted = true;
+        }
+    } else {
+        bind_to_parent_object(emitter, frame, parent);
+    }
+}
+
+void stream_end_array(StreamEmitter* emitter) {
+    pop_frame(emitter);
+}
+
+void stream_key(StreamEmitter* emitter, char* key) {
+    StreamFrame* frame = top_frame(emitter);
+    if (!frame || frame->kind != FRAME_OBJECT) {
+        return; // Released with the enclosing frame
+    }
+    frame->pending_key = key;
+}
+
+void stream_scalar(StreamEmitter* emitter, Value_Node value) {
+    StreamFrame* frame = top_frame(emitter);
+    if (!frame) {
+        fatal_error("Error: Root of JSON data must be an object or an array.\n");
+    }
+
+    switch (frame->kind) {
+        case FRAME_OBJECT:
+            add_field(frame, take_pending_key(frame), value);
+            return;
+        case FRAME_ARRAY: {
+            int index = next_array_element(emitter, frame, false);
+            if (frame->element_kind != ELEMENTS_SCALARS) break;
+            // Junction row: owner id, position in the array, value
+            StreamTable* table = find_stream_table(emitter, frame->table_name);
+            if (!table->schema.is_junction || table->schema.omitted) break; // Name taken by a table of objects
+            csv_put_int(table->writer, frame->parent_id);
+            csv_put_separator(table->writer);
+            csv_put_int(table->writer, index);
+            csv_put_separator(table->writer);
+            csv_put_value(table->writer, value);
+            csv_end_row(table->writer);
+            break;
+        }
+        case FRAME_IGNORED:
+            if (frame->is_array) ignored_counted(frame, false); // Classifies the array
+            break;
+    }
+}
+
+void stream_skipped_ids(StreamEmitter* emitter, int ids) {
+    StreamFrame* frame = top_frame(emitter);
+    // Only members of an object that has an ID are walked
+    if (frame && (frame->kind == FRAME_OBJECT || (frame->kind == FRAME_IGNORED && frame->counted))) {
+        take_node_ids(&emitter->next_node_id, ids);
+    }
+}
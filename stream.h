@@ -0,0 +1,49 @@
+/**
+ * stream.h - Event-driven (--stream) conversion for json2relcsv
+ *
+ * In streaming mode the parser does not build an AST. Instead every grammar
+ * action reports an event to a StreamEmitter, which keeps one frame per open
+ * object/array and writes a CSV row as soon as an object closes. Memory use
+ * therefore depends on nesting depth, not on document size.
+ */
+
+#ifndef STREAM_H
+#define STREAM_H
+
+#include "ast.h"
+#include "csv_writer.h"
+
+typedef struct StreamEmitter StreamEmitter;
+
+// Emitter used by this thread's parser actions; NULL when building an AST
+extern _Thread_local StreamEmitter* stream_emitter;
+
+// Keeps a pointer to options and 'projection'. The tables of 'known'
+// (schema_file.h), if given, are created first and their files written even
+// if they get no rows; IDs continue from its next_node_id, if set. Subtrees
+// 'projection' (projection.h) does not need are ignored; NULL keeps all.
+StreamEmitter* create_stream_emitter(const OutputOptions* options, const Schema* known, const struct Projection* projection);
+// The emitter's tables, in the order they were created, and its next ID;
+// valid until the next call or finish_stream_emitter()
+const Schema* stream_emitter_tables(StreamEmitter* emitter);
+// Flush and close every table's file ahead of finish_stream_emitter()
+void close_stream_files(StreamEmitter* emitter);
+void finish_stream_emitter(StreamEmitter* emitter); // Closes all files and frees the emitter
+// Free the emitter without closing its files; after an error, with the files
+// left to discard_open_files()
+void free_stream_emitter(StreamEmitter* emitter);
+
+// Parser events. 'key' and string payloads in 'value' must come from
+// ast_arena (released when their enclosing frame closes) or from a mapped
+// input that outlives the parse.
+void stream_start_object(StreamEmitter* emitter);
+void stream_end_object(StreamEmitter* emitter);
+void stream_start_array(StreamEmitter* emitter);
+void stream_end_array(StreamEmitter* emitter);
+void stream_key(StreamEmitter* emitter, char* key);
+void stream_scalar(StreamEmitter* emitter, Value_Node value);
+// The value of the pending key was skimmed by the parser (projection.h) and
+// sent as a null; 'ids' is the number of IDs its objects would have had
+void stream_skipped_ids(StreamEmitter* emitter, int ids);
+
+#endif /* STREAM_H */
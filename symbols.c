@@ -0,0 +1,109 @@
+/**
+ * symbols.c - Interned object keys
+ */
+
+#include "symbols.h"
+#include "arena.h"
+#include "name_index.h"
+#include "error.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+// Names are stored in fixed pages that never move, so key_name() can read
+// them without the lock while another thread adds keys
+#define KEY_PAGE_SIZE 1024
+#define KEY_PAGE_COUNT 65536
+
+struct KeyTable {
+    pthread_mutex_t lock;
+    NameIndex index;          // Name -> id; keys are the copies in 'arena'
+    Arena* arena;
+    const char** pages[KEY_PAGE_COUNT];
+    int total;
+};
+
+// The table this thread interns into, and the keys it has already resolved
+// there, so repeated keys skip the lock. The cache's keys are the interned names.
+static _Thread_local KeyTable* keys = NULL;
+static _Thread_local NameIndex thread_keys;
+
+KeyTable* create_key_table(void) {
+    KeyTable* table = (KeyTable*)calloc(1, sizeof(KeyTable));
+    if (!table) {
+        fatal_error("Error: Memory allocation failed for key symbols\n");
+    }
+    pthread_mutex_init(&table->lock, NULL);
+    name_index_init(&table->index);
+    table->arena = arena_create(64 * 1024);
+    return table;
+}
+
+void use_key_table(KeyTable* table) {
+    name_index_free(&thread_keys);
+    keys = table;
+}
+
+KeyTable* current_key_table(void) {
+    return keys;
+}
+
+// Look up or add 'key' in the shared table; called with its lock held
+static int intern_shared(KeyTable* table, const char* key, uint32_t hash) {
+    int id = name_index_get(&table->index, key, hash);
+    if (id >= 0) return id;
+
+    if (table->total == KEY_PAGE_SIZE * KEY_PAGE_COUNT) {
+        pthread_mutex_unlock(&table->lock);
+        fatal_error("Error: Too many distinct object keys (%d)\n", table->total);
+    }
+    const char*** page = &table->pages[table->total / KEY_PAGE_SIZE];
+    if (!*page) {
+        *page = (const char**)malloc(KEY_PAGE_SIZE * sizeof(const char*));
+        if (!*page) {
+            pthread_mutex_unlock(&table->lock);
+            fatal_error("Error: Memory allocation failed for key symbols\n");
+        }
+    }
+    // The parse arena is released after every --ndjson record, so keep a copy
+    char* name = arena_strndup(table->arena, key, strlen(key));
+    (*page)[table->total % KEY_PAGE_SIZE] = name;
+    name_index_put(&table->index, name, hash, table->total);
+    return table->total++;
+}
+
+int intern_key(const char* key) {
+    uint32_t hash = hash_name(key);
+    int id = name_index_get(&thread_keys, key, hash);
+    if (id >= 0) return id;
+
+    pthread_mutex_lock(&keys->lock);
+    id = intern_shared(keys, key, hash);
+    pthread_mutex_unlock(&keys->lock);
+    name_index_put(&thread_keys, key_name(id), hash, id);
+    return id;
+}
+
+const char* key_name(int id) {
+    return keys->pages[id / KEY_PAGE_SIZE][id % KEY_PAGE_SIZE];
+}
+
+int key_count(void) {
+    pthread_mutex_lock(&keys->lock);
+    int count = keys->total;
+    pthread_mutex_unlock(&keys->lock);
+    return count;
+}
+
+void free_key_table(KeyTable* table) {
+    if (!table) return;
+    if (keys == table) use_key_table(NULL);
+    name_index_free(&table->index);
+    for (int i = 0; i < KEY_PAGE_COUNT && table->pages[i]; i++) {
+        free(table->pages[i]);
+    }
+    arena_destroy(table->arena);
+    pthread_mutex_destroy(&table->lock);
+    free(table);
+}
@@ -0,0 +1,37 @@
+/**
+ * symbols.h - Interned object keys
+ *
+ * Every key of the AST is interned as it is parsed, so each distinct key is
+ * stored once and identified by a small integer id (its position in the
+ * symbol table). Each conversion has a table of its own; ids and names stay
+ * valid until it is freed, across all records of an --ndjson run.
+ *
+ * The functions below use the calling thread's table (use_key_table()).
+ * Interning is thread-safe: each thread remembers the keys it has resolved,
+ * and only keys new to that thread take the shared table's lock.
+ */
+
+#ifndef SYMBOLS_H
+#define SYMBOLS_H
+
+typedef struct KeyTable KeyTable;
+
+KeyTable* create_key_table(void);
+// Free every key; called once no thread interns into the table any more
+void free_key_table(KeyTable* table);
+
+// Make 'table' the calling thread's table and drop the thread's lookup
+// cache; parse workers end with use_key_table(NULL)
+void use_key_table(KeyTable* table);
+KeyTable* current_key_table(void);
+
+// Id of 'key', adding a copy of it to the table on first sight
+int intern_key(const char* key);
+
+// Interned name of a key id
+const char* key_name(int id);
+
+// Number of distinct keys interned so far
+int key_count(void);
+
+#endif /* SYMBOLS_H */